@@ -6,11 +6,12 @@
 #include "../tekgl.h"
 
 // using fixed size arrays, basically built to not have exceptions because if an exception occurs, there is nothing in place to handle it yet.
+// the buffers are per thread, so the physics thread and the asset workers can throw without trampling each other or the render thread.
 
 flag initialised = 0;
-char exception_buffer[E_BUFFER_SIZE]; // stores the actual exception that occurred e.g. "Memory Exception in something.c"
-char stack_trace_buffer[STACK_TRACE_BUFFER_SIZE][E_MESSAGE_SIZE]; // stores stack trace e.g. "... in line 21..."
-uint stack_trace_index = 0;
+_Thread_local char exception_buffer[E_BUFFER_SIZE]; // stores the actual exception that occurred e.g. "Memory Exception in something.c"
+_Thread_local char stack_trace_buffer[STACK_TRACE_BUFFER_SIZE][E_MESSAGE_SIZE]; // stores stack trace e.g. "... in line 21..."
+_Thread_local uint stack_trace_index = 0;
 char* default_exception = "Unknown Exception";
 char* exceptions[NUM_EXCEPTIONS]; // stores name of each exception e.g. "Memory Exception"
 
@@ -88,6 +89,24 @@ char* tekGetExceptionName(const int exception_code) {
     return exception;
 }
 
+/**
+ * Get the last exception that occurred on this thread, without the stack trace.
+ * @return The exception, or an empty string if there hasn't been one.
+ */
+const char* tekGetException() {
+    return exception_buffer;
+}
+
+/**
+ * Take on an exception from another thread as the last exception on this one, so that it is printed instead of "Unknown exception!" once this thread throws it on.
+ * @note The stack trace starts again, as the other thread's trace is only known to that thread.
+ * @param exception_text The exception, from tekGetException() on the other thread.
+ */
+void tekCopyException(const char* exception_text) {
+    snprintf(exception_buffer, E_BUFFER_SIZE, "%s", exception_text);
+    stack_trace_index = 0;
+}
+
 /**
  * Print out the last exception that occurred, including stack trace.
  */
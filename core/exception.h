@@ -41,6 +41,7 @@ typedef int exception;
 void tekInitExceptions();
 void tekCloseExceptions();
 const char* tekGetException();
+void tekCopyException(const char* exception_text);
 void tekPrintException();
 void tekSetException(int exception_code, int exception_line, const char* exception_function, const char* exception_file, const char* exception_message);
 void tekTraceException(int exception_code, int exception_line, const char* exception_function, const char* exception_file);
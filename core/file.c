@@ -3,6 +3,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 /**
@@ -115,3 +118,84 @@ flag fileExists(const char* filename) {
     }
     return 0; // otherwise it effectively does not exist.
 }
+
+/**
+ * Check if a file was changed more recently than another one, for example to see if something generated from it is out of date.
+ * @param filename The file that might be newer.
+ * @param other_filename The file to compare against.
+ * @return 1 if the file exists and either the other one doesn't, or it was modified after the other one. 0 otherwise.
+ */
+flag fileIsNewer(const char* filename, const char* other_filename) {
+    struct stat file_stat, other_stat;
+    if (stat(filename, &file_stat) == -1) return 0;
+    if (stat(other_filename, &other_stat) == -1) return 1;
+
+    // seconds alone aren't enough, a file could be regenerated within the same second as it was edited
+    if (file_stat.st_mtim.tv_sec != other_stat.st_mtim.tv_sec)
+        return file_stat.st_mtim.tv_sec > other_stat.st_mtim.tv_sec;
+    return file_stat.st_mtim.tv_nsec > other_stat.st_mtim.tv_nsec;
+}
+
+/**
+ * Map a whole file into memory read-only, and say what went wrong if it couldn't be.
+ * @param filename The path that leads to the file to be mapped.
+ * @param mapping Set to the start of the file in memory.
+ * @param mapping_size Set to the size of the file in bytes.
+ * @return Null if the file was mapped, otherwise a message saying why not.
+ */
+static const char* mapFileProblem(const char* filename, const void** mapping, size_t* mapping_size) {
+    const int file_descriptor = open(filename, O_RDONLY);
+    if (file_descriptor == -1) return "Could not open file.";
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) == -1) {
+        close(file_descriptor);
+        return "Could not read file stat.";
+    }
+    if (file_stat.st_size <= 0) {
+        close(file_descriptor);
+        return "Cannot map an empty file.";
+    }
+
+    // the mapping stays valid after the file is closed
+    void* address = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    close(file_descriptor);
+    if (address == MAP_FAILED) return "Could not map file.";
+
+    *mapping = address;
+    *mapping_size = (size_t)file_stat.st_size;
+    return 0;
+}
+
+/**
+ * Map a whole file into memory read-only, so it can be used without reading it into a buffer first. Pages are only loaded from disk when they are touched.
+ * @param filename The path that leads to the file to be mapped.
+ * @param mapping Set to the start of the file in memory.
+ * @param mapping_size Set to the size of the file in bytes.
+ * @throws FILE_EXCEPTION if the file could not be opened, is empty, or could not be mapped.
+ */
+exception mapFile(const char* filename, const void** mapping, size_t* mapping_size) {
+    const char* problem = mapFileProblem(filename, mapping, mapping_size);
+    if (problem) tekThrow(FILE_EXCEPTION, problem);
+    return SUCCESS;
+}
+
+/**
+ * Map a whole file into memory read-only, for when it not being there or being empty is expected, e.g. a cache. Same as mapFile() but doesn't throw.
+ * @param filename The path that leads to the file to be mapped.
+ * @param mapping Set to the start of the file in memory.
+ * @param mapping_size Set to the size of the file in bytes.
+ * @return 1 if the file was mapped, 0 if not.
+ */
+flag tryMapFile(const char* filename, const void** mapping, size_t* mapping_size) {
+    return mapFileProblem(filename, mapping, mapping_size) == 0;
+}
+
+/**
+ * Unmap a file that was mapped by mapFile().
+ * @param mapping The start of the file in memory.
+ * @param mapping_size The size of the file in bytes.
+ */
+void unmapFile(const void* mapping, const size_t mapping_size) {
+    munmap((void*)mapping, mapping_size);
+}
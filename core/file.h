@@ -3,8 +3,14 @@
 #include "../tekgl.h"
 #include "exception.h"
 
+#include <stddef.h>
+
 exception getFileSize(const char* filename, uint* file_size);
 exception readFile(const char* filename, uint buffer_size, char* buffer);
 exception writeFile(const char* buffer, const char* filename);
 exception addPathToFile(const char* directory, const char* filename, char** result);
 flag fileExists(const char* filename);
+flag fileIsNewer(const char* filename, const char* other_filename);
+exception mapFile(const char* filename, const void** mapping, size_t* mapping_size);
+flag tryMapFile(const char* filename, const void** mapping, size_t* mapping_size);
+void unmapFile(const void* mapping, size_t mapping_size);
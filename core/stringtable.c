@@ -0,0 +1,79 @@
+#include "stringtable.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Create an empty string table.
+ * @param string_table A pointer to an empty StringTable struct.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FAILURE if the mutex could not be created.
+ */
+exception stringTableCreate(StringTable* string_table) {
+    tekChainThrow(hashtableCreate(&string_table->strings, 16));
+    if (pthread_mutex_init(&string_table->mutex, NULL))
+        tekThrowThen(FAILURE, "Failed to create string table mutex.", {
+            hashtableDelete(&string_table->strings);
+        });
+    return SUCCESS;
+}
+
+/**
+ * @brief Get the interned copy of a string, adding it to the table if it isn't there yet.
+ * @note Safe to call from any thread. The interned pointer stays valid until the table is deleted, and must not be written to or freed.
+ * @param string_table The string table to look in.
+ * @param string The string to intern.
+ * @param interned Where to write a pointer to the interned copy of the string.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception stringTableIntern(StringTable* string_table, const char* string, const char** interned) {
+    pthread_mutex_lock(&string_table->mutex);
+
+    // already interned, so give back the same pointer as last time
+    if (hashtableHasKey(&string_table->strings, string)) {
+        void* copy;
+        tekChainThrowThen(hashtableGet(&string_table->strings, string, &copy), {
+            pthread_mutex_unlock(&string_table->mutex);
+        });
+        pthread_mutex_unlock(&string_table->mutex);
+        *interned = (const char*)copy;
+        return SUCCESS;
+    }
+
+    // hashtable keeps its own copy of the key, but that isn't ours to hand out, so make another one
+    const uint len_string = strlen(string) + 1;
+    char* copy = (char*)malloc(len_string);
+    if (!copy) tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for interned string.", {
+        pthread_mutex_unlock(&string_table->mutex);
+    });
+    memcpy(copy, string, len_string);
+    tekChainThrowThen(hashtableSet(&string_table->strings, string, copy), {
+        free(copy);
+        pthread_mutex_unlock(&string_table->mutex);
+    });
+
+    pthread_mutex_unlock(&string_table->mutex);
+    *interned = copy;
+    return SUCCESS;
+}
+
+/**
+ * @brief Delete a string table, freeing every interned string.
+ * @note Any pointers returned by stringTableIntern() are invalid afterwards.
+ * @param string_table The string table to delete.
+ */
+void stringTableDelete(StringTable* string_table) {
+    // free the copies before the hashtable forgets about them
+    for (uint i = 0; i < string_table->strings.length; i++) {
+        const HashNode* node = string_table->strings.internal[i];
+        while (node) {
+            free(node->data);
+            node = node->next;
+        }
+    }
+    hashtableDelete(&string_table->strings);
+    pthread_mutex_destroy(&string_table->mutex);
+
+    // prevent further misuse
+    memset(string_table, 0, sizeof(StringTable));
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "../tekgl.h"
+#include "exception.h"
+#include "hashtable.h"
+
+/// A set of strings that are only stored once, so a string can be passed between threads as a pointer that stays valid until the table is deleted.
+typedef struct StringTable {
+    HashTable strings; // each string maps to its own copy, which is the interned pointer
+    pthread_mutex_t mutex;
+} StringTable;
+
+exception stringTableCreate(StringTable* string_table);
+exception stringTableIntern(StringTable* string_table, const char* string, const char** interned);
+void stringTableDelete(StringTable* string_table);
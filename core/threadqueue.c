@@ -2,111 +2,555 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+// where the item that the producer is currently writing is going to end up
+#define THREAD_QUEUE_RESERVED_NONE     0
+#define THREAD_QUEUE_RESERVED_RING     1
+#define THREAD_QUEUE_RESERVED_OVERFLOW 2
+
+/// Header of an item that didn't fit in the ring, the item itself follows straight after it in the overflow buffer.
+struct ThreadQueueOverflowItem {
+    uint key;
+    flag keyed;
+};
+
+#define THREAD_QUEUE_ROUND_UP(size) (((size) + THREAD_QUEUE_ALIGNMENT - 1) / THREAD_QUEUE_ALIGNMENT * THREAD_QUEUE_ALIGNMENT)
+#define THREAD_QUEUE_OVERFLOW_HEADER THREAD_QUEUE_ROUND_UP(sizeof(struct ThreadQueueOverflowItem))
+#define THREAD_QUEUE_OVERFLOW_DATA(overflow_item) ((char*)(overflow_item) + THREAD_QUEUE_OVERFLOW_HEADER)
+
+/**
+ * Get a pointer to a slot in the ring.
+ * @param thread_queue The thread queue that owns the ring.
+ * @param index The index of the slot, can be past the end of the ring as it will be wrapped around.
+ * @returns A pointer to the start of the slot.
+ */
+static void* threadQueueSlot(const ThreadQueue* thread_queue, const uint index) {
+    return (char*)thread_queue->buffer + (size_t)(index & thread_queue->mask) * thread_queue->element_size;
+}
+
+/**
+ * Get a pointer to an item in the overflow buffer.
+ * @param thread_queue The thread queue that owns the overflow.
+ * @param index The index of the item in the overflow buffer.
+ * @returns A pointer to the header of the item.
+ */
+static struct ThreadQueueOverflowItem* threadQueueOverflowItem(const ThreadQueue* thread_queue, const uint index) {
+    return (struct ThreadQueueOverflowItem*)((char*)thread_queue->overflow.internal + (size_t)index * thread_queue->overflow.element_size);
+}
 
 /**
  * Initialise a thread queue. Based on the principle of a lock-free circular queue.
- * @note Single-consumer single-producer
+ * @note Single-consumer single-producer. Items are copied into the queue, so nothing is allocated per item. The capacity is rounded up to a power of two, and one slot is always left empty, so a queue with capacity 32 holds 31 items.
  * @param thread_queue A pointer to an existing but empty ThreadQueue struct.
  * @param capacity The capacity of the thread queue.
+ * @param element_size The size of each item in bytes.
  * @throws MEMORY_EXCEPTION if malloc() fails.
  */
-exception threadQueueCreate(ThreadQueue* thread_queue, const uint capacity) {
+exception threadQueueCreate(ThreadQueue* thread_queue, const uint capacity, const uint element_size) {
+    // round up to a power of two so that wrapping around is just a mask
+    uint buffer_size = 2;
+    while (buffer_size < capacity) buffer_size <<= 1;
+
     // allocate memory for queue
-    thread_queue->buffer = (void**)malloc(capacity * sizeof(void*));
+    thread_queue->buffer = malloc((size_t)buffer_size * element_size);
     if (!thread_queue->buffer)
         tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory buffer for thread queue.");
-    thread_queue->buffer_size = capacity;
+    thread_queue->element_size = element_size;
+    thread_queue->mask = buffer_size - 1;
+
+    // overflow starts off empty, and is only needed if the policy allows it
+    const uint overflow_size = THREAD_QUEUE_OVERFLOW_HEADER + THREAD_QUEUE_ROUND_UP(element_size);
+    thread_queue->staging = malloc(overflow_size);
+    if (!thread_queue->staging) {
+        free(thread_queue->buffer);
+        thread_queue->buffer = 0;
+        tekThrow(MEMORY_EXCEPTION, "Failed to allocate staging item for thread queue.");
+    }
+    tekChainThrowThen(vectorCreate(0, overflow_size, &thread_queue->overflow), {
+        free(thread_queue->buffer);
+        free(thread_queue->staging);
+        thread_queue->buffer = 0;
+        thread_queue->staging = 0;
+    });
+    thread_queue->overflow_front = 0;
+    thread_queue->reservation = THREAD_QUEUE_RESERVED_NONE;
+    thread_queue->reserved_keyed = 0;
+    thread_queue->reserved_key = 0;
+    thread_queue->policy = THREAD_QUEUE_DROP;
 
     // atomic integer for front and rear
     atomic_init(&thread_queue->front, 0);
     atomic_init(&thread_queue->rear, 0);
+    thread_queue->cached_front = 0;
+    thread_queue->cached_rear = 0;
+    atomic_init(&thread_queue->producer_waiting, 0);
+    atomic_init(&thread_queue->consumer_waiting, 0);
+    atomic_init(&thread_queue->high_water_mark, 0);
+    atomic_init(&thread_queue->dropped, 0);
+    atomic_init(&thread_queue->coalesced, 0);
     return SUCCESS;
 }
 
 /**
  * Delete a thread queue and free the buffer allocated.
- * @note Only frees the thread queue's used memory, not that of stored pointers.
+ * @note Only frees the thread queue's used memory, not anything that the items point to.
  * @param thread_queue The thread queue to delete.
  */
 void threadQueueDelete(ThreadQueue* thread_queue) {
     // free allocated memory
     free(thread_queue->buffer);
+    free(thread_queue->staging);
+    vectorDelete(&thread_queue->overflow);
 
     // prevent misuse by setting things to null
     thread_queue->buffer = 0;
-    thread_queue->buffer_size = 0;
+    thread_queue->staging = 0;
+    thread_queue->mask = 0;
+    thread_queue->overflow_front = 0;
 }
 
 /**
- * Enqueue a new item to the thread queue, storing a pointer.
- * @note Only to be used by a single producer thread.
- * @param thread_queue The thread queue to enqueue to.
- * @param data A pointer to store in the queue.
- * @returns 0 if the queue is already full, 1 if the operation was successful.
+ * Set what the thread queue should do when the producer enqueues into a full queue.
+ * @note Should be set before the queue is shared between threads. The default is THREAD_QUEUE_DROP.
+ * @param thread_queue The thread queue to set the policy of.
+ * @param policy One of THREAD_QUEUE_DROP, THREAD_QUEUE_BLOCK, THREAD_QUEUE_GROW or THREAD_QUEUE_COALESCE.
  */
-flag threadQueueEnqueue(ThreadQueue* thread_queue, void* data) {
-    // can use relaxed memory order here, thread using this "owns" the rear pointer, other thread should write after we are done.
-    const uint rear = atomic_load_explicit(&thread_queue->rear, memory_order_relaxed);
-    const uint next_rear = (rear + 1) % thread_queue->buffer_size;
+void threadQueueSetPolicy(ThreadQueue* thread_queue, const flag policy) {
+    thread_queue->policy = policy;
+}
+
+/**
+ * Get the number of free slots in the ring, from the point of view of the producer.
+ * @note Only to be used by the producer thread. Uses the cached front index if it shows enough space, so the consumer's cache line is only touched when the ring looks too full.
+ * @param thread_queue The thread queue to check.
+ * @param rear The current rear index.
+ * @param needed How many free slots the producer would like.
+ * @returns The number of free slots, which could be more or less than needed.
+ */
+static uint threadQueueFreeSlots(ThreadQueue* thread_queue, const uint rear, const uint needed) {
+    uint free_slots = (thread_queue->cached_front - rear - 1) & thread_queue->mask;
+    if (free_slots >= needed) return free_slots;
 
     // need to use acquire here, should get front index after the other thread has finished with it.
-    // we only need this to make sure the queue isn't full.
-    const uint front = atomic_load_explicit(&thread_queue->front, memory_order_acquire);
+    thread_queue->cached_front = atomic_load_explicit(&thread_queue->front, memory_order_acquire);
+    free_slots = (thread_queue->cached_front - rear - 1) & thread_queue->mask;
+    return free_slots;
+}
+
+/**
+ * Get the number of items waiting in the ring, from the point of view of the consumer.
+ * @note Only to be used by the consumer thread. Uses the cached rear index if it shows enough items, so the producer's cache line is only touched when the ring looks too empty.
+ * @param thread_queue The thread queue to check.
+ * @param front The current front index.
+ * @param needed How many items the consumer would like.
+ * @returns The number of items, which could be more or less than needed.
+ */
+static uint threadQueueUsedSlots(ThreadQueue* thread_queue, const uint front, const uint needed) {
+    uint used_slots = (thread_queue->cached_rear - front) & thread_queue->mask;
+    if (used_slots >= needed) return used_slots;
+
+    // need to ensure that other thread is finished with rear ptr before we can use it
+    thread_queue->cached_rear = atomic_load_explicit(&thread_queue->rear, memory_order_acquire);
+    used_slots = (thread_queue->cached_rear - front) & thread_queue->mask;
+    return used_slots;
+}
+
+/**
+ * Make items written to the ring visible to the consumer, and wake the consumer if it is asleep.
+ * @param thread_queue The thread queue to publish to.
+ * @param rear The new rear index, one past the last item written.
+ */
+static void threadQueuePublish(ThreadQueue* thread_queue, const uint rear) {
+    // the exchange is sequentially consistent, so it is also what stops the check of the waiting flag below from
+    // happening before rear is updated. a locked exchange is cheaper than a release store followed by a full fence.
+    atomic_exchange(&thread_queue->rear, rear);
+
+    // if the consumer is asleep waiting for something to arrive, wake it up.
+    if (atomic_load(&thread_queue->consumer_waiting)) {
+        atomic_store_explicit(&thread_queue->consumer_waiting, 0, memory_order_relaxed);
+        syscall(SYS_futex, (uint*)&thread_queue->rear, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/**
+ * Hand slots that have been read back to the producer, and wake the producer if it is asleep.
+ * @param thread_queue The thread queue to release slots in.
+ * @param front The new front index, one past the last item read.
+ */
+static void threadQueueRelease(ThreadQueue* thread_queue, const uint front) {
+    // make sure that when front ptr is read next, it happens after it has been updated to the new size
+    atomic_store_explicit(&thread_queue->front, front, memory_order_release);
+
+    // if the producer might be asleep waiting for space, wake it up.
+    // the fence stops the check of the waiting flag from happening before the store to front.
+    if (thread_queue->policy == THREAD_QUEUE_BLOCK) {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&thread_queue->producer_waiting, memory_order_relaxed)) {
+            atomic_store_explicit(&thread_queue->producer_waiting, 0, memory_order_relaxed);
+            syscall(SYS_futex, (uint*)&thread_queue->front, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+        }
+    }
+}
+
+/**
+ * Update the high water mark of the queue, with the number of items that are currently waiting.
+ * @note Only to be used by the producer thread, which is the only thread that writes the high water mark.
+ * @param thread_queue The thread queue to update.
+ */
+static void threadQueueRecordLength(ThreadQueue* thread_queue) {
+    const uint rear = atomic_load_explicit(&thread_queue->rear, memory_order_relaxed);
+    const uint overflow_length = thread_queue->overflow.length - thread_queue->overflow_front;
+    const uint high_water_mark = atomic_load_explicit(&thread_queue->high_water_mark, memory_order_relaxed);
+
+    // the cached front can only be behind the real one, so this is never less than the real length.
+    // if even this isn't a new record then there's no need to look at the real front index
+    if (((rear - thread_queue->cached_front) & thread_queue->mask) + overflow_length <= high_water_mark) return;
+
+    // acquire, because the producer will write into slots using this cached front later on
+    thread_queue->cached_front = atomic_load_explicit(&thread_queue->front, memory_order_acquire);
+    const uint length = ((rear - thread_queue->cached_front) & thread_queue->mask) + overflow_length;
+    if (length > high_water_mark)
+        atomic_store_explicit(&thread_queue->high_water_mark, length, memory_order_relaxed);
+}
+
+/**
+ * Work out how much of a timeout is left.
+ * @param start_time When the wait started.
+ * @param timeout The total time that can be waited in nanoseconds.
+ * @param remaining Where to write the time that is left.
+ * @returns 1 if there is time left, 0 if the timeout has run out.
+ */
+static flag threadQueueTimeLeft(const struct timespec* start_time, const long long timeout, struct timespec* remaining) {
+    struct timespec curr_time;
+    clock_gettime(CLOCK_MONOTONIC, &curr_time);
+    const long long waited = (long long)(curr_time.tv_sec - start_time->tv_sec) * BILLION + (curr_time.tv_nsec - start_time->tv_nsec);
+    if (waited >= timeout) return 0;
+    remaining->tv_sec = (timeout - waited) / BILLION;
+    remaining->tv_nsec = (timeout - waited) % BILLION;
+    return 1;
+}
+
+/**
+ * Sleep until the consumer makes space in the ring, or until the block timeout runs out.
+ * @note Uses a futex on the front index, so a blocked producer doesn't use any cpu time while it waits.
+ * @param thread_queue The thread queue to wait on.
+ * @returns 1 if there is now space in the ring, 0 if the wait timed out.
+ */
+static flag threadQueueWaitForSpace(ThreadQueue* thread_queue) {
+    struct timespec start_time, timeout;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    while (1) {
+        // say that we are waiting before checking the front index, that way the consumer either sees the flag
+        // and wakes us, or it moved the front index before we checked it and we don't need to sleep.
+        atomic_store(&thread_queue->producer_waiting, 1);
+        const uint front = atomic_load(&thread_queue->front);
+        const uint rear = atomic_load_explicit(&thread_queue->rear, memory_order_relaxed);
+        if (front != ((rear + 1) & thread_queue->mask)) {
+            atomic_store_explicit(&thread_queue->producer_waiting, 0, memory_order_relaxed);
+            thread_queue->cached_front = front;
+            return 1;
+        }
+
+        if (!threadQueueTimeLeft(&start_time, THREAD_QUEUE_BLOCK_TIMEOUT, &timeout)) {
+            atomic_store_explicit(&thread_queue->producer_waiting, 0, memory_order_relaxed);
+            return 0;
+        }
+
+        // only sleeps if the front index is still what we read, so a dequeue in between can't be missed
+        syscall(SYS_futex, (uint*)&thread_queue->front, FUTEX_WAIT_PRIVATE, front, &timeout, NULL, 0);
+    }
+}
+
+/**
+ * Move as many overflowing items as will fit into the ring, in the order they were enqueued.
+ * @note Only to be used by a single producer thread. Enqueueing does this automatically, but the producer should also call it regularly so that items don't sit in the overflow when nothing new is being enqueued.
+ * @param thread_queue The thread queue to flush.
+ * @returns 1 if the overflow is now empty, 0 if some items are still waiting for space.
+ */
+flag threadQueueFlush(ThreadQueue* thread_queue) {
+    // nearly always the case, and the overflow is already cleared
+    const uint waiting = thread_queue->overflow.length - thread_queue->overflow_front;
+    if (!waiting) return 1;
+
+    // move everything that fits across, then publish them all at once
+    const uint rear = atomic_load_explicit(&thread_queue->rear, memory_order_relaxed);
+    const uint free_slots = threadQueueFreeSlots(thread_queue, rear, waiting);
+    const uint num_moved = free_slots < waiting ? free_slots : waiting;
+    for (uint i = 0; i < num_moved; i++) {
+        const struct ThreadQueueOverflowItem* item = threadQueueOverflowItem(thread_queue, thread_queue->overflow_front + i);
+        memcpy(threadQueueSlot(thread_queue, rear + i), THREAD_QUEUE_OVERFLOW_DATA(item), thread_queue->element_size);
+    }
+    if (num_moved) threadQueuePublish(thread_queue, (rear + num_moved) & thread_queue->mask);
+    thread_queue->overflow_front += num_moved;
+    if (num_moved < waiting) return 0;
+
+    // everything has been moved across, so the overflow can start again from the beginning
+    vectorClear(&thread_queue->overflow);
+    thread_queue->overflow_front = 0;
+    return 1;
+}
+
+/**
+ * Find somewhere to write the next item, doing whatever the policy says if the queue is full.
+ * @param thread_queue The thread queue to reserve space in.
+ * @param keyed Whether the item has a key that it can be coalesced with.
+ * @param key The key of the item.
+ * @returns A pointer to write the item to, or null if the item has to be dropped.
+ */
+static void* threadQueueReserveItem(ThreadQueue* thread_queue, const flag keyed, const uint key) {
+    thread_queue->reserved_keyed = keyed;
+    thread_queue->reserved_key = key;
+
+    // anything already overflowing has to go first, otherwise items would be out of order
+    if (threadQueueFlush(thread_queue)) {
+        // can use relaxed memory order here, thread using this "owns" the rear pointer, other thread should write after we are done.
+        const uint rear = atomic_load_explicit(&thread_queue->rear, memory_order_relaxed);
+        if (threadQueueFreeSlots(thread_queue, rear, 1)) {
+            thread_queue->reservation = THREAD_QUEUE_RESERVED_RING;
+            return threadQueueSlot(thread_queue, rear);
+        }
+    }
+
+    switch (thread_queue->policy) {
+    case THREAD_QUEUE_BLOCK:
+        if (threadQueueWaitForSpace(thread_queue)) {
+            thread_queue->reservation = THREAD_QUEUE_RESERVED_RING;
+            return threadQueueSlot(thread_queue, atomic_load_explicit(&thread_queue->rear, memory_order_relaxed));
+        }
+        break;
+    case THREAD_QUEUE_COALESCE:
+    case THREAD_QUEUE_GROW:
+        // written to the side first, then added to the overflow when it is committed
+        thread_queue->reservation = THREAD_QUEUE_RESERVED_OVERFLOW;
+        return THREAD_QUEUE_OVERFLOW_DATA(thread_queue->staging);
+    case THREAD_QUEUE_DROP:
+    default:
+        break;
+    }
+
+    atomic_fetch_add_explicit(&thread_queue->dropped, 1, memory_order_relaxed);
+    return NULL;
+}
+
+/**
+ * Reserve space for the next item, so that the producer can write it in place instead of building it somewhere else and copying it in.
+ * @note Only to be used by a single producer thread. The item must be committed with threadQueueCommit() before anything else is enqueued. What happens when the queue is full depends on the policy.
+ * @param thread_queue The thread queue to reserve space in.
+ * @returns A pointer to write the item to, or null if the queue is full and the item has been dropped.
+ */
+void* threadQueueReserve(ThreadQueue* thread_queue) {
+    return threadQueueReserveItem(thread_queue, 0, 0);
+}
 
-    // if front == next_rear, this write would overwrite data in the queue
-    if (front == next_rear) {
+/**
+ * Finish writing a reserved item and make it available to the consumer.
+ * @note Only to be used by a single producer thread.
+ * @param thread_queue The thread queue that the item was reserved in.
+ * @returns 0 if nothing was reserved or the item had to be dropped, 1 if the item was enqueued.
+ */
+flag threadQueueCommit(ThreadQueue* thread_queue) {
+    switch (thread_queue->reservation) {
+    case THREAD_QUEUE_RESERVED_RING:
+        threadQueuePublish(thread_queue, (atomic_load_explicit(&thread_queue->rear, memory_order_relaxed) + 1) & thread_queue->mask);
+        break;
+    case THREAD_QUEUE_RESERVED_OVERFLOW:
+        struct ThreadQueueOverflowItem* header = (struct ThreadQueueOverflowItem*)thread_queue->staging;
+        header->keyed = thread_queue->reserved_keyed;
+        header->key = thread_queue->reserved_key;
+        if (vectorAddItem(&thread_queue->overflow, thread_queue->staging) != SUCCESS) {
+            thread_queue->reservation = THREAD_QUEUE_RESERVED_NONE;
+            atomic_fetch_add_explicit(&thread_queue->dropped, 1, memory_order_relaxed);
+            return 0;
+        }
+        break;
+    default:
         return 0;
     }
 
-    thread_queue->buffer[rear] = data;
-    // release order means that subsequent access to rear must happen after this, so other thread has to have the updated rear ptr
-    atomic_store_explicit(&thread_queue->rear, next_rear, memory_order_release);
+    thread_queue->reservation = THREAD_QUEUE_RESERVED_NONE;
+    threadQueueRecordLength(thread_queue);
     return 1;
 }
 
 /**
- * Dequeue from a thread queue, returning the stored pointer.
+ * Enqueue a new item to the thread queue, copying it into the queue.
+ * @note Only to be used by a single producer thread. What happens when the queue is full depends on the policy.
+ * @param thread_queue The thread queue to enqueue to.
+ * @param item A pointer to the item to copy into the queue.
+ * @returns 0 if the queue is full and the item was dropped, 1 if the operation was successful.
+ */
+flag threadQueueEnqueue(ThreadQueue* thread_queue, const void* item) {
+    void* slot = threadQueueReserveItem(thread_queue, 0, 0);
+    if (!slot) return 0;
+    memcpy(slot, item, thread_queue->element_size);
+    return threadQueueCommit(thread_queue);
+}
+
+/**
+ * Enqueue a new item to the thread queue with a key, so that if the queue is full it can replace an older item with the same key.
+ * @note Only to be used by a single producer thread. Only coalesces with the THREAD_QUEUE_COALESCE policy, and only with items that are still in the overflow. The replaced item is overwritten, so it shouldn't own anything that needs to be freed.
+ * @param thread_queue The thread queue to enqueue to.
+ * @param item A pointer to the item to copy into the queue.
+ * @param key The key of the item, an item will only replace another with the same key.
+ * @returns 0 if the queue is full and the item was dropped, 1 if the operation was successful.
+ */
+flag threadQueueEnqueueKeyed(ThreadQueue* thread_queue, const void* item, const uint key) {
+    // linear search, but the overflow should only ever be short lived
+    if (thread_queue->policy == THREAD_QUEUE_COALESCE && !threadQueueFlush(thread_queue)) {
+        for (uint i = thread_queue->overflow_front; i < thread_queue->overflow.length; i++) {
+            struct ThreadQueueOverflowItem* overflow_item = threadQueueOverflowItem(thread_queue, i);
+            if (!overflow_item->keyed || overflow_item->key != key) continue;
+            memcpy(THREAD_QUEUE_OVERFLOW_DATA(overflow_item), item, thread_queue->element_size);
+            atomic_fetch_add_explicit(&thread_queue->coalesced, 1, memory_order_relaxed);
+            return 1;
+        }
+    }
+
+    // nothing to coalesce with, so enqueue like normal
+    void* slot = threadQueueReserveItem(thread_queue, 1, key);
+    if (!slot) return 0;
+    memcpy(slot, item, thread_queue->element_size);
+    return threadQueueCommit(thread_queue);
+}
+
+/**
+ * Enqueue several items at once. Everything that fits in the ring is made visible to the consumer in one go, which is much cheaper than enqueueing them one at a time.
+ * @note Only to be used by a single producer thread. Items that don't fit are handled one at a time according to the policy. If one is dropped, all the items after it are dropped as well so that the order is kept.
+ * @param thread_queue The thread queue to enqueue to.
+ * @param items An array of items to copy into the queue.
+ * @param count The number of items in the array.
+ * @returns The number of items that were enqueued, any after that were dropped.
+ */
+uint threadQueueEnqueueBatch(ThreadQueue* thread_queue, const void* items, const uint count) {
+    const uint element_size = thread_queue->element_size;
+    uint num_pushed = 0;
+
+    // anything already overflowing has to go first, otherwise items would be out of order
+    if (threadQueueFlush(thread_queue)) {
+        const uint rear = atomic_load_explicit(&thread_queue->rear, memory_order_relaxed);
+        const uint free_slots = threadQueueFreeSlots(thread_queue, rear, count);
+        num_pushed = free_slots < count ? free_slots : count;
+        for (uint i = 0; i < num_pushed; i++)
+            memcpy(threadQueueSlot(thread_queue, rear + i), (const char*)items + (size_t)i * element_size, element_size);
+        if (num_pushed) {
+            threadQueuePublish(thread_queue, (rear + num_pushed) & thread_queue->mask);
+            threadQueueRecordLength(thread_queue);
+        }
+    }
+
+    // whatever didn't fit gets the same treatment as a normal enqueue
+    for (; num_pushed < count; num_pushed++) {
+        if (!threadQueueEnqueue(thread_queue, (const char*)items + (size_t)num_pushed * element_size)) {
+            // one has already been counted by the enqueue
+            atomic_fetch_add_explicit(&thread_queue->dropped, count - num_pushed - 1, memory_order_relaxed);
+            break;
+        }
+    }
+
+    return num_pushed;
+}
+
+/**
+ * Dequeue from a thread queue, copying the item out of the queue.
  * @note Only to be used by a single consumer thread.
  * @param thread_queue The thread queue to dequeue from.
- * @param data A pointer to a pointer that will recieve the dequeued data.
+ * @param item A pointer to where the item should be copied to.
  * @returns 0 if the queue is empty, 1 if the operation was successful.
  */
-flag threadQueueDequeue(ThreadQueue* thread_queue, void** data) {
+flag threadQueueDequeue(ThreadQueue* thread_queue, void* item) {
+    return threadQueueDequeueBatch(thread_queue, item, 1) ? 1 : 0;
+}
+
+/**
+ * Dequeue up to a number of items at once. All of the slots are handed back to the producer in one go, which is much cheaper than dequeueing them one at a time.
+ * @note Only to be used by a single consumer thread.
+ * @param thread_queue The thread queue to dequeue from.
+ * @param items An array that the items will be copied into.
+ * @param max_count The length of the array, the most items that will be dequeued.
+ * @returns The number of items that were dequeued, 0 if the queue is empty.
+ */
+uint threadQueueDequeueBatch(ThreadQueue* thread_queue, void* items, const uint max_count) {
     // dequeue side is the main controller of the front ptr, we can be relaxed because other thread is working around what we do with it.
     const uint front = atomic_load_explicit(&thread_queue->front, memory_order_relaxed);
-    // however, we need to ensure that other thread is finished with rear ptr before we can use it
-    const uint rear = atomic_load_explicit(&thread_queue->rear, memory_order_acquire);
+    const uint used_slots = threadQueueUsedSlots(thread_queue, front, max_count);
+    const uint num_popped = used_slots < max_count ? used_slots : max_count;
+    if (!num_popped) return 0;
 
-    // if front == rear, the queue is empty
-    if (front == rear) {
-        return 0;
-    }
+    const uint element_size = thread_queue->element_size;
+    for (uint i = 0; i < num_popped; i++)
+        memcpy((char*)items + (size_t)i * element_size, threadQueueSlot(thread_queue, front + i), element_size);
+    threadQueueRelease(thread_queue, (front + num_popped) & thread_queue->mask);
+    return num_popped;
+}
 
-    *data = thread_queue->buffer[front];
-    // make sure that when front ptr is read next, it happens after it has been updated to the new size
-    atomic_store_explicit(&thread_queue->front, (front + 1) % thread_queue->buffer_size, memory_order_release);
-    return 1;
+/**
+ * Sleep until there is something in the queue to dequeue, or until the timeout runs out.
+ * @note Only to be used by a single consumer thread. Uses a futex on the rear index, so the consumer doesn't use any cpu time while it waits.
+ * @param thread_queue The thread queue to wait on.
+ * @param timeout The longest time to wait in nanoseconds.
+ * @returns 1 if the queue is not empty, 0 if the wait timed out.
+ */
+flag threadQueueWait(ThreadQueue* thread_queue, const long long timeout) {
+    struct timespec start_time, remaining;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    while (1) {
+        // same as waiting for space, say that we are waiting before checking so that the producer can't miss us
+        atomic_store(&thread_queue->consumer_waiting, 1);
+        const uint rear = atomic_load(&thread_queue->rear);
+        const uint front = atomic_load_explicit(&thread_queue->front, memory_order_relaxed);
+        if (front != rear) {
+            atomic_store_explicit(&thread_queue->consumer_waiting, 0, memory_order_relaxed);
+            return 1;
+        }
+
+        if (!threadQueueTimeLeft(&start_time, timeout, &remaining)) {
+            atomic_store_explicit(&thread_queue->consumer_waiting, 0, memory_order_relaxed);
+            return 0;
+        }
+
+        // only sleeps if the rear index is still what we read, so an enqueue in between can't be missed
+        syscall(SYS_futex, (uint*)&thread_queue->rear, FUTEX_WAIT_PRIVATE, rear, &remaining, NULL, 0);
+    }
 }
 
 /**
- * Peek into a thread queue, returning the stored pointer.
+ * Dequeue from a thread queue, waiting for something to arrive if it is empty.
  * @note Only to be used by a single consumer thread.
+ * @param thread_queue The thread queue to dequeue from.
+ * @param item A pointer to where the item should be copied to.
+ * @param timeout The longest time to wait in nanoseconds.
+ * @returns 0 if the queue was still empty when the timeout ran out, 1 if the operation was successful.
+ */
+flag threadQueueDequeueTimeout(ThreadQueue* thread_queue, void* item, const long long timeout) {
+    if (threadQueueDequeue(thread_queue, item)) return 1;
+    if (!threadQueueWait(thread_queue, timeout)) return 0;
+    return threadQueueDequeue(thread_queue, item);
+}
+
+/**
+ * Peek into a thread queue, getting a pointer to the item at the front without copying it.
+ * @note Only to be used by a single consumer thread. The pointer is only valid until the item is dequeued.
  * @param thread_queue The thread queue to peek.
- * @param data A pointer to a pointer that will recieve the peeked data.
+ * @param item A pointer that will be set to point at the item in the queue.
  * @returns 0 if the queue is empty, 1 if the operation was successful.
  */
-flag threadQueuePeek(ThreadQueue* thread_queue, void** data) {
+flag threadQueuePeek(ThreadQueue* thread_queue, void** item) {
     // dequeue side is the main controller of the front ptr, we can be relaxed because other thread is working around what we do with it.
     const uint front = atomic_load_explicit(&thread_queue->front, memory_order_relaxed);
-    // however, we need to ensure that other thread is finished with rear ptr before we can use it
-    const uint rear = atomic_load_explicit(&thread_queue->rear, memory_order_acquire);
 
-    // if front == rear, the queue is empty
-    if (front == rear) {
+    // if there are no used slots, the queue is empty
+    if (!threadQueueUsedSlots(thread_queue, front, 1)) {
         return 0;
     }
 
-    *data = thread_queue->buffer[front];
+    *item = threadQueueSlot(thread_queue, front);
     return 1;
 }
 
@@ -119,8 +563,17 @@ flag threadQueuePeek(ThreadQueue* thread_queue, void** data) {
 flag threadQueueIsEmpty(ThreadQueue* thread_queue) {
     // dequeue side is the main controller of the front ptr, we can be relaxed because other thread is working around what we do with it.
     const uint front = atomic_load_explicit(&thread_queue->front, memory_order_relaxed);
-    // however, we need to ensure that other thread is finished with rear ptr before we can use it
-    const uint rear = atomic_load_explicit(&thread_queue->rear, memory_order_acquire);
+    return threadQueueUsedSlots(thread_queue, front, 1) ? 0 : 1;
+}
 
-    return front == rear;
+/**
+ * Get the counters that describe how full the queue has been.
+ * @note Safe to call from either thread, but the values might be slightly out of date.
+ * @param thread_queue The thread queue to get the stats of.
+ * @param stats Where to write the stats.
+ */
+void threadQueueGetStats(ThreadQueue* thread_queue, ThreadQueueStats* stats) {
+    stats->high_water_mark = atomic_load_explicit(&thread_queue->high_water_mark, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&thread_queue->dropped, memory_order_relaxed);
+    stats->coalesced = atomic_load_explicit(&thread_queue->coalesced, memory_order_relaxed);
 }
@@ -5,17 +5,69 @@
 
 #include "../tekgl.h"
 #include "exception.h"
+#include "vector.h"
 
+// what to do when the producer tries to enqueue into a full queue
+#define THREAD_QUEUE_DROP     0 // give up and count the item as dropped
+#define THREAD_QUEUE_BLOCK    1 // sleep until the consumer makes space, dropping only if it takes too long
+#define THREAD_QUEUE_GROW     2 // keep the item in an overflow buffer until there is space, never drops
+#define THREAD_QUEUE_COALESCE 3 // same as grow, but a keyed item replaces an older overflowing item with the same key
+
+#define THREAD_QUEUE_BLOCK_TIMEOUT 250000000 // nanoseconds a blocked producer will wait before dropping the item
+
+/// Counters that describe how close to full a thread queue has been.
+typedef struct ThreadQueueStats {
+    uint high_water_mark; // most items that have been waiting at once, including any overflow
+    uint dropped;
+    uint coalesced;
+} ThreadQueueStats;
+
+#define THREAD_QUEUE_CACHE_LINE 64 // fields written by different threads are kept this far apart so they don't share a cache line
+#define THREAD_QUEUE_ALIGNMENT  16 // items in the overflow are aligned to this, enough for any cglm vector
+
+/// Single producer single consumer ring of fixed size items stored inline, with the producer's and consumer's fields on separate cache lines.
 typedef struct ThreadQueue {
-    void** buffer;
-    uint buffer_size;
-    atomic_uint front;
-    atomic_uint rear;
+    // only written by the producer
+    _Alignas(THREAD_QUEUE_CACHE_LINE) atomic_uint rear;
+    uint cached_front; // front index as the producer last saw it, only reloaded when the ring looks full
+    Vector overflow; // items that didn't fit, each one a header followed by the item
+    uint overflow_front;
+    void* staging; // a reserved item that is going into the overflow is written here first
+    flag reservation; // where the currently reserved item is, if anywhere
+    flag reserved_keyed;
+    uint reserved_key;
+    atomic_uint high_water_mark;
+    atomic_uint dropped;
+    atomic_uint coalesced;
+
+    // only written by the consumer
+    _Alignas(THREAD_QUEUE_CACHE_LINE) atomic_uint front;
+    uint cached_rear; // rear index as the consumer last saw it, only reloaded when the ring looks empty
+
+    // only written when one of the threads goes to sleep or wakes the other up
+    _Alignas(THREAD_QUEUE_CACHE_LINE) atomic_uint producer_waiting; // set by a blocked producer so the consumer knows to wake it up
+    atomic_uint consumer_waiting; // set by a waiting consumer so the producer knows to wake it up
+
+    // don't change once the queue is shared
+    _Alignas(THREAD_QUEUE_CACHE_LINE) void* buffer;
+    uint element_size;
+    uint mask; // capacity is always a power of two, so indices wrap with index & mask
+    flag policy;
 } ThreadQueue;
 
-exception threadQueueCreate(ThreadQueue* thread_queue, uint capacity);
+exception threadQueueCreate(ThreadQueue* thread_queue, uint capacity, uint element_size);
 void threadQueueDelete(ThreadQueue* thread_queue);
-flag threadQueueEnqueue(ThreadQueue* thread_queue, void* data);
-flag threadQueueDequeue(ThreadQueue* thread_queue, void** data);
-flag threadQueuePeek(ThreadQueue* thread_queue, void** data);
+void threadQueueSetPolicy(ThreadQueue* thread_queue, flag policy);
+void* threadQueueReserve(ThreadQueue* thread_queue);
+flag threadQueueCommit(ThreadQueue* thread_queue);
+flag threadQueueEnqueue(ThreadQueue* thread_queue, const void* item);
+flag threadQueueEnqueueKeyed(ThreadQueue* thread_queue, const void* item, uint key);
+uint threadQueueEnqueueBatch(ThreadQueue* thread_queue, const void* items, uint count);
+flag threadQueueFlush(ThreadQueue* thread_queue);
+flag threadQueueDequeue(ThreadQueue* thread_queue, void* item);
+uint threadQueueDequeueBatch(ThreadQueue* thread_queue, void* items, uint max_count);
+flag threadQueueWait(ThreadQueue* thread_queue, long long timeout);
+flag threadQueueDequeueTimeout(ThreadQueue* thread_queue, void* item, long long timeout);
+flag threadQueuePeek(ThreadQueue* thread_queue, void** item);
 flag threadQueueIsEmpty(ThreadQueue* thread_queue);
+void threadQueueGetStats(ThreadQueue* thread_queue, ThreadQueueStats* stats);
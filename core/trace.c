@@ -0,0 +1,248 @@
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct TraceEvent {
+    const char* name;
+    long long time; // nanoseconds on the monotonic clock
+    char phase;
+} TraceEvent;
+
+/// Events recorded by one thread. Only the thread that owns it writes to it, the thread saving the capture only reads the events that have been published by length.
+typedef struct TraceBuffer {
+    TraceEvent* events; // only allocated once the thread records something
+    atomic_uint length;
+    atomic_uint generation; // the capture that the events belong to, a buffer from an older capture counts as empty
+    _Atomic(const char*) thread_name;
+    flag in_use; // set while a thread owns it, only touched while holding the mutex
+} TraceBuffer;
+
+static TraceBuffer trace_buffers[TRACE_MAX_THREADS] = {};
+static atomic_uint num_trace_buffers = 0;
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t trace_key;
+static _Thread_local TraceBuffer* thread_buffer = 0;
+static _Thread_local flag thread_registered = 0;
+static flag trace_full_logged = 0;
+
+static atomic_uint trace_generation = 0; // 0 means no capture has been started yet
+static atomic_char trace_capturing = 0;
+static long long trace_start_time = 0;
+
+/**
+ * Get the current time for a trace event.
+ * @returns The monotonic time in nanoseconds.
+ */
+static long long traceGetTime() {
+    struct timespec curr_time;
+    clock_gettime(CLOCK_MONOTONIC, &curr_time);
+    return (long long)curr_time.tv_sec * BILLION + curr_time.tv_nsec;
+}
+
+/**
+ * Give a thread's buffer back when the thread exits, so that a thread started later can use it.
+ * @param buffer The buffer that the thread owned.
+ */
+static void traceReleaseBuffer(void* buffer) {
+    pthread_mutex_lock(&trace_mutex);
+    ((TraceBuffer*)buffer)->in_use = 0;
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+/**
+ * Create the key used to find out when a thread with a buffer exits.
+ */
+static void traceCreateKey() {
+    pthread_key_create(&trace_key, traceReleaseBuffer);
+}
+
+/**
+ * Find a buffer that no thread owns. Must be called while holding the mutex.
+ * @param name The name that the thread will have, or null if it doesn't have one yet.
+ * @returns The buffer, or null if every buffer is owned by a thread that is still running.
+ */
+static TraceBuffer* traceFindFreeBuffer(const char* name) {
+    const uint num_buffers = atomic_load_explicit(&num_trace_buffers, memory_order_relaxed);
+
+    // threads that are started again and again, e.g. asset workers, carry on in the buffer of an old thread with the same name
+    TraceBuffer* free_buffer = 0;
+    for (uint i = 0; i < num_buffers; i++) {
+        TraceBuffer* buffer = trace_buffers + i;
+        if (buffer->in_use) continue;
+        const char* thread_name = atomic_load_explicit(&buffer->thread_name, memory_order_relaxed);
+        if (name && thread_name && !strcmp(name, thread_name)) return buffer;
+        if (!free_buffer) free_buffer = buffer;
+    }
+
+    // then a buffer that has never been used, and only then one that was used by a thread with a different name
+    if (num_buffers < TRACE_MAX_THREADS) {
+        atomic_store_explicit(&num_trace_buffers, num_buffers + 1, memory_order_release);
+        return trace_buffers + num_buffers;
+    }
+    return free_buffer;
+}
+
+/**
+ * Get the buffer of the calling thread, giving it one the first time it is called. The buffer is given back when the thread exits.
+ * @param name The name of the thread, or null if it hasn't been given one.
+ * @returns The buffer, or null if every buffer is owned by another thread.
+ */
+static TraceBuffer* traceGetThreadBuffer(const char* name) {
+    if (thread_registered) return thread_buffer;
+    thread_registered = 1;
+    pthread_once(&trace_key_once, traceCreateKey);
+
+    pthread_mutex_lock(&trace_mutex);
+    thread_buffer = traceFindFreeBuffer(name);
+    if (thread_buffer) {
+        thread_buffer->in_use = 1;
+        atomic_store_explicit(&thread_buffer->thread_name, name, memory_order_relaxed);
+        pthread_setspecific(trace_key, thread_buffer);
+    } else if (!trace_full_logged) {
+        trace_full_logged = 1;
+        printf("More than %d threads are being traced at once, events from the rest will not be recorded.\n", TRACE_MAX_THREADS);
+    }
+    pthread_mutex_unlock(&trace_mutex);
+    return thread_buffer;
+}
+
+/**
+ * @brief Record the start or end of a section of code on the calling thread. Does nothing unless a capture is running.
+ * @note Use the tekTraceBegin() and tekTraceEnd() macros rather than calling this directly, so the markers disappear when tracing isn't built in.
+ * @param name The name of the section, must stay valid until the capture is saved.
+ * @param phase TRACE_BEGIN or TRACE_END.
+ */
+void traceRecord(const char* name, const char phase) {
+    if (!atomic_load_explicit(&trace_capturing, memory_order_acquire)) return;
+    TraceBuffer* buffer = traceGetThreadBuffer(0);
+    if (!buffer) return;
+
+    // first event of a new capture, so forget about the events from the last one
+    const uint generation = atomic_load_explicit(&trace_generation, memory_order_relaxed);
+    if (atomic_load_explicit(&buffer->generation, memory_order_relaxed) != generation) {
+        atomic_store_explicit(&buffer->length, 0, memory_order_relaxed);
+        atomic_store_explicit(&buffer->generation, generation, memory_order_release);
+    }
+
+    if (!buffer->events) {
+        buffer->events = (TraceEvent*)malloc(TRACE_BUFFER_CAPACITY * sizeof(TraceEvent));
+        if (!buffer->events) return;
+    }
+
+    // if the buffer is full then the rest of the capture is lost for this thread, better than stalling it
+    const uint length = atomic_load_explicit(&buffer->length, memory_order_relaxed);
+    if (length >= TRACE_BUFFER_CAPACITY) return;
+    TraceEvent* event = buffer->events + length;
+    event->name = name;
+    event->time = traceGetTime();
+    event->phase = phase;
+    atomic_store_explicit(&buffer->length, length + 1, memory_order_release);
+}
+
+/**
+ * @brief Give the calling thread a name, which is shown next to its events when the trace is viewed.
+ * @param name The name of the thread, must stay valid until the last capture is saved.
+ */
+void traceSetThreadName(const char* name) {
+    TraceBuffer* buffer = traceGetThreadBuffer(name);
+    if (!buffer) return;
+    atomic_store_explicit(&buffer->thread_name, name, memory_order_relaxed);
+}
+
+/**
+ * @brief Start recording trace events on every thread. Events from any previous capture are thrown away.
+ */
+void traceStartCapture() {
+    trace_start_time = traceGetTime();
+    atomic_fetch_add_explicit(&trace_generation, 1, memory_order_relaxed);
+    atomic_store_explicit(&trace_capturing, 1, memory_order_release);
+}
+
+/**
+ * @brief Check whether trace events are being recorded right now.
+ * @returns 1 if a capture is running, 0 otherwise.
+ */
+flag traceIsCapturing() {
+    return atomic_load_explicit(&trace_capturing, memory_order_relaxed);
+}
+
+/**
+ * Write a string to a json file, with quotes around it and anything that would break the json escaped.
+ * @param file The file to write to.
+ * @param string The string to write.
+ */
+static void traceWriteString(FILE* file, const char* string) {
+    fputc('"', file);
+    for (const char* c = string; *c; c++) {
+        if (*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20) fprintf(file, "\\u%04x", (unsigned char)*c);
+        else fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+/**
+ * @brief Stop recording trace events, and write everything recorded since traceStartCapture() to a file in the chrome trace event format.
+ * @note The file can be opened with chrome://tracing or ui.perfetto.dev. Threads may still be finishing an event as the file is written, only events that were fully recorded are saved.
+ * @param filename The file to write to, will be overwritten.
+ * @throws FILE_EXCEPTION if the file could not be opened.
+ */
+exception traceStopCapture(const char* filename) {
+    atomic_store_explicit(&trace_capturing, 0, memory_order_relaxed);
+
+    FILE* file = fopen(filename, "w");
+    if (!file) tekThrow(FILE_EXCEPTION, "Failed to open trace output file.");
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"TekPhysics\"}}");
+
+    const uint generation = atomic_load_explicit(&trace_generation, memory_order_relaxed);
+    const uint num_buffers = atomic_load_explicit(&num_trace_buffers, memory_order_acquire);
+    for (uint i = 0; i < num_buffers; i++) {
+        TraceBuffer* buffer = trace_buffers + i;
+        const uint tid = i + 1;
+
+        const char* thread_name = atomic_load_explicit(&buffer->thread_name, memory_order_relaxed);
+        if (thread_name) {
+            fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", tid);
+            traceWriteString(file, thread_name);
+            fprintf(file, "}}");
+        }
+
+        if (atomic_load_explicit(&buffer->generation, memory_order_acquire) != generation) continue;
+        const uint length = atomic_load_explicit(&buffer->length, memory_order_acquire);
+        for (uint j = 0; j < length; j++) {
+            const TraceEvent* event = buffer->events + j;
+            fprintf(file, ",\n{\"name\":");
+            traceWriteString(file, event->name);
+            fprintf(
+                file, ",\"ph\":\"%c\",\"pid\":1,\"tid\":%u,\"ts\":%.3f}",
+                event->phase, tid, (double)(event->time - trace_start_time) / 1000.0
+            );
+        }
+    }
+
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    return SUCCESS;
+}
+
+/**
+ * @brief Stop any capture and free the memory used by every thread's events.
+ * @note Only call this once no other thread could be recording events, e.g. after the engine thread has stopped.
+ */
+void traceDelete() {
+    atomic_store_explicit(&trace_capturing, 0, memory_order_relaxed);
+    const uint num_buffers = atomic_load_explicit(&num_trace_buffers, memory_order_acquire);
+    for (uint i = 0; i < num_buffers; i++) {
+        free(trace_buffers[i].events);
+        trace_buffers[i].events = 0;
+        atomic_store_explicit(&trace_buffers[i].length, 0, memory_order_relaxed);
+    }
+}
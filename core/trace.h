@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../tekgl.h"
+#include "exception.h"
+
+#define TRACE_BEGIN 'B'
+#define TRACE_END   'E'
+
+#define TRACE_BUFFER_CAPACITY 262144 // events per thread in one capture, anything after that is dropped
+#define TRACE_MAX_THREADS     16 // threads running at once, a thread gives its buffer back when it exits
+
+// trace markers, only recorded when built with TEK_TRACE, otherwise they compile to nothing.
+// names must be string literals (or otherwise outlive the capture), they are written out as they are.
+#ifdef TEK_TRACE
+#define tekTraceBegin(name) traceRecord(name, TRACE_BEGIN)
+#define tekTraceEnd(name) traceRecord(name, TRACE_END)
+#define tekTraceThread(name) traceSetThreadName(name)
+#else
+#define tekTraceBegin(name)
+#define tekTraceEnd(name)
+#define tekTraceThread(name)
+#endif
+
+void traceRecord(const char* name, char phase);
+void traceSetThreadName(const char* name);
+void traceStartCapture();
+flag traceIsCapturing();
+exception traceStopCapture(const char* filename);
+void traceDelete();
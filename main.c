@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <cglm/mat4.h>
@@ -13,6 +15,7 @@
 #include "tekgui/primitives.h"
 
 #include "tekgl/camera.h"
+#include "tekgl/shader.h"
 
 #include <time.h>
 #include <math.h>
@@ -20,6 +23,8 @@
 
 #include "core/file.h"
 #include "core/threadqueue.h"
+#include "core/stringtable.h"
+#include "core/trace.h"
 #include "core/vector.h"
 #include "tekphys/engine.h"
 #include "tekphys/body.h"
@@ -32,8 +37,13 @@
 #include "tekgui/text_button.h"
 #include "tekgui/option_window.h"
 #include "tekphys/scenario.h"
+#include "tekphys/batch.h"
+#include "tekgl/meshbinary.h"
+#include "tekgl/assets.h"
 #include "tests/exception_test.h"
 #include "tests/unit_test.h"
+#include "tests/queue_benchmark.h"
+#include "tests/mesh_benchmark.h"
 
 #define WINDOW_WIDTH  1280
 #define WINDOW_HEIGHT 720
@@ -54,9 +64,16 @@
 #define MOUSE_SENSITIVITY 0.5f
 #define MOVE_SPEED        2.0f
 
-#define DEFAULT_RATE 100.0
+#define DEFAULT_RATE 120.0
 #define DEFAULT_SPEED  1.0
 
+#define DEFAULT_BENCHMARK_ITEMS 20000000
+#define DEFAULT_BENCHMARK_VERTICES 1000000
+
+#define MINIMISED_WAIT_TIMEOUT 0.1 // seconds between checking the state queue while the window is minimised
+#define PROFILE_FILENAME "profile.csv" // where F2 saves the engine profile, relative to the working directory
+#define TRACE_FILENAME "trace.json"    // where F3 saves the trace, if tracing is built in
+
 struct TekScenarioOptions {
     float gravity;
     double rate;
@@ -86,6 +103,7 @@ static flag next_mode = -1;
 static int hierarchy_index = -1, inspect_index = -1;
 
 ThreadQueue event_queue = {};
+StringTable string_table = {};
 
 double mouse_x = 0.0, mouse_y = 0.0;
 float mouse_dx = 0.0f, mouse_dy = 0.0f;
@@ -93,6 +111,10 @@ flag mouse_moved = 0, mouse_right = 0;
 flag w_pressed = 0, a_pressed = 0, s_pressed = 0, d_pressed = 0, up_pressed = 0, down_pressed = 0;
 TekScenario active_scenario = {};
 
+static struct timespec first_frame_start = {}; // when loading started, to time how long until there is something to see
+static const char* first_frame_name = 0; // what is being loaded, or null if not waiting for a first frame
+static uint first_frame_entities = 0; // entities that still have to be created before the frame counts
+
 /**
  * Push an inspect event to the event queue. Changes which body is shown to the display.
  * @param inspect_id The ID of the body to inspect.
@@ -155,6 +177,29 @@ void tekMainKeyCallback(const int key, const int scancode, const int action, con
         }
     }
 
+    // F2 writes the timings of the last few hundred engine ticks to a file
+    if (key == GLFW_KEY_F2 && action == GLFW_RELEASE) {
+        TekEvent event = {};
+        event.type = PROFILE_DUMP_EVENT;
+        event.data.filename = PROFILE_FILENAME;
+        pushEvent(&event_queue, event);
+    }
+
+#ifdef TEK_TRACE
+    // F3 starts recording a trace of every thread, pressing it again saves it for chrome://tracing
+    if (key == GLFW_KEY_F3 && action == GLFW_RELEASE) {
+        if (traceIsCapturing()) {
+            if (traceStopCapture(TRACE_FILENAME) == SUCCESS)
+                printf("Saved trace to %s\n", TRACE_FILENAME);
+            else
+                printf("Failed to save trace to %s\n", TRACE_FILENAME);
+        } else {
+            traceStartCapture();
+            printf("Recording trace, press F3 again to save it.\n");
+        }
+    }
+#endif
+
 }
 
 /**
@@ -194,6 +239,24 @@ void tekMainMouseButtonCallback(const int button, const int action, const int mo
     }
 }
 
+/**
+ * Copy a body snapshot into an event, swapping the model and material filenames for interned copies.
+ * @note The scenario may reallocate the filenames while the event is still waiting in the queue, but an interned string lives until the program exits.
+ * @param snapshot The snapshot to copy.
+ * @param event The event to copy the snapshot into.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+static exception tekCopySnapshotToEvent(const TekBodySnapshot* snapshot, TekEvent* event) {
+    memcpy(&event->data.body.snapshot, snapshot, sizeof(TekBodySnapshot));
+    const char* model;
+    const char* material;
+    tekChainThrow(stringTableIntern(&string_table, snapshot->model, &model));
+    tekChainThrow(stringTableIntern(&string_table, snapshot->material, &material));
+    event->data.body.snapshot.model = (char*)model;
+    event->data.body.snapshot.material = (char*)material;
+    return SUCCESS;
+}
+
 /**
  * Push a body create event to the event queue.
  * @param snapshot A pointer to a body snapshot.
@@ -205,7 +268,7 @@ static exception tekBodyCreateEvent(const TekBodySnapshot* snapshot, const int s
     // create event
     TekEvent event = {};
     event.type = BODY_CREATE_EVENT;
-    memcpy(&event.data.body.snapshot, snapshot, sizeof(TekBodySnapshot));
+    tekChainThrow(tekCopySnapshotToEvent(snapshot, &event));
     event.data.body.id = snapshot_id;
 
     // push event to event queue
@@ -293,7 +356,7 @@ static exception tekUpdateBodySnapshot(const TekScenario* scenario, const int sn
     // create event
     TekEvent event = {};
     event.type = BODY_UPDATE_EVENT;
-    memcpy(&event.data.body.snapshot, body_snapshot, sizeof(TekBodySnapshot));
+    tekChainThrow(tekCopySnapshotToEvent(body_snapshot, &event));
     event.data.body.id = (uint)snapshot_id;
 
     // push event to event queue
@@ -405,6 +468,69 @@ static exception tekChangeBodySnapshotMaterial(const TekScenario* scenario, cons
     return SUCCESS;
 }
 
+/**
+ * Start timing how long it takes until the first frame that shows what is being loaded, which is reported by tekReportFirstFrame().
+ * @param name What is being loaded, printed along with the time.
+ * @param num_entities The number of entities that have to be created before a frame counts.
+ */
+static void tekStartFirstFrameTimer(const char* name, const uint num_entities) {
+    clock_gettime(CLOCK_MONOTONIC, &first_frame_start);
+    first_frame_name = name;
+    first_frame_entities = num_entities;
+}
+
+/**
+ * Print the time to first frame if it is being timed and every entity it was waiting for has been created. Called once a frame has been presented.
+ */
+static void tekReportFirstFrame() {
+    if (!first_frame_name || first_frame_entities) return;
+    struct timespec curr_time;
+    clock_gettime(CLOCK_MONOTONIC, &curr_time);
+    const double milliseconds = (double)(curr_time.tv_sec - first_frame_start.tv_sec) * 1000.0 + (double)(curr_time.tv_nsec - first_frame_start.tv_nsec) / 1000000.0;
+    printf("Time to first frame (%s): %.1f ms\n", first_frame_name, milliseconds);
+    first_frame_name = 0;
+}
+
+/**
+ * Stop timing the first frame without reporting it, e.g. if loading failed and there is no first frame to wait for.
+ */
+static void tekStopFirstFrameTimer() {
+    first_frame_name = 0;
+    first_frame_entities = 0;
+}
+
+/**
+ * Start reading the meshes and materials of a scenario on other threads, so that creating its entities only has to upload them.
+ * @param scenario The scenario to preload the assets of.
+ * @param num_bodies The number of bodies in the scenario, which is written here.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+static exception tekPreloadScenarioAssets(const TekScenario* scenario, uint* num_bodies) {
+    TekAssetManifest manifest = {};
+    tekChainThrow(tekCreateAssetManifest(&manifest));
+
+    // every body has a model and a material, the shaders and textures come from reading the materials
+    uint* ids;
+    uint num_ids;
+    tekChainThrowThen(tekScenarioGetAllIds(scenario, &ids, &num_ids), tekDeleteAssetManifest(&manifest));
+    for (uint i = 0; i < num_ids; i++) {
+        TekBodySnapshot* snapshot;
+        tekChainThrowThen(tekScenarioGetSnapshot(scenario, ids[i], &snapshot), {
+            free(ids);
+            tekDeleteAssetManifest(&manifest);
+        });
+        tekChainThrowThen(tekAddEntityAssets(&manifest, snapshot->model, snapshot->material), {
+            free(ids);
+            tekDeleteAssetManifest(&manifest);
+        });
+    }
+    free(ids);
+
+    *num_bodies = num_ids;
+    tekPreloadAssets(&manifest);
+    return SUCCESS;
+}
+
 /**
  * Reset the scenario so that there are no bodies left, and it is back to its original state.
  * @param scenario The scenario to reset.
@@ -473,6 +599,7 @@ static exception tekSimulationSpeedEvent(const double rate, const double speed,
     event.type = TIME_EVENT;
     event.data.time.rate = rate;
     event.data.time.speed = speed;
+    event.data.time.max_substeps = DEFAULT_MAX_SUBSTEPS;
 
     // push event to event queue
     tekChainThrow(pushEvent(&event_queue, event));
@@ -522,6 +649,23 @@ static exception tekPauseEvent(const flag paused) {
     return SUCCESS;
 }
 
+/**
+ * Push an adaptive event to the event queue, which will let the engine choose its own time step, or go back to the rate set by the user.
+ * @param adaptive 1 to let the engine choose the time step, 0 to use the rate set by the user.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+static exception tekAdaptiveEvent(const flag adaptive) {
+    // create event
+    TekEvent event = {};
+    event.type = ADAPTIVE_EVENT;
+    event.data.adaptive = adaptive;
+
+    // push event to event queue
+    tekChainThrow(pushEvent(&event_queue, event));
+
+    return SUCCESS;
+}
+
 /**
  * Hide all the possible windows from each menu mode.
  * @param gui The gui components.
@@ -1342,9 +1486,16 @@ static exception tekLoadCallback(TekGuiOptionWindow* window, TekGuiOptionWindowC
     // if filepath == null, there was an invalid file.
     if (filepath) {
         // valid filepath = load that scenario file
+        // if loading fails, there won't be a first frame of it to report
+        tekStartFirstFrameTimer("scenario", 0);
         tekDeleteScenario(&active_scenario);
-        tekChainThrow(tekReadScenario(filepath, &active_scenario));
-        tekChainThrow(tekResetScenario(&active_scenario));
+        tekChainThrowThen(tekReadScenario(filepath, &active_scenario), tekStopFirstFrameTimer());
+
+        // start reading the models and materials now, while the engine is still creating the bodies
+        uint num_bodies;
+        tekChainThrowThen(tekPreloadScenarioAssets(&active_scenario, &num_bodies), tekStopFirstFrameTimer());
+        first_frame_entities = num_bodies;
+        tekChainThrowThen(tekResetScenario(&active_scenario), tekStopFirstFrameTimer());
 
         free(filepath);
 
@@ -1355,7 +1506,7 @@ static exception tekLoadCallback(TekGuiOptionWindow* window, TekGuiOptionWindowC
 }
 
 /**
- * The callback for the runner window, called when user updates the speed or rate of the simulation, or when they press play, pause, stop or step.
+ * The callback for the runner window, called when user updates the speed or rate of the simulation, or when they press play, pause, stop, step or change the time step mode.
  * @param window The option window / runner window.
  * @param callback_data The callback data containing the name of the option and its type.
  * @throws MEMORY_EXCEPTION if malloc() fails.
@@ -1379,6 +1530,16 @@ static exception tekRunnerCallback(TekGuiOptionWindow* window, TekGuiOptionWindo
         return SUCCESS;
     }
 
+    if (!strcmp(callback_data.name, "adaptive")) {
+        tekChainThrow(tekAdaptiveEvent(1));
+        return SUCCESS;
+    }
+
+    if (!strcmp(callback_data.name, "fixed")) {
+        tekChainThrow(tekAdaptiveEvent(0));
+        return SUCCESS;
+    }
+
     if (!strcmp(callback_data.name, "step")) {
         TekEvent event = {};
         event.type = STEP_EVENT;
@@ -1400,8 +1561,8 @@ static exception tekRunnerCallback(TekGuiOptionWindow* window, TekGuiOptionWindo
     tekChainThrow(tekGuiReadNumberOption(window, "rate", &rate));
     if (rate < 1)
         rate = 1;
-    if (rate > 100)
-        rate = 100;
+    if (rate > 240)
+        rate = 240;
 
     if (1 / rate / speed > 0.1) {
         rate = 10.0 / speed;
@@ -1427,39 +1588,87 @@ static exception tekInspectDrawCallback(TekGuiWindow* window) {
 }
 
 
+/**
+ * Get a short description of why the engine chose its current time step.
+ * @param period_reason The reason sent by the engine, one of the PERIOD_REASON_* values.
+ * @return The description of the reason.
+ */
+static const char* tekPeriodReasonName(const flag period_reason) {
+    switch (period_reason) {
+    case PERIOD_REASON_STEADY:
+        return "adaptive, steady";
+    case PERIOD_REASON_PENETRATION:
+        return "adaptive, reducing penetration";
+    case PERIOD_REASON_TICK_COST:
+        return "adaptive, limited by tick cost";
+    case PERIOD_REASON_RELAXING:
+        return "adaptive, relaxing";
+    case PERIOD_REASON_FIXED:
+    default:
+        return "fixed";
+    }
+}
+
+/// Everything that is shown in the inspect text.
+struct TekInspectInfo {
+    float time;
+    float fps;
+    float period;
+    flag period_reason;
+    const char* name;
+    vec3 position;
+    vec3 velocity;
+    ThreadQueueStats event_stats;
+    ThreadQueueStats state_stats;
+    TekRenderStats render_stats;
+    uint uniform_lookups;
+    TekProfileSummary profile;
+};
+
 /**
  * Write the inspector text, wrapper around a call to snprintf that has the format string.
  * @param string The string to output the inspect text to.
  * @param max_length The maximum allowed length / size of the string buffer provided.
- * @param time The current simulation time.
- * @param fps The current fps.
- * @param name The name of the object being inspected.
- * @param position The position of the object being inspected.
- * @param velocity The velocity of the object being inspected.
+ * @param info The information to show.
  * @return The number of characters that could not be written because they did not fit in the buffer.
  */
-static int tekWriteInspectText(char* string, size_t max_length, const float time, const float fps, const char* name, const vec3 position, const vec3 velocity) {
+static int tekWriteInspectText(char* string, size_t max_length, const struct TekInspectInfo* info) {
     // wrapper around snprintf.
-    return snprintf(
+    int length = snprintf(
         string, max_length,
-        "Time: %.3f\nFPS: %.3f\n\nObject Name: %s\nPosition: (%.5f, %.5f, %.5f)\nVelocity: (%.5f, %.5f, %.5f)\nSpeed: %f\n\nUse up and down arrows to switch.",
-        time, fps, name, EXPAND_VEC3(position), EXPAND_VEC3(velocity), glm_vec3_norm(velocity)
+        "Time: %.3f\nFPS: %.3f\nTime step: %.5f (%s)\nEvent queue: peak %u, dropped %u\nState queue: peak %u, dropped %u, coalesced %u\nDraw calls: %u for %u entities (binds: %u program, %u material, %u mesh)\nEntities: %u visible, %u culled\nTriangles: %u\nUniform lookups: %u\n\nObject Name: %s\nPosition: (%.5f, %.5f, %.5f)\nVelocity: (%.5f, %.5f, %.5f)\nSpeed: %f\n\nUse up and down arrows to switch.\n\nEngine tick (median / p99 us), F2 to save:",
+        info->time, info->fps, info->period, tekPeriodReasonName(info->period_reason),
+        info->event_stats.high_water_mark, info->event_stats.dropped,
+        info->state_stats.high_water_mark, info->state_stats.dropped, info->state_stats.coalesced,
+        info->render_stats.draw_calls, info->render_stats.num_packets,
+        info->render_stats.program_binds, info->render_stats.material_binds, info->render_stats.mesh_binds,
+        info->render_stats.num_packets, info->render_stats.num_culled,
+        info->render_stats.num_triangles,
+        info->uniform_lookups,
+        info->name, EXPAND_VEC3(info->position), EXPAND_VEC3(info->velocity), glm_vec3_norm((float*)info->velocity)
     );
+
+    // one line per phase, if the string is null then snprintf just counts so keep passing null
+    for (uint phase = 0; phase < NUM_PROFILE_PHASES; phase++) {
+        const size_t offset = (size_t)length < max_length ? (size_t)length : max_length;
+        length += snprintf(
+            string ? string + offset : NULL, max_length - offset,
+            "\n%s: %.1f / %.1f",
+            tekProfilerPhaseName((flag)phase), info->profile.median[phase], info->profile.p99[phase]
+        );
+    }
+    return length;
 }
 
 /**
  * Update the inspection text with new information that is useful to the user.
  * @param inspect_text The inspect text mesh in its current form to be updated.
- * @param time The current simulation time in seconds.
- * @param fps The current fps to display.
- * @param name The name of the object being inspected.
- * @param position The position of the inspected object.
- * @param velocity The velocity of the inspected object.
+ * @param info The information to show.
  * @throws MEMORY_EXCEPTION if malloc() fails.
  */
-static exception tekUpdateInspectText(TekText* inspect_text, const float time, const float fps, const char* name, const vec3 position, const vec3 velocity) {
+static exception tekUpdateInspectText(TekText* inspect_text, const struct TekInspectInfo* info) {
     // get lenght of buffer needed to fit inspect text
-    const int len_buffer = tekWriteInspectText(NULL, 0, time, fps, name, position, velocity) + 1;
+    const int len_buffer = tekWriteInspectText(NULL, 0, info) + 1;
 
     // alloca is real!
     char* buffer = alloca(len_buffer * sizeof(char));
@@ -1467,7 +1676,7 @@ static exception tekUpdateInspectText(TekText* inspect_text, const float time, c
         tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for inspect text.");
 
     // write the inspect buffer
-    tekWriteInspectText(buffer, len_buffer, time, fps, name, position, velocity);
+    tekWriteInspectText(buffer, len_buffer, info);
     buffer[len_buffer - 1] = 0;
 
     // update text with new inspect buffer
@@ -1498,6 +1707,7 @@ static exception tekCreateRunnerMenu(struct TekGuiComponents* gui) {
     // inspector window that has text in it
     tekChainThrow(tekGuiCreateWindow(&gui->inspect_window));
     tekChainThrow(tekGuiSetWindowTitle(&gui->inspect_window, "Inspect"));
+    tekGuiSetWindowSize(&gui->inspect_window, 420, 420); // default is too small for the queue stats and profile
     gui->inspect_window.draw_callback = tekInspectDrawCallback; // <-- manual draw method
     gui->inspect_window.data = &gui->inspect_text; // <-- here is the text in it, but need to manually draw
 
@@ -1676,6 +1886,8 @@ static void tekDeleteMenu(struct TekGuiComponents* gui) {
 #define tekRunCleanup() \
 pushEvent(&event_queue, quit_event); \
 tekAwaitEngineStop(engine_thread); \
+tekDeletePoseBuffer(&pose_buffer); \
+stringTableDelete(&string_table); \
 tekDeleteMenu(&gui); \
 tekDeleteScenario(&scenario); \
 vectorDelete(&bodies); \
@@ -1687,6 +1899,15 @@ tekDelete() \
  * @throws EXCEPTION Can throw all exceptions for many different reasons.
  */
 static exception run() {
+    tekTraceThread("render");
+    tekStartFirstFrameTimer("startup", 0);
+
+    // the gui fonts can be drawn on other threads while the window is being created
+    TekAssetManifest startup_assets = {};
+    tekChainThrow(tekCreateAssetManifest(&startup_assets));
+    tekChainThrowThen(tekGuiAddAssets(&startup_assets), tekDeleteAssetManifest(&startup_assets));
+    tekPreloadAssets(&startup_assets);
+
     // set up GLFW window and other utilities.
     tekChainThrow(tekInit("TekPhysics", WINDOW_WIDTH, WINDOW_HEIGHT));
 
@@ -1703,14 +1924,19 @@ static exception run() {
 
     // create state queue and thread queue, allow to communicate with thread.
     ThreadQueue state_queue = {};
-    tekChainThrowThen(threadQueueCreate(&event_queue, 4096), {
+    tekChainThrowThen(threadQueueCreate(&event_queue, 4096, sizeof(TekEvent)), {
         tekDelete();
     });
-    tekChainThrowThen(threadQueueCreate(&state_queue, 4096), {
+    tekChainThrowThen(threadQueueCreate(&state_queue, 4096, sizeof(TekState)), {
         threadQueueDelete(&event_queue);
         tekDelete();
     });
 
+    // never lose input or states about entities, if the queues fill up they will grow instead.
+    // the state queue also merges inspect states, only the newest one is worth showing.
+    threadQueueSetPolicy(&event_queue, THREAD_QUEUE_GROW);
+    threadQueueSetPolicy(&state_queue, THREAD_QUEUE_COALESCE);
+
     // create vector to store all entities to be drawn.
     Vector entities = {};
     tekChainThrowThen(vectorCreate(0, sizeof(TekEntity), &entities), {
@@ -1728,11 +1954,33 @@ static exception run() {
         tekDelete();
     });
 
+    // create the buffer that the engine will write the pose of every body into.
+    TekPoseBuffer pose_buffer = {};
+    tekChainThrowThen(tekCreatePoseBuffer(&pose_buffer), {
+        vectorDelete(&bodies);
+        vectorDelete(&entities);
+        threadQueueDelete(&state_queue);
+        threadQueueDelete(&event_queue);
+        tekDelete();
+    });
+
+    // filenames and messages sent between the threads are interned here, so neither thread has to free them.
+    tekChainThrowThen(stringTableCreate(&string_table), {
+        tekDeletePoseBuffer(&pose_buffer);
+        vectorDelete(&bodies);
+        vectorDelete(&entities);
+        threadQueueDelete(&state_queue);
+        threadQueueDelete(&event_queue);
+        tekDelete();
+    });
+
     // initialise the engine.
     TekEvent quit_event;
     quit_event.type = QUIT_EVENT;
     unsigned long long engine_thread;
-    tekChainThrowThen(tekInitEngine(&event_queue, &state_queue, 1.0 / 30.0, &engine_thread), {
+    tekChainThrowThen(tekInitEngine(&event_queue, &state_queue, &pose_buffer, &string_table, 1.0 / DEFAULT_RATE, 1.0 / 60.0, &engine_thread), {
+        stringTableDelete(&string_table);
+        tekDeletePoseBuffer(&pose_buffer);
         vectorDelete(&bodies);
         vectorDelete(&entities);
         threadQueueDelete(&event_queue);
@@ -1768,24 +2016,33 @@ static exception run() {
     struct timespec curr_time, prev_time;
     float delta_time = 0.0f, frame_time = 0.0f, fps = 0.0f;
     uint frame_count = 0;
+    uint frame_uniform_lookups = 0; // how many uniform locations the last frame had to ask the driver for
     clock_gettime(CLOCK_MONOTONIC, &prev_time);
     flag force_exit = 0;
     TekState state = {};
+    TekState inspect_state = {};
+    flag has_inspect_state = 0;
+    TekProfileSummary profile_summary = {};
+    uint entity_sequence = 0;
 
     // THE infamous main loop
     while (tekRunning()) {
+        // send any events that didn't fit in the event queue last frame
+        threadQueueFlush(&event_queue);
+
         // receive all states from the state queue
+        tekTraceBegin("state drain");
         while (recvState(&state_queue, &state) == SUCCESS) {
             switch (state.type) { // time to differentiate occasions
             case MESSAGE_STATE: // print out a message received from engine
-                if (state.data.message) {
+                if (state.data.message)
                     printf("%s", state.data.message);
-                    free(state.data.message);
-                }
                 break;
             case EXCEPTION_STATE: // stop the program because engine had an error
                 force_exit = 1;
-                tekChainThrowThen(state.data.exception, {
+                if (state.data.exception.message) tekCopyException(state.data.exception.message);
+                tekChainThrowThen(state.data.exception.code, {
+                    tekTraceEnd("state drain");
                     tekRunCleanup();
                     threadQueueDelete(&event_queue);
                     threadQueueDelete(&state_queue);
@@ -1796,77 +2053,126 @@ static exception run() {
                 // is this a new entity or overwriting a previously used id?
                 // either way, make some space for it
                 if (state.object_id == entities.length) {
-                    tekChainThrowThen(vectorAddItem(&entities, &dummy_entity), { tekRunCleanup(); });
+                    tekChainThrowThen(vectorAddItem(&entities, &dummy_entity), { tekTraceEnd("state drain"); tekRunCleanup(); });
                 } else {
-                    tekChainThrowThen(vectorSetItem(&entities, state.object_id, &dummy_entity), { tekRunCleanup(); });
+                    tekChainThrowThen(vectorSetItem(&entities, state.object_id, &dummy_entity), { tekTraceEnd("state drain"); tekRunCleanup(); });
                 }
 
                 // create the entity at that point in the entity list
                 TekEntity* create_entity = 0;
                 vec3 default_scale = { 1.0f, 1.0f, 1.0f };
-                tekChainThrowThen(vectorGetItemPtr(&entities, state.object_id, &create_entity), { tekRunCleanup(); });
-                tekChainThrowThen(tekCreateEntity(state.data.entity.mesh_filename, state.data.entity.material_filename, state.data.entity.position, state.data.entity.rotation, default_scale, create_entity), { tekRunCleanup(); });
-                break;
-            case ENTITY_UPDATE_STATE: // update an existing entity
-                TekEntity* update_entity = 0;
-                tekChainThrowThen(vectorGetItemPtr(&entities, state.object_id, &update_entity), { tekRunCleanup(); });
-                tekUpdateEntity(update_entity, state.data.entity_update.position, state.data.entity_update.rotation);
+                tekChainThrowThen(vectorGetItemPtr(&entities, state.object_id, &create_entity), { tekTraceEnd("state drain"); tekRunCleanup(); });
+                tekChainThrowThen(tekCreateEntity(state.data.entity.mesh_filename, state.data.entity.material_filename, state.data.entity.position, state.data.entity.rotation, default_scale, create_entity), { tekTraceEnd("state drain"); tekRunCleanup(); });
+                entity_sequence = state.sequence;
+                if (first_frame_entities) first_frame_entities--;
                 break;
             case ENTITY_DELETE_STATE: // delete an entity
                 TekEntity* delete_entity;
-                tekChainThrowThen(vectorGetItemPtr(&entities, state.object_id, &delete_entity), { tekRunCleanup(); });
+                tekChainThrowThen(vectorGetItemPtr(&entities, state.object_id, &delete_entity), { tekTraceEnd("state drain"); tekRunCleanup(); });
                 memset(delete_entity, 0, sizeof(TekEntity));
+                entity_sequence = state.sequence;
                 break;
             case INSPECT_STATE: // display some info about an entity
-                char* inspect_name;
-                vec3 position, velocity;
-                if (inspect_index < 0) {
-                    inspect_name = "<no body selected>";
-                    glm_vec3_zero(position);
-                    glm_vec3_zero(velocity);
-                } else {
-                    tekChainThrow(tekScenarioGetName(&active_scenario, (uint)inspect_index, &inspect_name));
-                    glm_vec3_copy(state.data.inspect.position, position);
-                    glm_vec3_copy(state.data.inspect.velocity, velocity);
-                }
-                tekChainThrow(tekUpdateInspectText(
-                    &gui.inspect_text,
-                    state.data.inspect.time, fps,
-                    inspect_name, position, velocity
-                ));
+                // if the engine got ahead, only the newest one is worth showing so just keep hold of it for now
+                memcpy(&inspect_state, &state, sizeof(TekState));
+                has_inspect_state = 1;
+                break;
+            case PROFILE_STATE: // timings of the engine, shown along with the next inspect state
+                memcpy(&profile_summary, &state.data.profile, sizeof(TekProfileSummary));
                 break;
             }
 
             if (force_exit) break;
         }
+        tekTraceEnd("state drain");
 
         if (force_exit) break;
 
+        // update the inspect text once per frame at most, rebuilding the text is not cheap
+        if (has_inspect_state) {
+            struct TekInspectInfo inspect_info = {};
+            if (inspect_index < 0) {
+                inspect_info.name = "<no body selected>";
+            } else {
+                tekChainThrow(tekScenarioGetName(&active_scenario, (uint)inspect_index, (char**)&inspect_info.name));
+                glm_vec3_copy(inspect_state.data.inspect.position, inspect_info.position);
+                glm_vec3_copy(inspect_state.data.inspect.velocity, inspect_info.velocity);
+            }
+            inspect_info.time = inspect_state.data.inspect.time;
+            inspect_info.fps = fps;
+            inspect_info.period = inspect_state.data.inspect.period;
+            inspect_info.period_reason = inspect_state.data.inspect.period_reason;
+            threadQueueGetStats(&event_queue, &inspect_info.event_stats);
+            threadQueueGetStats(&state_queue, &inspect_info.state_stats);
+            tekGetEntityRenderStats(&inspect_info.render_stats);
+            inspect_info.uniform_lookups = frame_uniform_lookups;
+            memcpy(&inspect_info.profile, &profile_summary, sizeof(TekProfileSummary));
+            tekChainThrow(tekUpdateInspectText(&gui.inspect_text, &inspect_info));
+            has_inspect_state = 0;
+        }
+
+        // nothing can be seen while the window is minimised, so don't draw and just sleep until something happens
+        if (tekMinimised()) {
+            tekWaitEvents(MINIMISED_WAIT_TIMEOUT);
+
+            // the camera shouldn't move by however long we were asleep for
+            clock_gettime(CLOCK_MONOTONIC, &prev_time);
+            continue;
+        }
+
+        // move entities to wherever the physics thread last put them.
+        // a frame written before the last create or delete we received could have the wrong body in a slot, so skip it,
+        // the engine always sends a new frame after creating or deleting.
+        const TekPoseFrame* pose_frame;
+        if (tekPoseBufferRead(&pose_buffer, &pose_frame) && (int)(pose_frame->sequence - entity_sequence) >= 0) {
+            for (uint i = 0; i < pose_frame->length && i < entities.length; i++) {
+                if (!(pose_frame->flags[i] & BODY_FLAG_ACTIVE)) continue;
+                TekEntity* update_entity;
+                tekChainThrowThen(vectorGetItemPtr(&entities, i, &update_entity), { tekRunCleanup(); });
+
+                // the frame can also be newer than the states we have received, so the entity might not exist yet
+                if (!update_entity->mesh) continue;
+                tekInterpolateEntity(
+                    update_entity,
+                    pose_frame->previous_positions[i], pose_frame->previous_rotations[i],
+                    pose_frame->positions[i], pose_frame->rotations[i],
+                    pose_frame->alpha
+                );
+            }
+        }
+
         // draw entities if in the correct mode
         switch (mode) {
         case MODE_MAIN_MENU:
             break;
         case MODE_RUNNER:
         case MODE_BUILDER:
-            for (uint i = 0; i < entities.length; i++) {
-                TekEntity* entity;
-                tekChainThrowThen(vectorGetItemPtr(&entities, i, &entity), { tekRunCleanup(); });
-                if (entity->mesh == 0) continue;
-                tekChainThrowThen(tekDrawEntity(entity, &camera), { tekRunCleanup(); });
-            }
+            // entities sharing a mesh and material are drawn together
+            tekTraceBegin("tekDrawEntities");
+            tekChainThrowThen(tekDrawEntities(&entities, &camera), { tekTraceEnd("tekDrawEntities"); tekRunCleanup(); });
+            tekTraceEnd("tekDrawEntities");
             break;
         default:
             break;
         }
 
         // draw gui elements.
+        tekTraceBegin("tekDrawMenu");
         tekChainThrowThen(tekDrawMenu(
             &gui
         ), {
+            tekTraceEnd("tekDrawMenu");
             tekRunCleanup();
         });
+        tekTraceEnd("tekDrawMenu");
 
-        tekChainThrow(tekUpdate());
+        // swaps buffers, so this includes waiting for vsync
+        tekTraceBegin("tekUpdate");
+        tekChainThrowThen(tekUpdate(), tekTraceEnd("tekUpdate"));
+        tekTraceEnd("tekUpdate");
+        tekReportFirstFrame();
+        frame_uniform_lookups = tekGetShaderUniformLookups();
+        tekResetShaderUniformLookups();
 
         // clock to get delta time, used to make camera and movement independent of framerate.
         clock_gettime(CLOCK_MONOTONIC, &curr_time);
@@ -1924,14 +2230,137 @@ static exception run() {
     return SUCCESS;
 }
 
+/**
+ * Run a scenario without opening a window, using the command line arguments.
+ * @note Usage: --batch <scenario> <ticks> [output] [--trajectory] [--deterministic] [--rate <updates per second>] [--gravity <acceleration>] [--profile <csv file>] [--trace <json file>]
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @throws FAILURE if the arguments are invalid.
+ * @throws FILE_EXCEPTION if the scenario or output could not be opened.
+ */
+static exception runBatch(const int argc, char** argv) {
+    if (argc < 4)
+        tekThrow(FAILURE, "Usage: --batch <scenario> <ticks> [output] [--trajectory] [--deterministic] [--rate <updates per second>] [--gravity <acceleration>] [--profile <csv file>] [--trace <json file>]");
+
+    const char* scenario_filename = argv[2];
+    const long num_ticks = strtol(argv[3], NULL, 10);
+    if (num_ticks <= 0)
+        tekThrow(FAILURE, "Number of ticks must be a positive number.");
+
+    const char* output_filename = 0;
+    const char* profile_filename = 0;
+    const char* trace_filename = 0;
+    flag output_mode = BATCH_FINAL_STATE;
+    flag deterministic = 0;
+    double rate = DEFAULT_RATE;
+    float gravity = 9.81f;
+    for (int i = 4; i < argc; i++) {
+        if (!strcmp(argv[i], "--trajectory")) {
+            output_mode = BATCH_TRAJECTORY;
+        } else if (!strcmp(argv[i], "--deterministic")) {
+            deterministic = 1;
+        } else if (!strcmp(argv[i], "--rate") && i + 1 < argc) {
+            rate = strtod(argv[++i], NULL);
+            if (rate <= 0.0)
+                tekThrow(FAILURE, "Rate must be a positive number.");
+        } else if (!strcmp(argv[i], "--gravity") && i + 1 < argc) {
+            gravity = strtof(argv[++i], NULL);
+        } else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+            profile_filename = argv[++i];
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            trace_filename = argv[++i];
+        } else {
+            output_filename = argv[i];
+        }
+    }
+
+#ifdef TEK_TRACE
+    tekTraceThread("batch");
+    if (trace_filename) traceStartCapture();
+    tekChainThrow(tekRunBatch(scenario_filename, (uint)num_ticks, 1.0 / rate, gravity, output_mode, deterministic, output_filename, profile_filename));
+    if (trace_filename) tekChainThrow(traceStopCapture(trace_filename));
+#else
+    if (trace_filename) fprintf(stderr, "Tracing is not built in, configure with -DTEK_TRACE=ON to use --trace.\n");
+    tekChainThrow(tekRunBatch(scenario_filename, (uint)num_ticks, 1.0 / rate, gravity, output_mode, deterministic, output_filename, profile_filename));
+#endif
+    return SUCCESS;
+}
+
+/**
+ * Measure how quickly the thread queue can pass items between two threads, using the command line arguments.
+ * @note Usage: --bench-queue [items]
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @throws FAILURE if the arguments are invalid, or the queue lost items.
+ */
+static exception runQueueBenchmark(const int argc, char** argv) {
+    unsigned long num_items = DEFAULT_BENCHMARK_ITEMS;
+    if (argc > 2) {
+        num_items = strtoul(argv[2], NULL, 10);
+        if (!num_items)
+            tekThrow(FAILURE, "Usage: --bench-queue [items]");
+    }
+
+    tekChainThrow(tekRunQueueBenchmark(num_items));
+    return SUCCESS;
+}
+
+/**
+ * Measure how quickly a large .tmsh file can be parsed, using the command line arguments.
+ * @note Usage: --bench-mesh [vertices]
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @throws FAILURE if the arguments are invalid, or the parsers read different meshes.
+ */
+static exception runMeshBenchmark(const int argc, char** argv) {
+    unsigned long num_vertices = DEFAULT_BENCHMARK_VERTICES;
+    if (argc > 2) {
+        num_vertices = strtoul(argv[2], NULL, 10);
+        if (!num_vertices)
+            tekThrow(FAILURE, "Usage: --bench-mesh [vertices]");
+    }
+
+    tekChainThrow(tekRunMeshBenchmark(num_vertices));
+    return SUCCESS;
+}
+
+/**
+ * Convert a .tmsh file into a .tmshb file ahead of time, using the command line arguments. Meshes are converted automatically when first loaded anyway, this is for shipping them already converted.
+ * @note Usage: --convert-mesh <mesh> [output]
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ * @throws FAILURE if the arguments are invalid.
+ * @throws FILE_EXCEPTION if the mesh couldn't be read or the output couldn't be written.
+ */
+static exception runMeshConversion(const int argc, char** argv) {
+    if (argc < 3 || argc > 4)
+        tekThrow(FAILURE, "Usage: --convert-mesh <mesh> [output]");
+
+    tekChainThrow(tekConvertMesh(argv[2], argc > 3 ? argv[3] : NULL));
+    return SUCCESS;
+}
+
 /**
  * The entrypoint of the code. Mostly just a wrapper around the \ref run function.
  * @return The exception code, or 0 if there were no exceptions.
  */
-int main(void) {
+int main(const int argc, char** argv) {
     // welcome to tekphysics :D
     tekInitExceptions();
-    const exception tek_exception = run();
+    exception tek_exception;
+    if (argc > 1 && !strcmp(argv[1], "--batch"))
+        tek_exception = runBatch(argc, argv);
+    else if (argc > 1 && !strcmp(argv[1], "--bench-queue"))
+        tek_exception = runQueueBenchmark(argc, argv);
+    else if (argc > 1 && !strcmp(argv[1], "--bench-mesh"))
+        tek_exception = runMeshBenchmark(argc, argv);
+    else if (argc > 1 && !strcmp(argv[1], "--convert-mesh"))
+        tek_exception = runMeshConversion(argc, argv);
+    else
+        tek_exception = run();
+#ifdef TEK_TRACE
+    traceDelete();
+#endif
     tekLog(tek_exception);
     tekCloseExceptions();
     return tek_exception;
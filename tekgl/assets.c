@@ -0,0 +1,398 @@
+#include "assets.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shader.h"
+#include "manager.h"
+#include "../core/trace.h"
+
+// only one lot of assets is preloaded at a time, and the loaders look in it before going to the disk.
+// everything below is only touched while holding the mutex, apart from the data of an asset that is being decoded, which belongs to whoever is decoding it.
+static pthread_mutex_t preload_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t preload_cond = PTHREAD_COND_INITIALIZER; // broadcast whenever an asset is added or finishes decoding
+static flag preload_active = 0, preload_stopping = 0;
+static TekAssetManifest preload = {};
+static uint preload_next = 0; // every asset before this one has been started
+static uint preload_decoding = 0; // number of assets being decoded right now
+static pthread_t preload_workers[ASSET_MAX_WORKERS];
+static uint num_preload_workers = 0;
+
+/**
+ * Free the decoded data of an asset, if it has any.
+ * @param asset The asset to free the data of.
+ */
+static void tekFreeAssetData(TekAsset* asset) {
+    if (asset->state != ASSET_DECODED) return;
+    switch (asset->kind) {
+    case ASSET_MESH:
+        tekDeletePreparedMesh(&asset->mesh);
+        break;
+    case ASSET_MATERIAL:
+        ymlDelete(&asset->material);
+        break;
+    case ASSET_SHADER:
+        free(asset->source);
+        break;
+    case ASSET_TEXTURE:
+        tekDeleteImage(&asset->image);
+        break;
+    case ASSET_FONT:
+        tekDeleteFontAtlas(&asset->font_atlas);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * Make the key that an asset is stored under in the lookup. The same file can be more than one asset, e.g. a font at two different sizes, so everything that changes the decoded data is part of the key.
+ * @param kind The kind of asset, e.g. ASSET_MESH.
+ * @param filename The file the asset is read from.
+ * @param face_index The face index, if it is a font.
+ * @param face_size The face size, if it is a font.
+ * @return The key, which should be freed afterwards, or null if malloc() failed.
+ */
+static char* tekCreateAssetKey(const flag kind, const char* filename, const uint face_index, const uint face_size) {
+    // the numbers go first, so no filename can make two keys look the same
+    const size_t len_key = strlen(filename) + 48;
+    char* key = (char*)malloc(len_key);
+    if (!key) return 0;
+    snprintf(key, len_key, "%d:%u:%u:%s", (int)kind, face_index, face_size, filename);
+    return key;
+}
+
+/**
+ * Create an empty asset manifest.
+ * @param manifest The manifest to create.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekCreateAssetManifest(TekAssetManifest* manifest) {
+    tekChainThrow(vectorCreate(16, sizeof(TekAsset*), &manifest->assets));
+    tekChainThrowThen(hashtableCreate(&manifest->lookup, 16), vectorDelete(&manifest->assets));
+    return SUCCESS;
+}
+
+/**
+ * Add an asset to a manifest, unless it is already in it.
+ * @param manifest The manifest to add to.
+ * @param kind The kind of asset, e.g. ASSET_MESH.
+ * @param filename The file to read.
+ * @param face_index The face index, if it is a font.
+ * @param face_size The face size, if it is a font.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+static exception tekAddAssetFace(TekAssetManifest* manifest, const flag kind, const char* filename, const uint face_index, const uint face_size) {
+    if (!filename) tekThrow(NULL_PTR_EXCEPTION, "Asset filename cannot be null.");
+    char* key = tekCreateAssetKey(kind, filename, face_index, face_size);
+    if (!key) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for asset key.");
+    if (hashtableHasKey(&manifest->lookup, key)) {
+        free(key);
+        return SUCCESS;
+    }
+
+    TekAsset* asset = (TekAsset*)calloc(1, sizeof(TekAsset));
+    if (!asset) tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for asset.", free(key));
+    const size_t len_filename = strlen(filename) + 1;
+    asset->filename = (char*)malloc(len_filename);
+    if (!asset->filename) tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for asset filename.", {
+        free(asset);
+        free(key);
+    });
+    memcpy(asset->filename, filename, len_filename);
+    asset->kind = kind;
+    asset->state = ASSET_WAITING;
+    asset->face_index = face_index;
+    asset->face_size = face_size;
+
+    tekChainThrowThen(vectorAddItem(&manifest->assets, &asset), {
+        free(asset->filename);
+        free(asset);
+        free(key);
+    });
+    tekChainThrowThen(hashtableSet(&manifest->lookup, key, asset), {
+        vectorPopItem(&manifest->assets, &asset);
+        free(asset->filename);
+        free(asset);
+        free(key);
+    });
+    free(key);
+    return SUCCESS;
+}
+
+/**
+ * Add an asset to a manifest, unless it is already in it. Shaders and textures used by a material are added automatically once the material is read.
+ * @param manifest The manifest to add to.
+ * @param kind The kind of asset, e.g. ASSET_MESH or ASSET_MATERIAL.
+ * @param filename The file to read.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekAddAsset(TekAssetManifest* manifest, const flag kind, const char* filename) {
+    tekChainThrow(tekAddAssetFace(manifest, kind, filename, 0, 0));
+    return SUCCESS;
+}
+
+/**
+ * Add a font to a manifest, which is drawn into an atlas ahead of time. The font has to be asked for with the same face index and size to use it.
+ * @param manifest The manifest to add to.
+ * @param filename The .ttf file to read.
+ * @param face_index The index of the face to use.
+ * @param face_size The size of the face in pixels.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekAddFontAsset(TekAssetManifest* manifest, const char* filename, const uint face_index, const uint face_size) {
+    tekChainThrow(tekAddAssetFace(manifest, ASSET_FONT, filename, face_index, face_size));
+    return SUCCESS;
+}
+
+/**
+ * Delete an asset manifest, along with anything that was decoded and not used.
+ * @param manifest The manifest to delete.
+ */
+void tekDeleteAssetManifest(TekAssetManifest* manifest) {
+    for (uint i = 0; i < manifest->assets.length; i++) {
+        TekAsset* asset;
+        if (vectorGetItem(&manifest->assets, i, &asset) != SUCCESS) continue;
+        tekFreeAssetData(asset);
+        free(asset->filename);
+        free(asset);
+    }
+    vectorDelete(&manifest->assets);
+    hashtableDelete(&manifest->lookup);
+    memset(manifest, 0, sizeof(TekAssetManifest));
+}
+
+/**
+ * Add the shaders and textures that a material uses to the preload, so that they are read while the material is still waiting to be used.
+ * @note Anything odd in the material is skipped over, creating the material will throw a proper exception about it later.
+ * @param material_yml The material file that has just been read.
+ */
+static void tekAddMaterialAssets(YmlFile* material_yml) {
+    // every shader is a file, and any string uniform that isn't a wildcard is a texture, same as in tekCreateMaterial()
+    static const char* sections[] = { "shaders", "uniforms" };
+    static const flag section_kinds[] = { ASSET_SHADER, ASSET_TEXTURE };
+
+    pthread_mutex_lock(&preload_mutex);
+    for (uint i = 0; i < sizeof(sections) / sizeof(char*); i++) {
+        if (!hashtableHasKey(material_yml, sections[i])) continue;
+        char** keys = 0;
+        uint num_keys = 0;
+        const exception tek_exception = ymlGetKeys(material_yml, &keys, &num_keys, sections[i]);
+        if (tek_exception) continue;
+        for (uint j = 0; j < num_keys; j++) {
+            YmlData* data;
+            if (ymlGet(material_yml, &data, sections[i], keys[j]) != SUCCESS || data->type != STRING_DATA) continue;
+            const char* string = data->value;
+            if (string[0] != '$') tekAddAsset(&preload, section_kinds[i], string);
+        }
+        free(keys);
+    }
+    pthread_cond_broadcast(&preload_cond);
+    pthread_mutex_unlock(&preload_mutex);
+}
+
+/**
+ * Read and decode an asset, everything up to the point where opengl is needed.
+ * @param asset The asset to decode.
+ * @throws EXCEPTION depending on the kind of asset, anything that reading it could throw.
+ */
+static exception tekDecodeAsset(TekAsset* asset) {
+    switch (asset->kind) {
+    case ASSET_MESH:
+        tekChainThrow(tekPrepareMesh(asset->filename, &asset->mesh));
+        break;
+    case ASSET_MATERIAL:
+        tekChainThrow(ymlReadFile(asset->filename, &asset->material));
+        tekAddMaterialAssets(&asset->material);
+        break;
+    case ASSET_SHADER:
+        tekChainThrow(tekReadShaderSource(asset->filename, &asset->source));
+        break;
+    case ASSET_TEXTURE:
+        tekChainThrow(tekReadImage(asset->filename, &asset->image));
+        break;
+    case ASSET_FONT:
+        tekChainThrow(tekReadFontAtlas(asset->filename, asset->face_index, asset->face_size, &asset->font_atlas));
+        break;
+    default:
+        tekThrow(FAILURE, "Unknown kind of asset.");
+    }
+    return SUCCESS;
+}
+
+/**
+ * Decode an asset that nothing has started on yet. Must be called while holding the mutex, which is let go of while decoding.
+ * @param asset The asset to decode.
+ */
+static void tekDecodeWaitingAsset(TekAsset* asset) {
+    asset->state = ASSET_DECODING;
+    preload_decoding++;
+    pthread_mutex_unlock(&preload_mutex);
+
+    // exceptions from here are thrown again by whoever reads the file themselves, so only the result matters
+    tekTraceBegin("tekDecodeAsset");
+    const exception tek_exception = tekDecodeAsset(asset);
+    tekTraceEnd("tekDecodeAsset");
+
+    pthread_mutex_lock(&preload_mutex);
+    asset->state = tek_exception == SUCCESS ? ASSET_DECODED : ASSET_FAILED;
+    preload_decoding--;
+    pthread_cond_broadcast(&preload_cond);
+}
+
+/**
+ * Find the next asset that nothing has started on yet. Must be called while holding the mutex.
+ * @return The asset, or null if every asset has been started.
+ */
+static TekAsset* tekNextWaitingAsset() {
+    while (preload_next < preload.assets.length) {
+        TekAsset* asset;
+        if (vectorGetItem(&preload.assets, preload_next++, &asset) != SUCCESS) continue;
+        if (asset->state == ASSET_WAITING) return asset; // might have been taken by tekFindPreloadedAsset() already
+    }
+    return 0;
+}
+
+/**
+ * The worker threads that decode assets. Keeps going until there is nothing left to start, and nothing still decoding that could add more.
+ * @param arg Unused.
+ * @return Nothing.
+ */
+static void* tekAssetWorker(void* arg) {
+    tekTraceThread("asset worker");
+    pthread_mutex_lock(&preload_mutex);
+    while (!preload_stopping) {
+        TekAsset* asset = tekNextWaitingAsset();
+        if (asset) {
+            tekDecodeWaitingAsset(asset);
+            continue;
+        }
+
+        // a material that is still being read might add its shaders and textures
+        if (!preload_decoding) break;
+        pthread_cond_wait(&preload_cond, &preload_mutex);
+    }
+    pthread_mutex_unlock(&preload_mutex);
+    return NULL;
+}
+
+/**
+ * Stop preloading assets, waiting for anything being decoded to finish, and free everything that was preloaded but not used.
+ */
+void tekStopPreloadingAssets() {
+    pthread_mutex_lock(&preload_mutex);
+    preload_stopping = 1;
+    pthread_cond_broadcast(&preload_cond);
+    pthread_mutex_unlock(&preload_mutex);
+
+    for (uint i = 0; i < num_preload_workers; i++)
+        pthread_join(preload_workers[i], NULL);
+    num_preload_workers = 0;
+
+    pthread_mutex_lock(&preload_mutex);
+    if (preload_active) tekDeleteAssetManifest(&preload);
+    preload_active = 0;
+    preload_stopping = 0;
+    preload_next = 0;
+    pthread_mutex_unlock(&preload_mutex);
+}
+
+/**
+ * Start reading and decoding every asset in a manifest on worker threads. From then on, loading a mesh, material, shader, texture or font that is in the manifest only has to upload it, waiting for it to be decoded if it isn't yet.
+ * @note Replaces anything that was being preloaded before. The manifest is taken over, so it doesn't need to be deleted afterwards.
+ * @note If no worker threads can be started, nothing is decoded ahead of time, but each asset is still decoded when it is asked for, so loading works the same just slower.
+ * @param manifest The manifest of assets to preload.
+ */
+void tekPreloadAssets(TekAssetManifest* manifest) {
+    tekStopPreloadingAssets();
+
+    pthread_mutex_lock(&preload_mutex);
+    memcpy(&preload, manifest, sizeof(TekAssetManifest));
+    memset(manifest, 0, sizeof(TekAssetManifest));
+    preload_active = 1;
+    pthread_mutex_unlock(&preload_mutex);
+
+    // one thread per core, the render thread is usually busy creating the window or waiting on these anyway
+    long num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_workers < 1) num_workers = 1;
+    if (num_workers > ASSET_MAX_WORKERS) num_workers = ASSET_MAX_WORKERS;
+    for (long i = 0; i < num_workers; i++) {
+        if (pthread_create(&preload_workers[num_preload_workers], NULL, tekAssetWorker, NULL)) break;
+        num_preload_workers++;
+    }
+}
+
+/**
+ * Find an asset that is being preloaded, waiting for it to be decoded if it isn't yet. If nothing has started on it, it is decoded right here rather than waiting behind everything else.
+ * @param kind The kind of asset, e.g. ASSET_MESH.
+ * @param filename The file the asset was read from.
+ * @param face_index The face index, if it is a font.
+ * @param face_size The face size, if it is a font.
+ * @return The decoded asset, or null if it isn't being preloaded or couldn't be read.
+ */
+static TekAsset* tekFindPreloadedAssetFace(const flag kind, const char* filename, const uint face_index, const uint face_size) {
+    if (!filename) return 0;
+    char* key = tekCreateAssetKey(kind, filename, face_index, face_size);
+    if (!key) return 0;
+
+    pthread_mutex_lock(&preload_mutex);
+    TekAsset* asset = 0;
+    // checking for the key first, as a missing key isn't an error here and shouldn't leave one behind
+    if (!preload_active || !hashtableHasKey(&preload.lookup, key)
+        || hashtableGet(&preload.lookup, key, (void**)&asset) != SUCCESS) {
+        pthread_mutex_unlock(&preload_mutex);
+        free(key);
+        return 0;
+    }
+    free(key);
+
+    if (asset->state == ASSET_WAITING) tekDecodeWaitingAsset(asset);
+    while (asset->state == ASSET_DECODING) pthread_cond_wait(&preload_cond, &preload_mutex);
+    if (asset->state != ASSET_DECODED) asset = 0;
+    pthread_mutex_unlock(&preload_mutex);
+    return asset;
+}
+
+/**
+ * Find an asset that is being preloaded, waiting for it to be decoded if it isn't yet. If nothing has started on it, it is decoded right here rather than waiting behind everything else.
+ * @note Meshes and materials are only used once, so they should be given back with tekReleasePreloadedAsset(). Shaders and textures can be shared, so they stay until the next preload. Fonts are found with tekFindPreloadedFont().
+ * @param kind The kind of asset, e.g. ASSET_MESH.
+ * @param filename The file the asset was read from.
+ * @return The decoded asset, or null if it isn't being preloaded or couldn't be read, in which case it should be read as normal.
+ */
+TekAsset* tekFindPreloadedAsset(const flag kind, const char* filename) {
+    return tekFindPreloadedAssetFace(kind, filename, 0, 0);
+}
+
+/**
+ * Find a font that is being preloaded, waiting for its atlas to be drawn if it isn't yet.
+ * @note Fonts are only used once, so they should be given back with tekReleasePreloadedAsset().
+ * @param filename The .ttf file the font was read from.
+ * @param face_index The index of the face.
+ * @param face_size The size of the face in pixels.
+ * @return The decoded font, or null if it isn't being preloaded at this face and size or couldn't be read, in which case it should be read as normal.
+ */
+TekAsset* tekFindPreloadedFont(const char* filename, const uint face_index, const uint face_size) {
+    return tekFindPreloadedAssetFace(ASSET_FONT, filename, face_index, face_size);
+}
+
+/**
+ * Free the decoded data of a preloaded asset once it has been uploaded. Loading it again after this goes to the disk as normal.
+ * @param asset The asset from tekFindPreloadedAsset().
+ */
+void tekReleasePreloadedAsset(TekAsset* asset) {
+    pthread_mutex_lock(&preload_mutex);
+    tekFreeAssetData(asset);
+    asset->state = ASSET_RELEASED;
+    pthread_mutex_unlock(&preload_mutex);
+}
+
+/**
+ * Make sure that the preload is stopped and freed when everything else is deleted.
+ */
+tek_init tekAssetsInit(void) {
+    tekAddDeleteFunc(tekStopPreloadingAssets);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "../tekgl.h"
+#include "../core/exception.h"
+#include "../core/vector.h"
+#include "../core/hashtable.h"
+#include "../core/yml.h"
+#include "mesh.h"
+#include "texture.h"
+#include "font.h"
+
+#define ASSET_MESH     0
+#define ASSET_MATERIAL 1
+#define ASSET_SHADER   2 // found by reading a material, not usually added by hand
+#define ASSET_TEXTURE  3 // same as shaders
+#define ASSET_FONT     4
+
+#define ASSET_WAITING  0 // nothing has started reading it yet
+#define ASSET_DECODING 1
+#define ASSET_DECODED  2 // read and ready to be uploaded
+#define ASSET_FAILED   3 // whoever wanted it reads it again themselves, so they get the real exception
+#define ASSET_RELEASED 4 // uploaded, and the decoded data has been freed
+
+#define ASSET_MAX_WORKERS 8 // most threads that will decode assets at once, however many cores there are
+
+/// A file that is read and decoded ahead of time, so that only the upload to opengl is left for when it is needed.
+typedef struct TekAsset {
+    flag kind;
+    flag state;
+    char* filename;
+    uint face_index; // only for fonts
+    uint face_size;
+    union { // depends on the kind
+        TekPreparedMesh mesh;
+        YmlFile material;
+        char* source; // of a shader
+        TekImage image;
+        TekFontAtlas font_atlas;
+    };
+} TekAsset;
+
+/// A list of files that are about to be needed, e.g. every mesh and material in a scenario.
+typedef struct TekAssetManifest {
+    Vector assets; // TekAsset*, so that an asset stays in the same place while more are added
+    HashTable lookup; // kind, face and filename -> TekAsset*
+} TekAssetManifest;
+
+exception tekCreateAssetManifest(TekAssetManifest* manifest);
+exception tekAddAsset(TekAssetManifest* manifest, flag kind, const char* filename);
+exception tekAddFontAsset(TekAssetManifest* manifest, const char* filename, uint face_index, uint face_size);
+void tekDeleteAssetManifest(TekAssetManifest* manifest);
+void tekPreloadAssets(TekAssetManifest* manifest);
+TekAsset* tekFindPreloadedAsset(flag kind, const char* filename);
+TekAsset* tekFindPreloadedFont(const char* filename, uint face_index, uint face_size);
+void tekReleasePreloadedAsset(TekAsset* asset);
+void tekStopPreloadingAssets();
@@ -6,10 +6,30 @@
 #include "manager.h"
 #include "../core/list.h"
 #include <cglm/cam.h>
+#include <cglm/frustum.h>
+#include <glad/glad.h>
+
+/// The camera uniform block as the shaders see it, laid out by the std140 rules so it can be copied straight in.
+typedef struct TekCameraBlock {
+    mat4 view;
+    mat4 projection;
+    vec4 position; // vec3 in the shader, but std140 pads it out to 16 bytes anyway
+} TekCameraBlock;
 
 static List cameras = {0, 0};
 static float aspect_ratio = 1.0f;
 
+/**
+ * Update the frustum planes of the camera, needs doing whenever the view or projection matrix changes.
+ * @param camera A pointer to the camera to update.
+ */
+static void tekUpdateCameraFrustum(TekCamera* camera) {
+    // the planes come straight out of the combined matrix, glm normalises them so they give actual distances
+    mat4 view_projection;
+    glm_mat4_mul(camera->projection, camera->view, view_projection);
+    glm_frustum_planes(view_projection, camera->frustum);
+}
+
 /**
  * Update the projection matrix of the camera.
  * @param camera A pointer to the camera to update.
@@ -17,6 +37,8 @@ static float aspect_ratio = 1.0f;
 static void tekUpdateCameraProjection(TekCamera* camera) {
     // glm provides method to create perspective matrix.
     glm_perspective(camera->fov, aspect_ratio, camera->near, camera->far, camera->projection);
+    tekUpdateCameraFrustum(camera);
+    camera->dirty = 1;
 }
 
 /**
@@ -35,6 +57,8 @@ static void tekUpdateCameraView(TekCamera* camera) {
 
     // then, look at this point. so we look in the same way as expected.
     glm_lookat(camera->position, look_at, up, camera->view);
+    tekUpdateCameraFrustum(camera);
+    camera->dirty = 1;
 }
 
 /**
@@ -58,6 +82,13 @@ static void tekCameraFramebufferCallback(const int framebuffer_width, const int
  * Called when program exits, cleans up some structures.
  */
 static void tekCameraDeleteFunc() {
+    // delete the uniform buffers of any cameras that were drawn with
+    const ListItem* item;
+    foreach(item, (&cameras), {
+        const TekCamera* camera = (const TekCamera*)item->data;
+        if (camera->uniform_buffer_id) glDeleteBuffers(1, &camera->uniform_buffer_id);
+    });
+
     listDelete(&cameras); // delete list of cameras.
 }
 
@@ -81,6 +112,7 @@ tek_init tekCameraInit() {
  * @param position The new position of the camera.
  */
 void tekSetCameraPosition(TekCamera* camera, vec3 position) {
+    if (!memcmp(camera->position, position, sizeof(vec3))) return; // set every frame, but usually hasn't moved
     memcpy(camera->position, position, sizeof(vec3)); // copy in position
     tekUpdateCameraView(camera); // update matrices.
 }
@@ -91,10 +123,41 @@ void tekSetCameraPosition(TekCamera* camera, vec3 position) {
  * @param rotation The new rotation of the camera.
  */
 void tekSetCameraRotation(TekCamera* camera, vec3 rotation) {
+    if (!memcmp(camera->rotation, rotation, sizeof(vec3))) return;
     memcpy(camera->rotation, rotation, sizeof(vec3)); // copy rotation in
     tekUpdateCameraView(camera); // update
 }
 
+/**
+ * Make a camera the one that shaders with the camera uniform block draw from. The matrices are only copied to the uniform buffer if they changed since the last time.
+ * @param camera The camera to bind.
+ * @throws OPENGL_EXCEPTION if the uniform buffer could not be created.
+ */
+exception tekBindCamera(TekCamera* camera) {
+    // the camera can be created before there is an opengl context, so make the buffer the first time it is used
+    if (!camera->uniform_buffer_id) {
+        glGenBuffers(1, &camera->uniform_buffer_id);
+        glBindBuffer(GL_UNIFORM_BUFFER, camera->uniform_buffer_id);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(TekCameraBlock), NULL, GL_DYNAMIC_DRAW);
+        if (glGetError() == GL_OUT_OF_MEMORY)
+            tekThrow(OPENGL_EXCEPTION, "Failed to allocate memory for camera uniform buffer.");
+        camera->dirty = 1;
+    }
+
+    if (camera->dirty) {
+        TekCameraBlock block = {};
+        glm_mat4_copy(camera->view, block.view);
+        glm_mat4_copy(camera->projection, block.projection);
+        glm_vec3_copy(camera->position, block.position);
+        glBindBuffer(GL_UNIFORM_BUFFER, camera->uniform_buffer_id);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(TekCameraBlock), &block);
+        camera->dirty = 0;
+    }
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_UNIFORM_BINDING, camera->uniform_buffer_id);
+    return SUCCESS;
+}
+
 /**
  * Create a camera struct, a container for some information about a camera + matrices needed to render with this camera.
  * @param camera A pointer to an empty TekCamera struct.
@@ -116,6 +179,7 @@ exception tekCreateCamera(TekCamera* camera, vec3 position, vec3 rotation, const
     camera->fov = fov;
     camera->near = near;
     camera->far = far;
+    camera->uniform_buffer_id = 0;
 
     // generate matrices.
     tekUpdateCameraView(camera);
@@ -6,16 +6,23 @@
 #include <cglm/vec3.h>
 #include <cglm/mat4.h>
 
+#define CAMERA_UNIFORM_BLOCK   "TekCamera" // shaders that declare a std140 uniform block with this name get the camera from it
+#define CAMERA_UNIFORM_BINDING 0
+
 typedef struct TekCamera {
     vec3 position;
     vec3 rotation;
     mat4 view;
     mat4 projection;
+    vec4 frustum[6]; // planes facing inwards as (normal, distance), anything further behind one than its radius is off screen
     float fov;
     float near;
     float far;
+    uint uniform_buffer_id; // created the first time the camera is bound
+    flag dirty; // set when the matrices have changed since they were last copied to the uniform buffer
 } TekCamera;
 
 exception tekCreateCamera(TekCamera* camera, vec3 position, vec3 rotation, float fov, float near, float far);
 void tekSetCameraPosition(TekCamera* camera, vec3 position);
-void tekSetCameraRotation(TekCamera* camera, vec3 rotation); 
+void tekSetCameraRotation(TekCamera* camera, vec3 rotation);
+exception tekBindCamera(TekCamera* camera);
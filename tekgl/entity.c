@@ -1,14 +1,23 @@
 #include "entity.h"
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "../core/hashtable.h"
+#include "shader.h"
+#include "glad/glad.h"
 
 static flag mesh_cache_init = 0, material_cache_init = 0;
 static HashTable mesh_cache = {}, material_cache = {};
-static TekMaterial* using_material = 0;
+
+#define INSTANCE_STREAM_SIZE (1024 * sizeof(mat4)) // bytes of model matrices per frame to start with, grows if there are more
+
+static flag render_queue_init = 0, cull_list_init = 0;
+static TekRenderQueue render_queue = {};
+static TekCullList cull_list = {};
+static TekStreamBuffer instance_stream = {}; // created the first time something is drawn, as there is no opengl context yet during init
 
 /**
  * The cleanup function for the entity code. Deletes caches uses for materials and meshes.
@@ -33,6 +42,11 @@ static void tekEntityDelete() {
     // once everything is deleted, can now free the hashtables.
     if (mesh_cache_init) hashtableDelete(&mesh_cache);
     if (material_cache_init) hashtableDelete(&material_cache);
+
+    // and the buffers used for drawing
+    if (render_queue_init) tekDeleteRenderQueue(&render_queue);
+    if (cull_list_init) tekDeleteCullList(&cull_list);
+    if (instance_stream.buffer_id) tekDeleteStreamBuffer(&instance_stream);
 }
 
 /**
@@ -43,6 +57,10 @@ tek_init tekEntityInit(void) {
     if (hashtableCreate(&mesh_cache, 4) == SUCCESS) mesh_cache_init = 1;
     if (hashtableCreate(&material_cache, 4) == SUCCESS) material_cache_init = 1;
 
+    // list of what to draw each frame, reused so it doesn't need to be allocated every frame
+    if (tekCreateRenderQueue(16, &render_queue) == SUCCESS) render_queue_init = 1;
+    if (tekCreateCullList(16, &cull_list) == SUCCESS) cull_list_init = 1;
+
     // specify the cleanup function
     tekAddDeleteFunc(tekEntityDelete);
 }
@@ -75,6 +93,21 @@ static exception func_name(const char* filename, func_type** param_name) { \
 REQUEST_FUNC(requestMesh, TekMesh, mesh, tekReadMesh, tekDeleteMesh);
 REQUEST_FUNC(requestMaterial, TekMaterial, material, tekCreateMaterial, tekDeleteMaterial);
 
+/**
+ * Add the mesh and material of an entity to an asset manifest, so they can be read before the entity is created. Anything that is already cached is left out, as it won't be read again.
+ * @param manifest The manifest to add to.
+ * @param mesh_filename The mesh file the entity will use.
+ * @param material_filename The material file the entity will use.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekAddEntityAssets(TekAssetManifest* manifest, const char* mesh_filename, const char* material_filename) {
+    if (!mesh_cache_init || !hashtableHasKey(&mesh_cache, mesh_filename))
+        tekChainThrow(tekAddAsset(manifest, ASSET_MESH, mesh_filename));
+    if (!material_cache_init || !hashtableHasKey(&material_cache, material_filename))
+        tekChainThrow(tekAddAsset(manifest, ASSET_MATERIAL, material_filename));
+    return SUCCESS;
+}
+
 /**
  * Create a new entity from a mesh and material file, along with other data.
  * mesh file type = .tmsh, material file type = .tmat
@@ -102,6 +135,7 @@ exception tekCreateEntity(const char* mesh_filename, const char* material_filena
     glm_vec3_copy(position, entity->position);
     glm_vec4_copy(rotation, entity->rotation);
     glm_vec3_copy(scale, entity->scale);
+    entity->lod = 0;
 
     return SUCCESS;
 }
@@ -118,52 +152,244 @@ void tekUpdateEntity(TekEntity* entity, vec3 position, vec4 rotation) {
 }
 
 /**
- * Draw an entity to the screen from the perspective of a camera.
- * Also use the material associated with the entity.
- * @param entity The entity to draw.
- * @param camera The camera which contains the perspective to draw from.
- * @throws SHADER_EXCEPTION if could not set shader uniforms for camera.
+ * Update an entity to a position and rotation part way between two others.
+ * @note Used to smooth out movement when the physics runs at a different rate to the graphics.
+ * @param entity The entity to update.
+ * @param previous_position The position at the start of the step.
+ * @param previous_rotation The rotation at the start of the step.
+ * @param position The position at the end of the step.
+ * @param rotation The rotation at the end of the step.
+ * @param alpha How far through the step, from 0 (previous) to 1 (current).
  */
-exception tekDrawEntity(TekEntity* entity, TekCamera* camera) {
-    // use entity's material
-    tekChainThrow(tekBindMaterial(entity->material));
+void tekInterpolateEntity(TekEntity* entity, vec3 previous_position, vec4 previous_rotation, vec3 position, vec4 rotation, const float alpha) {
+    glm_vec3_lerp(previous_position, position, alpha, entity->position);
+    glm_quat_slerp(previous_rotation, rotation, alpha, entity->rotation);
+}
 
-    // create the model matrix for this entity
-    // this specifies how the model is moved from its initial position
+/**
+ * Create the model matrix for an entity, which specifies how the model is moved from its initial position.
+ * @param entity The entity to create the matrix for.
+ * @param model The outputted model matrix.
+ */
+static void tekEntityModelMatrix(TekEntity* entity, mat4 model) {
     mat4 translation;
     glm_translate_make(translation, entity->position);
     mat4 rotation;
     glm_quat_mat4(entity->rotation, rotation);
     mat4 scale;
     glm_scale_make(scale, entity->scale);
-    mat4 model;
     glm_mat4_mul(rotation, scale, model);
     glm_mat4_mul(translation, model, model);
+}
 
-    // load all the matrices into the shader
-    // camera contains most of them already.
-    if (tekMaterialHasUniformType(entity->material, MODEL_MATRIX_DATA))
-        tekChainThrow(tekBindMaterialMatrix(entity->material, model, MODEL_MATRIX_DATA));
+/**
+ * Load the camera matrices into a material that has already been bound, if it wants them as separate uniforms rather than from the camera uniform block.
+ * @param material The material to load the matrices into.
+ * @param camera The camera which contains the perspective to draw from.
+ * @throws SHADER_EXCEPTION if could not set shader uniforms for camera.
+ */
+static exception tekBindEntityCamera(TekMaterial* material, TekCamera* camera) {
+    if (material->camera_block) return SUCCESS; // already has it from tekBindCamera()
 
-    if (tekMaterialHasUniformType(entity->material, VIEW_MATRIX_DATA))
-        tekChainThrow(tekBindMaterialMatrix(entity->material, camera->view, VIEW_MATRIX_DATA));
+    if (tekMaterialHasUniformType(material, VIEW_MATRIX_DATA))
+        tekChainThrow(tekBindMaterialMatrix(material, camera->view, VIEW_MATRIX_DATA));
+
+    if (tekMaterialHasUniformType(material, PROJECTION_MATRIX_DATA))
+        tekChainThrow(tekBindMaterialMatrix(material, camera->projection, PROJECTION_MATRIX_DATA));
+
+    if (tekMaterialHasUniformType(material, CAMERA_POSITION_DATA))
+        tekChainThrow(tekBindMaterialVec3(material, camera->position, CAMERA_POSITION_DATA));
+
+    return SUCCESS;
+}
 
-    if (tekMaterialHasUniformType(entity->material, PROJECTION_MATRIX_DATA))
-        tekChainThrow(tekBindMaterialMatrix(entity->material, camera->projection, PROJECTION_MATRIX_DATA));
+/**
+ * Get space in the instance stream buffer for this frame's model matrices, creating the buffer if needed. Call tekStreamBufferUnmap() once they are written.
+ * @param num_matrices The number of matrices that will be written.
+ * @param matrices Set to where the matrices should be written.
+ * @param first_instance Set to the instance number of the first matrix, to pass to tekDrawBoundMeshInstanced().
+ * @throws OPENGL_EXCEPTION if the buffer could not be created or mapped.
+ */
+static exception tekMapInstanceMatrices(const uint num_matrices, mat4** matrices, uint* first_instance) {
+    if (!instance_stream.buffer_id)
+        tekChainThrow(tekCreateStreamBuffer(INSTANCE_STREAM_SIZE, &instance_stream));
+    uint offset;
+    tekChainThrow(tekStreamBufferMap(&instance_stream, num_matrices * sizeof(mat4), (void**)matrices, &offset));
+    *first_instance = offset / sizeof(mat4); // offsets are aligned to far more than a matrix, so this is exact
+    return SUCCESS;
+}
 
-    if (tekMaterialHasUniformType(entity->material, CAMERA_POSITION_DATA))
-        tekChainThrow(tekBindMaterialVec3(entity->material, camera->position, CAMERA_POSITION_DATA));
+/**
+ * Work out where an entity should go in the render queue.
+ * @param entity The entity to be drawn.
+ * @param camera The camera it is being drawn from, to work out how far away it is.
+ * @returns The sort key for the entity.
+ */
+static unsigned long long tekEntityRenderKey(const TekEntity* entity, const TekCamera* camera) {
+    const float depth = camera->far > 0.0f ? glm_vec3_distance((float*)entity->position, (float*)camera->position) / camera->far : 0.0f;
+    return tekRenderKey(
+        entity->material->translucent, entity->material->shader_program_id, entity->material->id,
+        entity->mesh->vertex_array_id * MESH_MAX_LODS + entity->lod, depth
+    );
+}
 
-    // draw to the screen
-    tekDrawMesh(entity->mesh);
+/**
+ * Find a sphere around an entity in world space, by moving its mesh's bounding sphere the same way the model matrix does.
+ * @param entity The entity to find the bounds of.
+ * @param center Where to write the centre of the sphere.
+ * @param radius Where to write the radius of the sphere, negative if the mesh has no bounds.
+ */
+static void tekEntityBounds(const TekEntity* entity, vec3 center, float* radius) {
+    const TekMesh* mesh = entity->mesh;
+    if (mesh->bounds_radius < 0.0f) {
+        glm_vec3_copy((float*)entity->position, center);
+        *radius = -1.0f;
+        return;
+    }
+
+    // scale, then rotate, then translate, same order as the model matrix
+    vec3 scaled_center;
+    glm_vec3_mul((float*)mesh->bounds_center, (float*)entity->scale, scaled_center);
+    glm_quat_rotatev((float*)entity->rotation, scaled_center, center);
+    glm_vec3_add(center, (float*)entity->position, center);
+
+    // uneven scaling stretches the sphere, so the biggest scale has to cover every direction
+    const float max_scale = fmaxf(fabsf(entity->scale[0]), fmaxf(fabsf(entity->scale[1]), fabsf(entity->scale[2])));
+    *radius = mesh->bounds_radius * max_scale;
+}
+
+/**
+ * Draw a whole list of entities from the perspective of a camera. The entities are sorted so that each shader program, material and mesh is bound as few times as possible, and entities that share a mesh and an instanced material are drawn together with a single draw call.
+ * @note Entities with no mesh, or that are outside of the camera's frustum, are skipped. Translucent materials are drawn after everything else, furthest away first. The level of detail of each entity's mesh is picked by how big it is on screen, and stored in the entity for next frame.
+ * @param entities A vector of TekEntity structs to draw.
+ * @param camera The camera which contains the perspective to draw from.
+ * @throws SHADER_EXCEPTION if could not set shader uniforms for camera.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekDrawEntities(const Vector* entities, TekCamera* camera) {
+    if (!render_queue_init || !cull_list_init) tekThrow(NULL_PTR_EXCEPTION, "Render queue does not exist.");
+
+    // shared by every material with the camera uniform block, so only needs doing once
+    tekChainThrow(tekBindCamera(camera));
+
+    // throw away anything the camera can't see first, so none of the work after this is spent on it
+    tekClearCullList(&cull_list);
+    for (uint i = 0; i < entities->length; i++) {
+        TekEntity* entity;
+        tekChainThrow(vectorGetItemPtr(entities, i, &entity));
+        if (!entity->mesh) continue;
+        vec3 center;
+        float radius;
+        tekEntityBounds(entity, center, &radius);
+        tekChainThrow(tekAddCullSphere(&cull_list, center, radius, entity));
+    }
+    const uint num_visible = tekCullSpheres(&cull_list, camera->frustum);
+
+    // the bounding sphere is also how big the entity looks, which picks the level of detail
+    const float tan_half_fov = tanf(camera->fov * 0.5f);
+    tekClearRenderQueue(&render_queue);
+    for (uint i = 0; i < cull_list.length; i++) {
+        if (!cull_list.visible[i]) continue;
+        TekEntity* entity = cull_list.data[i];
+        vec3 offset = { cull_list.centers_x[i], cull_list.centers_y[i], cull_list.centers_z[i] };
+        glm_vec3_sub(offset, camera->position, offset);
+        const float distance = glm_vec3_norm(offset);
+        const float screen_size = distance > 0.0f ? cull_list.radii[i] / (distance * tan_half_fov) : INFINITY;
+        entity->lod = tekSelectMeshLod(entity->mesh, screen_size, entity->lod);
+        tekChainThrow(tekPushRenderPacket(&render_queue, tekEntityRenderKey(entity, camera), entity));
+    }
+    render_queue.stats.num_culled = cull_list.length - num_visible;
+    tekSortRenderQueue(&render_queue);
+    const TekRenderPacket* packets = render_queue.packets;
+    const uint num_packets = render_queue.length;
+
+    // write the model matrices of instanced entities straight into the stream buffer in the order they will be drawn, so each group's matrices are next to each other
+    uint num_instances = 0;
+    for (uint i = 0; i < num_packets; i++) {
+        const TekEntity* entity = packets[i].data;
+        if (entity->material->instanced) num_instances++;
+    }
+    uint next_instance = 0;
+    if (num_instances) {
+        mat4* matrices;
+        tekChainThrow(tekMapInstanceMatrices(num_instances, &matrices, &next_instance));
+        uint j = 0;
+        for (uint i = 0; i < num_packets; i++) {
+            TekEntity* entity = packets[i].data;
+            if (!entity->material->instanced) continue;
+
+            // the matrix is built on the stack and copied over, as reading back from mapped memory can be very slow
+            mat4 model;
+            tekEntityModelMatrix(entity, model);
+            memcpy(matrices[j++], model, sizeof(mat4));
+        }
+        tekStreamBufferUnmap(&instance_stream);
+    }
+
+    // whatever was bound before this frame could have been changed by the text and gui since, so start from nothing
+    TekRenderStats* stats = &render_queue.stats;
+    uint bound_program = 0;
+    const TekMaterial* bound_material = 0;
+    const TekMesh* bound_mesh = 0;
+    uint start = 0;
+    while (start < num_packets) {
+        TekEntity* entity = packets[start].data;
+        TekMaterial* material = entity->material;
+        const TekMesh* mesh = entity->mesh;
+
+        // instanced entities next to each other with the same mesh and material go in one draw call
+        uint end = start + 1;
+        if (material->instanced) {
+            while (end < num_packets) {
+                const TekEntity* next_entity = packets[end].data;
+                if (next_entity->material != material || next_entity->mesh != mesh || next_entity->lod != entity->lod) break;
+                end++;
+            }
+        }
+
+        if (material->shader_program_id != bound_program) {
+            tekBindShaderProgram(material->shader_program_id);
+            bound_program = material->shader_program_id;
+            bound_material = 0; // textures are bound to a shared slot, so the material needs binding again too
+            stats->program_binds++;
+        }
+        if (material != bound_material) {
+            tekChainThrow(tekBindMaterialUniforms(material));
+            tekChainThrow(tekBindEntityCamera(material, camera));
+            bound_material = material;
+            stats->material_binds++;
+        }
+        if (mesh != bound_mesh) {
+            tekBindMesh(mesh);
+            bound_mesh = mesh;
+            stats->mesh_binds++;
+        }
+
+        if (material->instanced) {
+            tekDrawBoundMeshInstanced(mesh, entity->lod, instance_stream.buffer_id, next_instance, end - start);
+            next_instance += end - start;
+        } else {
+            if (tekMaterialHasUniformType(material, MODEL_MATRIX_DATA)) {
+                mat4 model;
+                tekEntityModelMatrix(entity, model);
+                tekChainThrow(tekBindMaterialMatrix(material, model, MODEL_MATRIX_DATA));
+            }
+            tekDrawBoundMeshLod(mesh, entity->lod);
+        }
+        stats->draw_calls++;
+        stats->num_triangles += (uint)mesh->lod_elements[entity->lod] / 3 * (end - start);
+        start = end;
+    }
 
+    // the matrices can be overwritten once the gpu has finished with these draws
+    tekStreamBufferEndFrame(&instance_stream);
     return SUCCESS;
 }
 
 /**
- * Notify the materials renderer that the material has been changed without using the material code directly.
+ * Get how much work the last call to tekDrawEntities() did, to see how well the entities were grouped.
+ * @param stats Where to write the stats.
  */
-void tekNotifyEntityMaterialChange() {
-    using_material = 0; // bodgemethod
-    // i did this to debug and then it worked fine so its become permanent.
+void tekGetEntityRenderStats(TekRenderStats* stats) {
+    memcpy(stats, &render_queue.stats, sizeof(TekRenderStats));
 }
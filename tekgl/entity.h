@@ -4,9 +4,14 @@
 #include <cglm/quat.h>
 
 #include "manager.h"
+#include "../core/vector.h"
 #include "mesh.h"
 #include "material.h"
 #include "camera.h"
+#include "renderqueue.h"
+#include "streambuffer.h"
+#include "frustum.h"
+#include "assets.h"
 
 typedef struct TekEntity {
     TekMesh* mesh;
@@ -14,9 +19,12 @@ typedef struct TekEntity {
     vec3 position;
     vec4 rotation;
     vec3 scale;
+    uint lod; // level of detail of the mesh that was drawn last frame
 } TekEntity;
 
+exception tekAddEntityAssets(TekAssetManifest* manifest, const char* mesh_filename, const char* material_filename);
 exception tekCreateEntity(const char* mesh_filename, const char* material_filename, vec3 position, vec4 rotation, vec3 scale, TekEntity* entity);
 void tekUpdateEntity(TekEntity* entity, vec3 position, vec4 rotation);
-exception tekDrawEntity(TekEntity* entity, TekCamera* camera);
-void tekNotifyEntityMaterialChange();
\ No newline at end of file
+void tekInterpolateEntity(TekEntity* entity, vec3 previous_position, vec4 previous_rotation, vec3 position, vec4 rotation, float alpha);
+exception tekDrawEntities(const Vector* entities, TekCamera* camera);
+void tekGetEntityRenderStats(TekRenderStats* stats);
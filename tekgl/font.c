@@ -1,10 +1,12 @@
 #include "font.h"
 
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 #include <freetype/freetype.h>
 
 #include "glad/glad.h"
-#define FT_FREETYPE_H
+#include "assets.h"
 
 #define ATLAS_QUIT         0b1
 #define ATLAS_QUIT_ALREADY 0b10
@@ -65,8 +67,8 @@ exception tekCreateFontFace(const char* filename, const uint face_index, const u
  * @throws FREETYPE_EXCEPTION if FreeType was not initialised of the glyph could not be loaded.
  */
 exception tekGetGlyphSize(const FT_Face* face, const uint glyph, uint* glyph_width, uint* glyph_height) {
-    // make sure that the library has been initialised
-    if (!ft_library) tekThrow(FREETYPE_EXCEPTION, "FreeType must be initialised before loading a glyph.");
+    // make sure that there is a face, which can only be made once freetype is initialised
+    if (!face || !*face) tekThrow(FREETYPE_EXCEPTION, "Font face must be created before loading a glyph.");
 
     // load the glyph without loading the bitmap data, we only want the metrics
     if (FT_Load_Char(*face, glyph, FT_LOAD_BITMAP_METRICS_ONLY)) tekThrow(FREETYPE_EXCEPTION, "Failed to get glyph size.");
@@ -86,8 +88,8 @@ exception tekGetGlyphSize(const FT_Face* face, const uint glyph, uint* glyph_wid
  * @throws FREETYPE_EXCEPTION if FreeType is not initialised or the glyph couldn't be rendered.
  */
 exception tekTempLoadGlyph(const FT_Face* face, const uint glyph_id, TekGlyph* glyph, byte** glyph_data) {
-    // make sure that the library has been initialised
-    if (!ft_library) tekThrow(FREETYPE_EXCEPTION, "FreeType must be initialised before loading a glyph.");
+    // make sure that there is a face, which can only be made once freetype is initialised
+    if (!face || !*face) tekThrow(FREETYPE_EXCEPTION, "Font face must be created before loading a glyph.");
 
     // load the glyph and render the corresponding bitmap
     if (FT_Load_Char(*face, glyph_id, FT_LOAD_RENDER)) tekThrow(FREETYPE_EXCEPTION, "Failed to render glyph.");
@@ -237,29 +239,11 @@ exception tekCreateFontAtlasData(const FT_Face* face, const uint atlas_size, byt
 }
 
 /**
- * Create the font atlas texture,  this is a texture that contains every character in a tightly packed area.
- * Also returns an array of glyphs, which store where on the atlas each character is.
- * @param face The font face to create the texture atlas from.
+ * Create the font atlas texture from an atlas that has already been drawn.
+ * @param font_atlas The atlas to send to opengl.
  * @param texture_id A pointer to a uint which will have the id of the newly created texture written to it.
- * @param atlas_size A pointer to a uint which will have the new atlas size written to it.
- * @param glyphs A pointer to an array of glyphs which will have the glyph data written to it. 
- * @throws MEMORY_EXCEPTION if malloc() fails.
- * @throws FREETYPE_EXCEPTION if failed to load font.
  */
-exception tekCreateFontAtlasTexture(const FT_Face* face, uint* texture_id, uint* atlas_size, TekGlyph* glyphs) {
-    tekChainThrow(tekGetAtlasSize(face, atlas_size));
-
-    // allocate enough data for the atlas texture
-    byte* atlas_data = (byte*)malloc(*atlas_size * *atlas_size);
-    if (!atlas_data) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for atlas data.");
-
-    // pass empty buffer and fill it with atlas texture data
-    const exception result = tekCreateFontAtlasData(face, *atlas_size, &atlas_data, glyphs);
-    if (result) {
-        free(atlas_data);
-        tekChainThrow(result);
-    }
-
+static void tekCreateFontAtlasTexture(const TekFontAtlas* font_atlas, uint* texture_id) {
     // create a new opengl texture for the atlas
     glGenTextures(1, texture_id);
     glBindTexture(GL_TEXTURE_2D, *texture_id);
@@ -271,13 +255,80 @@ exception tekCreateFontAtlasTexture(const FT_Face* face, uint* texture_id, uint*
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     // write atlas texture data to buffer
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, (int)*atlas_size, (int)*atlas_size, 0, GL_RED, GL_UNSIGNED_BYTE, atlas_data);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, (int)font_atlas->atlas_size, (int)font_atlas->atlas_size, 0, GL_RED, GL_UNSIGNED_BYTE, font_atlas->data);
+}
 
-    // free the atlas data as it is no longer needed
-    free(atlas_data);
+/**
+ * Draw the font atlas of a true type font file, which contains every character in a tightly packed area, along with where each character is on it.
+ * Doesn't need opengl, so can be done on another thread.
+ * @note A FreeType library can't be used by more than one thread at once, so this makes its own rather than using the shared one. The atlas must be deleted with tekDeleteFontAtlas().
+ * @param filename The name of the .ttf file to be loaded.
+ * @param face_index The index of the face to use (use 0 if unsure)
+ * @param face_size The size of the face in pixels.
+ * @param font_atlas The font atlas to fill in.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FREETYPE_EXCEPTION if failed to load the font.
+ */
+exception tekReadFontAtlas(const char* filename, const uint face_index, const uint face_size, TekFontAtlas* font_atlas) {
+    // make sure that the font is large enough
+    if (face_size < MIN_FONT_SIZE) tekThrow(FREETYPE_EXCEPTION, "Font size is too small.");
+    font_atlas->data = 0;
+
+    // load the font face, same as tekCreateFontFace() but with our own library
+    FT_Library library;
+    if (FT_Init_FreeType(&library)) tekThrow(FREETYPE_EXCEPTION, "Failed to initialise FreeType.");
+    FT_Face face;
+    if (FT_New_Face(library, filename, face_index, &face))
+        tekThrowThen(FREETYPE_EXCEPTION, "Failed to create font face.", FT_Done_FreeType(library));
+    if (FT_Set_Pixel_Sizes(face, 0, face_size)) {
+        tekDeleteFontFace(face);
+        tekThrowThen(FREETYPE_EXCEPTION, "Failed to set face pixel size.", FT_Done_FreeType(library));
+    }
+
+    // allocate enough data for the atlas texture, and fill it with the atlas
+    exception tek_exception = tekGetAtlasSize(&face, &font_atlas->atlas_size);
+    if (!tek_exception) {
+        font_atlas->data = (byte*)calloc(font_atlas->atlas_size * font_atlas->atlas_size, sizeof(byte));
+        if (!font_atlas->data) {
+            tek_exception = MEMORY_EXCEPTION;
+            tekExcept(tek_exception, "Failed to allocate memory for atlas data.");
+        }
+    }
+    if (!tek_exception) tek_exception = tekCreateFontAtlasData(&face, font_atlas->atlas_size, &font_atlas->data, font_atlas->glyphs);
+
+    // store original size
+    font_atlas->original_size = face->size->metrics.height >> 6;
+
+    // only the atlas is needed from here
+    tekDeleteFontFace(face);
+    FT_Done_FreeType(library);
+    if (tek_exception) tekDeleteFontAtlas(font_atlas);
+    tekChainThrow(tek_exception);
+    return SUCCESS;
+}
+
+/**
+ * Create a bitmap font from a font atlas that has already been drawn, by sending the atlas to opengl.
+ * @param font_atlas The font atlas from tekReadFontAtlas().
+ * @param bitmap_font A pointer to a TekBitmapFont struct that will have the font data written to it.
+ */
+exception tekCreateFontAtlasFont(const TekFontAtlas* font_atlas, TekBitmapFont* bitmap_font) {
+    tekCreateFontAtlasTexture(font_atlas, &bitmap_font->atlas_id);
+    bitmap_font->atlas_size = font_atlas->atlas_size;
+    bitmap_font->original_size = font_atlas->original_size;
+    memcpy(bitmap_font->glyphs, font_atlas->glyphs, sizeof(bitmap_font->glyphs));
     return SUCCESS;
 }
 
+/**
+ * Free the data of a font atlas.
+ * @param font_atlas The font atlas to delete.
+ */
+void tekDeleteFontAtlas(TekFontAtlas* font_atlas) {
+    free(font_atlas->data);
+    font_atlas->data = 0;
+}
+
 /**
  * Create a new bitmap font from a true type font file. The files contain multiple faces such as italic, bold.
  * So you need to also specify which font you want to use with a font index.
@@ -288,15 +339,20 @@ exception tekCreateFontAtlasTexture(const FT_Face* face, uint* texture_id, uint*
  * @throws FREETYPE_EXCEPTION if failed to load the font.
  */
 exception tekCreateBitmapFont(const char* filename, const uint face_index, const uint face_size, TekBitmapFont* bitmap_font) {
-    // load the font face
-    FT_Face face;
-    tekChainThrow(tekCreateFontFace(filename, face_index, face_size, &face));
-
-    // create the font atlas texture
-    tekChainThrow(tekCreateFontAtlasTexture(&face, &bitmap_font->atlas_id, &bitmap_font->atlas_size, &bitmap_font->glyphs));
+    // the atlas might have already been drawn on another thread
+    TekAsset* asset = tekFindPreloadedFont(filename, face_index, face_size);
+    if (asset) {
+        const exception tek_exception = tekCreateFontAtlasFont(&asset->font_atlas, bitmap_font);
+        tekReleasePreloadedAsset(asset);
+        tekChainThrow(tek_exception);
+        return SUCCESS;
+    }
 
-    // store original size
-    bitmap_font->original_size = face->size->metrics.height >> 6;
-    tekDeleteFontFace(face); // delete font face, we only need the atlas from it.
+    // otherwise draw the atlas now
+    TekFontAtlas font_atlas;
+    tekChainThrow(tekReadFontAtlas(filename, face_index, face_size, &font_atlas));
+    const exception tek_exception = tekCreateFontAtlasFont(&font_atlas, bitmap_font);
+    tekDeleteFontAtlas(&font_atlas);
+    tekChainThrow(tek_exception);
     return SUCCESS;
-}
\ No newline at end of file
+}
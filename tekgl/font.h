@@ -4,7 +4,6 @@
 #include "../tekgl.h"
 
 #include <freetype/freetype.h>
-#define FT_FREETYPE_H
 
 #define ATLAS_SIZE    256
 #define MIN_FONT_SIZE 3
@@ -28,9 +27,19 @@ typedef struct TekBitmapFont {
     TekGlyph glyphs[ATLAS_SIZE];
 } TekBitmapFont;
 
+/// The atlas of a bitmap font, drawn but not yet sent to opengl.
+typedef struct TekFontAtlas {
+    byte* data; // one byte per pixel, atlas_size by atlas_size
+    uint atlas_size;
+    uint original_size;
+    TekGlyph glyphs[ATLAS_SIZE];
+} TekFontAtlas;
+
 exception tekCreateFreeType();
 void tekDeleteFreeType();
 exception tekCreateFontFace(const char* filename, uint face_index, uint face_size, FT_Face* face);
 exception tekTempLoadGlyph(const FT_Face* face, uint glyph_id, TekGlyph* glyph, byte** glyph_data);
-//exception tekCreateFontAtlasTexture(const FT_Face* face, uint* texture_id, TekGlyph* glyphs);
+exception tekReadFontAtlas(const char* filename, uint face_index, uint face_size, TekFontAtlas* font_atlas);
+exception tekCreateFontAtlasFont(const TekFontAtlas* font_atlas, TekBitmapFont* bitmap_font);
+void tekDeleteFontAtlas(TekFontAtlas* font_atlas);
 exception tekCreateBitmapFont(const char* filename, uint face_index, uint face_size, TekBitmapFont* bitmap_font);
\ No newline at end of file
@@ -0,0 +1,222 @@
+#include "frustum.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TEK_AVX2_KERNEL
+#define TEK_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
+/**
+ * Move the cull list into a new block of memory with space for more spheres, keeping the ones already in it.
+ * @param list The list to resize.
+ * @param capacity The new number of spheres that fit.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+static exception tekResizeCullList(TekCullList* list, const uint capacity) {
+    // one block for every array, pointers first so nothing ends up misaligned
+    const size_t sphere_size = sizeof(void*) + 4 * sizeof(float) + sizeof(flag);
+    char* block = (char*)malloc(capacity * sphere_size);
+    if (!block) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for cull list.");
+
+    void** data = (void**)block;
+    float* centers_x = (float*)(data + capacity);
+    float* centers_y = centers_x + capacity;
+    float* centers_z = centers_y + capacity;
+    float* radii = centers_z + capacity;
+    flag* visible = (flag*)(radii + capacity);
+
+    if (list->length) {
+        memcpy(data, list->data, list->length * sizeof(void*));
+        memcpy(centers_x, list->centers_x, list->length * sizeof(float));
+        memcpy(centers_y, list->centers_y, list->length * sizeof(float));
+        memcpy(centers_z, list->centers_z, list->length * sizeof(float));
+        memcpy(radii, list->radii, list->length * sizeof(float));
+        memcpy(visible, list->visible, list->length * sizeof(flag));
+    }
+    free(list->data); // start of the old block
+
+    list->data = data;
+    list->centers_x = centers_x;
+    list->centers_y = centers_y;
+    list->centers_z = centers_z;
+    list->radii = radii;
+    list->visible = visible;
+    list->capacity = capacity;
+    return SUCCESS;
+}
+
+/**
+ * @brief Create an empty cull list.
+ * @param capacity The number of spheres that fit before the list has to grow (use 1 if unsure).
+ * @param list A pointer to the list to be created.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekCreateCullList(uint capacity, TekCullList* list) {
+    if (!capacity) capacity = 1; // same as vectors, 0 would never grow
+    memset(list, 0, sizeof(TekCullList));
+    tekChainThrow(tekResizeCullList(list, capacity));
+    return SUCCESS;
+}
+
+/**
+ * @brief Empty the list ready for the next frame. Keeps the memory that has been allocated.
+ * @param list The list to clear.
+ */
+void tekClearCullList(TekCullList* list) {
+    list->length = 0;
+}
+
+/**
+ * @brief Add a sphere to the end of the list, growing it if it is full.
+ * @param list The list to add to.
+ * @param center The centre of the sphere in world space.
+ * @param radius The radius of the sphere. If negative, the size isn't known and the sphere is never culled.
+ * @param data The thing inside the sphere, given back when the list is read.
+ * @throws MEMORY_EXCEPTION if the list could not grow.
+ */
+exception tekAddCullSphere(TekCullList* list, vec3 center, const float radius, void* data) {
+    if (list->length == list->capacity)
+        tekChainThrow(tekResizeCullList(list, list->capacity * 2));
+    const uint index = list->length++;
+    list->centers_x[index] = center[0];
+    list->centers_y[index] = center[1];
+    list->centers_z[index] = center[2];
+    list->radii[index] = radius < 0.0f ? INFINITY : radius; // infinitely far behind every plane is still inside
+    list->visible[index] = 1;
+    list->data[index] = data;
+    return SUCCESS;
+}
+
+/**
+ * Test part of the list against the frustum, one sphere at a time.
+ * @param list The list of spheres.
+ * @param planes The planes of the frustum, facing inwards.
+ * @param start The index of the first sphere to test.
+ * @param end The index after the last sphere to test.
+ * @return The number of spheres in that part that are visible.
+ */
+static uint tekCullSpheresRange(TekCullList* list, vec4 planes[FRUSTUM_NUM_PLANES], const uint start, const uint end) {
+    uint num_visible = 0;
+    for (uint i = start; i < end; i++) {
+        // a sphere is off screen if it is completely behind any one of the planes
+        flag visible = 1;
+        for (uint j = 0; j < FRUSTUM_NUM_PLANES; j++) {
+            const float distance = planes[j][0] * list->centers_x[i] + planes[j][1] * list->centers_y[i] + planes[j][2] * list->centers_z[i] + planes[j][3];
+            if (distance < -list->radii[i]) {
+                visible = 0;
+                break;
+            }
+        }
+        list->visible[i] = visible;
+        num_visible += visible;
+    }
+    return num_visible;
+}
+
+/**
+ * @brief Work out which spheres in the list can be seen by the camera, one sphere at a time.
+ * @note Spheres that are partly on screen, or only in the corners of the frustum, count as visible. That is fine, as the gpu clips whatever is actually off screen.
+ * @param list The list of spheres, visible is written for each one.
+ * @param planes The planes of the frustum, facing inwards, such as the frustum of a camera.
+ * @return The number of visible spheres.
+ */
+uint tekCullSpheresScalar(TekCullList* list, vec4 planes[FRUSTUM_NUM_PLANES]) {
+    return tekCullSpheresRange(list, planes, 0, list->length);
+}
+
+#ifdef TEK_AVX2_KERNEL
+
+/**
+ * Check whether the cpu this is running on supports the AVX2 and FMA instructions needed by the vectorised culling.
+ * @return 1 if the instructions are supported, 0 otherwise.
+ */
+static flag tekFrustumHasAVX2() {
+    // only need to ask the cpu once, answer is not going to change
+    static int has_avx2 = -1;
+    if (has_avx2 < 0) {
+        __builtin_cpu_init();
+        has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return (flag)has_avx2;
+}
+
+/**
+ * Test the spheres against the frustum 8 at a time, leaving any that don't make a full 8 at the end.
+ * @param list The list of spheres.
+ * @param planes The planes of the frustum, facing inwards.
+ * @param end Where to stop, must be a multiple of 8.
+ * @return The number of spheres up to end that are visible.
+ */
+TEK_AVX2_TARGET static uint tekCullSpheresRangeAVX2(TekCullList* list, vec4 planes[FRUSTUM_NUM_PLANES], const uint end) {
+    const __m256 all_inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    uint num_visible = 0;
+    for (uint i = 0; i < end; i += 8) {
+        const __m256 x = _mm256_loadu_ps(list->centers_x + i);
+        const __m256 y = _mm256_loadu_ps(list->centers_y + i);
+        const __m256 z = _mm256_loadu_ps(list->centers_z + i);
+        const __m256 negative_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(list->radii + i));
+
+        // same test as the scalar version, but every plane is checked as there is no branching per sphere
+        __m256 inside = all_inside;
+        for (uint j = 0; j < FRUSTUM_NUM_PLANES; j++) {
+            __m256 distance = _mm256_fmadd_ps(_mm256_broadcast_ss(planes[j] + 2), z, _mm256_broadcast_ss(planes[j] + 3));
+            distance = _mm256_fmadd_ps(_mm256_broadcast_ss(planes[j] + 1), y, distance);
+            distance = _mm256_fmadd_ps(_mm256_broadcast_ss(planes[j]), x, distance);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negative_radius, _CMP_GE_OQ));
+        }
+
+        // one bit per sphere, spread back out into the visible flags
+        const uint mask = (uint)_mm256_movemask_ps(inside);
+        for (uint j = 0; j < 8; j++)
+            list->visible[i + j] = (flag)((mask >> j) & 1);
+        num_visible += (uint)__builtin_popcount(mask);
+    }
+    return num_visible;
+}
+
+#endif
+
+/**
+ * @brief Work out which spheres in the list can be seen by the camera, 8 at a time using AVX2 if the cpu supports it.
+ * @note Uses fma, so a sphere that is just touching a plane can come out differently to tekCullSpheresScalar().
+ * @param list The list of spheres, visible is written for each one.
+ * @param planes The planes of the frustum, facing inwards, such as the frustum of a camera.
+ * @param num_visible Set to the number of visible spheres, if the spheres were tested.
+ * @return 1 if the spheres were tested, 0 if AVX2 is not available and nothing was done.
+ */
+flag tekCullSpheresSIMD(TekCullList* list, vec4 planes[FRUSTUM_NUM_PLANES], uint* num_visible) {
+#ifdef TEK_AVX2_KERNEL
+    if (tekFrustumHasAVX2()) {
+        const uint end = list->length & ~7u;
+        *num_visible = tekCullSpheresRangeAVX2(list, planes, end) + tekCullSpheresRange(list, planes, end, list->length);
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/**
+ * @brief Work out which spheres in the list can be seen by the camera. Uses the vectorised version if possible.
+ * @param list The list of spheres, visible is written for each one.
+ * @param planes The planes of the frustum, facing inwards, such as the frustum of a camera.
+ * @return The number of visible spheres.
+ */
+uint tekCullSpheres(TekCullList* list, vec4 planes[FRUSTUM_NUM_PLANES]) {
+    uint num_visible;
+    if (!tekCullSpheresSIMD(list, planes, &num_visible))
+        num_visible = tekCullSpheresScalar(list, planes);
+    return num_visible;
+}
+
+/**
+ * @brief Free the memory used by a cull list.
+ * @param list The list to delete.
+ */
+void tekDeleteCullList(TekCullList* list) {
+    free(list->data); // start of the block that every array is in
+    memset(list, 0, sizeof(TekCullList));
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "../tekgl.h"
+#include "../core/exception.h"
+
+#include <cglm/vec3.h>
+#include <cglm/vec4.h>
+
+#define FRUSTUM_NUM_PLANES 6
+
+/// A list of bounding spheres to test against the camera each frame. Stored as separate arrays of x, y, z and radius so that 8 spheres can be loaded at once.
+typedef struct TekCullList {
+    float* centers_x;
+    float* centers_y;
+    float* centers_z;
+    float* radii; // infinite for spheres that should never be culled
+    flag* visible; // written by tekCullSpheres()
+    void** data; // whatever each sphere belongs to, the list never looks at it
+    uint length;
+    uint capacity;
+} TekCullList;
+
+exception tekCreateCullList(uint capacity, TekCullList* list);
+void tekClearCullList(TekCullList* list);
+exception tekAddCullSphere(TekCullList* list, vec3 center, float radius, void* data);
+uint tekCullSpheresScalar(TekCullList* list, vec4 planes[FRUSTUM_NUM_PLANES]);
+flag tekCullSpheresSIMD(TekCullList* list, vec4 planes[FRUSTUM_NUM_PLANES], uint* num_visible);
+uint tekCullSpheres(TekCullList* list, vec4 planes[FRUSTUM_NUM_PLANES]);
+void tekDeleteCullList(TekCullList* list);
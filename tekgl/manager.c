@@ -356,6 +356,22 @@ flag tekRunning() {
     return glfwWindowShouldClose(tek_window) ? 0 : 1;
 }
 
+/**
+ * Return whether the window is minimised, in which case nothing drawn will be visible.
+ * @return 1 if the window is minimised, 0 otherwise.
+ */
+flag tekMinimised() {
+    return glfwGetWindowAttrib(tek_window, GLFW_ICONIFIED) ? 1 : 0;
+}
+
+/**
+ * Sleep until an event arrives or the timeout runs out, then process any events. Used instead of tekUpdate() when there is nothing to draw.
+ * @param timeout The longest time to wait in seconds.
+ */
+void tekWaitEvents(const double timeout) {
+    glfwWaitEventsTimeout(timeout);
+}
+
 /**
  * Swap buffers and poll events. Should be called every frame / every loop of the main loop.
  * @throws NOTHING not sure why it's not a void function. 
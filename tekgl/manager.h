@@ -27,7 +27,9 @@ typedef void(*TekMouseScrollCallback)(double x_offset, double y_offset);
 
 exception tekInit(const char* window_name, int window_width, int window_height);
 flag tekRunning();
+flag tekMinimised();
 exception tekUpdate();
+void tekWaitEvents(double timeout);
 void tekDelete();
 
 void tekGetWindowSize(int* window_width, int* window_height);
@@ -10,6 +10,9 @@
 #include <cglm/vec4.h>
 
 #include "texture.h"
+#include "mesh.h"
+#include "camera.h"
+#include "assets.h"
 
 #define UINTEGER_DATA 0
 #define UFLOAT_DATA   1
@@ -31,6 +34,8 @@
 #define PROJECTION_MATRIX_WILDCARD "$tek_projection_matrix"
 #define CAMERA_POSITION_WILDCARD   "$tek_camera_position"
 
+static uint num_materials_created = 0; // only ever goes up, so every material gets its own id
+
 /**
  * Create a uniform for vector data that is made of multiple yml key value pairs.
  * @param hashtable The yml data containing the vector.
@@ -253,27 +258,22 @@ void tekDeleteUniform(TekMaterialUniform* uniform) {
 }
 
 /**
- * Create a material from a file, a collection of shaders and uniforms to texture a mesh.
- * @param filename The filename of the YAML file containing the material data.
+ * Create a material from the contents of a material file, which are left for the caller to delete.
+ * @param material_yml The yml data read from the material file.
  * @param material A pointer to a TekMaterial struct which will be overwritten with the material data.
- * @throws FILE_EXCEPTION if file could not be read.
+ * @throws YML_EXCEPTION if the material file is missing something.
  * @throws MEMORY_EXCEPTION if malloc() fails.
  */
-exception tekCreateMaterial(const char* filename, TekMaterial* material) {
-    // load up the material yml file
-    YmlFile material_yml = {};
-    ymlCreate(&material_yml);
-    tekChainThrow(ymlReadFile(filename, &material_yml));
-
+static exception tekCreateMaterialYml(YmlFile* material_yml, TekMaterial* material) {
     // read some stuff that has to exist
     YmlData* vs_data = 0;
     YmlData* fs_data = 0;
     YmlData* gs_data = 0;
-    tekChainThrow(ymlGet(&material_yml, &vs_data, "shaders", "vertex_shader"));
-    tekChainThrow(ymlGet(&material_yml, &fs_data, "shaders", "fragment_shader"));
+    tekChainThrow(ymlGet(material_yml, &vs_data, "shaders", "vertex_shader"));
+    tekChainThrow(ymlGet(material_yml, &fs_data, "shaders", "fragment_shader"));
 
     // geometry shader is optional, check if we have one, don't throw error otherwise.
-    exception check_for_geometry = ymlGet(&material_yml, &gs_data, "shaders", "geometry_shader");
+    exception check_for_geometry = ymlGet(material_yml, &gs_data, "shaders", "geometry_shader");
     flag has_geometry = 0;
     if (check_for_geometry == SUCCESS)
         has_geometry = 1;
@@ -287,7 +287,6 @@ exception tekCreateMaterial(const char* filename, TekMaterial* material) {
     tek_exception = ymlDataToString(vs_data, &vertex_shader);
     if (tek_exception) {
         free(vertex_shader);
-        ymlDelete(&material_yml);
         tekChainThrow(tek_exception);
     }
 
@@ -295,7 +294,6 @@ exception tekCreateMaterial(const char* filename, TekMaterial* material) {
     if (tek_exception) {
         free(vertex_shader);
         free(fragment_shader);
-        ymlDelete(&material_yml);
         tekChainThrow(tek_exception);
     }
 
@@ -309,7 +307,6 @@ exception tekCreateMaterial(const char* filename, TekMaterial* material) {
             free(vertex_shader);
             free(fragment_shader);
             free(geometry_shader);
-            ymlDelete(&material_yml);
         });
         tek_exception = tekCreateShaderProgramVGF(vertex_shader, geometry_shader, fragment_shader, &shader_program_id);
         free(geometry_shader);
@@ -321,7 +318,6 @@ exception tekCreateMaterial(const char* filename, TekMaterial* material) {
     free(vertex_shader);
     free(fragment_shader);
     if (tek_exception) {
-        ymlDelete(&material_yml);
         tekDeleteShaderProgram(shader_program_id);
         tekChainThrow(tek_exception);
     }
@@ -329,14 +325,27 @@ exception tekCreateMaterial(const char* filename, TekMaterial* material) {
     // set the shader program id
     material->shader_program_id = shader_program_id;
 
+    // if the model matrix comes in per instance, entities with this material can all be drawn in one go
+    material->instanced = tekGetShaderAttributeLocation(shader_program_id, INSTANCE_MODEL_ATTRIBUTE) == MESH_INSTANCE_LOCATION;
+
+    // shaders can share the camera through a uniform block rather than having it set for every material
+    material->camera_block = tekBindShaderUniformBlock(shader_program_id, CAMERA_UNIFORM_BLOCK, CAMERA_UNIFORM_BINDING);
+
+    // translucency is optional, most materials are solid
+    YmlData* translucent_data = 0;
+    long translucent = 0;
+    if (ymlGet(material_yml, &translucent_data, "translucent") == SUCCESS)
+        ymlDataToInteger(translucent_data, &translucent);
+    material->translucent = translucent != 0;
+    material->id = ++num_materials_created;
+
     // according to Comment Buggerer v1.1, i am 39.932% finished writing ts (352/586 functions still remain)
     // this is why u should always write comments as you go, not all at the end
     // alas i still ignore that
     char** keys = 0;
     uint num_keys;
-    tek_exception = ymlGetKeys(&material_yml, &keys, &num_keys, "uniforms");
+    tek_exception = ymlGetKeys(material_yml, &keys, &num_keys, "uniforms");
     if (tek_exception) {
-        ymlDelete(&material_yml);
         tekDeleteShaderProgram(shader_program_id);
         tekChainThrow(tek_exception);
     }
@@ -345,7 +354,6 @@ exception tekCreateMaterial(const char* filename, TekMaterial* material) {
     material->num_uniforms = num_keys;
     material->uniforms = (TekMaterialUniform**)calloc(num_keys, sizeof(TekMaterialUniform*));
     if (!material->uniforms) {
-        ymlDelete(&material_yml);
         tekDeleteShaderProgram(shader_program_id);
         tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for uniforms.");
     }
@@ -354,7 +362,7 @@ exception tekCreateMaterial(const char* filename, TekMaterial* material) {
     for (uint i = 0; i < num_keys; i++) {
         YmlData* uniform_yml;
         // archaic exception handling!!! (blast from the past)
-        tek_exception = ymlGet(&material_yml, &uniform_yml, "uniforms", keys[i]); tekChainBreak(tek_exception);
+        tek_exception = ymlGet(material_yml, &uniform_yml, "uniforms", keys[i]); tekChainBreak(tek_exception);
         flag uniform_type;
         switch (uniform_yml->type) { // act different according to data type. (is this polymorphism?)
             case YML_DATA:
@@ -381,6 +389,10 @@ exception tekCreateMaterial(const char* filename, TekMaterial* material) {
         tek_exception = tekCreateUniform(keys[i], uniform_type, uniform_yml->value, &uniform);
         tekChainBreak(tek_exception);
 
+        // look up where the uniform is now rather than every time the material is bound.
+        // if the shader doesn't have it, the location is -1 and binding will complain about it
+        uniform->location = tekFindShaderUniformLocation(shader_program_id, uniform->name);
+
         // write uniform at that index.
         material->uniforms[i] = uniform;
     }
@@ -391,12 +403,36 @@ exception tekCreateMaterial(const char* filename, TekMaterial* material) {
             if (!material->uniforms[i]) break;
             tekDeleteUniform(material->uniforms[i]);
         }
-        ymlDelete(&material_yml);
         tekDeleteShaderProgram(shader_program_id);
         tekChainThrow(tek_exception);
     }
 
+    return SUCCESS;
+}
+
+/**
+ * Create a material from a file, a collection of shaders and uniforms to texture a mesh.
+ * @param filename The filename of the YAML file containing the material data.
+ * @param material A pointer to a TekMaterial struct which will be overwritten with the material data.
+ * @throws FILE_EXCEPTION if file could not be read.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekCreateMaterial(const char* filename, TekMaterial* material) {
+    // the file might have been read on another thread already
+    TekAsset* asset = tekFindPreloadedAsset(ASSET_MATERIAL, filename);
+    if (asset) {
+        const exception tek_exception = tekCreateMaterialYml(&asset->material, material);
+        tekReleasePreloadedAsset(asset);
+        tekChainThrow(tek_exception);
+        return SUCCESS;
+    }
+
+    // load up the material yml file
+    YmlFile material_yml = {};
+    tekChainThrow(ymlReadFile(filename, &material_yml));
+    const exception tek_exception = tekCreateMaterialYml(&material_yml, material);
     ymlDelete(&material_yml);
+    tekChainThrow(tek_exception);
     return SUCCESS;
 }
 
@@ -406,32 +442,46 @@ exception tekCreateMaterial(const char* filename, TekMaterial* material) {
  * @throws OPENGL_EXCEPTION if the material is invalid in some way.
  */
 exception tekBindMaterial(const TekMaterial* material) {
-    const uint shader_program_id = material->shader_program_id;
-    tekBindShaderProgram(shader_program_id); // load the internal shader.
+    tekBindShaderProgram(material->shader_program_id); // load the internal shader.
+    tekChainThrow(tekBindMaterialUniforms(material));
+    return SUCCESS;
+}
+
+/**
+ * Load the uniforms of a material into its shader program, without binding the program. Used when the program is already bound because the last material used it too.
+ * @param material The material to load the uniforms of, its shader program must be the one in use.
+ * @throws OPENGL_EXCEPTION if the material is invalid in some way.
+ */
+exception tekBindMaterialUniforms(const TekMaterial* material) {
     for (uint i = 0; i < material->num_uniforms; i++) { // bind all uniforms
         const TekMaterialUniform* uniform = material->uniforms[i];
+
+        // wildcards are filled in by whatever is drawing, everything else has to be in the shader
+        if (uniform->type < 0) continue;
+        if (uniform->location == -1) tekThrow(OPENGL_EXCEPTION, "Uniform name does not correspond to a shader uniform.");
+
         switch (uniform->type) { // map each type to the correct shader bind function.
             case UINTEGER_DATA:
                 long* uinteger = uniform->data;
-                tekChainThrow(tekShaderUniformInt(shader_program_id, uniform->name, (int)(*uinteger)));
+                tekShaderUniformIntLocation(uniform->location, (int)(*uinteger));
                 break;
             case UFLOAT_DATA:
                 double* ufloat = uniform->data;
-                tekChainThrow(tekShaderUniformFloat(shader_program_id, uniform->name, (float)(*ufloat)));
+                tekShaderUniformFloatLocation(uniform->location, (float)(*ufloat));
                 break;
             case TEXTURE_DATA:
                 uint* texture_id = uniform->data; // textures also need to be bound to a slot.
                 tekBindTexture(*texture_id, 1);
-                tekChainThrow(tekShaderUniformInt(shader_program_id, uniform->name, 1));//(int)(*texture_id)));
+                tekShaderUniformIntLocation(uniform->location, 1);
                 break;
             case VEC2_DATA:
-                tekChainThrow(tekShaderUniformVec2(shader_program_id, uniform->name, uniform->data));
+                tekShaderUniformVec2Location(uniform->location, uniform->data);
                 break;
             case VEC3_DATA:
-                tekChainThrow(tekShaderUniformVec3(shader_program_id, uniform->name, uniform->data));
+                tekShaderUniformVec3Location(uniform->location, uniform->data);
                 break;
             case VEC4_DATA:
-                tekChainThrow(tekShaderUniformVec4(shader_program_id, uniform->name, uniform->data));
+                tekShaderUniformVec4Location(uniform->location, uniform->data);
                 break;
             default:
                 break;
@@ -463,7 +513,7 @@ flag tekMaterialHasUniformType(TekMaterial* material, const flag uniform_type) {
  */
 #define MATERIAL_BIND_UNIFORM_FUNC(func_name, func_type, bind_func) \
 exception func_name(const TekMaterial* material, func_type uniform_data, flag uniform_type) { \
-    const TekMaterialUniform* uniform; \
+    const TekMaterialUniform* uniform = 0; \
     for (uint i = 0; i < material->num_uniforms; i++) { \
         const TekMaterialUniform* loop_uniform = material->uniforms[i]; \
         if (loop_uniform->type == uniform_type) { \
@@ -473,12 +523,14 @@ exception func_name(const TekMaterial* material, func_type uniform_data, flag un
     } \
     if (!uniform) \
         tekThrow(FAILURE, "Material does not have such a uniform."); \
-    tekChainThrow(bind_func(material->shader_program_id, uniform->name, uniform_data)); \
+    if (uniform->location == -1) \
+        tekThrow(OPENGL_EXCEPTION, "Uniform name does not correspond to a shader uniform."); \
+    bind_func(uniform->location, uniform_data); \
     return SUCCESS; \
 } \
 
-MATERIAL_BIND_UNIFORM_FUNC(tekBindMaterialVec3, vec3, tekShaderUniformVec3);
-MATERIAL_BIND_UNIFORM_FUNC(tekBindMaterialMatrix, mat4, tekShaderUniformMat4);
+MATERIAL_BIND_UNIFORM_FUNC(tekBindMaterialVec3, vec3, tekShaderUniformVec3Location);
+MATERIAL_BIND_UNIFORM_FUNC(tekBindMaterialMatrix, mat4, tekShaderUniformMat4Location);
 
 /**
  * Delete a matrerial, freeing any allocated memory.
@@ -10,20 +10,28 @@
 #define PROJECTION_MATRIX_DATA -3
 #define CAMERA_POSITION_DATA   -4
 
+#define INSTANCE_MODEL_ATTRIBUTE "i_model" // vertex shaders with this input get the model matrix per instance instead of from a uniform
+
 typedef struct TekMaterialUniform {
     char* name;
     flag type;
+    int location; // looked up when the material is created, -1 if the shader doesn't have this uniform
     void* data;
 } TekMaterialUniform;
 
 typedef struct TekMaterial {
+    uint id; // different for every material that has been created, used to group draws by material
     uint shader_program_id;
+    flag instanced; // set if the shader takes the model matrix as an instance attribute, so many entities can be drawn at once
+    flag camera_block; // set if the shader reads the camera from the uniform block, so the camera doesn't need to be set per material
+    flag translucent; // set by 'translucent: 1' in the material file, these are drawn last and furthest first
     uint num_uniforms;
     TekMaterialUniform** uniforms;
 } TekMaterial;
 
 exception tekCreateMaterial(const char* filename, TekMaterial* material);
 exception tekBindMaterial(const TekMaterial* material);
+exception tekBindMaterialUniforms(const TekMaterial* material);
 flag tekMaterialHasUniformType(TekMaterial* material, flag uniform_type);
 exception tekBindMaterialVec3(const TekMaterial* material, vec3 uniform_data, flag uniform_type);
 exception tekBindMaterialMatrix(const TekMaterial* material, mat4 uniform_data, flag uniform_type);
@@ -2,9 +2,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "mesh.h"
-#include "../core/list.h"
+#include "simplify.h"
+#include "meshbinary.h"
+#include "assets.h"
 #include "../core/file.h"
 
 #include "glad/glad.h"
@@ -12,6 +15,8 @@
 #define READ_VERTICES 0
 #define READ_INDICES  1
 #define READ_LAYOUT   2
+#define READ_POSITION 3 // the value after $POSITION_LAYOUT_INDEX
+#define READ_NOTHING  4 // anything before the first header
 
 /**
  * Create a buffer in opengl and fill it with data.
@@ -109,137 +114,229 @@ exception tekCreateMesh(const float* vertices, const long len_vertices, const ui
 
     // keep track of how many elements are in element buffer - we need this to draw later on
     mesh_ptr->num_elements = (int)len_indices;
+    mesh_ptr->num_lods = 1;
+    mesh_ptr->lod_elements[0] = (int)len_indices;
+    mesh_ptr->lod_offsets[0] = 0;
+
+    // nothing says which part of the layout is the position here, tekReadMesh() fills these in when it knows
+    glm_vec3_zero(mesh_ptr->bounds_center);
+    mesh_ptr->bounds_radius = -1.0f;
 
     return SUCCESS;
 }
 
+#define MESH_ARRAY_INITIAL_CAPACITY 256 // items in each array before it first has to grow
+#define MESH_MAX_WORD_LENGTH        64 // longest number that can be handed to strtod() when the fast path can't read it
+#define MESH_MAX_FAST_DIGITS        19 // most significant digits that fit in the 64 bit mantissa used by the fast path
+
 /**
- * 
+ * Add an item to the end of an array, doubling the size of the array whenever it fills up.
  * @param func_name The name of the function.
- * @param func_type The return type of the function.
- * @param conv_func The function to convert from a string to that type(ish)
- * @param conv_type The actual type of the conv_func, will be casted to func_type after conversion.
+ * @param array_type The type of item in the array.
  */
-#define STRING_CONV_FUNC(func_name, func_type, conv_func, conv_type) \
-exception func_name(const char* string, func_type* output) { \
-    char* check = 0; \
-    const conv_type converted = conv_func(string, &check); \
-    int error = errno; \
-    if ((string + strlen(string) != check) || (error == ERANGE)) \
-        tekThrow(FAILURE, "Failed to convert string data while processing mesh."); \
-    *output = (func_type)converted; \
+#define MESH_ARRAY_FUNC(func_name, array_type) \
+static exception func_name(array_type** array, uint* length, uint* capacity, const array_type item) { \
+    if (*length == *capacity) { \
+        const uint new_capacity = *capacity ? *capacity * 2 : MESH_ARRAY_INITIAL_CAPACITY; \
+        array_type* new_array = (array_type*)realloc(*array, new_capacity * sizeof(array_type)); \
+        if (!new_array) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for mesh data."); \
+        *array = new_array; \
+        *capacity = new_capacity; \
+    } \
+    (*array)[(*length)++] = item; \
     return SUCCESS; \
 } \
 
-STRING_CONV_FUNC(stringToFloat, float, strtod, double);
-STRING_CONV_FUNC(stringToUint, uint, strtold, long);
-STRING_CONV_FUNC(stringToInt, int, strtold, long);
+MESH_ARRAY_FUNC(tekAppendMeshVertex, float);
+MESH_ARRAY_FUNC(tekAppendMeshIndex, uint);
+MESH_ARRAY_FUNC(tekAppendMeshLayout, int);
 
 /**
- * Build an array from a backwards list.
- * @param func_name The name of the function.
- * @param array_type The type of array to build.
- * @param conv_func The function used to convert a string into the type of the array.
+ * Read a number without strtod(), for the plain decimal numbers that make up almost all of a mesh file. Only gives an answer when it is exactly what strtod() would give, which is when the digits fit in a double and the power of ten is small enough to be exact too.
+ * @param word The start of the number.
+ * @param end The end of the number, the character after the last one.
+ * @param number The outputted number.
+ * @return 1 if the number was read, 0 if it needs strtod() instead.
  */
-#define ARRAY_BUILD_FUNC(func_name, array_type, conv_func) \
-exception func_name(const List* list, array_type* array) { \
-    uint index = list->length - 1; \
-    const ListItem* item = list->data; \
-    while (item) { \
-        const char* string = item->data; \
-        array_type data; \
-        tekChainThrow(conv_func(string, &data)); \
-        array[index--] = (array_type)data; \
-        item = item->next; \
-    } \
-    return SUCCESS; \
-} \
+static flag tekParseFastNumber(const char* word, const char* end, double* number) {
+    // every power of ten that can be stored exactly in a double
+    static const double powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* c = word;
+    flag negative = 0;
+    if (c < end && (*c == '-' || *c == '+')) negative = *c++ == '-';
+
+    // collect every digit into one integer, and keep track of where the decimal point goes
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    uint num_digits = 0, num_significant = 0;
+    for (; c < end && *c >= '0' && *c <= '9'; c++, num_digits++) {
+        if (mantissa || *c != '0') num_significant++;
+        mantissa = mantissa * 10 + (*c - '0');
+    }
+    if (c < end && *c == '.') {
+        for (c++; c < end && *c >= '0' && *c <= '9'; c++, num_digits++) {
+            if (mantissa || *c != '0') num_significant++;
+            mantissa = mantissa * 10 + (*c - '0');
+            exponent--;
+        }
+    }
+    if (!num_digits || num_significant > MESH_MAX_FAST_DIGITS) return 0;
+
+    if (c < end && (*c == 'e' || *c == 'E')) {
+        c++;
+        flag negative_exponent = 0;
+        if (c < end && (*c == '-' || *c == '+')) negative_exponent = *c++ == '-';
+        if (c == end) return 0;
+        int written_exponent = 0;
+        for (; c < end && *c >= '0' && *c <= '9'; c++) {
+            if (written_exponent > 1000) return 0; // way past anything a float can hold
+            written_exponent = written_exponent * 10 + (*c - '0');
+        }
+        exponent += negative_exponent ? -written_exponent : written_exponent;
+    }
 
-ARRAY_BUILD_FUNC(tekCreateMeshVertices, float, stringToFloat);
-ARRAY_BUILD_FUNC(tekCreateMeshIndices, uint, stringToUint);
-ARRAY_BUILD_FUNC(tekCreateMeshLayout, int, stringToInt);
+    // anything left over is something like inf, nan or hex, which strtod() can deal with
+    if (c != end) return 0;
+    if (mantissa > (1ull << 53) || exponent < -22 || exponent > 22) return 0;
+
+    // the mantissa and power of ten are both exact, so one multiply or divide rounds exactly like strtod() does
+    double value = (double)mantissa;
+    value = exponent < 0 ? value / powers_of_ten[-exponent] : value * powers_of_ten[exponent];
+    *number = negative ? -value : value;
+    return 1;
+}
 
 /**
- * Convert the lists produced by tekReadMeshLists into arrays. Very useful because the lists are produced in reverse order and need to be flipped. And the lists are linked lists which cannot be used as arrays.
- * FAQ: Where is the length? Its stored in the lists already...
- * Does this allocate the lists for me? No, because then its easier to free everything if this fails.
- * @param vertices The list of vertices.
- * @param indices The list of indices.
- * @param layout The layout list.
- * @param vertex_array The outputted vertex array.
- * @param index_array The outputted index array.
- * @param layout_array The outputted layout array. 
- * @throws FAILURE if there is an item in the list that is badly formatted. (still strings at this point)
+ * Read a number from a word in a mesh file, using the fast path where possible.
+ * @param word The start of the number.
+ * @param end The end of the number, the character after the last one.
+ * @param number The outputted number.
+ * @throws FAILURE if the word is not a number.
  */
-static exception tekCreateMeshArrays(const List* vertices, const List* indices, const List* layout, float* vertex_array, uint* index_array, int* layout_array) {
-    // using template functions for converting backwards list to arrays.
-    tekChainThrow(tekCreateMeshVertices(vertices, vertex_array));
-    tekChainThrow(tekCreateMeshIndices(indices, index_array));
-    tekChainThrow(tekCreateMeshLayout(layout, layout_array));
+static exception tekParseMeshNumber(const char* word, const char* end, double* number) {
+    if (tekParseFastNumber(word, end, number)) return SUCCESS;
+
+    // the file isn't null terminated, so give strtod() its own copy of the word to read
+    const size_t len_word = end - word;
+    if (len_word >= MESH_MAX_WORD_LENGTH)
+        tekThrow(FAILURE, "Failed to convert string data while processing mesh.");
+    char string[MESH_MAX_WORD_LENGTH];
+    memcpy(string, word, len_word);
+    string[len_word] = 0;
+
+    char* check = 0;
+    errno = 0;
+    *number = strtod(string, &check);
+    if ((check != string + len_word) || (errno == ERANGE))
+        tekThrow(FAILURE, "Failed to convert string data while processing mesh.");
     return SUCCESS;
 }
 
 /**
- * Read a mesh file into lists. The file should be loaded into a buffer and the lists should already be created and ready to use. Should only really be used in \ref tekReadMeshArrays.
- * IMPORTANT: for linked list speed, the items are inserted at the start not the end. So the items come out back to front. Haha. So please dont use this function anywhere else.
- * @param buffer The loaded file.
- * @param vertices The list of vertices.
- * @param indices The list of indices.
- * @param layout The layout list.
- * @param position_layout_index The outputted position layout index.
- * @throws LIST_EXCEPTION if could not append to one of the lists.
+ * Read a whole number from a word in a mesh file, such as an index.
+ * @param word The start of the number.
+ * @param end The end of the number, the character after the last one.
+ * @param number The outputted number.
+ * @throws FAILURE if the word is not a number.
  */
-static exception tekReadMeshLists(char* buffer, List* vertices, List* indices, List* layout, uint* position_layout_index) {
-    char* prev_c = buffer;
-    uint line = 1;
-    flag in_word = 0;
-    flag in_wildcard = 0;
+static exception tekParseMeshUint(const char* word, const char* end, uint* number) {
+    // indices are nearly always just a few digits
+    unsigned long long value = 0;
+    const char* c = word;
+    for (; c < end && c - word < 10 && *c >= '0' && *c <= '9'; c++)
+        value = value * 10 + (*c - '0');
+    if (c == end && c != word && value <= 0xFFFFFFFF) {
+        *number = (uint)value;
+        return SUCCESS;
+    }
+
+    // anything else goes through as a decimal, so 3.0 is still 3
+    double decimal;
+    tekChainThrow(tekParseMeshNumber(word, end, &decimal));
+    *number = (uint)(long)decimal;
+    return SUCCESS;
+}
+
+/**
+ * Check if a word in a mesh file is one of the section headers.
+ * @param word The start of the word.
+ * @param len_word The length of the word.
+ * @param header The header to compare against.
+ * @return 1 if the word is that header, 0 if not.
+ */
+static flag tekIsMeshHeader(const char* word, const size_t len_word, const char* header) {
+    return len_word == strlen(header) && !memcmp(word, header, len_word);
+}
+
+/**
+ * Read the text of a mesh file straight into arrays in a single pass. Each word is read in place and added to the array for the section it is in, so nothing is allocated per word. The arrays must start out empty, and are left allocated if this fails.
+ * @param buffer The text of the mesh file, doesn't need to be null terminated.
+ * @param end The end of the text, the character after the last one.
+ * @param vertex_array The array of vertices to fill.
+ * @param len_vertex_array The length of the vertex array.
+ * @param capacity_vertex_array The number of vertices the array has space for.
+ * @param index_array The array of indices to fill.
+ * @param len_index_array The length of the index array.
+ * @param capacity_index_array The number of indices the array has space for.
+ * @param layout_array The array of layout to fill.
+ * @param len_layout_array The length of the layout array.
+ * @param capacity_layout_array The amount of layout the array has space for.
+ * @param position_layout_index The outputted position layout index, or null if not needed.
+ * @throws MEMORY_EXCEPTION if one of the arrays could not grow.
+ * @throws FAILURE if there is a word that is badly formatted.
+ */
+static exception tekParseMeshText(const char* buffer, const char* end, float** vertex_array, uint* len_vertex_array, uint* capacity_vertex_array, uint** index_array, uint* len_index_array, uint* capacity_index_array, int** layout_array, uint* len_layout_array, uint* capacity_layout_array, uint* position_layout_index) {
     if (position_layout_index) *position_layout_index = 0;
 
-    List* write_list = 0;
-    char* c;
-    for (c = buffer; *c; c++) {
-        if ((*c == '\n') || (*c == '\r')) line++; // line counter
-        if (*c == '#') { // commented out lines should be ignored
-            while ((*c != '\n') && (*c != '\r')) c++;
-            in_word = 0;
-            line++;
+    flag section = READ_NOTHING;
+    const char* c = buffer;
+    while (c < end) {
+        if ((*c == ' ') || (*c == 0x09) || (*c == '\n') || (*c == '\r')) { // looking for word seperators
+            c++;
             continue;
         }
-        if ((*c == ' ') || (*c == 0x09) || (*c == '\n') || (*c == '\r')) { // looking for word seperators
-            if (in_word) {
-                // split the string here, so any of the string functions see this as the end of the string
-                *c = 0;
-                // if the word up until now matches one of these, then thats important.
-                // for these three, it means update the list we are writing to what is specified.
-                if (!strcmp(prev_c, "VERTICES")) write_list = vertices;
-                else if (!strcmp(prev_c, "INDICES")) write_list = indices;
-                else if (!strcmp(prev_c, "LAYOUT")) write_list = layout;
-                // this one means that we need to write to the position layout index
-                else if (!strcmp(prev_c, "$POSITION_LAYOUT_INDEX")) {
-                    write_list = 0;
-                    in_wildcard = 1;
-                }
-                // if not a special word, then we need to add the last thing to the write list or position layout variable.
-                else if (!in_wildcard) {
-                    if (write_list) tekChainThrow(listInsertItem(write_list, 0, prev_c)); // inserting at 0, faster for linked list
-                } else {
-                    if (position_layout_index) tekChainThrow(stringToUint(prev_c, position_layout_index));
-                }
-            }
-            in_word = 0;
+        if (*c == '#') { // commented out lines should be ignored
+            while ((c < end) && (*c != '\n') && (*c != '\r')) c++;
             continue;
         }
-        if (!in_word) prev_c = c;
-        in_word = 1;
-    }
-    if (in_word) {
-        // if the last item is a section header, then there would be no items below it, which is pointless and should be an error anyway
-        // so dont bother with checking at this stage.
-        if (!in_wildcard) {
-            if (write_list) tekChainThrow(listInsertItem(write_list, 0, prev_c)); // inserting at 0, faster for linked list
-        } else {
-            tekChainThrow(stringToUint(prev_c, position_layout_index));
+
+        // find the end of the word
+        const char* word = c;
+        while ((c < end) && (*c != ' ') && (*c != 0x09) && (*c != '\n') && (*c != '\r') && (*c != '#')) c++;
+        const size_t len_word = c - word;
+
+        // if the word matches one of these, then it changes which array we are writing to
+        if (tekIsMeshHeader(word, len_word, "VERTICES")) section = READ_VERTICES;
+        else if (tekIsMeshHeader(word, len_word, "INDICES")) section = READ_INDICES;
+        else if (tekIsMeshHeader(word, len_word, "LAYOUT")) section = READ_LAYOUT;
+        else if (tekIsMeshHeader(word, len_word, "$POSITION_LAYOUT_INDEX")) section = READ_POSITION;
+        else {
+            // otherwise it is a number to go in that array
+            double vertex;
+            uint index;
+            switch (section) {
+            case READ_VERTICES:
+                tekChainThrow(tekParseMeshNumber(word, c, &vertex));
+                tekChainThrow(tekAppendMeshVertex(vertex_array, len_vertex_array, capacity_vertex_array, (float)vertex));
+                break;
+            case READ_INDICES:
+                tekChainThrow(tekParseMeshUint(word, c, &index));
+                tekChainThrow(tekAppendMeshIndex(index_array, len_index_array, capacity_index_array, index));
+                break;
+            case READ_LAYOUT:
+                tekChainThrow(tekParseMeshUint(word, c, &index));
+                tekChainThrow(tekAppendMeshLayout(layout_array, len_layout_array, capacity_layout_array, (int)index));
+                break;
+            case READ_POSITION:
+                tekChainThrow(tekParseMeshUint(word, c, &index));
+                if (position_layout_index) *position_layout_index = index;
+                break;
+            default:
+                break; // nothing to write to yet
+            }
         }
     }
     return SUCCESS;
@@ -257,112 +354,311 @@ static exception tekReadMeshLists(char* buffer, List* vertices, List* indices, L
  * @param position_layout_index The outputted position layout index which can be specified in the mesh file.
  * @throws MEMORY_EXCEPTION if malloc() fails.
  * @throws FILE_EXCEPTION if file couldn't be read.
+ * @throws FAILURE if the file is badly formatted.
  */
 exception tekReadMeshArrays(const char* filename, float** vertex_array, uint* len_vertex_array, uint** index_array, uint* len_index_array, int** layout_array, uint* len_layout_array, uint* position_layout_index) {
-    // read mesh file ito buffer.
-    uint file_size;
-    tekChainThrow(getFileSize(filename, &file_size));
-    char* buffer = (char*)malloc(file_size);
-    tekChainThrowThen(readFile(filename, file_size, buffer), {
-        free(buffer);
-    });
-
-    // create an empty list for each data type.
-    List vertices = {};
-    listCreate(&vertices);
-    List indices = {};
-    listCreate(&indices);
-    List layout = {};
-    listCreate(&layout);
-
-    // attempt to read mesh into those lists.
-    tekChainThrowThen(tekReadMeshLists(buffer, &vertices, &indices, &layout, position_layout_index), {
-        listDelete(&vertices);
-        listDelete(&indices);
-        listDelete(&layout);
-    });
-
-    // allocate buffers to copy over the data from each list into
-    *vertex_array = (float*)malloc(vertices.length * sizeof(float));
-    if (!*vertex_array) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for vertices.");
-    *len_vertex_array = vertices.length;
-
-    *index_array = (uint*)malloc(indices.length * sizeof(uint));
-    if (!*index_array) tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for indices.", {
-        free(*vertex_array);
-    });
-    *len_index_array = indices.length;
-
-    *layout_array = (int*)malloc(layout.length * sizeof(int));
-    if (!*layout_array) tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for layout.", {
-        free(*vertex_array);
-        free(*index_array);
-    });
-    *len_layout_array = layout.length;
-
-    // attempt to create mesh using these arrays.
-    const exception tek_exception = tekCreateMeshArrays(&vertices, &indices, &layout, *vertex_array, *index_array, *layout_array);
+    // map the file rather than copying it into a buffer, the parser reads it once from start to end.
+    const void* mapping;
+    size_t mapping_size;
+    tekChainThrow(mapFile(filename, &mapping, &mapping_size));
+
+    // arrays start empty and grow as the file is read.
+    *vertex_array = 0;
+    *index_array = 0;
+    *layout_array = 0;
+    *len_vertex_array = 0;
+    *len_index_array = 0;
+    *len_layout_array = 0;
+    uint capacity_vertex_array = 0, capacity_index_array = 0, capacity_layout_array = 0;
+
+    const char* buffer = (const char*)mapping;
+    const exception tek_exception = tekParseMeshText(
+        buffer, buffer + mapping_size,
+        vertex_array, len_vertex_array, &capacity_vertex_array,
+        index_array, len_index_array, &capacity_index_array,
+        layout_array, len_layout_array, &capacity_layout_array,
+        position_layout_index
+    );
+    unmapFile(mapping, mapping_size);
 
     if (tek_exception) {
         free(*vertex_array);
         free(*index_array);
         free(*layout_array);
     }
+    tekChainThrow(tek_exception);
+    return SUCCESS;
+}
+
+/**
+ * Find a sphere that contains every vertex of a mesh, so that it can be skipped when it is off screen.
+ * @note The sphere is centred on the middle of the vertices' bounding box, which is close enough to the smallest sphere for culling. If there is no 3d position in the layout, the bounds are left unknown.
+ * @param prepared_mesh The prepared mesh, with its data already read, to write the bounds into.
+ */
+static void tekCalculateMeshBounds(TekPreparedMesh* prepared_mesh) {
+    const TekMeshData* data = &prepared_mesh->data;
+    glm_vec3_zero(prepared_mesh->bounds_center);
+    prepared_mesh->bounds_radius = -1.0f;
+    if (data->position_layout_index >= data->len_layout || data->layout[data->position_layout_index] != 3) return;
+
+    // find where the position is in each vertex, same as when creating a body
+    uint vertex_size = 0, position_offset = 0;
+    for (uint i = 0; i < data->len_layout; i++) {
+        if (i == data->position_layout_index) position_offset = vertex_size;
+        vertex_size += data->layout[i];
+    }
+    const uint num_vertices = data->len_vertices / vertex_size;
+    if (!num_vertices) return;
+
+    const float* vertices = data->vertices;
+    vec3 min, max;
+    glm_vec3_copy((float*)(vertices + position_offset), min);
+    glm_vec3_copy(min, max);
+    for (uint i = 1; i < num_vertices; i++) {
+        const float* position = vertices + i * vertex_size + position_offset;
+        for (uint j = 0; j < 3; j++) {
+            if (position[j] < min[j]) min[j] = position[j];
+            if (position[j] > max[j]) max[j] = position[j];
+        }
+    }
+    glm_vec3_center(min, max, prepared_mesh->bounds_center);
 
-    // delete lists as they are no longer needed
-    listDelete(&vertices);
-    listDelete(&indices);
-    listDelete(&layout);
+    // then grow the sphere until it reaches the furthest vertex
+    float radius_squared = 0.0f;
+    for (uint i = 0; i < num_vertices; i++) {
+        const float distance_squared = glm_vec3_distance2((float*)(vertices + i * vertex_size + position_offset), prepared_mesh->bounds_center);
+        if (distance_squared > radius_squared) radius_squared = distance_squared;
+    }
+    prepared_mesh->bounds_radius = sqrtf(radius_squared);
+}
 
-    // free file buffer
-    free(buffer);
+/**
+ * Make simplified versions of a mesh for drawing it further away, and put every level one after the other so they can go in the element buffer after the full mesh. They all share the same vertices.
+ * @note Each level is simplified from the one before it, aiming for half the triangles. Stops once the mesh gets too small, or the simplifier can't take away enough to be worth it.
+ * @param prepared_mesh The prepared mesh, with its data already read, to write the levels into.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+static exception tekPrepareMeshLods(TekPreparedMesh* prepared_mesh) {
+    const TekMeshData* data = &prepared_mesh->data;
+    prepared_mesh->num_lods = 1;
+    prepared_mesh->lod_elements[0] = (int)data->len_indices;
+    prepared_mesh->lod_offsets[0] = 0;
+    if (data->position_layout_index >= data->len_layout || data->layout[data->position_layout_index] != 3) return SUCCESS;
+
+    uint* levels[MESH_MAX_LODS] = {};
+    uint len_levels[MESH_MAX_LODS] = {};
+    len_levels[0] = data->len_indices;
+    uint num_lods = 1, len_total = data->len_indices;
+    while (num_lods < MESH_MAX_LODS && len_levels[num_lods - 1] / 3 >= MESH_LOD_MIN_TRIANGLES) {
+        const uint* previous = num_lods == 1 ? data->indices : levels[num_lods - 1];
+        const uint len_previous = len_levels[num_lods - 1];
+        tekChainThrowThen(tekSimplifyMesh(
+            data->vertices, data->len_vertices, data->layout, data->len_layout, data->position_layout_index,
+            previous, len_previous, len_previous / 6 * 3, levels + num_lods, len_levels + num_lods
+        ), {
+            for (uint i = 1; i < num_lods; i++) free(levels[i]);
+        });
+
+        // not much of a saving, so the next level would be no better either
+        if (len_levels[num_lods] > len_previous / 4 * 3) {
+            free(levels[num_lods]);
+            break;
+        }
+        len_total += len_levels[num_lods];
+        num_lods++;
+    }
+    if (num_lods == 1) return SUCCESS;
 
-    tekChainThrow(tek_exception);
+    // every level goes in the one element buffer, the full mesh first so that it draws the same as before
+    uint* all_indices = (uint*)malloc(len_total * sizeof(uint));
+    if (!all_indices) {
+        for (uint i = 1; i < num_lods; i++) free(levels[i]);
+        tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for mesh levels of detail.");
+    }
+    uint offset = 0;
+    for (uint i = 0; i < num_lods; i++) {
+        memcpy(all_indices + offset, i ? levels[i] : data->indices, len_levels[i] * sizeof(uint));
+        prepared_mesh->lod_elements[i] = (int)len_levels[i];
+        prepared_mesh->lod_offsets[i] = offset;
+        offset += len_levels[i];
+        if (i) free(levels[i]);
+    }
+    prepared_mesh->num_lods = num_lods;
+    prepared_mesh->lod_indices = all_indices;
+    prepared_mesh->len_lod_indices = len_total;
     return SUCCESS;
 }
 
 /**
- * Read a file and write data into a mesh.
+ * Read a mesh file and do everything to it that doesn't need opengl, which is working out the bounds and the levels of detail. Safe to call from any thread.
+ * @note The prepared mesh must be deleted with tekDeletePreparedMesh() once it has been created with tekCreatePreparedMesh().
  * @param filename The file that contains the mesh data.
- * @param mesh_ptr A pointer to an existing but empty TekMesh struct that will have data written to it.
+ * @param prepared_mesh The prepared mesh to fill in.
  * @throws FILE_EXCEPTION if could not read the file.
  * @throws MEMORY_EXCEPTION if malloc() fails.
  */
-exception tekReadMesh(const char* filename, TekMesh* mesh_ptr) {
-    // make a bunch of variables to read into.
-    float* vertex_array = 0;
-    uint* index_array = 0;
-    int* layout_array = 0;
-    uint len_vertex_array = 0, len_index_array = 0, len_layout_array = 0;
+exception tekPrepareMesh(const char* filename, TekPreparedMesh* prepared_mesh) {
+    memset(prepared_mesh, 0, sizeof(TekPreparedMesh));
+
+    // read the file, or the binary cache of it if there is an up to date one.
+    tekChainThrow(tekReadMeshData(filename, &prepared_mesh->data));
+    tekCalculateMeshBounds(prepared_mesh);
+    tekChainThrowThen(tekPrepareMeshLods(prepared_mesh), tekDeletePreparedMesh(prepared_mesh));
+    return SUCCESS;
+}
+
+/**
+ * Upload a prepared mesh to opengl, the only part of loading a mesh that has to happen on the render thread.
+ * @param prepared_mesh The mesh from tekPrepareMesh().
+ * @param mesh_ptr A pointer to an existing but empty TekMesh struct that will have data written to it.
+ * @throws OPENGL_EXCEPTION if the mesh could not be created.
+ */
+exception tekCreatePreparedMesh(const TekPreparedMesh* prepared_mesh, TekMesh* mesh_ptr) {
+    // the arrays can point straight into the mapped file so nothing is copied on the way to the gpu.
+    // if there are simplified versions, the element buffer gets all of them at once instead of uploading the full mesh twice
+    const TekMeshData* data = &prepared_mesh->data;
+    const uint* indices = prepared_mesh->lod_indices ? prepared_mesh->lod_indices : data->indices;
+    const uint len_indices = prepared_mesh->lod_indices ? prepared_mesh->len_lod_indices : data->len_indices;
+    tekChainThrow(tekCreateMesh(data->vertices, (long)data->len_vertices, indices, (long)len_indices, data->layout, data->len_layout, mesh_ptr));
+
+    mesh_ptr->num_elements = prepared_mesh->lod_elements[0];
+    glm_vec3_copy((float*)prepared_mesh->bounds_center, mesh_ptr->bounds_center);
+    mesh_ptr->bounds_radius = prepared_mesh->bounds_radius;
+    mesh_ptr->num_lods = prepared_mesh->num_lods;
+    memcpy(mesh_ptr->lod_elements, prepared_mesh->lod_elements, sizeof(mesh_ptr->lod_elements));
+    memcpy(mesh_ptr->lod_offsets, prepared_mesh->lod_offsets, sizeof(mesh_ptr->lod_offsets));
+    return SUCCESS;
+}
 
-    // read the file into variables.
-    tekChainThrow(tekReadMeshArrays(filename, &vertex_array, &len_vertex_array, &index_array, &len_index_array, &layout_array, &len_layout_array, NULL));
+/**
+ * Free everything in a prepared mesh, and unmap the file if it was read from a binary cache.
+ * @param prepared_mesh The prepared mesh to delete.
+ */
+void tekDeletePreparedMesh(TekPreparedMesh* prepared_mesh) {
+    tekDeleteMeshData(&prepared_mesh->data);
+    free(prepared_mesh->lod_indices);
+    memset(prepared_mesh, 0, sizeof(TekPreparedMesh));
+}
 
-    // attempt to create the mesh
-    const exception tek_exception = tekCreateMesh(vertex_array, (long)len_vertex_array, index_array, (long)len_index_array, layout_array, len_layout_array, mesh_ptr);
+/**
+ * Read a file and write data into a mesh. If the mesh was preloaded, only the upload is left to do.
+ * @param filename The file that contains the mesh data.
+ * @param mesh_ptr A pointer to an existing but empty TekMesh struct that will have data written to it.
+ * @throws FILE_EXCEPTION if could not read the file.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekReadMesh(const char* filename, TekMesh* mesh_ptr) {
+    // another thread might have already done the reading and simplifying
+    TekAsset* asset = tekFindPreloadedAsset(ASSET_MESH, filename);
+    if (asset) {
+        const exception tek_exception = tekCreatePreparedMesh(&asset->mesh, mesh_ptr);
+        tekReleasePreloadedAsset(asset);
+        tekChainThrow(tek_exception);
+        return SUCCESS;
+    }
 
-    // free everything because either path that happens next doesn't want them in memory
-    free(vertex_array);
-    free(index_array);
-    free(layout_array);
+    TekPreparedMesh prepared_mesh;
+    tekChainThrow(tekPrepareMesh(filename, &prepared_mesh));
+    const exception tek_exception = tekCreatePreparedMesh(&prepared_mesh, mesh_ptr);
 
-    // check for an exception
+    // free or unmap everything because either path that happens next doesn't want them in memory
+    tekDeletePreparedMesh(&prepared_mesh);
     tekChainThrow(tek_exception);
     return SUCCESS;
 }
 
+/**
+ * Bind a mesh's vertex array, so that it can be drawn with tekDrawBoundMesh() or tekDrawBoundMeshInstanced().
+ * @param mesh_ptr A pointer to the mesh to bind.
+ */
+void tekBindMesh(const TekMesh* mesh_ptr) {
+    // binding vertex array buffer - OpenGL should know which vertex buffer and element buffer we want from this
+    glBindVertexArray(mesh_ptr->vertex_array_id);
+}
+
 /**
  * Draw a mesh to the screen. Requires setting a shader/material first in order to render anything.
  * @param mesh_ptr A pointer to the mesh to be drawn.
  */
 void tekDrawMesh(const TekMesh* mesh_ptr) {
-    // binding vertex array buffer - OpenGL should know which vertex buffer and element buffer we want from this
-    glBindVertexArray(mesh_ptr->vertex_array_id);
+    tekBindMesh(mesh_ptr);
+    tekDrawBoundMesh(mesh_ptr);
+}
 
+/**
+ * Draw a mesh that has already been bound with tekBindMesh(), so that drawing the same mesh many times doesn't rebind it each time.
+ * @param mesh_ptr A pointer to the mesh to be drawn, must be the one that is bound.
+ */
+void tekDrawBoundMesh(const TekMesh* mesh_ptr) {
     // draw elements as triangles, using the number of elements we tracked before
     glDrawElements(GL_TRIANGLES, mesh_ptr->num_elements, GL_UNSIGNED_INT, 0);
 }
 
+/**
+ * Draw one of the levels of detail of a mesh that has already been bound with tekBindMesh().
+ * @param mesh_ptr A pointer to the mesh to be drawn, must be the one that is bound.
+ * @param lod The level of detail to draw, 0 is the full mesh. Levels the mesh doesn't have draw the least detailed one it does.
+ */
+void tekDrawBoundMeshLod(const TekMesh* mesh_ptr, uint lod) {
+    if (lod >= mesh_ptr->num_lods) lod = mesh_ptr->num_lods - 1;
+    glDrawElements(GL_TRIANGLES, mesh_ptr->lod_elements[lod], GL_UNSIGNED_INT, (void*)((long)mesh_ptr->lod_offsets[lod] * sizeof(uint)));
+}
+
+/**
+ * Draw many copies of a mesh that has already been bound with tekBindMesh(), each with its own model matrix. Requires a material whose vertex shader reads the model matrix from the attribute at MESH_INSTANCE_LOCATION.
+ * @param mesh_ptr A pointer to the mesh to be drawn, must be the one that is bound.
+ * @param lod The level of detail to draw, 0 is the full mesh.
+ * @param instance_buffer_id The buffer containing the model matrices, one mat4 per instance.
+ * @param first_instance The index of the first matrix in the buffer to use.
+ * @param num_instances The number of copies to draw.
+ */
+void tekDrawBoundMeshInstanced(const TekMesh* mesh_ptr, uint lod, const uint instance_buffer_id, const uint first_instance, const uint num_instances) {
+    // a mat4 attribute is really 4 vec4 attributes next to each other.
+    // the vertex array remembers these, but the offset changes depending on where this mesh's instances are in the buffer, so set them every time
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_id);
+    const long offset = (long)first_instance * 16 * sizeof(float);
+    for (uint i = 0; i < 4; i++) {
+        const uint location = MESH_INSTANCE_LOCATION + i;
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(offset + i * 4 * sizeof(float)));
+        glVertexAttribDivisor(location, 1); // move onto the next matrix once per instance rather than once per vertex
+        glEnableVertexAttribArray(location);
+    }
+
+    if (lod >= mesh_ptr->num_lods) lod = mesh_ptr->num_lods - 1;
+    glDrawElementsInstanced(GL_TRIANGLES, mesh_ptr->lod_elements[lod], GL_UNSIGNED_INT, (void*)((long)mesh_ptr->lod_offsets[lod] * sizeof(uint)), (int)num_instances);
+}
+
+/**
+ * Find the size on screen that a mesh has to be smaller than to use a level of detail.
+ * @param lod The level of detail, must be at least 1.
+ * @return The fraction of the screen height.
+ */
+static float tekMeshLodScreenSize(const uint lod) {
+    return MESH_LOD_SCREEN_SIZE / (float)(1u << (lod - 1));
+}
+
+/**
+ * @brief Pick which level of detail to draw a mesh with, based on how big it is on screen.
+ * @note The size has to go a bit past where two levels meet before it switches, see MESH_LOD_HYSTERESIS, so something sitting right on the edge keeps the level it already had.
+ * @param mesh_ptr The mesh being drawn.
+ * @param screen_size How tall the mesh's bounding sphere is on screen, as a fraction of the screen height.
+ * @param current_lod The level that was drawn last time.
+ * @return The level to draw this time.
+ */
+uint tekSelectMeshLod(const TekMesh* mesh_ptr, const float screen_size, const uint current_lod) {
+    uint lod = current_lod < mesh_ptr->num_lods ? current_lod : mesh_ptr->num_lods - 1;
+
+    // less detail while clearly smaller than where the next level starts
+    while (lod + 1 < mesh_ptr->num_lods && screen_size < tekMeshLodScreenSize(lod + 1) * (1.0f - MESH_LOD_HYSTERESIS))
+        lod++;
+
+    // more detail while clearly bigger than where this level starts
+    while (lod > 0 && screen_size > tekMeshLodScreenSize(lod) * (1.0f + MESH_LOD_HYSTERESIS))
+        lod--;
+
+    return lod;
+}
+
 /**
  * Recreate an existing mesh and provide a new set of vertices, indices and layout.
  * Can set any paramater to be NULL if you want to retain the old data for that.
@@ -380,12 +676,15 @@ exception tekRecreateMesh(TekMesh* mesh_ptr, const float* vertices, const long l
     if (vertices) { // update vertices if not null
         glBindBuffer(GL_ARRAY_BUFFER, mesh_ptr->vertex_buffer_id);
         glBufferData(GL_ARRAY_BUFFER, (long)(len_vertices * sizeof(float)), vertices, GL_STATIC_DRAW);
+        mesh_ptr->bounds_radius = -1.0f; // the old bounds might not fit anymore
     }
 
     if (indices) { // update indices if not null
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_ptr->element_buffer_id);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, (long)(len_indices * sizeof(uint)), indices, GL_STATIC_DRAW);
         mesh_ptr->num_elements = (int)len_indices;
+        mesh_ptr->num_lods = 1; // any simplified versions were of the old indices
+        mesh_ptr->lod_elements[0] = (int)len_indices;
     }
 
     if (layout) { // update layout if not null
@@ -2,17 +2,52 @@
 
 #include "../tekgl.h"
 #include "../core/exception.h"
+#include "meshbinary.h"
+
+#include <cglm/vec3.h>
+
+#define MESH_INSTANCE_LOCATION 4 // first attribute location of the per instance model matrix, which takes up 4 locations
+
+#define MESH_MAX_LODS           4 // the full mesh and up to 3 simplified versions, each with about half the triangles of the last
+#define MESH_LOD_MIN_TRIANGLES  32 // meshes with fewer triangles than this aren't worth simplifying any further
+#define MESH_LOD_SCREEN_SIZE    0.25f // fraction of the screen height the mesh has to be smaller than before the first simplified version is used, halving for each one after
+#define MESH_LOD_HYSTERESIS     0.15f // how far past a switching point the size has to go before switching, so meshes don't flicker between two levels
 
 typedef struct TekMesh {
     uint vertex_array_id;
     uint vertex_buffer_id;
     uint element_buffer_id;
     int num_elements;
+    vec3 bounds_center; // centre of a sphere containing every vertex, in the mesh's own space
+    float bounds_radius; // negative if the bounds aren't known, which means the mesh is never culled
+    uint num_lods; // levels of detail, always at least 1 for the full mesh
+    int lod_elements[MESH_MAX_LODS]; // number of indices in each level
+    uint lod_offsets[MESH_MAX_LODS]; // where each level starts in the element buffer, in indices
 } TekMesh;
 
+/// Everything about a mesh that can be worked out without opengl, so it can be done on another thread and only uploaded on the render thread.
+typedef struct TekPreparedMesh {
+    TekMeshData data;
+    vec3 bounds_center;
+    float bounds_radius;
+    uint num_lods;
+    int lod_elements[MESH_MAX_LODS];
+    uint lod_offsets[MESH_MAX_LODS];
+    uint* lod_indices; // every level one after the other, or null if there are no simplified versions
+    uint len_lod_indices;
+} TekPreparedMesh;
+
 exception tekReadMeshArrays(const char* filename, float** vertex_array, uint* len_vertex_array, uint** index_array, uint* len_index_array, int** layout_array, uint* len_layout_array, uint* position_layout_index);
+exception tekPrepareMesh(const char* filename, TekPreparedMesh* prepared_mesh);
+exception tekCreatePreparedMesh(const TekPreparedMesh* prepared_mesh, TekMesh* mesh_ptr);
+void tekDeletePreparedMesh(TekPreparedMesh* prepared_mesh);
 exception tekReadMesh(const char* filename, TekMesh* mesh_ptr);
 exception tekCreateMesh(const float* vertices, long len_vertices, const uint* indices, long len_indices, const int* layout, uint len_layout, TekMesh* mesh_ptr);
 exception tekRecreateMesh(TekMesh* mesh_ptr, const float* vertices, long len_vertices, const uint* indices, long len_indices, const int* layout, uint len_layout);
+void tekBindMesh(const TekMesh* mesh_ptr);
 void tekDrawMesh(const TekMesh* mesh_ptr);
+void tekDrawBoundMesh(const TekMesh* mesh_ptr);
+void tekDrawBoundMeshLod(const TekMesh* mesh_ptr, uint lod);
+void tekDrawBoundMeshInstanced(const TekMesh* mesh_ptr, uint lod, uint instance_buffer_id, uint first_instance, uint num_instances);
+uint tekSelectMeshLod(const TekMesh* mesh_ptr, float screen_size, uint current_lod);
 void tekDeleteMesh(const TekMesh* mesh_ptr);
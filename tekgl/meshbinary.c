@@ -0,0 +1,258 @@
+#include "meshbinary.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mesh.h"
+#include "../core/file.h"
+
+/**
+ * Round an offset in the file up to the alignment of the arrays.
+ * @param offset The offset to round.
+ * @return The rounded offset.
+ */
+static unsigned long long tekMeshBinaryAlign(const unsigned long long offset) {
+    return (offset + MESH_BINARY_ALIGNMENT - 1) / MESH_BINARY_ALIGNMENT * MESH_BINARY_ALIGNMENT;
+}
+
+/**
+ * Check that a mapped .tmshb file is valid, and point the mesh data at the arrays inside it if it is.
+ * @param mapping The start of the file in memory.
+ * @param mapping_size The size of the file in bytes.
+ * @param mesh_data The mesh data to fill in.
+ * @return Null if the mesh data was filled in, otherwise a message saying what is wrong with the file.
+ */
+static const char* tekPointAtMeshBinary(const void* mapping, const size_t mapping_size, TekMeshData* mesh_data) {
+    // check everything the header says actually fits in the file before pointing at it
+    const TekMeshBinaryHeader* header = mapping;
+    if (mapping_size < sizeof(TekMeshBinaryHeader))
+        return "Mesh binary is too small to have a header.";
+    if (header->magic != MESH_BINARY_MAGIC)
+        return "File is not a mesh binary.";
+    if (header->version != MESH_BINARY_VERSION)
+        return "Mesh binary is from a different version.";
+    const unsigned long long layout_end = sizeof(TekMeshBinaryHeader) + (unsigned long long)header->len_layout * sizeof(int);
+    const unsigned long long vertices_end = header->vertices_offset + (unsigned long long)header->len_vertices * sizeof(float);
+    const unsigned long long indices_end = header->indices_offset + (unsigned long long)header->len_indices * sizeof(uint);
+    if (header->vertices_offset % MESH_BINARY_ALIGNMENT || header->indices_offset % MESH_BINARY_ALIGNMENT
+        || header->vertices_offset < layout_end || header->indices_offset < vertices_end || indices_end > mapping_size)
+        return "Mesh binary is corrupted or cut short.";
+
+    mesh_data->layout = (const int*)((const char*)mapping + sizeof(TekMeshBinaryHeader));
+    mesh_data->len_layout = header->len_layout;
+    mesh_data->position_layout_index = header->position_layout_index;
+    mesh_data->vertices = (const float*)((const char*)mapping + header->vertices_offset);
+    mesh_data->len_vertices = header->len_vertices;
+    mesh_data->indices = (const uint*)((const char*)mapping + header->indices_offset);
+    mesh_data->len_indices = header->len_indices;
+    mesh_data->mapping = mapping;
+    mesh_data->mapping_size = mapping_size;
+    return 0;
+}
+
+/**
+ * @brief Map a .tmshb file into memory, and point the mesh data at the arrays inside it. Nothing is copied or parsed, pages of the file are only read from disk as they are used.
+ * @note The mesh data must be deleted with tekDeleteMeshData() to unmap the file.
+ * @param filename The .tmshb file to map.
+ * @param mesh_data The mesh data to fill in.
+ * @throws FILE_EXCEPTION if the file could not be mapped.
+ * @throws FAILURE if the file is not a .tmshb file of this version, or is cut short.
+ */
+exception tekMapMeshBinary(const char* filename, TekMeshData* mesh_data) {
+    const void* mapping;
+    size_t mapping_size;
+    tekChainThrow(mapFile(filename, &mapping, &mapping_size));
+    const char* problem = tekPointAtMeshBinary(mapping, mapping_size, mesh_data);
+    if (problem) tekThrowThen(FAILURE, problem, unmapFile(mapping, mapping_size));
+    return SUCCESS;
+}
+
+/**
+ * Map a .tmshb cache if it is there and valid, without throwing if it isn't, as then the mesh is just parsed instead.
+ * @param filename The .tmshb file to map.
+ * @param mesh_data The mesh data to fill in.
+ * @return 1 if the cache was mapped, 0 if not.
+ */
+static flag tekTryMapMeshBinary(const char* filename, TekMeshData* mesh_data) {
+    const void* mapping;
+    size_t mapping_size;
+    if (!tryMapFile(filename, &mapping, &mapping_size)) return 0;
+    if (tekPointAtMeshBinary(mapping, mapping_size, mesh_data)) {
+        unmapFile(mapping, mapping_size);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Write some bytes to a file, followed by zeroes up to the next alignment.
+ * @param file The file to write to.
+ * @param data The bytes to write.
+ * @param size The number of bytes to write.
+ * @param padding The number of zeroes to write after.
+ * @return 1 if everything was written, 0 if not.
+ */
+static flag tekWritePadded(FILE* file, const void* data, const size_t size, const size_t padding) {
+    static const char zeroes[MESH_BINARY_ALIGNMENT] = {};
+    if (size && fwrite(data, 1, size, file) != size) return 0;
+    if (padding && fwrite(zeroes, 1, padding, file) != padding) return 0;
+    return 1;
+}
+
+/**
+ * Write mesh data into a .tmshb file, and say what went wrong if it couldn't be.
+ * @note Written to a temporary file first and then renamed, so a half written file is never left where it would be found. Safe to call from more than one thread at once.
+ * @param filename The .tmshb file to write.
+ * @param mesh_data The mesh data to write.
+ * @return Null if the file was written, otherwise a message saying why not.
+ */
+static const char* tekWriteMeshBinaryProblem(const char* filename, const TekMeshData* mesh_data) {
+    TekMeshBinaryHeader header = {};
+    header.magic = MESH_BINARY_MAGIC;
+    header.version = MESH_BINARY_VERSION;
+    header.len_layout = mesh_data->len_layout;
+    header.position_layout_index = mesh_data->position_layout_index;
+    header.len_vertices = mesh_data->len_vertices;
+    header.len_indices = mesh_data->len_indices;
+    const unsigned long long layout_end = sizeof(TekMeshBinaryHeader) + (unsigned long long)header.len_layout * sizeof(int);
+    const unsigned long long vertices_offset = tekMeshBinaryAlign(layout_end);
+    const unsigned long long vertices_end = vertices_offset + (unsigned long long)header.len_vertices * sizeof(float);
+    const unsigned long long indices_offset = tekMeshBinaryAlign(vertices_end);
+    if (indices_offset + (unsigned long long)header.len_indices * sizeof(uint) > 0xFFFFFFFF)
+        return "Mesh is too big for a mesh binary.";
+    header.vertices_offset = (uint)vertices_offset;
+    header.indices_offset = (uint)indices_offset;
+
+    // the physics thread and the asset workers can both write the cache of the same mesh at once, so each write gets its own temporary file
+    static atomic_uint num_writes = 0;
+    const size_t len_temporary_filename = strlen(filename) + 32;
+    char* temporary_filename = (char*)malloc(len_temporary_filename);
+    if (!temporary_filename) return "Failed to allocate memory for temporary filename.";
+    snprintf(temporary_filename, len_temporary_filename, "%s.%d.%u.tmp", filename, (int)getpid(), atomic_fetch_add(&num_writes, 1));
+    FILE* file = fopen(temporary_filename, "wb");
+    if (!file) {
+        free(temporary_filename);
+        return "Could not open file.";
+    }
+
+    const flag written =
+        tekWritePadded(file, &header, sizeof(TekMeshBinaryHeader), 0)
+        && tekWritePadded(file, mesh_data->layout, header.len_layout * sizeof(int), vertices_offset - layout_end)
+        && tekWritePadded(file, mesh_data->vertices, header.len_vertices * sizeof(float), indices_offset - vertices_end)
+        && tekWritePadded(file, mesh_data->indices, header.len_indices * sizeof(uint), 0);
+    if (fclose(file) || !written || rename(temporary_filename, filename)) {
+        remove(temporary_filename);
+        free(temporary_filename);
+        return "Failed to write mesh binary.";
+    }
+    free(temporary_filename);
+    return 0;
+}
+
+/**
+ * @brief Write mesh data into a .tmshb file, so it can be mapped with tekMapMeshBinary() next time instead of parsing the text again.
+ * @note Written to a temporary file first and then renamed, so a half written file is never left where it would be found. Safe to call from more than one thread at once.
+ * @param filename The .tmshb file to write.
+ * @param mesh_data The mesh data to write.
+ * @throws FILE_EXCEPTION if the file could not be written.
+ */
+exception tekWriteMeshBinary(const char* filename, const TekMeshData* mesh_data) {
+    const char* problem = tekWriteMeshBinaryProblem(filename, mesh_data);
+    if (problem) tekThrow(FILE_EXCEPTION, problem);
+    return SUCCESS;
+}
+
+/**
+ * Read a .tmsh text file into mesh data, with the arrays allocated.
+ * @param filename The .tmsh file to read.
+ * @param mesh_data The mesh data to fill in.
+ * @throws FILE_EXCEPTION if the file couldn't be read.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+static exception tekParseMeshData(const char* filename, TekMeshData* mesh_data) {
+    float* vertices;
+    uint* indices;
+    int* layout;
+    mesh_data->position_layout_index = 0;
+    tekChainThrow(tekReadMeshArrays(filename, &vertices, &mesh_data->len_vertices, &indices, &mesh_data->len_indices, &layout, &mesh_data->len_layout, &mesh_data->position_layout_index));
+    mesh_data->vertices = vertices;
+    mesh_data->indices = indices;
+    mesh_data->layout = layout;
+    mesh_data->mapping = 0;
+    mesh_data->mapping_size = 0;
+    return SUCCESS;
+}
+
+/**
+ * @brief Load the arrays of a mesh file. A .tmsh file is loaded from its .tmshb cache next to it if that is up to date, otherwise it is parsed and the cache is written for next time. A .tmshb file is mapped directly.
+ * @note The mesh data must be deleted with tekDeleteMeshData(). Not being able to write the cache, e.g. in a read only folder, isn't an error, the mesh is just parsed every time.
+ * @param filename The .tmsh or .tmshb file to load.
+ * @param mesh_data The mesh data to fill in.
+ * @throws FILE_EXCEPTION if the file couldn't be read.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FAILURE if a .tmshb file was asked for directly and is not valid.
+ */
+exception tekReadMeshData(const char* filename, TekMeshData* mesh_data) {
+    memset(mesh_data, 0, sizeof(TekMeshData));
+
+    const size_t len_filename = strlen(filename);
+    if (len_filename > 6 && !strcmp(filename + len_filename - 6, ".tmshb")) {
+        tekChainThrow(tekMapMeshBinary(filename, mesh_data));
+        return SUCCESS;
+    }
+
+    char* binary_filename;
+    tekChainThrow(addPathToFile(filename, MESH_BINARY_EXTENSION, &binary_filename));
+
+    // a cache that is missing, out of date or broken just gets written again, none of which should leave an exception behind
+    if (!fileIsNewer(filename, binary_filename) && tekTryMapMeshBinary(binary_filename, mesh_data)) {
+        free(binary_filename);
+        return SUCCESS;
+    }
+
+    tekChainThrowThen(tekParseMeshData(filename, mesh_data), free(binary_filename));
+    tekWriteMeshBinaryProblem(binary_filename, mesh_data);
+    free(binary_filename);
+    return SUCCESS;
+}
+
+/**
+ * @brief Convert a .tmsh text file into a .tmshb file, whether or not it is up to date.
+ * @param filename The .tmsh file to convert.
+ * @param binary_filename The .tmshb file to write, or null to write it next to the .tmsh file.
+ * @throws FILE_EXCEPTION if either file couldn't be read or written.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekConvertMesh(const char* filename, const char* binary_filename) {
+    TekMeshData mesh_data = {};
+    tekChainThrow(tekParseMeshData(filename, &mesh_data));
+
+    char* default_filename = 0;
+    if (!binary_filename) {
+        tekChainThrowThen(addPathToFile(filename, MESH_BINARY_EXTENSION, &default_filename), tekDeleteMeshData(&mesh_data));
+        binary_filename = default_filename;
+    }
+    const exception tek_exception = tekWriteMeshBinary(binary_filename, &mesh_data);
+    free(default_filename);
+    tekDeleteMeshData(&mesh_data);
+    tekChainThrow(tek_exception);
+    return SUCCESS;
+}
+
+/**
+ * @brief Free the arrays of some mesh data, or unmap the file they are in.
+ * @param mesh_data The mesh data to delete.
+ */
+void tekDeleteMeshData(TekMeshData* mesh_data) {
+    if (mesh_data->mapping) {
+        unmapFile(mesh_data->mapping, mesh_data->mapping_size);
+    } else {
+        free((void*)mesh_data->vertices);
+        free((void*)mesh_data->indices);
+        free((void*)mesh_data->layout);
+    }
+    memset(mesh_data, 0, sizeof(TekMeshData));
+}
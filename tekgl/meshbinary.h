@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../tekgl.h"
+#include "../core/exception.h"
+
+#include <stddef.h>
+
+#define MESH_BINARY_EXTENSION "b" // added onto the end of a .tmsh filename, so mesh.tmsh is cached as mesh.tmshb
+#define MESH_BINARY_MAGIC     0x42534D54 // "TMSB" when read as bytes
+#define MESH_BINARY_VERSION   1
+#define MESH_BINARY_ALIGNMENT 16 // each array starts on this many bytes, so they can be used straight from the file
+
+/// The start of a .tmshb file. The layout comes straight after it, and the vertices and indices at the offsets given.
+typedef struct TekMeshBinaryHeader {
+    uint magic;
+    uint version;
+    uint len_layout;
+    uint position_layout_index;
+    uint len_vertices;
+    uint len_indices;
+    uint vertices_offset; // in bytes from the start of the file
+    uint indices_offset;
+} TekMeshBinaryHeader;
+
+/// The arrays that make up a mesh. Either read from a .tmsh file into memory, or pointing straight into a mapped .tmshb file.
+typedef struct TekMeshData {
+    const float* vertices;
+    uint len_vertices;
+    const uint* indices;
+    uint len_indices;
+    const int* layout;
+    uint len_layout;
+    uint position_layout_index;
+    const void* mapping; // the mapped .tmshb file, or null if the arrays were allocated
+    size_t mapping_size;
+} TekMeshData;
+
+exception tekReadMeshData(const char* filename, TekMeshData* mesh_data);
+exception tekMapMeshBinary(const char* filename, TekMeshData* mesh_data);
+exception tekWriteMeshBinary(const char* filename, const TekMeshData* mesh_data);
+exception tekConvertMesh(const char* filename, const char* binary_filename);
+void tekDeleteMeshData(TekMeshData* mesh_data);
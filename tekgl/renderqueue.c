@@ -0,0 +1,157 @@
+#include "renderqueue.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RENDER_KEY_MASK(bits) ((1ULL << (bits)) - 1)
+
+/**
+ * @brief Create an empty render queue.
+ * @param capacity The number of packets that fit before the queue has to grow (use 1 if unsure).
+ * @param queue A pointer to the queue to be created.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekCreateRenderQueue(uint capacity, TekRenderQueue* queue) {
+    if (!capacity) capacity = 1; // same as vectors, 0 would never grow
+    memset(queue, 0, sizeof(TekRenderQueue));
+    queue->packets = (TekRenderPacket*)malloc(capacity * sizeof(TekRenderPacket));
+    if (!queue->packets) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for render queue.");
+    queue->scratch = (TekRenderPacket*)malloc(capacity * sizeof(TekRenderPacket));
+    if (!queue->scratch) tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for render queue.", free(queue->packets));
+    queue->capacity = capacity;
+    return SUCCESS;
+}
+
+/**
+ * @brief Build the sort key for a packet. Opaque packets come first, grouped by shader, then material, then mesh, and drawn front to back within that. Translucent packets come last and are drawn back to front, only grouped when they are at the same depth.
+ * @param translucent Whether the packet needs to be blended over what is behind it.
+ * @param shader_id The shader program used to draw the packet.
+ * @param material_id The material used to draw the packet.
+ * @param mesh_id The mesh being drawn.
+ * @param depth The distance from the camera, from 0 at the camera to 1 at the far plane. Anything outside that range is clamped.
+ * @returns The key to push the packet with.
+ */
+unsigned long long tekRenderKey(const flag translucent, const uint shader_id, const uint material_id, const uint mesh_id, float depth) {
+    if (!(depth > 0.0f)) depth = 0.0f; // also catches nan
+    if (depth > 1.0f) depth = 1.0f;
+    unsigned long long depth_bits = (unsigned long long)(depth * (float)RENDER_KEY_MASK(RENDER_KEY_DEPTH_BITS));
+    const unsigned long long shader_bits = shader_id & RENDER_KEY_MASK(RENDER_KEY_SHADER_BITS);
+    const unsigned long long material_bits = material_id & RENDER_KEY_MASK(RENDER_KEY_MATERIAL_BITS);
+    const unsigned long long mesh_bits = mesh_id & RENDER_KEY_MASK(RENDER_KEY_MESH_BITS);
+
+    // state is worth more than depth for solid things, the depth test sorts out the rest
+    if (!translucent) {
+        unsigned long long key = shader_bits;
+        key = (key << RENDER_KEY_MATERIAL_BITS) | material_bits;
+        key = (key << RENDER_KEY_MESH_BITS) | mesh_bits;
+        key = (key << RENDER_KEY_DEPTH_BITS) | depth_bits;
+        return key;
+    }
+
+    // but blending only looks right if the furthest things are drawn first
+    depth_bits = RENDER_KEY_MASK(RENDER_KEY_DEPTH_BITS) - depth_bits;
+    unsigned long long key = 1;
+    key = (key << RENDER_KEY_DEPTH_BITS) | depth_bits;
+    key = (key << RENDER_KEY_SHADER_BITS) | shader_bits;
+    key = (key << RENDER_KEY_MATERIAL_BITS) | material_bits;
+    key = (key << RENDER_KEY_MESH_BITS) | mesh_bits;
+    return key;
+}
+
+/**
+ * @brief Empty the queue and reset its stats, ready for the next frame. Keeps the memory that has been allocated.
+ * @param queue The queue to clear.
+ */
+void tekClearRenderQueue(TekRenderQueue* queue) {
+    queue->length = 0;
+    memset(&queue->stats, 0, sizeof(TekRenderStats));
+}
+
+/**
+ * @brief Add a packet to the end of the queue, growing it if it is full.
+ * @param queue The queue to add to.
+ * @param key The sort key, from tekRenderKey().
+ * @param data The thing to draw, given back when the queue is read.
+ * @throws MEMORY_EXCEPTION if the queue could not grow.
+ */
+exception tekPushRenderPacket(TekRenderQueue* queue, const unsigned long long key, void* data) {
+    if (queue->length == queue->capacity) {
+        if (queue->capacity > UINT_MAX / 2 / sizeof(TekRenderPacket))
+            tekThrow(MEMORY_EXCEPTION, "Render queue is too big to grow.");
+        const uint new_capacity = queue->capacity * 2;
+
+        // the sort needs the scratch buffer to be as big as the packets, so the capacity only goes up once both have grown.
+        // if the second one fails, the first is just bigger than it needs to be
+        TekRenderPacket* packets = (TekRenderPacket*)realloc(queue->packets, new_capacity * sizeof(TekRenderPacket));
+        if (!packets) tekThrow(MEMORY_EXCEPTION, "Failed to allocate more memory to grow render queue.");
+        queue->packets = packets;
+        TekRenderPacket* scratch = (TekRenderPacket*)realloc(queue->scratch, new_capacity * sizeof(TekRenderPacket));
+        if (!scratch) tekThrow(MEMORY_EXCEPTION, "Failed to allocate more memory to grow render queue.");
+        queue->scratch = scratch;
+        queue->capacity = new_capacity;
+    }
+    TekRenderPacket* packet = queue->packets + queue->length++;
+    packet->key = key;
+    packet->data = data;
+    queue->stats.num_packets = queue->length;
+    return SUCCESS;
+}
+
+/**
+ * @brief Sort the packets by key, smallest first. Packets with the same key stay in the order they were pushed.
+ * @note Least significant digit radix sort, one byte at a time, so it takes the same time whatever order the packets arrive in. Bytes that are the same in every key are skipped, which is most of them when there are only a few shaders and materials.
+ * @param queue The queue to sort.
+ */
+void tekSortRenderQueue(TekRenderQueue* queue) {
+    const uint length = queue->length;
+    if (length < 2) return;
+
+    // count every byte in one go rather than reading the packets again for each pass
+    uint counts[8][256];
+    memset(counts, 0, sizeof(counts));
+    for (uint i = 0; i < length; i++) {
+        const unsigned long long key = queue->packets[i].key;
+        for (uint digit = 0; digit < 8; digit++)
+            counts[digit][(key >> (digit * 8)) & 0xFF]++;
+    }
+
+    TekRenderPacket* source = queue->packets;
+    TekRenderPacket* destination = queue->scratch;
+    for (uint digit = 0; digit < 8; digit++) {
+        const uint shift = digit * 8;
+        uint* digit_counts = counts[digit];
+
+        // every key has the same byte here, so the pass wouldn't move anything
+        if (digit_counts[(source[0].key >> shift) & 0xFF] == length) continue;
+
+        // turn the counts into where each byte starts
+        uint offset = 0;
+        for (uint value = 0; value < 256; value++) {
+            const uint count = digit_counts[value];
+            digit_counts[value] = offset;
+            offset += count;
+        }
+
+        for (uint i = 0; i < length; i++)
+            destination[digit_counts[(source[i].key >> shift) & 0xFF]++] = source[i];
+
+        TekRenderPacket* temp = source;
+        source = destination;
+        destination = temp;
+    }
+
+    // depending on how many passes ran, the sorted packets could be in either buffer
+    queue->packets = source;
+    queue->scratch = destination;
+}
+
+/**
+ * @brief Free the memory used by a render queue.
+ * @param queue The queue to delete.
+ */
+void tekDeleteRenderQueue(TekRenderQueue* queue) {
+    free(queue->packets);
+    free(queue->scratch);
+    memset(queue, 0, sizeof(TekRenderQueue));
+}
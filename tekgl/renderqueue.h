@@ -0,0 +1,43 @@
+#pragma once
+
+#include "../tekgl.h"
+#include "../core/exception.h"
+
+// how many bits of the sort key each part gets, adds up to 64 with the translucency bit.
+// ids that don't fit just wrap around, which only makes the grouping worse, it never draws the wrong thing.
+#define RENDER_KEY_SHADER_BITS   10
+#define RENDER_KEY_MATERIAL_BITS 14
+#define RENDER_KEY_MESH_BITS     15
+#define RENDER_KEY_DEPTH_BITS    24
+
+/// Something to draw this frame, with a key that puts it in the order that needs the fewest state changes.
+typedef struct TekRenderPacket {
+    unsigned long long key;
+    void* data; // whatever is being drawn, the queue never looks at it
+} TekRenderPacket;
+
+/// How much work the last frame took to draw.
+typedef struct TekRenderStats {
+    uint num_packets;
+    uint num_culled; // things that were never pushed because they were off screen
+    uint program_binds;
+    uint material_binds;
+    uint mesh_binds;
+    uint draw_calls;
+    uint num_triangles;
+} TekRenderStats;
+
+typedef struct TekRenderQueue {
+    TekRenderPacket* packets;
+    TekRenderPacket* scratch; // the radix sort copies back and forth between this and packets
+    uint length;
+    uint capacity;
+    TekRenderStats stats;
+} TekRenderQueue;
+
+exception tekCreateRenderQueue(uint capacity, TekRenderQueue* queue);
+unsigned long long tekRenderKey(flag translucent, uint shader_id, uint material_id, uint mesh_id, float depth);
+void tekClearRenderQueue(TekRenderQueue* queue);
+exception tekPushRenderPacket(TekRenderQueue* queue, unsigned long long key, void* data);
+void tekSortRenderQueue(TekRenderQueue* queue);
+void tekDeleteRenderQueue(TekRenderQueue* queue);
@@ -4,6 +4,9 @@
 #include <stdlib.h>
 #include <glad/glad.h>
 #include "../core/file.h"
+#include "assets.h"
+
+static uint uniform_lookups = 0; // number of times the driver has been asked for a uniform location, to check that they are being cached
 
 /**
  * Delete a shader using its id.
@@ -14,30 +17,46 @@ static void tekDeleteShader(const uint shader_id) {
 }
 
 /**
- * Compile a piece of shader code contained within a file and return an id of this shader.
- * @param shader_type The type of shader, either VERTEX_SHADER, GEOMETRY_SHADER, FRAGMENT_SHADER.
+ * Read the source code of a shader file into a new buffer. Doesn't need opengl, so can be done on another thread.
  * @param shader_filename The filename of the shader file.
- * @param shader_id A pointer to an unsigned integer that will be overwritten with the shader id.
+ * @param source A pointer to a char pointer that will be set to the null terminated source code, which needs to be freed.
  * @throws MEMORY_EXCEPTION if malloc() fails.
  * @throws FILE_EXCEPTION if the file could not be read.
  */
-static exception tekCreateShader(const GLenum shader_type, const char* shader_filename, uint* shader_id) {
+exception tekReadShaderSource(const char* shader_filename, char** source) {
     // get the size of the shader file to read
     uint file_size;
     tekChainThrow(getFileSize(shader_filename, &file_size));
 
     // read the file contents into a buffer of that size
-    char* file_buffer = (char*)malloc(file_size * sizeof(char));
-    if (!file_buffer) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for shader.")
-    tekChainThrow(readFile(shader_filename, file_size, file_buffer));
+    *source = (char*)malloc(file_size * sizeof(char));
+    if (!*source) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for shader.")
+    tekChainThrowThen(readFile(shader_filename, file_size, *source), free(*source));
+    return SUCCESS;
+}
+
+/**
+ * Compile a piece of shader code contained within a file and return an id of this shader.
+ * @param shader_type The type of shader, either VERTEX_SHADER, GEOMETRY_SHADER, FRAGMENT_SHADER.
+ * @param shader_filename The filename of the shader file.
+ * @param shader_id A pointer to an unsigned integer that will be overwritten with the shader id.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FILE_EXCEPTION if the file could not be read.
+ */
+static exception tekCreateShader(const GLenum shader_type, const char* shader_filename, uint* shader_id) {
+    // use the source if it was preloaded, otherwise read it now
+    const TekAsset* asset = tekFindPreloadedAsset(ASSET_SHADER, shader_filename);
+    char* file_buffer = 0;
+    if (!asset) tekChainThrow(tekReadShaderSource(shader_filename, &file_buffer));
+    const char* source = asset ? asset->source : file_buffer;
 
     // opengl calls to create shader
     *shader_id = glCreateShader(shader_type);
 
-    if (*shader_id == 0) tekThrow(OPENGL_EXCEPTION, "Failed to create shader.");
-    if (*shader_id == GL_INVALID_ENUM) tekThrow(OPENGL_EXCEPTION, "Invalid shader type.");
+    if (*shader_id == 0) tekThrowThen(OPENGL_EXCEPTION, "Failed to create shader.", free(file_buffer));
+    if (*shader_id == GL_INVALID_ENUM) tekThrowThen(OPENGL_EXCEPTION, "Invalid shader type.", free(file_buffer));
 
-    glShaderSource(*shader_id, 1, &file_buffer, NULL);
+    glShaderSource(*shader_id, 1, &source, NULL);
     glCompileShader(*shader_id);
     free(file_buffer);
 
@@ -180,98 +199,90 @@ exception tekCreateShaderProgramVGF(const char* vertex_shader_filename, const ch
 }
 
 /**
- * Get the location of a shader uniform by name.
- * @param shader_program_id The id of the shader program to get the uniform location from.
- * @param uniform_name The name of the uniform.
- * @param uniform_location A pointer to an integer that will be overwritten with the location.
- * @throws SHADER_EXCEPTION if the uniform name does not exist.
+ * Get the location of a vertex shader input by name.
+ * @param shader_program_id The id of the shader program to look in.
+ * @param attribute_name The name of the input.
+ * @return The location of the input, or -1 if the shader doesn't have it (or the compiler optimised it out).
  */
-exception tekGetShaderUniformLocation(const uint shader_program_id, const char* uniform_name, int* uniform_location) {
-    *uniform_location = glGetUniformLocation(shader_program_id, uniform_name); // returns location or -1 if not exist.
-    if (*uniform_location == -1) tekThrow(OPENGL_EXCEPTION, "Uniform name does not correspond to a shader uniform.");
-    return SUCCESS;
+int tekGetShaderAttributeLocation(const uint shader_program_id, const char* attribute_name) {
+    return glGetAttribLocation(shader_program_id, attribute_name);
 }
 
 /**
- * Write an integer into a shader uniform.
- * @param shader_program_id The id of the shader program to write to.
- * @param uniform_name The name of the uniform to write.
- * @param uniform_value The value of the integer to write.
- * @throws SHADER_EXCEPTION if the uniform name does not exist.
+ * Connect a uniform block in a shader program to a binding point, so that the block reads from whichever buffer is bound there.
+ * @param shader_program_id The id of the shader program.
+ * @param block_name The name of the uniform block.
+ * @param binding The binding point to connect it to.
+ * @return 1 if the shader has the block, 0 if it doesn't and nothing was done.
  */
-exception tekShaderUniformInt(const uint shader_program_id, const char* uniform_name, const int uniform_value) {
-    int uniform_location;
-    tekChainThrow(tekGetShaderUniformLocation(shader_program_id, uniform_name, &uniform_location));
-    glUniform1i(uniform_location, uniform_value); // method for writing one integer.
-    return SUCCESS;
+flag tekBindShaderUniformBlock(const uint shader_program_id, const char* block_name, const uint binding) {
+    const uint block_index = glGetUniformBlockIndex(shader_program_id, block_name);
+    if (block_index == GL_INVALID_INDEX) return 0;
+    glUniformBlockBinding(shader_program_id, block_index, binding);
+    return 1;
 }
 
 /**
- * Write a float into a shader uniform.
- * @param shader_program_id The id of the shader program.
- * @param uniform_name The name of the uniform to write into.
- * @param uniform_value The value of the float to write.
- * @throws SHADER_EXCEPTION if the uniform name does not exist.
+ * Get the location of a shader uniform by name, for when it is fine for the uniform not to be there, e.g. if the driver optimised it out.
+ * @note This asks the driver every time, same as tekGetShaderUniformLocation().
+ * @param shader_program_id The id of the shader program to get the uniform location from.
+ * @param uniform_name The name of the uniform.
+ * @return The location of the uniform, or -1 if the shader doesn't have it.
  */
-exception tekShaderUniformFloat(const uint shader_program_id, const char* uniform_name, const float uniform_value) {
-    int uniform_location;
-    tekChainThrow(tekGetShaderUniformLocation(shader_program_id, uniform_name, &uniform_location));
-    glUniform1f(uniform_location, uniform_value); // method for writing a single float into a uniform
-    return SUCCESS;
+int tekFindShaderUniformLocation(const uint shader_program_id, const char* uniform_name) {
+    uniform_lookups++;
+    return glGetUniformLocation(shader_program_id, uniform_name); // returns location or -1 if not exist.
 }
 
 /**
- * Write a 2 vector into a shader uniform.
- * @param shader_program_id The id of the shader program to update.
- * @param uniform_name The name of the uniform
- * @param uniform_value The 3 vector to write into the uniform.
+ * Get the location of a shader uniform by name.
+ * @note This asks the driver every time, which is slow, so anything that is drawn a lot should look up its locations once and use the tekShaderUniform*Location() functions.
+ * @param shader_program_id The id of the shader program to get the uniform location from.
+ * @param uniform_name The name of the uniform.
+ * @param uniform_location A pointer to an integer that will be overwritten with the location.
  * @throws SHADER_EXCEPTION if the uniform name does not exist.
  */
-exception tekShaderUniformVec2(const uint shader_program_id, const char* uniform_name, const vec2 uniform_value) {
-    int uniform_location;
-    tekChainThrow(tekGetShaderUniformLocation(shader_program_id, uniform_name, &uniform_location));
-    glUniform2fv(uniform_location, 1, uniform_value); // method for writing 2 vectors.
+exception tekGetShaderUniformLocation(const uint shader_program_id, const char* uniform_name, int* uniform_location) {
+    *uniform_location = tekFindShaderUniformLocation(shader_program_id, uniform_name);
+    if (*uniform_location == -1) tekThrow(OPENGL_EXCEPTION, "Uniform name does not correspond to a shader uniform.");
     return SUCCESS;
 }
 
 /**
- * Write a 3 vector to a shader uniform.
- * @param shader_program_id The id of the shader program to update.
- * @param uniform_name The name of the uniform to update.
- * @param uniform_value The value of the 3 vector to update with.
- * @throws SHADER_EXCEPTION if the uniform name does not exist.
+ * Get the number of times a uniform location has been looked up by name since the count was last reset.
+ * @return The number of lookups.
  */
-exception tekShaderUniformVec3(const uint shader_program_id, const char* uniform_name, const vec3 uniform_value) {
-    int uniform_location;
-    tekChainThrow(tekGetShaderUniformLocation(shader_program_id, uniform_name, &uniform_location));
-    glUniform3fv(uniform_location, 1, uniform_value); // method for 3 vector uniform
-    return SUCCESS;
+uint tekGetShaderUniformLookups() {
+    return uniform_lookups;
 }
 
 /**
- * Write a shader uniform for a 4 vector.
- * @param shader_program_id The id of the shader program to update.
- * @param uniform_name The name of the uniform to update.
- * @param uniform_value The 4 vector to write into the uniform.
- * @throws SHADER_EXCEPTION if the uniform name is not found.
+ * Set the count of uniform lookups back to 0, e.g. at the end of each frame to count the lookups per frame.
  */
-exception tekShaderUniformVec4(const uint shader_program_id, const char* uniform_name, const vec4 uniform_value) {
-    int uniform_location;
-    tekChainThrow(tekGetShaderUniformLocation(shader_program_id, uniform_name, &uniform_location));
-    glUniform4fv(uniform_location, 1, uniform_value); // method for 4 vector uniform.
-    return SUCCESS;
+void tekResetShaderUniformLookups() {
+    uniform_lookups = 0;
 }
 
 /**
- * Update a shader uniform of mat4 type.
- * @param shader_program_id The shader program to update.
- * @param uniform_name The name of the uniform to update.
- * @param uniform_value The 4x4 matrix to update with.
- * @throws SHADER_EXCEPTION if the uniform is not found
+ * Template for the functions that write to a uniform. Makes one function that writes to a uniform location that has already been looked up, and one that looks up the location by name first.
+ * @param func_name The name of the function that takes a name, the one that takes a location has "Location" on the end.
+ * @param func_type The type of value that is written.
+ * @param write_func The code that writes uniform_value into uniform_location.
  */
-exception tekShaderUniformMat4(const uint shader_program_id, const char* uniform_name, const mat4 uniform_value) {
-    int uniform_location;
-    tekChainThrow(tekGetShaderUniformLocation(shader_program_id, uniform_name, &uniform_location));
-    glUniformMatrix4fv(uniform_location, 1, GL_FALSE, uniform_value); // method for 4x4 matrix uniform.
-    return SUCCESS;
-}
+#define SHADER_UNIFORM_FUNC(func_name, func_type, write_func) \
+void func_name##Location(const int uniform_location, func_type uniform_value) { \
+    write_func; \
+} \
+exception func_name(const uint shader_program_id, const char* uniform_name, func_type uniform_value) { \
+    int uniform_location; \
+    tekChainThrow(tekGetShaderUniformLocation(shader_program_id, uniform_name, &uniform_location)); \
+    func_name##Location(uniform_location, uniform_value); \
+    return SUCCESS; \
+} \
+
+SHADER_UNIFORM_FUNC(tekShaderUniformInt, const int, glUniform1i(uniform_location, uniform_value));
+SHADER_UNIFORM_FUNC(tekShaderUniformFloat, const float, glUniform1f(uniform_location, uniform_value));
+SHADER_UNIFORM_FUNC(tekShaderUniformVec2, const vec2, glUniform2fv(uniform_location, 1, uniform_value));
+SHADER_UNIFORM_FUNC(tekShaderUniformVec3, const vec3, glUniform3fv(uniform_location, 1, uniform_value));
+SHADER_UNIFORM_FUNC(tekShaderUniformVec4, const vec4, glUniform4fv(uniform_location, 1, uniform_value));
+SHADER_UNIFORM_FUNC(tekShaderUniformMat4, const mat4, glUniformMatrix4fv(uniform_location, 1, GL_FALSE, (const float*)uniform_value));
@@ -4,13 +4,26 @@
 #include "../core/exception.h"
 #include <cglm/mat4.h>
 
+exception tekReadShaderSource(const char* shader_filename, char** source);
 exception tekCreateShaderProgramVF(const char* vertex_shader_filename, const char* fragment_shader_filename, uint* shader_program_id);
 exception tekCreateShaderProgramVGF(const char* vertex_shader_filename, const char* geometry_shader_filename, const char* fragment_shader_filename, uint* shader_program_id);
 void tekBindShaderProgram(uint shader_program_id);
 void tekDeleteShaderProgram(uint shader_program_id);
+int tekGetShaderAttributeLocation(uint shader_program_id, const char* attribute_name);
+flag tekBindShaderUniformBlock(uint shader_program_id, const char* block_name, uint binding);
+int tekFindShaderUniformLocation(uint shader_program_id, const char* uniform_name);
+exception tekGetShaderUniformLocation(uint shader_program_id, const char* uniform_name, int* uniform_location);
+uint tekGetShaderUniformLookups();
+void tekResetShaderUniformLookups();
 exception tekShaderUniformInt(uint shader_program_id, const char* uniform_name, int uniform_value);
 exception tekShaderUniformFloat(uint shader_program_id, const char* uniform_name, float uniform_value);
 exception tekShaderUniformVec2(uint shader_program_id, const char* uniform_name, const vec2 uniform_value);
 exception tekShaderUniformVec3(uint shader_program_id, const char* uniform_name, const vec3 uniform_value);
 exception tekShaderUniformVec4(uint shader_program_id, const char* uniform_name, const vec4 uniform_value);
 exception tekShaderUniformMat4(uint shader_program_id, const char* uniform_name, const mat4 uniform_value);
+void tekShaderUniformIntLocation(int uniform_location, int uniform_value);
+void tekShaderUniformFloatLocation(int uniform_location, float uniform_value);
+void tekShaderUniformVec2Location(int uniform_location, const vec2 uniform_value);
+void tekShaderUniformVec3Location(int uniform_location, const vec3 uniform_value);
+void tekShaderUniformVec4Location(int uniform_location, const vec4 uniform_value);
+void tekShaderUniformMat4Location(int uniform_location, const mat4 uniform_value);
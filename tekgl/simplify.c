@@ -0,0 +1,535 @@
+#include "simplify.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIMPLIFY_MAX_PASSES     64 // each pass collapses edges that don't touch each other, so a pass can only do so much
+#define SIMPLIFY_BOUNDARY_WEIGHT 10.0 // how strongly open edges are held in place compared to the surface
+#define SIMPLIFY_MIN_NORMAL_DOT  0.2 // cosine of the biggest angle a triangle can turn by in one collapse
+#define SIMPLIFY_EMPTY_SLOT      0xFFFFFFFF
+
+/// The sum of squared distances to a set of planes, stored as the 10 unique values of a symmetric 4x4 matrix.
+typedef struct Quadric {
+    double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+} Quadric;
+
+/// Moving every vertex at one position onto another position, and how much error that would add.
+typedef struct Collapse {
+    uint from;
+    uint to;
+    double cost;
+} Collapse;
+
+/// Everything the simplifier needs to keep track of. Vertices are grouped into classes by position, as meshes repeat vertices with different normals or uvs along seams, and the surface shouldn't tear apart there.
+typedef struct SimplifyContext {
+    const float* vertices;
+    uint vertex_size;
+    uint position_offset;
+    uint num_vertices;
+
+    uint num_classes;
+    uint* vertex_class; // class of each vertex
+    uint* class_vertex; // a vertex from each class, to get its position from
+    uint* member_start; // where each class's vertices start in members, with one extra at the end
+    uint* members; // vertices of every class one after the other
+    Quadric* quadrics; // error of moving each class, from the planes of the triangles around it
+
+    uint* indices; // the simplified triangles so far
+    uint len_indices;
+    uint* remap; // where each vertex goes at the end of a pass
+    flag* locked; // classes that can't collapse again in this pass
+
+    uint* triangle_start; // same as member_start, but for the triangles around each class
+    uint* triangles;
+    unsigned long long* edges; // pairs of classes packed into one number, smallest class in the high bits
+    flag* boundary; // set for edges that only have a triangle on one side
+    uint num_edges;
+    Collapse* collapses;
+} SimplifyContext;
+
+/**
+ * Get the position of one of the classes.
+ * @param context The simplifier context.
+ * @param class The class to get the position of.
+ * @return A pointer to the x, y and z of that class.
+ */
+static const float* tekClassPosition(const SimplifyContext* context, const uint class) {
+    return context->vertices + context->class_vertex[class] * context->vertex_size + context->position_offset;
+}
+
+/**
+ * Add the squared distance to a plane to a quadric.
+ * @param quadric The quadric to add to.
+ * @param plane The plane as (a, b, c, d), where (a, b, c) is the unit normal.
+ * @param weight How much the plane counts, usually the area of the triangle it came from.
+ */
+static void tekQuadricAddPlane(Quadric* quadric, const double plane[4], const double weight) {
+    const double a = plane[0], b = plane[1], c = plane[2], d = plane[3];
+    quadric->a2 += weight * a * a;
+    quadric->ab += weight * a * b;
+    quadric->ac += weight * a * c;
+    quadric->ad += weight * a * d;
+    quadric->b2 += weight * b * b;
+    quadric->bc += weight * b * c;
+    quadric->bd += weight * b * d;
+    quadric->c2 += weight * c * c;
+    quadric->cd += weight * c * d;
+    quadric->d2 += weight * d * d;
+}
+
+/**
+ * Add one quadric onto another.
+ * @param quadric The quadric to add to.
+ * @param other The quadric to add.
+ */
+static void tekQuadricAdd(Quadric* quadric, const Quadric* other) {
+    quadric->a2 += other->a2;
+    quadric->ab += other->ab;
+    quadric->ac += other->ac;
+    quadric->ad += other->ad;
+    quadric->b2 += other->b2;
+    quadric->bc += other->bc;
+    quadric->bd += other->bd;
+    quadric->c2 += other->c2;
+    quadric->cd += other->cd;
+    quadric->d2 += other->d2;
+}
+
+/**
+ * Find the error of a point, which is the weighted sum of its squared distance to every plane in the quadric.
+ * @param quadric The quadric to use.
+ * @param point The point to measure.
+ * @return The error at that point.
+ */
+static double tekQuadricError(const Quadric* quadric, const float* point) {
+    const double x = point[0], y = point[1], z = point[2];
+    const double error =
+        quadric->a2 * x * x + 2.0 * quadric->ab * x * y + 2.0 * quadric->ac * x * z + 2.0 * quadric->ad * x
+        + quadric->b2 * y * y + 2.0 * quadric->bc * y * z + 2.0 * quadric->bd * y
+        + quadric->c2 * z * z + 2.0 * quadric->cd * z
+        + quadric->d2;
+    return fabs(error); // can be a tiny bit negative from rounding
+}
+
+/**
+ * Find the normal of a triangle, scaled by twice its area.
+ * @param a The first corner.
+ * @param b The second corner.
+ * @param c The third corner.
+ * @param normal Where to write the normal.
+ */
+static void tekTriangleNormal(const float* a, const float* b, const float* c, double normal[3]) {
+    const double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    const double ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+    normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+    normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+}
+
+/**
+ * Compare function for sorting edges with qsort().
+ */
+static int tekCompareEdges(const void* a, const void* b) {
+    const unsigned long long edge_a = *(const unsigned long long*)a, edge_b = *(const unsigned long long*)b;
+    return (edge_a > edge_b) - (edge_a < edge_b);
+}
+
+/**
+ * Compare function for sorting collapses with qsort(), cheapest first.
+ */
+static int tekCompareCollapses(const void* a, const void* b) {
+    const double cost_a = ((const Collapse*)a)->cost, cost_b = ((const Collapse*)b)->cost;
+    return (cost_a > cost_b) - (cost_a < cost_b);
+}
+
+/**
+ * Pack the classes at either end of an edge into one number, so that the same edge always gives the same number.
+ * @param a The class at one end.
+ * @param b The class at the other end.
+ * @return The edge as a single number.
+ */
+static unsigned long long tekEdgeKey(const uint a, const uint b) {
+    return a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+}
+
+/**
+ * Free everything allocated for a simplifier context.
+ * @param context The context to free.
+ */
+static void tekDeleteSimplifyContext(SimplifyContext* context) {
+    free(context->vertex_class);
+    free(context->class_vertex);
+    free(context->member_start);
+    free(context->members);
+    free(context->quadrics);
+    free(context->indices);
+    free(context->remap);
+    free(context->locked);
+    free(context->triangle_start);
+    free(context->triangles);
+    free(context->edges);
+    free(context->boundary);
+    free(context->collapses);
+}
+
+/**
+ * Group the vertices into classes by position, using a hash table of positions.
+ * @param context The simplifier context, with vertices filled in.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+static exception tekWeldVertices(SimplifyContext* context) {
+    uint table_size = 1;
+    while (table_size < context->num_vertices * 2) table_size *= 2;
+    uint* table = (uint*)malloc(table_size * sizeof(uint));
+    if (!table) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for simplifier.");
+    memset(table, 0xFF, table_size * sizeof(uint));
+
+    for (uint i = 0; i < context->num_vertices; i++) {
+        const float* position = context->vertices + i * context->vertex_size + context->position_offset;
+
+        // adding 0 turns -0 into 0, so they hash the same
+        uint bits[3];
+        for (uint j = 0; j < 3; j++) {
+            const float value = position[j] + 0.0f;
+            memcpy(bits + j, &value, sizeof(float));
+        }
+        uint slot = ((bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u)) & (table_size - 1);
+
+        while (1) {
+            const uint other = table[slot];
+            if (other == SIMPLIFY_EMPTY_SLOT) {
+                table[slot] = i;
+                context->vertex_class[i] = context->num_classes;
+                context->class_vertex[context->num_classes++] = i;
+                break;
+            }
+            const float* other_position = context->vertices + other * context->vertex_size + context->position_offset;
+            if (position[0] == other_position[0] && position[1] == other_position[1] && position[2] == other_position[2]) {
+                context->vertex_class[i] = context->vertex_class[other];
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+    }
+    free(table);
+
+    // list the vertices in each class, counting first so they can all go in one array
+    memset(context->member_start, 0, (context->num_classes + 1) * sizeof(uint));
+    for (uint i = 0; i < context->num_vertices; i++)
+        context->member_start[context->vertex_class[i] + 1]++;
+    for (uint i = 0; i < context->num_classes; i++)
+        context->member_start[i + 1] += context->member_start[i];
+    uint* next_member = context->remap; // not in use yet, so borrow it
+    memcpy(next_member, context->member_start, context->num_classes * sizeof(uint));
+    for (uint i = 0; i < context->num_vertices; i++)
+        context->members[next_member[context->vertex_class[i]]++] = i;
+
+    return SUCCESS;
+}
+
+/**
+ * Remove triangles that have been collapsed down to a line or a point.
+ * @param context The simplifier context.
+ */
+static void tekRemoveDegenerateTriangles(SimplifyContext* context) {
+    uint length = 0;
+    for (uint i = 0; i < context->len_indices; i += 3) {
+        const uint a = context->vertex_class[context->indices[i]];
+        const uint b = context->vertex_class[context->indices[i + 1]];
+        const uint c = context->vertex_class[context->indices[i + 2]];
+        if (a == b || b == c || a == c) continue;
+        memmove(context->indices + length, context->indices + i, 3 * sizeof(uint));
+        length += 3;
+    }
+    context->len_indices = length;
+}
+
+/**
+ * List the triangles around each class, and every edge between two classes.
+ * @param context The simplifier context.
+ */
+static void tekBuildAdjacency(SimplifyContext* context) {
+    const uint num_triangles = context->len_indices / 3;
+
+    // triangles around each class, same counting trick as the class members
+    memset(context->triangle_start, 0, (context->num_classes + 1) * sizeof(uint));
+    for (uint i = 0; i < context->len_indices; i++)
+        context->triangle_start[context->vertex_class[context->indices[i]] + 1]++;
+    for (uint i = 0; i < context->num_classes; i++)
+        context->triangle_start[i + 1] += context->triangle_start[i];
+    uint* next_triangle = context->remap; // remap isn't needed until the collapses start
+    memcpy(next_triangle, context->triangle_start, context->num_classes * sizeof(uint));
+    for (uint i = 0; i < context->len_indices; i++)
+        context->triangles[next_triangle[context->vertex_class[context->indices[i]]]++] = i / 3;
+
+    // every edge of every triangle, sorted so that repeats are next to each other
+    for (uint i = 0; i < num_triangles; i++) {
+        for (uint j = 0; j < 3; j++) {
+            const uint a = context->vertex_class[context->indices[i * 3 + j]];
+            const uint b = context->vertex_class[context->indices[i * 3 + (j + 1) % 3]];
+            context->edges[i * 3 + j] = tekEdgeKey(a, b);
+        }
+    }
+    qsort(context->edges, num_triangles * 3, sizeof(unsigned long long), tekCompareEdges);
+
+    // an edge that only shows up once has nothing on the other side
+    uint num_edges = 0;
+    for (uint i = 0; i < num_triangles * 3;) {
+        uint j = i + 1;
+        while (j < num_triangles * 3 && context->edges[j] == context->edges[i]) j++;
+        context->edges[num_edges] = context->edges[i];
+        context->boundary[num_edges] = j - i == 1;
+        num_edges++;
+        i = j;
+    }
+    context->num_edges = num_edges;
+}
+
+/**
+ * Find the starting quadric for each class from the planes of the triangles around it. Open edges also get a plane at right angles to them, so the outline of the mesh doesn't shrink.
+ * @param context The simplifier context, with adjacency already built.
+ */
+static void tekBuildQuadrics(const SimplifyContext* context) {
+    memset(context->quadrics, 0, context->num_classes * sizeof(Quadric));
+    for (uint i = 0; i < context->len_indices; i += 3) {
+        uint classes[3];
+        const float* positions[3];
+        for (uint j = 0; j < 3; j++) {
+            classes[j] = context->vertex_class[context->indices[i + j]];
+            positions[j] = tekClassPosition(context, classes[j]);
+        }
+
+        double normal[3];
+        tekTriangleNormal(positions[0], positions[1], positions[2], normal);
+        const double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length == 0.0) continue;
+        for (uint j = 0; j < 3; j++) normal[j] /= length;
+        const double plane[4] = {
+            normal[0], normal[1], normal[2],
+            -(normal[0] * positions[0][0] + normal[1] * positions[0][1] + normal[2] * positions[0][2])
+        };
+        for (uint j = 0; j < 3; j++)
+            tekQuadricAddPlane(context->quadrics + classes[j], plane, length * 0.5);
+
+        for (uint j = 0; j < 3; j++) {
+            const uint k = (j + 1) % 3;
+            const unsigned long long key = tekEdgeKey(classes[j], classes[k]);
+            const unsigned long long* edge = bsearch(&key, context->edges, context->num_edges, sizeof(unsigned long long), tekCompareEdges);
+            if (!edge || !context->boundary[edge - context->edges]) continue;
+
+            // plane through the edge, standing up from the triangle
+            const double along[3] = { positions[k][0] - positions[j][0], positions[k][1] - positions[j][1], positions[k][2] - positions[j][2] };
+            double side[3] = {
+                along[1] * normal[2] - along[2] * normal[1],
+                along[2] * normal[0] - along[0] * normal[2],
+                along[0] * normal[1] - along[1] * normal[0]
+            };
+            const double side_length = sqrt(side[0] * side[0] + side[1] * side[1] + side[2] * side[2]);
+            if (side_length == 0.0) continue;
+            for (uint l = 0; l < 3; l++) side[l] /= side_length;
+            const double side_plane[4] = {
+                side[0], side[1], side[2],
+                -(side[0] * positions[j][0] + side[1] * positions[j][1] + side[2] * positions[j][2])
+            };
+            const double weight = SIMPLIFY_BOUNDARY_WEIGHT * (along[0] * along[0] + along[1] * along[1] + along[2] * along[2]);
+            tekQuadricAddPlane(context->quadrics + classes[j], side_plane, weight);
+            tekQuadricAddPlane(context->quadrics + classes[k], side_plane, weight);
+        }
+    }
+}
+
+/**
+ * Check that moving one class onto another won't fold any of the triangles around it over.
+ * @param context The simplifier context.
+ * @param from The class that would move.
+ * @param to The class it would move onto.
+ * @param num_removed Set to the number of triangles that would disappear.
+ * @return 1 if the collapse is allowed, 0 if not.
+ */
+static flag tekCollapseIsValid(const SimplifyContext* context, const uint from, const uint to, uint* num_removed) {
+    *num_removed = 0;
+    for (uint i = context->triangle_start[from]; i < context->triangle_start[from + 1]; i++) {
+        const uint triangle = context->triangles[i];
+        const float* positions[3];
+        const float* moved[3];
+        flag squashed = 0;
+        for (uint j = 0; j < 3; j++) {
+            const uint class = context->vertex_class[context->indices[triangle * 3 + j]];
+            if (class == to) squashed = 1;
+            positions[j] = tekClassPosition(context, class);
+            moved[j] = class == from ? tekClassPosition(context, to) : positions[j];
+        }
+        // triangles along the edge become lines, so they don't need checking
+        if (squashed) {
+            (*num_removed)++;
+            continue;
+        }
+
+        double before[3], after[3];
+        tekTriangleNormal(positions[0], positions[1], positions[2], before);
+        tekTriangleNormal(moved[0], moved[1], moved[2], after);
+        const double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+        const double length_before = sqrt(before[0] * before[0] + before[1] * before[1] + before[2] * before[2]);
+        const double length_after = sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+        if (dot <= SIMPLIFY_MIN_NORMAL_DOT * length_before * length_after) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Move every vertex in one class onto the vertex in another class with the closest normal, uv etc, so that seams stay sharp.
+ * @param context The simplifier context.
+ * @param from The class being collapsed.
+ * @param to The class it is collapsing onto.
+ */
+static void tekRemapClass(const SimplifyContext* context, const uint from, const uint to) {
+    for (uint i = context->member_start[from]; i < context->member_start[from + 1]; i++) {
+        const uint vertex = context->members[i];
+        const float* attributes = context->vertices + vertex * context->vertex_size;
+        uint best_vertex = context->class_vertex[to];
+        float best_distance = INFINITY;
+        for (uint j = context->member_start[to]; j < context->member_start[to + 1]; j++) {
+            const uint other = context->members[j];
+            const float* other_attributes = context->vertices + other * context->vertex_size;
+            float distance = 0.0f;
+            for (uint k = 0; k < context->vertex_size; k++) {
+                const float difference = attributes[k] - other_attributes[k];
+                distance += difference * difference;
+            }
+            if (distance < best_distance) {
+                best_distance = distance;
+                best_vertex = other;
+            }
+        }
+        context->remap[vertex] = best_vertex;
+    }
+}
+
+/**
+ * Collapse the cheapest edges that don't touch each other, until enough triangles are gone or no more edges can collapse.
+ * @param context The simplifier context, with adjacency already built.
+ * @param num_to_remove The number of triangles that still need removing.
+ * @return The number of collapses that happened.
+ */
+static uint tekSimplifyPass(SimplifyContext* context, const uint num_to_remove) {
+    // try moving each end of every edge onto the other, and keep whichever adds less error
+    for (uint i = 0; i < context->num_edges; i++) {
+        const uint a = (uint)(context->edges[i] >> 32);
+        const uint b = (uint)(context->edges[i] & 0xFFFFFFFF);
+        Quadric quadric = context->quadrics[a];
+        tekQuadricAdd(&quadric, context->quadrics + b);
+        const double a_to_b = tekQuadricError(&quadric, tekClassPosition(context, b));
+        const double b_to_a = tekQuadricError(&quadric, tekClassPosition(context, a));
+        Collapse* collapse = context->collapses + i;
+        collapse->from = a_to_b <= b_to_a ? a : b;
+        collapse->to = a_to_b <= b_to_a ? b : a;
+        collapse->cost = a_to_b <= b_to_a ? a_to_b : b_to_a;
+    }
+    qsort(context->collapses, context->num_edges, sizeof(Collapse), tekCompareCollapses);
+
+    for (uint i = 0; i < context->num_vertices; i++) context->remap[i] = i;
+    memset(context->locked, 0, context->num_classes * sizeof(flag));
+
+    uint num_collapses = 0, num_removed = 0;
+    for (uint i = 0; i < context->num_edges && num_removed < num_to_remove; i++) {
+        const uint from = context->collapses[i].from, to = context->collapses[i].to;
+        if (context->locked[from] || context->locked[to]) continue;
+        uint num_squashed;
+        if (!tekCollapseIsValid(context, from, to, &num_squashed)) continue;
+
+        // nothing around this collapse can change again until the next pass, otherwise the checks above could be out of date
+        for (uint j = context->triangle_start[from]; j < context->triangle_start[from + 1]; j++) {
+            const uint triangle = context->triangles[j];
+            for (uint k = 0; k < 3; k++)
+                context->locked[context->vertex_class[context->indices[triangle * 3 + k]]] = 1;
+        }
+        context->locked[to] = 1;
+
+        tekQuadricAdd(context->quadrics + to, context->quadrics + from);
+        tekRemapClass(context, from, to);
+        num_removed += num_squashed;
+        num_collapses++;
+    }
+
+    for (uint i = 0; i < context->len_indices; i++)
+        context->indices[i] = context->remap[context->indices[i]];
+    return num_collapses;
+}
+
+/**
+ * @brief Reduce the number of triangles in a mesh using quadric edge collapse, for drawing it further away.
+ * @note Only the indices change, the simplified triangles use the same vertices as the original, so they can share a vertex buffer. Vertices at the same position are moved together, so the mesh doesn't split along seams in the normals or uvs. Triangles with two corners in the same place are always removed. Stops early if there are no more edges that can be collapsed without folding triangles over.
+ * @param vertices The array of vertices.
+ * @param len_vertices The length of the array of vertices.
+ * @param layout The layout array.
+ * @param len_layout The length of the layout array.
+ * @param position_layout_index Which part of the layout is the position.
+ * @param indices The indices of the triangles to simplify.
+ * @param len_indices The length of the array of indices.
+ * @param target_indices The number of indices to aim for.
+ * @param simplified_indices Set to a new array of simplified indices, which needs to be freed.
+ * @param len_simplified_indices Set to the length of the simplified indices.
+ * @throws FAILURE if the position is not 3 floats, or the indices don't make triangles.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekSimplifyMesh(const float* vertices, const uint len_vertices, const int* layout, const uint len_layout, const uint position_layout_index, const uint* indices, const uint len_indices, const uint target_indices, uint** simplified_indices, uint* len_simplified_indices) {
+    if (position_layout_index >= len_layout || layout[position_layout_index] != 3) tekThrow(FAILURE, "Position data must be 3 floats.");
+    if (len_indices % 3) tekThrow(FAILURE, "Indices must make whole triangles.");
+
+    SimplifyContext context = {};
+    context.vertices = vertices;
+    for (uint i = 0; i < len_layout; i++) {
+        if (i == position_layout_index) context.position_offset = context.vertex_size;
+        context.vertex_size += layout[i];
+    }
+    context.num_vertices = len_vertices / context.vertex_size;
+    for (uint i = 0; i < len_indices; i++) {
+        if (indices[i] >= context.num_vertices) tekThrow(FAILURE, "Index is out of range of the vertices.");
+    }
+
+    const uint num_triangles = len_indices / 3;
+    context.vertex_class = (uint*)malloc(context.num_vertices * sizeof(uint));
+    context.class_vertex = (uint*)malloc(context.num_vertices * sizeof(uint));
+    context.member_start = (uint*)malloc((context.num_vertices + 1) * sizeof(uint));
+    context.members = (uint*)malloc(context.num_vertices * sizeof(uint));
+    context.quadrics = (Quadric*)malloc(context.num_vertices * sizeof(Quadric));
+    context.indices = (uint*)malloc(len_indices * sizeof(uint));
+    context.remap = (uint*)malloc(context.num_vertices * sizeof(uint));
+    context.locked = (flag*)malloc(context.num_vertices * sizeof(flag));
+    context.triangle_start = (uint*)malloc((context.num_vertices + 1) * sizeof(uint));
+    context.triangles = (uint*)malloc(len_indices * sizeof(uint));
+    context.edges = (unsigned long long*)malloc(num_triangles * 3 * sizeof(unsigned long long));
+    context.boundary = (flag*)malloc(num_triangles * 3 * sizeof(flag));
+    context.collapses = (Collapse*)malloc(num_triangles * 3 * sizeof(Collapse));
+    if (!context.vertex_class || !context.class_vertex || !context.member_start || !context.members || !context.quadrics
+        || !context.indices || !context.remap || !context.locked || !context.triangle_start || !context.triangles
+        || (num_triangles && (!context.edges || !context.boundary || !context.collapses)))
+        tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for simplifier.", tekDeleteSimplifyContext(&context));
+
+    memcpy(context.indices, indices, len_indices * sizeof(uint));
+    context.len_indices = len_indices;
+    tekChainThrowThen(tekWeldVertices(&context), tekDeleteSimplifyContext(&context));
+
+    tekRemoveDegenerateTriangles(&context);
+    tekBuildAdjacency(&context);
+    tekBuildQuadrics(&context);
+    for (uint pass = 0; pass < SIMPLIFY_MAX_PASSES && context.len_indices > target_indices; pass++) {
+        if (pass) tekBuildAdjacency(&context);
+        const uint num_to_remove = (context.len_indices - target_indices + 2) / 3;
+        if (!tekSimplifyPass(&context, num_to_remove)) break;
+        tekRemoveDegenerateTriangles(&context);
+    }
+
+    // hand over the indices rather than copying them, shrinking to fit
+    uint* output = context.indices;
+    if (context.len_indices) {
+        uint* shrunk = (uint*)realloc(output, context.len_indices * sizeof(uint));
+        if (shrunk) output = shrunk;
+    }
+    *simplified_indices = output;
+    *len_simplified_indices = context.len_indices;
+    context.indices = 0;
+    tekDeleteSimplifyContext(&context);
+    return SUCCESS;
+}
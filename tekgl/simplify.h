@@ -0,0 +1,6 @@
+#pragma once
+
+#include "../tekgl.h"
+#include "../core/exception.h"
+
+exception tekSimplifyMesh(const float* vertices, uint len_vertices, const int* layout, uint len_layout, uint position_layout_index, const uint* indices, uint len_indices, uint target_indices, uint** simplified_indices, uint* len_simplified_indices);
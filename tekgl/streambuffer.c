@@ -0,0 +1,180 @@
+#include "streambuffer.h"
+
+#include <string.h>
+#include <glad/glad.h>
+
+#define STREAM_BUFFER_ALIGNMENT    256 // every piece starts on this many bytes, enough for any vertex attribute or uniform buffer offset
+#define STREAM_BUFFER_WAIT_TIMEOUT 1000000 // nanoseconds to wait for a fence before checking again
+
+/**
+ * Round a size up to the alignment of the stream buffer.
+ * @param size The size to round.
+ * @return The rounded size.
+ */
+static uint tekStreamBufferAlign(const uint size) {
+    return (size + STREAM_BUFFER_ALIGNMENT - 1) / STREAM_BUFFER_ALIGNMENT * STREAM_BUFFER_ALIGNMENT;
+}
+
+/**
+ * Create the opengl buffer for a stream buffer, and map it if it can stay mapped.
+ * @param frame_size The size of each frame's region in bytes, already aligned.
+ * @param buffer The stream buffer to create the storage for.
+ * @throws OPENGL_EXCEPTION if the buffer could not be created or mapped.
+ */
+static exception tekCreateStreamBufferStorage(const uint frame_size, TekStreamBuffer* buffer) {
+    const long total_size = (long)frame_size * STREAM_BUFFER_FRAMES;
+    glGenBuffers(1, &buffer->buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->buffer_id);
+    buffer->frame_size = frame_size;
+    buffer->mapped = 0;
+
+    // buffer storage is only in opengl 4.4 and up, without it each piece has to be mapped and unmapped
+    buffer->persistent = GLAD_GL_VERSION_4_4 && glBufferStorage;
+    if (buffer->persistent) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, total_size, NULL, flags);
+        buffer->mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, total_size, flags);
+        if (!buffer->mapped) {
+            glDeleteBuffers(1, &buffer->buffer_id);
+            buffer->buffer_id = 0;
+            tekThrow(OPENGL_EXCEPTION, "Failed to map stream buffer.");
+        }
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, total_size, NULL, GL_STREAM_DRAW);
+        if (glGetError() == GL_OUT_OF_MEMORY) {
+            glDeleteBuffers(1, &buffer->buffer_id);
+            buffer->buffer_id = 0;
+            tekThrow(OPENGL_EXCEPTION, "Failed to allocate memory for stream buffer.");
+        }
+    }
+    return SUCCESS;
+}
+
+/**
+ * @brief Create a stream buffer, for data that is written by the cpu every frame such as model matrices.
+ * @note Needs an opengl context. Uses a persistently mapped buffer when opengl 4.4 is available, otherwise maps each piece unsynchronised, which is still safe because of the fences.
+ * @param frame_size The number of bytes that can be written each frame, the buffer grows if a frame needs more.
+ * @param buffer A pointer to the stream buffer to create.
+ * @throws OPENGL_EXCEPTION if the buffer could not be created or mapped.
+ */
+exception tekCreateStreamBuffer(const uint frame_size, TekStreamBuffer* buffer) {
+    memset(buffer, 0, sizeof(TekStreamBuffer));
+    tekChainThrow(tekCreateStreamBufferStorage(tekStreamBufferAlign(frame_size ? frame_size : 1), buffer));
+    return SUCCESS;
+}
+
+/**
+ * Wait until the gpu has finished reading a frame's region of the buffer.
+ * @param buffer The stream buffer.
+ * @param frame The region to wait for.
+ * @throws OPENGL_EXCEPTION if the wait failed.
+ */
+static exception tekStreamBufferWait(TekStreamBuffer* buffer, const uint frame) {
+    const GLsync fence = buffer->fences[frame];
+    if (!fence) return SUCCESS;
+
+    // usually done already, only count it as a stall if there was actually a wait
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        buffer->stalls++;
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, STREAM_BUFFER_WAIT_TIMEOUT);
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(fence);
+    buffer->fences[frame] = 0;
+    if (result == GL_WAIT_FAILED) tekThrow(OPENGL_EXCEPTION, "Failed to wait for stream buffer fence.");
+    return SUCCESS;
+}
+
+/**
+ * Replace the storage of a stream buffer with a bigger one, once the gpu has finished with all of the old one.
+ * @param buffer The stream buffer to grow.
+ * @param frame_size The new size of each frame's region in bytes.
+ * @throws OPENGL_EXCEPTION if the new buffer could not be created or mapped.
+ */
+static exception tekGrowStreamBuffer(TekStreamBuffer* buffer, const uint frame_size) {
+    for (uint i = 0; i < STREAM_BUFFER_FRAMES; i++)
+        tekChainThrow(tekStreamBufferWait(buffer, i));
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->buffer_id);
+    if (buffer->persistent) glUnmapBuffer(GL_ARRAY_BUFFER);
+    glDeleteBuffers(1, &buffer->buffer_id);
+    buffer->buffer_id = 0;
+    tekChainThrow(tekCreateStreamBufferStorage(tekStreamBufferAlign(frame_size), buffer));
+    return SUCCESS;
+}
+
+/**
+ * @brief Get a piece of this frame's region to write into. Call tekStreamBufferUnmap() once it has been written, before drawing with it.
+ * @note The first piece of each frame may have to wait for the gpu to finish the frame that used the region last. If the first piece of a frame doesn't fit, the buffer grows, but a later piece that doesn't fit is an error, because the earlier pieces would be lost.
+ * @param buffer The stream buffer to write into.
+ * @param size The number of bytes needed.
+ * @param pointer Set to where the bytes should be written. Only write to it, reading from it can be very slow.
+ * @param offset Set to where the bytes will be in the buffer, for use with glVertexAttribPointer etc.
+ * @throws OPENGL_EXCEPTION if the frame is full, or the buffer could not be mapped.
+ */
+exception tekStreamBufferMap(TekStreamBuffer* buffer, const uint size, void** pointer, uint* offset) {
+    if (!buffer->frame_started) {
+        tekChainThrow(tekStreamBufferWait(buffer, buffer->frame));
+        buffer->frame_started = 1;
+    }
+
+    const uint start = tekStreamBufferAlign(buffer->offset);
+    if (start + size > buffer->frame_size) {
+        if (buffer->offset) tekThrow(OPENGL_EXCEPTION, "Stream buffer frame is full.");
+        tekChainThrow(tekGrowStreamBuffer(buffer, size > buffer->frame_size * 2 ? size : buffer->frame_size * 2));
+    }
+
+    const uint buffer_offset = buffer->frame * buffer->frame_size + start;
+    if (buffer->persistent) {
+        *pointer = (char*)buffer->mapped + buffer_offset;
+    } else {
+        // the fence already makes sure the gpu isn't using this part, so tell opengl not to check
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->buffer_id);
+        *pointer = glMapBufferRange(GL_ARRAY_BUFFER, buffer_offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (!*pointer) tekThrow(OPENGL_EXCEPTION, "Failed to map stream buffer.");
+    }
+    buffer->offset = start + size;
+    *offset = buffer_offset;
+    return SUCCESS;
+}
+
+/**
+ * @brief Finish writing the piece from the last call to tekStreamBufferMap(), so it can be drawn with.
+ * @param buffer The stream buffer that was written to.
+ */
+void tekStreamBufferUnmap(const TekStreamBuffer* buffer) {
+    // coherent persistent mappings are seen by the gpu without doing anything
+    if (buffer->persistent) return;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->buffer_id);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+
+/**
+ * @brief Call once everything that reads this frame's pieces has been drawn. Fences off the region and moves on to the next one.
+ * @param buffer The stream buffer.
+ */
+void tekStreamBufferEndFrame(TekStreamBuffer* buffer) {
+    if (buffer->frame_started) {
+        buffer->fences[buffer->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        buffer->frame = (buffer->frame + 1) % STREAM_BUFFER_FRAMES;
+    }
+    buffer->offset = 0;
+    buffer->frame_started = 0;
+}
+
+/**
+ * @brief Delete a stream buffer and its opengl buffer.
+ * @param buffer The stream buffer to delete.
+ */
+void tekDeleteStreamBuffer(TekStreamBuffer* buffer) {
+    for (uint i = 0; i < STREAM_BUFFER_FRAMES; i++) {
+        if (buffer->fences[i]) glDeleteSync(buffer->fences[i]);
+    }
+    if (buffer->buffer_id) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffer->buffer_id);
+        if (buffer->persistent) glUnmapBuffer(GL_ARRAY_BUFFER);
+        glDeleteBuffers(1, &buffer->buffer_id);
+    }
+    memset(buffer, 0, sizeof(TekStreamBuffer));
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../tekgl.h"
+#include "../core/exception.h"
+
+#define STREAM_BUFFER_FRAMES 3 // the gpu can still be reading the last two frames while the next one is written
+
+/// A buffer split into one region per frame, written by the cpu while the gpu reads the regions of earlier frames. A fence stops a region being overwritten before the gpu is done with it.
+typedef struct TekStreamBuffer {
+    uint buffer_id;
+    uint frame_size; // size of each region in bytes
+    uint frame; // the region being written this frame
+    uint offset; // how much of this frame's region has been used
+    flag frame_started; // set once this frame's region is known to be free
+    flag persistent; // if set, the whole buffer stays mapped at mapped, otherwise each piece is mapped when it is needed
+    void* mapped;
+    void* fences[STREAM_BUFFER_FRAMES];
+    uint stalls; // number of times the cpu had to wait for the gpu to finish with a region
+} TekStreamBuffer;
+
+exception tekCreateStreamBuffer(uint frame_size, TekStreamBuffer* buffer);
+exception tekStreamBufferMap(TekStreamBuffer* buffer, uint size, void** pointer, uint* offset);
+void tekStreamBufferUnmap(const TekStreamBuffer* buffer);
+void tekStreamBufferEndFrame(TekStreamBuffer* buffer);
+void tekDeleteStreamBuffer(TekStreamBuffer* buffer);
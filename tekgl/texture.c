@@ -3,24 +3,32 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "../stb/stb_image.h"
 #include "glad/glad.h"
+#include "assets.h"
 
 /**
- * Create a new texture from an image file, and return the id of the newly created texture.
- * It is recommended to have square textures with side lengths that are powers of 2.
- * e.g. 128x128, 512x512.
- * @param filename The name of the file that should be loaded into a texture.
- * @param texture_id A pointer to a uint that will have the new texture id written to it.
+ * Decode an image file into pixels without creating a texture, so that it can be done on another thread.
+ * @note The image must be deleted with tekDeleteImage().
+ * @param filename The name of the image file to load.
+ * @param image The image to fill in.
  * @throws STBI_EXCEPTION if the image could not be loaded.
  */
-exception tekCreateTexture(const char* filename, uint* texture_id) {
-    // load texture using stbi
-    stbi_set_flip_vertically_on_load(1);
-    int width, height, num_channels;
-    byte* image_data = stbi_load(filename, &width, &height, &num_channels, 4);
+exception tekReadImage(const char* filename, TekImage* image) {
+    // set per thread, as the asset workers decode images alongside each other
+    stbi_set_flip_vertically_on_load_thread(1);
+    int num_channels;
+    image->pixels = stbi_load(filename, &image->width, &image->height, &num_channels, 4);
 
     // catch any potential errors
-    if (!image_data) tekThrow(STBI_EXCEPTION, "STBI failed to load image.")
+    if (!image->pixels) tekThrow(STBI_EXCEPTION, "STBI failed to load image.")
+    return SUCCESS;
+}
 
+/**
+ * Create a new texture from an image that has already been decoded.
+ * @param image The image to send to opengl.
+ * @param texture_id A pointer to a uint that will have the new texture id written to it.
+ */
+exception tekCreateImageTexture(const TekImage* image, uint* texture_id) {
     // create an empty image with OpenGL
     glGenTextures(1, texture_id);
     glBindTexture(GL_TEXTURE_2D, *texture_id);
@@ -32,10 +40,42 @@ exception tekCreateTexture(const char* filename, uint* texture_id) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     // send image data to OpenGL and create mipmap (different levels of detail)
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image->width, image->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image->pixels);
     glGenerateMipmap(GL_TEXTURE_2D);
+    return SUCCESS;
+}
 
-    stbi_image_free(image_data);
+/**
+ * Free the pixels of a decoded image.
+ * @param image The image to delete.
+ */
+void tekDeleteImage(TekImage* image) {
+    if (image->pixels) stbi_image_free(image->pixels);
+    image->pixels = 0;
+}
+
+/**
+ * Create a new texture from an image file, and return the id of the newly created texture.
+ * It is recommended to have square textures with side lengths that are powers of 2.
+ * e.g. 128x128, 512x512.
+ * @param filename The name of the file that should be loaded into a texture.
+ * @param texture_id A pointer to a uint that will have the new texture id written to it.
+ * @throws STBI_EXCEPTION if the image could not be loaded.
+ */
+exception tekCreateTexture(const char* filename, uint* texture_id) {
+    // if the image was preloaded, it has already been decoded on another thread
+    const TekAsset* asset = tekFindPreloadedAsset(ASSET_TEXTURE, filename);
+    if (asset) {
+        tekChainThrow(tekCreateImageTexture(&asset->image, texture_id));
+        return SUCCESS;
+    }
+
+    // load texture using stbi
+    TekImage image;
+    tekChainThrow(tekReadImage(filename, &image));
+    const exception tek_exception = tekCreateImageTexture(&image, texture_id);
+    tekDeleteImage(&image);
+    tekChainThrow(tek_exception);
     return SUCCESS;
 }
 
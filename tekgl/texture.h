@@ -3,6 +3,16 @@
 #include "../tekgl.h"
 #include "../core/exception.h"
 
+/// The pixels of an image file, decoded but not yet sent to opengl.
+typedef struct TekImage {
+    byte* pixels; // rgba, with the bottom row first like opengl wants
+    int width;
+    int height;
+} TekImage;
+
+exception tekReadImage(const char* filename, TekImage* image);
+exception tekCreateImageTexture(const TekImage* image, uint* texture_id);
+void tekDeleteImage(TekImage* image);
 exception tekCreateTexture(const char* filename, uint* texture_id);
 void tekBindTexture(uint texture_id, byte texture_slot);
-void tekDeleteTexture(uint texture_id);
\ No newline at end of file
+void tekDeleteTexture(uint texture_id);
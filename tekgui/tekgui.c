@@ -354,11 +354,22 @@ void tekGuiDelete() {
  */
 exception tekGuiGLLoad() {
     // default font is hard coded... lol
-    tekChainThrow(tekCreateBitmapFont("../res/urwgothic.ttf", 0, 64, &default_font));
+    tekChainThrow(tekCreateBitmapFont(DEFAULT_FONT_FILENAME, 0, GUI_FONT_SIZE, &default_font));
     tek_gui_gl_init = INITIALISED;
     return SUCCESS;
 }
 
+/**
+ * Add the fonts used by the gui to an asset manifest, so their atlases can be drawn while the window is still being created.
+ * @param manifest The manifest to add to.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekGuiAddAssets(TekAssetManifest* manifest) {
+    tekChainThrow(tekAddFontAsset(manifest, DEFAULT_FONT_FILENAME, 0, GUI_FONT_SIZE));
+    tekChainThrow(tekAddFontAsset(manifest, MONOSPACE_FONT_FILENAME, 0, GUI_FONT_SIZE));
+    return SUCCESS;
+}
+
 /**
  * Initialisation function for tek gui base / loader code.
  */
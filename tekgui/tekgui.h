@@ -3,6 +3,11 @@
 #include <cglm/vec4.h>
 #include "../core/exception.h"
 #include "../tekgl/font.h"
+#include "../tekgl/assets.h"
+
+#define DEFAULT_FONT_FILENAME   "../res/urwgothic.ttf"
+#define MONOSPACE_FONT_FILENAME "../res/inconsolata.ttf"
+#define GUI_FONT_SIZE           64 // pixel size the atlases are drawn at, text of any size is scaled from these
 
 struct TekGuiWindowDefaults {
     uint x_pos;
@@ -56,3 +61,4 @@ exception tekGuiGetListWindowDefaults(struct TekGuiListWindowDefaults* defaults)
 exception tekGuiGetTextButtonDefaults(struct TekGuiTextButtonDefaults* defaults);
 exception tekGuiGetTextInputDefaults(struct TekGuiTextInputDefaults* defaults);
 exception tekGuiGetDefaultFont(TekBitmapFont** font);
+exception tekGuiAddAssets(TekAssetManifest* manifest);
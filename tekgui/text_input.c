@@ -324,7 +324,7 @@ static void tekGuiTextInputButtonCallback(TekGuiButton* button, TekGuiButtonCall
  */
 static exception tekGuiTextInputGLLoad() {
     // commenting every function !!
-    tekChainThrow(tekCreateBitmapFont("../res/inconsolata.ttf", 0, 64, &monospace_font));
+    tekChainThrow(tekCreateBitmapFont(MONOSPACE_FONT_FILENAME, 0, GUI_FONT_SIZE, &monospace_font));
     return SUCCESS;
 }
 
@@ -0,0 +1,245 @@
+#include "batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cglm/euler.h>
+
+#include "collisions.h"
+#include "../core/trace.h"
+
+/**
+ * Create a body for every snapshot in a scenario, the same way that the engine would when the scenario is started.
+ * @param scenario The scenario containing the snapshots.
+ * @param ids The ids of every snapshot in the scenario.
+ * @param num_ids The number of ids.
+ * @param bodies A vector to add the bodies to, the index of each body will be its id.
+ * @param store The body store to write the state of each body into.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FAILURE if a mesh file is malformed.
+ */
+static exception tekBatchCreateBodies(const TekScenario* scenario, const uint* ids, const uint num_ids, Vector* bodies, TekBodyStore* store) {
+    for (uint i = 0; i < num_ids; i++) {
+        TekBodySnapshot* snapshot;
+        tekChainThrow(tekScenarioGetSnapshot(scenario, ids[i], &snapshot));
+
+        // same conversion as the engine, snapshots store rotation as euler angles
+        mat4 rotation_matrix;
+        vec4 rotation;
+        glm_euler(snapshot->rotation, rotation_matrix);
+        glm_mat4_quat(rotation_matrix, rotation);
+
+        tekChainThrow(tekBodyStoreReserve(store, ids[i] + 1));
+        TekBody body = {};
+        tekChainThrowThen(tekCreateBody(
+            snapshot->model, snapshot->mass, snapshot->friction, snapshot->restitution,
+            snapshot->position, rotation, (vec3){ 1.0f, 1.0f, 1.0f },
+            store, ids[i], &body
+        ), {
+            tekBodyStoreClearSlot(store, ids[i]);
+        });
+        glm_vec3_copy(snapshot->velocity, store->velocities[ids[i]]);
+        tekBodyStoreSetImmovable(store, ids[i], (flag)snapshot->immovable);
+
+        // fill any gaps in the ids with empty bodies, so that index = id
+        TekBody empty = {};
+        while (bodies->length < ids[i]) {
+            tekChainThrowThen(vectorAddItem(bodies, &empty), {
+                tekDeleteBody(&body);
+            });
+        }
+        if (bodies->length == ids[i]) {
+            tekChainThrowThen(vectorAddItem(bodies, &body), {
+                tekDeleteBody(&body);
+            });
+        } else {
+            tekChainThrowThen(vectorSetItem(bodies, ids[i], &body), {
+                tekDeleteBody(&body);
+            });
+        }
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Write the state of every body at one point in time, as lines of comma separated values.
+ * @param output The file to write to.
+ * @param tick The number of ticks that have been simulated.
+ * @param time The simulation time in seconds.
+ * @param scenario The scenario, used to get the name of each body.
+ * @param bodies The vector containing the bodies.
+ * @param store The body store containing the state of the bodies.
+ * @throws VECTOR_EXCEPTION if the bodies could not be read.
+ */
+static exception tekBatchWriteState(FILE* output, const uint tick, const double time, const TekScenario* scenario, const Vector* bodies, const TekBodyStore* store) {
+    for (uint i = 0; i < bodies->length; i++) {
+        TekBody* body;
+        tekChainThrow(vectorGetItemPtr(bodies, i, &body));
+        if (!body->num_vertices) continue;
+
+        char* name;
+        if (tekScenarioGetName(scenario, i, &name) != SUCCESS)
+            name = "";
+
+        fprintf(
+            output, "%u,%.6f,%u,%s,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+            tick, time, i, name,
+            EXPAND_VEC3(store->positions[i]), EXPAND_VEC4(store->rotations[i]),
+            EXPAND_VEC3(store->velocities[i]), EXPAND_VEC3(store->angular_velocities[i])
+        );
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Load a scenario and create all of the bodies in it, ready to be stepped.
+ * @param scenario_filename The scenario file to load the bodies from.
+ * @param deterministic If set, the batch will give exactly the same results every time it is run, even on different machines. Slower than normal.
+ * @param batch The batch to create.
+ * @throws FILE_EXCEPTION if the scenario file could not be opened.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekCreateBatch(const char* scenario_filename, const flag deterministic, TekBatch* batch) {
+    // everything is safe to delete when zeroed, so can just delete the whole batch if anything goes wrong
+    memset(batch, 0, sizeof(TekBatch));
+    tekChainThrow(tekReadScenario(scenario_filename, &batch->scenario));
+    tekChainThrowThen(tekScenarioGetAllIds(&batch->scenario, &batch->ids, &batch->num_ids), {
+        tekDeleteBatch(batch);
+    });
+    tekChainThrowThen(vectorCreate(batch->num_ids, sizeof(TekBody), &batch->bodies), {
+        tekDeleteBatch(batch);
+    });
+    tekChainThrowThen(tekCreateBodyStore(batch->num_ids, &batch->store), {
+        tekDeleteBatch(batch);
+    });
+    batch->store.deterministic = deterministic;
+    tekChainThrowThen(tekBatchCreateBodies(&batch->scenario, batch->ids, batch->num_ids, &batch->bodies, &batch->store), {
+        tekDeleteBatch(batch);
+    });
+    return SUCCESS;
+}
+
+/**
+ * @brief Simulate one tick of a batch, the same as one fixed step of the engine.
+ * @param batch The batch to step.
+ * @param phys_period The length of the tick in seconds.
+ * @param gravity The downwards acceleration due to gravity.
+ * @throws FAILURE if the collision solver failed.
+ */
+exception tekBatchStep(TekBatch* batch, const double phys_period, const float gravity) {
+    float max_penetration;
+    tekTraceBegin("tekBatchStep");
+    tekChainThrowThen(tekSolveCollisions(&batch->bodies, &batch->store, (float)phys_period, &max_penetration, batch->profiler), tekTraceEnd("tekBatchStep"));
+    long long integrate_start = tekProfilerStart(batch->profiler);
+    tekTraceBegin("tekBodyAdvanceTime");
+    tekBodyAdvanceTime(&batch->store, (float)phys_period, gravity);
+    tekTraceEnd("tekBodyAdvanceTime");
+    tekProfilerLap(batch->profiler, PROFILE_INTEGRATE, &integrate_start);
+    tekProfilerEndTick(batch->profiler);
+    tekTraceEnd("tekBatchStep");
+    batch->tick++;
+    return SUCCESS;
+}
+
+/**
+ * @brief Delete a batch, freeing all the bodies and the scenario.
+ * @param batch The batch to delete.
+ */
+void tekDeleteBatch(TekBatch* batch) {
+    for (uint i = 0; i < batch->bodies.length; i++) {
+        TekBody* body;
+        if (vectorGetItemPtr(&batch->bodies, i, &body) == SUCCESS && body->num_vertices) tekDeleteBody(body);
+    }
+    vectorDelete(&batch->bodies);
+    tekDeleteBodyStore(&batch->store);
+    free(batch->ids);
+    tekDeleteScenario(&batch->scenario);
+
+    // prevent further misuse
+    memset(batch, 0, sizeof(TekBatch));
+}
+
+#define tekBatchCleanup \
+    tekDeleteBatch(&batch); \
+    free(profiler); \
+    if (output && output != stdout) fclose(output) \
+
+/**
+ * @brief Run a scenario for a number of ticks as fast as possible, without a window or graphics thread, and write out the result.
+ * @note Each tick is the same as one fixed step of the engine. The output is comma separated values with one line per body: tick, time, id, name, position, rotation, velocity, angular velocity. A summary of how long it took and a hash of the final state is printed to stderr.
+ * @param scenario_filename The scenario file to load the bodies from.
+ * @param num_ticks The number of ticks to simulate.
+ * @param phys_period The length of each tick in seconds.
+ * @param gravity The downwards acceleration due to gravity.
+ * @param output_mode BATCH_FINAL_STATE to only write the state after the last tick, or BATCH_TRAJECTORY to write the state after every tick.
+ * @param deterministic If set, run in deterministic mode so that the final hash is the same on every run.
+ * @param output_filename The file to write the output to, or null / "-" to write to stdout.
+ * @param profile_filename The file to write the time spent in each phase of the last ticks to, or null to not profile the batch.
+ * @throws FILE_EXCEPTION if the scenario, output or profile file could not be opened.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekRunBatch(const char* scenario_filename, const uint num_ticks, const double phys_period, const float gravity, const flag output_mode, const flag deterministic, const char* output_filename, const char* profile_filename) {
+    TekBatch batch;
+    FILE* output = 0;
+    TekProfiler* profiler = 0;
+    tekChainThrow(tekCreateBatch(scenario_filename, deterministic, &batch));
+
+    // the history is a bit big for the stack
+    if (profile_filename) {
+        profiler = (TekProfiler*)malloc(sizeof(TekProfiler));
+        if (!profiler) tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for profiler.", {
+            tekBatchCleanup;
+        });
+        tekCreateProfiler(profiler);
+        batch.profiler = profiler;
+    }
+
+    // open output, stdout if no file given
+    if (!output_filename || !strcmp(output_filename, "-")) {
+        output = stdout;
+    } else {
+        output = fopen(output_filename, "w");
+        if (!output) tekThrowThen(FILE_EXCEPTION, "Failed to open batch output file.", {
+            tekBatchCleanup;
+        });
+    }
+    fprintf(output, "tick,time,id,name,px,py,pz,qx,qy,qz,qw,vx,vy,vz,wx,wy,wz\n");
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    // no sleeping, just step as fast as we can
+    while (batch.tick < num_ticks) {
+        tekChainThrowThen(tekBatchStep(&batch, phys_period, gravity), {
+            tekBatchCleanup;
+        });
+
+        if (output_mode == BATCH_TRAJECTORY || batch.tick == num_ticks) {
+            tekChainThrowThen(tekBatchWriteState(output, batch.tick, batch.tick * phys_period, &batch.scenario, &batch.bodies, &batch.store), {
+                tekBatchCleanup;
+            });
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    const double wall_time = (double)(end_time.tv_sec - start_time.tv_sec) + (double)(end_time.tv_nsec - start_time.tv_nsec) / (double)BILLION;
+    fprintf(
+        stderr, "Simulated %u ticks of %u bodies in %.3fs (%.1f ticks/s, %.1fx real time)\n",
+        num_ticks, batch.num_ids, wall_time,
+        wall_time > 0.0 ? num_ticks / wall_time : 0.0,
+        wall_time > 0.0 ? num_ticks * phys_period / wall_time : 0.0
+    );
+    fprintf(stderr, "Final state hash: %016llx%s\n", tekBodyStoreHash(&batch.store), deterministic ? " (deterministic)" : "");
+
+    if (profiler) {
+        tekChainThrowThen(tekProfilerWriteCSV(profiler, profile_filename), {
+            tekBatchCleanup;
+        });
+    }
+
+    tekBatchCleanup;
+    return SUCCESS;
+}
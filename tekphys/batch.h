@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../tekgl.h"
+#include "../core/exception.h"
+#include "../core/vector.h"
+
+#include "body.h"
+#include "scenario.h"
+#include "profiler.h"
+
+#define BATCH_FINAL_STATE 0
+#define BATCH_TRAJECTORY  1
+
+/// A scenario loaded into a set of bodies, that can be stepped without running the engine thread.
+typedef struct TekBatch {
+    TekScenario scenario;
+    uint* ids;
+    uint num_ids;
+    Vector bodies;
+    TekBodyStore store;
+    uint tick;
+    TekProfiler* profiler; // null unless the batch is being profiled
+} TekBatch;
+
+exception tekCreateBatch(const char* scenario_filename, flag deterministic, TekBatch* batch);
+exception tekBatchStep(TekBatch* batch, double phys_period, float gravity);
+void tekDeleteBatch(TekBatch* batch);
+exception tekRunBatch(const char* scenario_filename, uint num_ticks, double phys_period, float gravity, flag output_mode, flag deterministic, const char* output_filename, const char* profile_filename);
@@ -4,9 +4,19 @@
 #include <cglm/vec3.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../tekgl/manager.h"
+#include "../tekgl/meshbinary.h"
 #include "collider.h"
 
+// the vectorised integrator is compiled for avx2 regardless of the compiler flags, and only used if the cpu supports it at runtime
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TEK_AVX2_KERNEL
+#define TEK_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+
 /// Struct containing the volume and centre of a tetrahedron
 struct TetrahedronData {
     float volume;
@@ -16,9 +26,10 @@ struct TetrahedronData {
 /**
  * @brief Calculate the volume, centre of mass and inverse inertia tensor of an object.
  * @param body The body to calculate properties of.
+ * @param inverse_inertia_tensor Where to write the inverse inertia tensor, normally the body's slot in the body store.
  * @throws MEMORY_EXCEPTION if malloc() fails.
  */
-static exception tekCalculateBodyProperties(TekBody* body) {
+static exception tekCalculateBodyProperties(TekBody* body, mat3 inverse_inertia_tensor) {
     // create an array to cache some data about tetrahedra
     // avoids recalculation later on.
     const uint len_tetrahedron_data = body->num_indices / 3;
@@ -102,26 +113,202 @@ static exception tekCalculateBodyProperties(TekBody* body) {
     }
 
     // store inverse inertia tensor, as this is more useful to us.
-    glm_mat3_inv(inertia_tensor, body->inverse_inertia_tensor);
+    glm_mat3_inv(inertia_tensor, inverse_inertia_tensor);
 
     free(tetrahedron_data);
     return SUCCESS;
 }
 
 /**
- * Update the transformation matrix of a body based on its current position and rotation.
- * @param body The body to update.
+ * Rotate the inverse inertia tensor of a body into world space, using the rotation part of its transform.
+ * @note The solver needs the inertia in world space for every contact on every iteration, so it is worked out once here instead.
+ * @param store The body store containing the body, its transform must already be up to date.
+ * @param id The id / index of the body in the store.
+ */
+static void tekBodyUpdateWorldInertia(const TekBodyStore* store, const uint id) {
+    // I⁻¹(world) = R * I⁻¹(local) * Rᵀ
+    mat3 rotation, rotation_transpose, temp;
+    glm_mat4_pick3(store->transforms[id], rotation);
+    glm_mat3_transpose_to(rotation, rotation_transpose);
+    glm_mat3_mul(rotation, store->inverse_inertia_tensors[id], temp);
+    glm_mat3_mul(temp, rotation_transpose, store->world_inverse_inertia_tensors[id]);
+}
+
+/**
+ * Update the transformation matrix and world space inverse inertia tensor of a body based on its current position and rotation.
+ * @note The matrix is written directly rather than multiplying a translation and rotation matrix together, translation only ever affects the final column.
+ * @param store The body store containing the body.
+ * @param id The id / index of the body in the store.
  */
-static void tekBodyUpdateTransform(TekBody* body) {
-    // transform matrix is a mixture of translation and rotation
-    mat4 translation;
-    glm_translate_make(translation, body->position);
-    mat4 rotation;
-    glm_quat_mat4(body->rotation, rotation);
-
-    // rotate first, then translate (but matrices work backwards :D)
-    // cuz rotation only rotates around the origin
-    glm_mat4_mul(translation, rotation, body->transform);
+void tekBodyUpdateTransform(const TekBodyStore* store, const uint id) {
+    // rotation part of the matrix comes straight from the quaternion
+    glm_quat_mat4(store->rotations[id], store->transforms[id]);
+
+    // rotate first, then translate. so the translation just ends up in the last column
+    store->transforms[id][3][0] = store->positions[id][0];
+    store->transforms[id][3][1] = store->positions[id][1];
+    store->transforms[id][3][2] = store->positions[id][2];
+
+    tekBodyUpdateWorldInertia(store, id);
+}
+
+/**
+ * Template for growing one of the arrays in the body store to a new capacity.
+ * @param array_name The name of the array in the store.
+ * @param array_type The type of each element in the array.
+ */
+#define BODY_STORE_GROW(array_name, array_type) { \
+    array_type* temp = (array_type*)realloc(store->array_name, new_capacity * sizeof(array_type)); \
+    if (!temp) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory to grow body store."); \
+    store->array_name = temp; \
+} \
+
+/**
+ * Grow every array in the body store to a new capacity.
+ * @param store The body store to grow.
+ * @param new_capacity The number of bodies the store should be able to hold.
+ * @throws MEMORY_EXCEPTION if realloc() fails.
+ */
+static exception tekBodyStoreGrow(TekBodyStore* store, const uint new_capacity) {
+    BODY_STORE_GROW(positions, vec3);
+    BODY_STORE_GROW(velocities, vec3);
+    BODY_STORE_GROW(rotations, vec4);
+    BODY_STORE_GROW(previous_positions, vec3);
+    BODY_STORE_GROW(previous_rotations, vec4);
+    BODY_STORE_GROW(angular_velocities, vec3);
+    BODY_STORE_GROW(inverse_masses, float);
+    BODY_STORE_GROW(inverse_inertia_tensors, mat3);
+    BODY_STORE_GROW(world_inverse_inertia_tensors, mat3);
+    BODY_STORE_GROW(transforms, mat4);
+    BODY_STORE_GROW(flags, flag);
+    store->capacity = new_capacity;
+    return SUCCESS;
+}
+
+/**
+ * Create a body store, the structure of arrays that holds everything about a body that changes every tick.
+ * @note Keeping this data packed together means that integrating every body only has to touch the data it needs, rather than the whole TekBody.
+ * @param start_capacity The number of bodies the store can initially hold (use 1 if unsure)
+ * @param store A pointer to an empty TekBodyStore struct.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekCreateBodyStore(uint start_capacity, TekBodyStore* store) {
+    // realloc() of a null pointer acts like malloc(), so growing from nothing creates the arrays
+    memset(store, 0, sizeof(TekBodyStore));
+    if (start_capacity == 0) start_capacity = 1;
+    tekChainThrowThen(tekBodyStoreGrow(store, start_capacity), {
+        tekDeleteBodyStore(store);
+    });
+    return SUCCESS;
+}
+
+/**
+ * Zero out the slot of a body in the store, marking it as not in use.
+ * @param store The body store.
+ * @param id The id of the slot to clear.
+ */
+void tekBodyStoreClearSlot(const TekBodyStore* store, const uint id) {
+    glm_vec3_zero(store->positions[id]);
+    glm_vec3_zero(store->velocities[id]);
+    glm_quat_identity(store->rotations[id]);
+    glm_vec3_zero(store->previous_positions[id]);
+    glm_quat_identity(store->previous_rotations[id]);
+    glm_vec3_zero(store->angular_velocities[id]);
+    store->inverse_masses[id] = 0.0f;
+    glm_mat3_zero(store->inverse_inertia_tensors[id]);
+    glm_mat3_zero(store->world_inverse_inertia_tensors[id]);
+    glm_mat4_identity(store->transforms[id]);
+    store->flags[id] = 0;
+}
+
+/**
+ * Make sure that the body store has at least a certain length, so that any id less than the length can be used.
+ * @note New slots are cleared and marked as not in use.
+ * @param store The body store.
+ * @param length The minimum length of the store.
+ * @throws MEMORY_EXCEPTION if realloc() fails.
+ */
+exception tekBodyStoreReserve(TekBodyStore* store, const uint length) {
+    if (length <= store->length) return SUCCESS;
+
+    // same growth pattern as the vector, double until it fits
+    uint new_capacity = store->capacity;
+    while (new_capacity < length) new_capacity *= 2;
+    if (new_capacity != store->capacity)
+        tekChainThrow(tekBodyStoreGrow(store, new_capacity));
+
+    for (uint i = store->length; i < length; i++)
+        tekBodyStoreClearSlot(store, i);
+    store->length = length;
+    return SUCCESS;
+}
+
+/**
+ * Mark a body as immovable (or not). Immovable bodies are not affected by gravity or collisions.
+ * @param store The body store containing the body.
+ * @param id The id of the body.
+ * @param immovable 1 if the body should be immovable, 0 otherwise.
+ */
+void tekBodyStoreSetImmovable(const TekBodyStore* store, const uint id, const flag immovable) {
+    if (immovable) store->flags[id] |= BODY_FLAG_IMMOVABLE;
+    else store->flags[id] &= ~BODY_FLAG_IMMOVABLE;
+}
+
+/**
+ * Delete a body store, freeing all the arrays.
+ * @param store The body store to delete.
+ */
+void tekDeleteBodyStore(TekBodyStore* store) {
+    free(store->positions);
+    free(store->velocities);
+    free(store->rotations);
+    free(store->previous_positions);
+    free(store->previous_rotations);
+    free(store->angular_velocities);
+    free(store->inverse_masses);
+    free(store->inverse_inertia_tensors);
+    free(store->world_inverse_inertia_tensors);
+    free(store->transforms);
+    free(store->flags);
+
+    // prevent further misuse
+    memset(store, 0, sizeof(TekBodyStore));
+}
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME        1099511628211ULL
+
+/**
+ * Add some bytes to an FNV-1a hash.
+ * @param hash The hash so far.
+ * @param data The bytes to add.
+ * @param num_bytes The number of bytes to add.
+ * @return The updated hash.
+ */
+static unsigned long long tekHashBytes(unsigned long long hash, const void* data, const size_t num_bytes) {
+    const byte* bytes = data;
+    for (size_t i = 0; i < num_bytes; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @brief Hash the state of every body in the store.
+ * @note Hashes the exact bits of the position, rotation, velocity, angular velocity and flags of every slot, so any difference at all between two simulations will change the hash.
+ * @param store The body store to hash.
+ * @return A 64 bit hash of the state of the store.
+ */
+unsigned long long tekBodyStoreHash(const TekBodyStore* store) {
+    unsigned long long hash = FNV_OFFSET_BASIS;
+    hash = tekHashBytes(hash, &store->length, sizeof(uint));
+    hash = tekHashBytes(hash, store->positions, store->length * sizeof(vec3));
+    hash = tekHashBytes(hash, store->rotations, store->length * sizeof(vec4));
+    hash = tekHashBytes(hash, store->velocities, store->length * sizeof(vec3));
+    hash = tekHashBytes(hash, store->angular_velocities, store->length * sizeof(vec3));
+    hash = tekHashBytes(hash, store->flags, store->length * sizeof(flag));
+    return hash;
 }
 
 /**
@@ -134,131 +321,402 @@ static void tekBodyUpdateTransform(TekBody* body) {
  * @param position The position (x, y, z) of the body's center of mass
  * @param rotation The rotation quaternion of the body.
  * @param scale The scaling applied to the object
+ * @param store The body store to write the position, rotation etc. into. Must already be long enough to contain the id.
+ * @param id The id of the body, which is its index in the body store.
  * @param body A pointer to a struct to contain the new body.
  * @throws MEMORY_EXCEPTION if malloc() fails.
  * @throws FAILURE if file is malformed
  */
-exception tekCreateBody(const char* mesh_filename, const float mass, const float friction, const float restitution, vec3 position, vec4 rotation, vec3 scale, TekBody* body) {
-    // some variables used throughout
-    float* vertex_array = 0;
-    uint* index_array = 0;
-    int* layout_array = 0;
-    uint len_vertex_array = 0, len_index_array = 0, len_layout_array = 0;
-    uint position_layout_index = 0;
-
-    // read mesh data from the file. read into arrays of vertices, indices and layout
-    tekChainThrow(tekReadMeshArrays(mesh_filename, &vertex_array, &len_vertex_array, &index_array, &len_index_array, &layout_array, &len_layout_array, &position_layout_index));
+exception tekCreateBody(const char* mesh_filename, const float mass, const float friction, const float restitution, vec3 position, vec4 rotation, vec3 scale, TekBodyStore* store, const uint id, TekBody* body) {
+    // read mesh data from the file, or the binary cache of it. read into arrays of vertices, indices and layout
+    TekMeshData mesh_data;
+    tekChainThrow(tekReadMeshData(mesh_filename, &mesh_data));
 
     int vertex_size = 0;
     int position_index = 0;
 
     // check position layout index. should be a 3 vector
-    for (uint i = 0; i < len_layout_array; i++) {
-        if (position_layout_index == i) {
-            if (layout_array[i] != 3) tekThrow(FAILURE, "Position data must be 3 floats.");
+    for (uint i = 0; i < mesh_data.len_layout; i++) {
+        if (mesh_data.position_layout_index == i) {
+            if (mesh_data.layout[i] != 3) tekThrowThen(FAILURE, "Position data must be 3 floats.", tekDeleteMeshData(&mesh_data));
             position_index = vertex_size;
         }
-        vertex_size += layout_array[i];
+        vertex_size += mesh_data.layout[i];
     }
 
-    // no longer needed, only useful for rendering
-    free(layout_array);
-
     // allocate memory for body vertices and copy them in
-    const uint num_vertices = len_vertex_array / vertex_size;
+    const uint num_vertices = mesh_data.len_vertices / vertex_size;
     body->vertices = (vec3*)malloc(num_vertices * sizeof(vec3));
-    if (!body->vertices) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for vertices.");
+    if (!body->vertices) tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for vertices.", tekDeleteMeshData(&mesh_data));
     for (uint i = 0; i < num_vertices; i++) {
         for (uint j = 0; j < 3; j++) {
-            body->vertices[i][j] = vertex_array[i * vertex_size + position_index + j];
+            body->vertices[i][j] = mesh_data.vertices[i * vertex_size + position_index + j];
         }
     }
 
+    // the body outlives the mesh data, which might just be a mapped file, so it gets its own copy of the indices
+    uint* index_array = (uint*)malloc(mesh_data.len_indices * sizeof(uint));
+    if (!index_array) tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for indices.", {
+        free(body->vertices);
+        tekDeleteMeshData(&mesh_data);
+    });
+    memcpy(index_array, mesh_data.indices, mesh_data.len_indices * sizeof(uint));
+    const uint len_index_array = mesh_data.len_indices;
+    tekDeleteMeshData(&mesh_data);
+
     // copy other values into the body
+    body->id = id;
     body->num_vertices = num_vertices;
     body->indices = index_array;
     body->num_indices = len_index_array;
     body->mass = mass;
     body->friction = friction;
     body->restitution = restitution;
-    glm_vec3_copy(position, body->position);
-    glm_vec4_copy(rotation, body->rotation);
     glm_vec3_copy(scale, body->scale);
 
+    // values that change every tick live in the store
+    tekBodyStoreClearSlot(store, id);
+    glm_vec3_copy(position, store->positions[id]);
+    glm_vec4_copy(rotation, store->rotations[id]);
+    glm_vec3_copy(position, store->previous_positions[id]);
+    glm_vec4_copy(rotation, store->previous_rotations[id]);
+    store->inverse_masses[id] = 1.0f / mass;
+    store->flags[id] = BODY_FLAG_ACTIVE;
+
     // calculate properties - centre of mass, inertia tensor
-    tekChainThrow(tekCalculateBodyProperties(body));
+    tekChainThrow(tekCalculateBodyProperties(body, store->inverse_inertia_tensors[id]));
 
     // create the collider structure
     tekChainThrow(tekCreateCollider(body, &body->collider));
 
-    // create transformation matrix
-    tekBodyUpdateTransform(body);
+    // create transformation matrix, needs to come after the inertia tensor is calculated
+    tekBodyUpdateTransform(store, id);
 
     return SUCCESS;
 }
 
 /**
- * @brief Simulate the effect of a certain amount of time passing on the body's position and rotation.
- * @note Simulate linearly, e.g. with constant acceleration between the two points in time.
- * @param body The body to advance forward in time.
+ * @brief Simulate the effect of a certain amount of time passing on a range of bodies in the store, one body at a time.
+ * @note This is the reference version of the integrator, any vectorised version should produce the same results as this to within floating point error.
+ * @param store The body store containing the bodies.
+ * @param start The index of the first body to advance.
+ * @param end One past the index of the last body to advance.
  * @param delta_time The length of time to advance by.
  * @param gravity The downwards acceleration due to gravity.
  */
-void tekBodyAdvanceTime(TekBody* body, const float delta_time, const float gravity) {
-    if (body->immovable) {
-        tekBodyUpdateTransform(body);
-        return;
+static void tekBodyAdvanceRange(const TekBodyStore* store, const uint start, const uint end, const float delta_time, const float gravity) {
+    // linear motion first. this loop has no branches, so it can be vectorised by the compiler
+    // immovable bodies and empty slots get a mask of 0, which zeroes their velocity and stops them moving
+    for (uint i = start; i < end; i++) {
+        const float movable = (store->flags[i] & (BODY_FLAG_ACTIVE | BODY_FLAG_IMMOVABLE)) == BODY_FLAG_ACTIVE ? 1.0f : 0.0f;
+        store->velocities[i][1] -= gravity * delta_time;
+        for (uint j = 0; j < 3; j++) {
+            store->velocities[i][j] *= movable;
+            store->angular_velocities[i][j] *= movable;
+            store->positions[i][j] += store->velocities[i][j] * delta_time;
+        }
     }
 
-    vec3 delta_position = { 0.0f, 0.0f, 0.0f };
-    body->velocity[1] -= gravity * delta_time;
-    glm_vec3_scale(body->velocity, delta_time, delta_position);
-    glm_vec3_add(body->position, delta_position, body->position);
-
     // calculating change in angle due to angular velocity is a LOT more complex than anticipated
     // so here is a lot of comments so hopefully I can understand later on
+    for (uint i = start; i < end; i++) {
+        if (!(store->flags[i] & BODY_FLAG_ACTIVE)) continue;
+
+        // the magnitude of angular velocity = angular speed (in radians per second).
+        // so multiplying by delta time gives us a change in angle.
+        const float delta_angle = glm_vec3_norm(store->angular_velocities[i]) * delta_time;
+
+        // for small angles, floating point precision may start to become a problem
+        // therefore, safe to skip these small angles as rotation change may be smaller than floating point precision anyway
+        if (delta_angle > 1e-5f) {
+            // normalise angular velocity vector to get the axis of rotation as a unit vector
+            // e.g. { 0.0, 1.0, 0.0 } would mean rotation around the Y axis
+            vec3 axis;
+            glm_vec3_normalize_to(store->angular_velocities[i], axis);
+
+            // calculate a quaternion that represents the change in rotation
+            // e.g. create a rotation around "axis" of size "angle"
+            vec4 delta_quat;
+            glm_quatv(delta_quat, delta_angle, axis);
+
+            // apply the rotation by multiplying rotation change by current rotation
+            vec4 result;
+            glm_quat_mul(delta_quat, store->rotations[i], result);
+
+            // normalise the quaternion, as this rotation causes slight errors that need to be corrected
+            glm_quat_normalize(result);
+
+            glm_quat_copy(result, store->rotations[i]);
+        }
 
-    // the magnitude of angular velocity = angular speed (in radians per second).
-    // so multiplying by delta time gives us a change in angle.
-    const float delta_angle = glm_vec3_norm(body->angular_velocity) * delta_time;
+        tekBodyUpdateTransform(store, i);
+    }
+}
+
+#ifdef TEK_AVX2_KERNEL
+
+/**
+ * Check whether the cpu this is running on supports the AVX2 and FMA instructions needed by the vectorised integrator.
+ * @return 1 if the instructions are supported, 0 otherwise.
+ */
+static flag tekBodyHasAVX2() {
+    // only need to ask the cpu once, answer is not going to change
+    static int has_avx2 = -1;
+    if (has_avx2 < 0) {
+        __builtin_cpu_init();
+        has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return (flag)has_avx2;
+}
+
+/**
+ * Calculate the sine and cosine of 8 angles at once.
+ * @note Uses the range reduction and polynomials from the cephes sinf() and cosf(), which are accurate to about 1e-7 for angles that a body could reasonably rotate by in one tick.
+ * @param angle The 8 angles in radians.
+ * @param sin_out Where to write the sine of each angle.
+ * @param cos_out Where to write the cosine of each angle.
+ */
+TEK_AVX2_TARGET static void tekSinCos8(const __m256 angle, __m256* sin_out, __m256* cos_out) {
+    // find which quarter of the circle the angle is in, and reduce it to the range [-pi/4, pi/4]
+    // pi/2 is subtracted in 3 parts so that precision isn't lost for larger angles
+    const __m256 quadrant = _mm256_round_ps(_mm256_mul_ps(angle, _mm256_set1_ps(0.63661977236758134f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 x = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(1.5703125f), angle);
+    x = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(4.837512969970703125e-4f), x);
+    x = _mm256_fnmadd_ps(quadrant, _mm256_set1_ps(7.54978995489188216e-8f), x);
+    const __m256 x2 = _mm256_mul_ps(x, x);
+
+    // sin(x) ~= x - x³/6 + x⁵/120 - x⁷/5040, with tweaked coefficients
+    __m256 sin_x = _mm256_fmadd_ps(_mm256_set1_ps(-1.9515295891e-4f), x2, _mm256_set1_ps(8.3321608736e-3f));
+    sin_x = _mm256_fmadd_ps(sin_x, x2, _mm256_set1_ps(-1.6666654611e-1f));
+    sin_x = _mm256_fmadd_ps(_mm256_mul_ps(sin_x, x2), x, x);
+
+    // cos(x) ~= 1 - x²/2 + x⁴/24 - x⁶/720 + x⁸/40320, same again
+    __m256 cos_x = _mm256_fmadd_ps(_mm256_set1_ps(2.443315711809948e-5f), x2, _mm256_set1_ps(-1.388731625493765e-3f));
+    cos_x = _mm256_fmadd_ps(cos_x, x2, _mm256_set1_ps(4.166664568298827e-2f));
+    cos_x = _mm256_fmadd_ps(_mm256_mul_ps(cos_x, x2), x2, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), x2, _mm256_set1_ps(1.0f)));
+
+    // in odd quadrants, sine and cosine swap places
+    const __m256i quadrant_int = _mm256_cvtps_epi32(quadrant);
+    const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant_int, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+    const __m256 sin_result = _mm256_blendv_ps(sin_x, cos_x, swap);
+    const __m256 cos_result = _mm256_blendv_ps(cos_x, sin_x, swap);
+
+    // sine is negative in quadrants 2 and 3, cosine is negative in quadrants 1 and 2
+    // shift bit 1 of the quadrant up to the sign bit and flip the sign with xor
+    const __m256 sin_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant_int, _mm256_set1_epi32(2)), 30));
+    const __m256 cos_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant_int, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+    *sin_out = _mm256_xor_ps(sin_result, sin_sign);
+    *cos_out = _mm256_xor_ps(cos_result, cos_sign);
+}
 
-    // for small angles, floating point precision may start to become a problem
-    // therefore, safe to skip these small angles as rotation change may be smaller than floating point precision anyway
-    if (delta_angle > 1e-5f) {
-        // normalise angular velocity vector to get the axis of rotation as a unit vector
-        // e.g. { 0.0, 1.0, 0.0 } would mean rotation around the Y axis
-        vec3 axis;
-        glm_vec3_normalize_to(body->angular_velocity, axis);
+/**
+ * @brief Simulate the effect of a certain amount of time passing on a range of bodies in the store, 8 bodies at a time using AVX2.
+ * @note Does the same maths as tekBodyAdvanceRange(), but the rotation matrix is built directly from the quaternion and only the top 3 rows of the transform are written. The bottom row of each transform is always 0, 0, 0, 1 so never needs to change.
+ * @param store The body store containing the bodies.
+ * @param start The index of the first body to advance.
+ * @param end One past the index of the last body to advance, any bodies left over after the last group of 8 are advanced by tekBodyAdvanceRange().
+ * @param delta_time The length of time to advance by.
+ * @param gravity The downwards acceleration due to gravity.
+ */
+TEK_AVX2_TARGET static void tekBodyAdvanceRangeAVX2(const TekBodyStore* store, const uint start, const uint end, const float delta_time, const float gravity) {
+    // offsets of each body in the vec3 and vec4 arrays, used to gather 8 bodies into one register
+    const __m256i vec3_offsets = _mm256_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21);
+    const __m256i vec4_offsets = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 dt = _mm256_set1_ps(delta_time);
+    const __m256 gravity_dt = _mm256_set1_ps(gravity * delta_time);
+    const __m256 min_angle = _mm256_set1_ps(1e-5f);
+    const __m256 tiny = _mm256_set1_ps(1e-30f);
+
+    // there is no scatter in AVX2, so results are written here first and then copied back into the store
+    _Alignas(32) float position_out[3][8], velocity_out[3][8], angular_velocity_out[3][8], rotation_out[4][8], basis_out[9][8];
+
+    uint i = start;
+    for (; i + 8 <= end; i += 8) {
+        // work out which bodies are allowed to move, same as the scalar version
+        const __m256i flags = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)&store->flags[i]));
+        const __m256i movable_mask = _mm256_cmpeq_epi32(_mm256_and_si256(flags, _mm256_set1_epi32(BODY_FLAG_ACTIVE | BODY_FLAG_IMMOVABLE)), _mm256_set1_epi32(BODY_FLAG_ACTIVE));
+        const __m256 movable = _mm256_and_ps(_mm256_castsi256_ps(movable_mask), one);
+
+        // split the xyz of 8 bodies into one register per component
+        const float* position_ptr = store->positions[i];
+        const float* velocity_ptr = store->velocities[i];
+        const float* angular_ptr = store->angular_velocities[i];
+        const float* rotation_ptr = store->rotations[i];
+        __m256 px = _mm256_i32gather_ps(position_ptr, vec3_offsets, 4);
+        __m256 py = _mm256_i32gather_ps(position_ptr + 1, vec3_offsets, 4);
+        __m256 pz = _mm256_i32gather_ps(position_ptr + 2, vec3_offsets, 4);
+        __m256 vx = _mm256_i32gather_ps(velocity_ptr, vec3_offsets, 4);
+        __m256 vy = _mm256_i32gather_ps(velocity_ptr + 1, vec3_offsets, 4);
+        __m256 vz = _mm256_i32gather_ps(velocity_ptr + 2, vec3_offsets, 4);
+        __m256 wx = _mm256_i32gather_ps(angular_ptr, vec3_offsets, 4);
+        __m256 wy = _mm256_i32gather_ps(angular_ptr + 1, vec3_offsets, 4);
+        __m256 wz = _mm256_i32gather_ps(angular_ptr + 2, vec3_offsets, 4);
+        __m256 qx = _mm256_i32gather_ps(rotation_ptr, vec4_offsets, 4);
+        __m256 qy = _mm256_i32gather_ps(rotation_ptr + 1, vec4_offsets, 4);
+        __m256 qz = _mm256_i32gather_ps(rotation_ptr + 2, vec4_offsets, 4);
+        __m256 qw = _mm256_i32gather_ps(rotation_ptr + 3, vec4_offsets, 4);
+
+        // linear motion
+        vy = _mm256_sub_ps(vy, gravity_dt);
+        vx = _mm256_mul_ps(vx, movable);
+        vy = _mm256_mul_ps(vy, movable);
+        vz = _mm256_mul_ps(vz, movable);
+        wx = _mm256_mul_ps(wx, movable);
+        wy = _mm256_mul_ps(wy, movable);
+        wz = _mm256_mul_ps(wz, movable);
+        px = _mm256_fmadd_ps(vx, dt, px);
+        py = _mm256_fmadd_ps(vy, dt, py);
+        pz = _mm256_fmadd_ps(vz, dt, pz);
+
+        // change in angle = angular speed * time, only rotate bodies where this is big enough to matter
+        const __m256 angular_speed = _mm256_sqrt_ps(_mm256_fmadd_ps(wx, wx, _mm256_fmadd_ps(wy, wy, _mm256_mul_ps(wz, wz))));
+        const __m256 delta_angle = _mm256_mul_ps(angular_speed, dt);
+        const __m256 rotate_mask = _mm256_cmp_ps(delta_angle, min_angle, _CMP_GT_OQ);
+
+        // delta quaternion = (axis * sin(angle / 2), cos(angle / 2))
+        __m256 sin_half, cos_half;
+        tekSinCos8(_mm256_mul_ps(delta_angle, half), &sin_half, &cos_half);
+        const __m256 axis_scale = _mm256_div_ps(sin_half, _mm256_max_ps(angular_speed, tiny));
+        const __m256 dx = _mm256_mul_ps(wx, axis_scale);
+        const __m256 dy = _mm256_mul_ps(wy, axis_scale);
+        const __m256 dz = _mm256_mul_ps(wz, axis_scale);
+        const __m256 dw = cos_half;
+
+        // result = delta quaternion * rotation, written out the same way as glm_quat_mul()
+        __m256 rx = _mm256_fmadd_ps(dw, qx, _mm256_fmadd_ps(dx, qw, _mm256_fmsub_ps(dy, qz, _mm256_mul_ps(dz, qy))));
+        __m256 ry = _mm256_fmadd_ps(dw, qy, _mm256_fmadd_ps(dy, qw, _mm256_fmsub_ps(dz, qx, _mm256_mul_ps(dx, qz))));
+        __m256 rz = _mm256_fmadd_ps(dw, qz, _mm256_fmadd_ps(dz, qw, _mm256_fmsub_ps(dx, qy, _mm256_mul_ps(dy, qx))));
+        __m256 rw = _mm256_fnmadd_ps(dx, qx, _mm256_fnmadd_ps(dy, qy, _mm256_fmsub_ps(dw, qw, _mm256_mul_ps(dz, qz))));
+
+        // normalise to correct for floating point drift
+        const __m256 inverse_norm = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_fmadd_ps(rx, rx, _mm256_fmadd_ps(ry, ry, _mm256_fmadd_ps(rz, rz, _mm256_mul_ps(rw, rw))))));
+        qx = _mm256_blendv_ps(qx, _mm256_mul_ps(rx, inverse_norm), rotate_mask);
+        qy = _mm256_blendv_ps(qy, _mm256_mul_ps(ry, inverse_norm), rotate_mask);
+        qz = _mm256_blendv_ps(qz, _mm256_mul_ps(rz, inverse_norm), rotate_mask);
+        qw = _mm256_blendv_ps(qw, _mm256_mul_ps(rw, inverse_norm), rotate_mask);
+
+        // rotation matrix from quaternion, same as glm_quat_mat4()
+        const __m256 s = _mm256_div_ps(two, _mm256_max_ps(_mm256_sqrt_ps(_mm256_fmadd_ps(qx, qx, _mm256_fmadd_ps(qy, qy, _mm256_fmadd_ps(qz, qz, _mm256_mul_ps(qw, qw))))), tiny));
+        const __m256 sx = _mm256_mul_ps(s, qx), sy = _mm256_mul_ps(s, qy), sz = _mm256_mul_ps(s, qz);
+        const __m256 xx = _mm256_mul_ps(sx, qx), yy = _mm256_mul_ps(sy, qy), zz = _mm256_mul_ps(sz, qz);
+        const __m256 xy = _mm256_mul_ps(sx, qy), yz = _mm256_mul_ps(sy, qz), xz = _mm256_mul_ps(sx, qz);
+        const __m256 xw = _mm256_mul_ps(sx, qw), yw = _mm256_mul_ps(sy, qw), zw = _mm256_mul_ps(sz, qw);
+
+        _mm256_store_ps(basis_out[0], _mm256_sub_ps(_mm256_sub_ps(one, yy), zz));
+        _mm256_store_ps(basis_out[1], _mm256_add_ps(xy, zw));
+        _mm256_store_ps(basis_out[2], _mm256_sub_ps(xz, yw));
+        _mm256_store_ps(basis_out[3], _mm256_sub_ps(xy, zw));
+        _mm256_store_ps(basis_out[4], _mm256_sub_ps(_mm256_sub_ps(one, xx), zz));
+        _mm256_store_ps(basis_out[5], _mm256_add_ps(yz, xw));
+        _mm256_store_ps(basis_out[6], _mm256_add_ps(xz, yw));
+        _mm256_store_ps(basis_out[7], _mm256_sub_ps(yz, xw));
+        _mm256_store_ps(basis_out[8], _mm256_sub_ps(_mm256_sub_ps(one, xx), yy));
+
+        _mm256_store_ps(position_out[0], px);
+        _mm256_store_ps(position_out[1], py);
+        _mm256_store_ps(position_out[2], pz);
+        _mm256_store_ps(velocity_out[0], vx);
+        _mm256_store_ps(velocity_out[1], vy);
+        _mm256_store_ps(velocity_out[2], vz);
+        _mm256_store_ps(angular_velocity_out[0], wx);
+        _mm256_store_ps(angular_velocity_out[1], wy);
+        _mm256_store_ps(angular_velocity_out[2], wz);
+        _mm256_store_ps(rotation_out[0], qx);
+        _mm256_store_ps(rotation_out[1], qy);
+        _mm256_store_ps(rotation_out[2], qz);
+        _mm256_store_ps(rotation_out[3], qw);
+
+        // copy everything back into the store
+        for (uint j = 0; j < 8; j++) {
+            const uint id = i + j;
+            for (uint k = 0; k < 3; k++) {
+                store->positions[id][k] = position_out[k][j];
+                store->velocities[id][k] = velocity_out[k][j];
+                store->angular_velocities[id][k] = angular_velocity_out[k][j];
+            }
+
+            // empty slots keep their identity transform, like the scalar version
+            if (!(store->flags[id] & BODY_FLAG_ACTIVE)) continue;
+            for (uint k = 0; k < 4; k++)
+                store->rotations[id][k] = rotation_out[k][j];
+            for (uint k = 0; k < 3; k++) {
+                store->transforms[id][k][0] = basis_out[k * 3][j];
+                store->transforms[id][k][1] = basis_out[k * 3 + 1][j];
+                store->transforms[id][k][2] = basis_out[k * 3 + 2][j];
+                store->transforms[id][3][k] = position_out[k][j];
+            }
+            tekBodyUpdateWorldInertia(store, id);
+        }
+    }
 
-        // calculate a quaternion that represents the change in rotation
-        // e.g. create a rotation around "axis" of size "angle"
-        vec4 delta_quat;
-        glm_quatv(delta_quat, delta_angle, axis);
+    // fewer than 8 left, not worth a vector for these
+    tekBodyAdvanceRange(store, i, end, delta_time, gravity);
+}
 
-        // apply the rotation by multiplying rotation change by current rotation
-        vec4 result;
-        glm_quat_mul(delta_quat, body->rotation, result);
+#endif
 
-        // normalise the quaternion, as this rotation causes slight errors that need to be corrected
-        glm_quat_normalize(result);
+/**
+ * @brief Simulate the effect of a certain amount of time passing on every body in the store, using the plain C version of the integrator.
+ * @note Always available, and used as the reference that the vectorised integrator is tested against.
+ * @param store The body store containing all the bodies to advance forward in time.
+ * @param delta_time The length of time to advance by.
+ * @param gravity The downwards acceleration due to gravity.
+ */
+void tekBodyAdvanceTimeScalar(const TekBodyStore* store, const float delta_time, const float gravity) {
+    tekBodyAdvanceRange(store, 0, store->length, delta_time, gravity);
+}
 
-        glm_quat_copy(result, body->rotation);
+/**
+ * @brief Simulate the effect of a certain amount of time passing on every body in the store, using the vectorised version of the integrator.
+ * @note Does nothing and returns 0 if the vectorised integrator was not compiled in, or the cpu does not support it.
+ * @param store The body store containing all the bodies to advance forward in time.
+ * @param delta_time The length of time to advance by.
+ * @param gravity The downwards acceleration due to gravity.
+ * @return 1 if the bodies were advanced, 0 otherwise.
+ */
+flag tekBodyAdvanceTimeSIMD(const TekBodyStore* store, const float delta_time, const float gravity) {
+#ifdef TEK_AVX2_KERNEL
+    if (tekBodyHasAVX2()) {
+        tekBodyAdvanceRangeAVX2(store, 0, store->length, delta_time, gravity);
+        return 1;
     }
+#endif
+    return 0;
+}
 
-    tekBodyUpdateTransform(body);
+/**
+ * @brief Simulate the effect of a certain amount of time passing on the position and rotation of every body in the store.
+ * @note Simulate linearly, e.g. with constant acceleration between the two points in time. Immovable bodies and empty slots are not moved. Uses the vectorised integrator if possible. The position and rotation from before the step are kept in the store.
+ * @param store The body store containing all the bodies to advance forward in time.
+ * @param delta_time The length of time to advance by.
+ * @param gravity The downwards acceleration due to gravity.
+ */
+void tekBodyAdvanceTime(const TekBodyStore* store, const float delta_time, const float gravity) {
+    // save where everything was, so that the renderer can blend between the last two steps
+    memcpy(store->previous_positions, store->positions, store->length * sizeof(vec3));
+    memcpy(store->previous_rotations, store->rotations, store->length * sizeof(vec4));
+
+    // the simd path uses fma and approximates sin/cos, so it gives slightly different answers to the scalar one.
+    // deterministic mode has to give the same answer whatever cpu it runs on, so always use the scalar path.
+    if (store->deterministic || !tekBodyAdvanceTimeSIMD(store, delta_time, gravity))
+        tekBodyAdvanceTimeScalar(store, delta_time, gravity);
 }
 
 /**
  * @brief Apply an impulse (change in momentum) to a body.
  * @note The point of application is in world coordinates, not relative to the body.
+ * @param store The body store containing the body.
  * @param body The body to apply the impulse to.
  * @param point_of_application The point in space where the impulse is applied.
  * @param impulse The size of the impulse to apply.
  * @param delta_time The duration of time for which this impulse takes place. Should be the same as the physics time step typically.
  */
-void tekBodyApplyImpulse(TekBody* body, vec3 point_of_application, vec3 impulse, const float delta_time) {
+void tekBodyApplyImpulse(const TekBodyStore* store, TekBody* body, vec3 point_of_application, vec3 impulse, const float delta_time) {
     // impulse = mass * Δvelocity
-    glm_vec3_muladds(impulse, 1.0f / body->mass, body->velocity);
+    glm_vec3_muladds(impulse, store->inverse_masses[body->id], store->velocities[body->id]);
 
     // calculating force:
     // force = impulse / time
@@ -273,24 +731,27 @@ void tekBodyApplyImpulse(TekBody* body, vec3 point_of_application, vec3 impulse,
     glm_vec3_cross(displacement, force, torque);
 
     // calculating angular acceleration:
-    // α = I⁻¹τ
+    // α = I⁻¹τ, using the inertia tensor in world space as the torque is in world space
     vec3 angular_acceleration;
-    glm_mat3_mulv(body->inverse_inertia_tensor, torque, angular_acceleration);
+    glm_mat3_mulv(store->world_inverse_inertia_tensors[body->id], torque, angular_acceleration);
 
     // add change in angular velocity (angular acceleration * Δtime = Δangular velocity)
-    glm_vec3_muladds(angular_acceleration, delta_time, body->angular_velocity);
+    glm_vec3_muladds(angular_acceleration, delta_time, store->angular_velocities[body->id]);
 }
 
 /**
  * Update the mass of a body. Don't set the mass directly because the mass affects the density, inertia tensor and other properties that need to be updated.
+ * @param store The body store containing the body.
  * @param body The body to have its mass changed.
  * @param mass The new mass of the body.
  * @throws MEMORY_EXCEPTION if malloc() fails
  */
-exception tekBodySetMass(TekBody* body, const float mass) {
+exception tekBodySetMass(const TekBodyStore* store, TekBody* body, const float mass) {
     body->mass = mass; // kiss my mass
+    store->inverse_masses[body->id] = 1.0f / mass;
     // recalculate some properties that are based on mass
-    tekChainThrow(tekCalculateBodyProperties(body));
+    tekChainThrow(tekCalculateBodyProperties(body, store->inverse_inertia_tensors[body->id]));
+    tekBodyUpdateWorldInertia(store, body->id);
     return SUCCESS;
 }
 
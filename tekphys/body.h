@@ -13,7 +13,29 @@
 struct TekColliderNode;
 typedef struct TekColliderNode* TekCollider;
 
+#define BODY_FLAG_ACTIVE    0x01
+#define BODY_FLAG_IMMOVABLE 0x02
+
+/// Dense structure of arrays containing the state of every body that changes each tick, indexed by body id.
+typedef struct TekBodyStore {
+    vec3* positions;
+    vec3* velocities;
+    vec4* rotations;
+    vec3* previous_positions; // position and rotation before the most recent step, so the renderer can interpolate between steps
+    vec4* previous_rotations;
+    vec3* angular_velocities; // direction = axis of rotation, magnitude = speed of rotation (radians/second)
+    float* inverse_masses;
+    mat3* inverse_inertia_tensors; // in the body's local space, only changes if the mass changes
+    mat3* world_inverse_inertia_tensors; // rotated into world space, updated whenever the transform is
+    mat4* transforms;
+    flag* flags;
+    uint length;
+    uint capacity;
+    flag deterministic; // if set, results are bit for bit the same every run on every machine, at the cost of speed
+} TekBodyStore;
+
 typedef struct TekBody {
+    uint id;
     vec3* vertices;
     uint num_vertices;
     uint* indices;
@@ -24,15 +46,8 @@ typedef struct TekBody {
     float restitution;
     float friction;
     vec3 centre_of_mass;
-    vec3 position;
-    vec3 velocity;
-    vec4 rotation;
-    vec3 angular_velocity; // direction = axis of rotation, magnitude = speed of rotation (radians/second)
     vec3 scale;
-    mat3 inverse_inertia_tensor;
-    mat4 transform;
     TekCollider collider;
-    int immovable;
 } TekBody;
 
 typedef struct TekBodySnapshot {
@@ -48,9 +63,19 @@ typedef struct TekBodySnapshot {
     char* material;
 } TekBodySnapshot;
 
-exception tekCreateBody(const char* mesh_filename, float mass, float friction, float restitution, vec3 position, vec4 rotation, vec3 scale, TekBody* body);
-void tekBodyAdvanceTime(TekBody* body, float delta_time, float gravity);
+exception tekCreateBodyStore(uint start_capacity, TekBodyStore* store);
+exception tekBodyStoreReserve(TekBodyStore* store, uint length);
+void tekBodyStoreClearSlot(const TekBodyStore* store, uint id);
+void tekBodyStoreSetImmovable(const TekBodyStore* store, uint id, flag immovable);
+void tekDeleteBodyStore(TekBodyStore* store);
+void tekBodyUpdateTransform(const TekBodyStore* store, uint id);
+unsigned long long tekBodyStoreHash(const TekBodyStore* store);
+
+exception tekCreateBody(const char* mesh_filename, float mass, float friction, float restitution, vec3 position, vec4 rotation, vec3 scale, TekBodyStore* store, uint id, TekBody* body);
+void tekBodyAdvanceTime(const TekBodyStore* store, float delta_time, float gravity);
+void tekBodyAdvanceTimeScalar(const TekBodyStore* store, float delta_time, float gravity);
+flag tekBodyAdvanceTimeSIMD(const TekBodyStore* store, float delta_time, float gravity);
 void tekDeleteBody(const TekBody* body);
-void tekBodyApplyImpulse(TekBody* body, vec3 point_of_application, vec3 impulse, float delta_time);
-exception tekBodySetMass(TekBody* body, float mass);
+void tekBodyApplyImpulse(const TekBodyStore* store, TekBody* body, vec3 point_of_application, vec3 impulse, float delta_time);
+exception tekBodySetMass(const TekBodyStore* store, TekBody* body, float mass);
 exception tekBodyGetContactPoints(const TekBody* body_a, const TekBody* body_b, Vector* contact_points);
@@ -1,6 +1,7 @@
 #include "collisions.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <cglm/cam.h>
@@ -12,6 +13,7 @@
 #include "../core/vector.h"
 #include "../tekgl/manager.h"
 #include "../core/bitset.h"
+#include "../core/trace.h"
 #include "../stb/stb_image.h"
 
 #define NOT_INITIALISED 0
@@ -29,7 +31,14 @@ struct TekPolytopeVertex {
     vec3 support;
 };
 
+/// Two leaves whose bounding boxes overlap, waiting for their triangles to be checked.
+struct TekLeafPair {
+    TekColliderNode* leaves[2];
+    TekBody* bodies[2];
+};
+
 static Vector collider_buffer = {};
+static Vector leaf_pair_buffer = {};
 static Vector contact_buffer = {};
 static Vector impulse_buffer = {};
 
@@ -48,6 +57,7 @@ void tekColliderDelete() {
     collider_init = DE_INITIALISED;
     // stuff for broad collision detection
     vectorDelete(&collider_buffer);
+    vectorDelete(&leaf_pair_buffer);
     vectorDelete(&contact_buffer);
     // collision response
     vectorDelete(&impulse_buffer);
@@ -66,6 +76,9 @@ tek_init TekColliderInit() {
     exception tek_exception = vectorCreate(16, 2 * sizeof(TekColliderNode*), &collider_buffer);
     if (tek_exception != SUCCESS) return;
 
+    tek_exception = vectorCreate(16, sizeof(struct TekLeafPair), &leaf_pair_buffer);
+    if (tek_exception != SUCCESS) return;
+
     tek_exception = vectorCreate(8, sizeof(TekCollisionManifold), &contact_buffer);
     if (tek_exception != SUCCESS) return;
 
@@ -624,10 +637,25 @@ int tekCheckTriangleCollision(vec3 triangle_a[3], vec3 triangle_b[3], struct Tek
     if (fabsf(glm_vec3_norm(direction)) < EPSILON
         || fabsf(glm_vec3_dot(direction, normal_a)) < EPSILON
         || fabsf(glm_vec3_dot(direction, normal_b)) < EPSILON) {
-        vec3 random_direction = {
-            randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f), randomFloat(-100.0f, 100.0f)
+        // used to pick a random direction here, but that made the result depend on the time the program started.
+        // instead try a few fixed directions and keep whichever is furthest from being parallel to either triangle.
+        static const vec3 fallback_directions[4] = {
+            { 1.0f, 0.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f },
+            { 0.0f, 0.0f, 1.0f },
+            { 0.57735027f, 0.57735027f, 0.57735027f }
         };
-        glm_vec3_normalize_to(random_direction, direction);
+        float best_score = -1.0f;
+        for (uint i = 0; i < 4; i++) {
+            const float score = fminf(
+                fabsf(glm_vec3_dot((float*)fallback_directions[i], normal_a)),
+                fabsf(glm_vec3_dot((float*)fallback_directions[i], normal_b))
+            );
+            if (score > best_score) {
+                best_score = score;
+                glm_vec3_copy((float*)fallback_directions[i], direction);
+            }
+        }
     }
 
     // add an initial point to the simplex
@@ -1464,32 +1492,30 @@ static exception tekDoesManifoldContainContacts(const Vector* manifold_vector, T
 #define getChild(collider_node, i) (i == LEFT) ? collider_node->data.node.left : collider_node->data.node.right
 
 /**
- * Get the collision manifolds releating to the two bodies, and add them to a provided vector. Gives information such as contact position, depth, normals, tangent vectors etc.
+ * Walk the collider trees of two bodies, and find every pair of leaves whose triangles might be touching.
+ * @note Only the bounding boxes are checked here, the triangles are checked later by tekCheckLeafPairs(). The leaves found are left transformed into world space, ready to be checked.
+ * @param store The body store containing the transforms of both bodies.
  * @param body_a The first body involved in the potential collision.
  * @param body_b The second body involved.
- * @param collision Flag that is set to 1 if there was a collision, 0 if not.
- * @param manifold_vector The vector containing all the manifolds that will be produced. Will not empty the vector, so the same vector can be used to collect all the manifolds of an entire colliding system / scenario.
- * @throws FAILURE if collider buffer not initialised.
+ * @param leaf_pairs The vector to add the pairs of leaves to. Will not empty the vector, so the pairs of an entire scenario can be collected at once.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
  */
-exception tekGetCollisionManifolds(TekBody* body_a, TekBody* body_b, flag* collision, Vector* manifold_vector) {
+static exception tekFindLeafPairs(const TekBodyStore* store, TekBody* body_a, TekBody* body_b, Vector* leaf_pairs) {
     // general process:
     // check for collision between each pair of sub-obb in the colliding pair.
     // for each colliding pair, add that pair to the collider stack.
     // if the child is a leaf node/triangle, then only traverse the non-leaf node until two triangles are being checked.
-    // if two triangles are found to collide, no need to keep traversing the collider structure. can just create a manifold / check for triangle-triangle collision.
-
-    // we need a collider buffer to store pairs of nodes. if not initialised, cannot continue
-    if (collider_init == DE_INITIALISED) return SUCCESS;
-    if (collider_init == NOT_INITIALISED) tekThrow(FAILURE, "Collider buffer was never initialised.");
+    // if two leaves are found to overlap, no need to keep traversing the collider structure. can just save them to check for triangle-triangle collision.
 
     // initial item to add to collider stack, body a and body b's collider.
-    *collision = 0;
     collider_buffer.length = 0;
+    vec4* transform_a = store->transforms[body_a->id];
+    vec4* transform_b = store->transforms[body_b->id];
     TekColliderNode* pair[2] = {
         body_a->collider, body_b->collider
     };
-    tekUpdateOBB(&body_a->collider->obb, body_a->transform);
-    tekUpdateOBB(&body_b->collider->obb, body_b->transform);
+    tekUpdateOBB(&body_a->collider->obb, transform_a);
+    tekUpdateOBB(&body_b->collider->obb, transform_b);
     tekChainThrow(vectorAddItem(&collider_buffer, &pair));
 
     uint obb_obb_checks = 0;
@@ -1499,12 +1525,12 @@ exception tekGetCollisionManifolds(TekBody* body_a, TekBody* body_b, flag* colli
     // tree traversal.
     while (vectorPopItem(&collider_buffer, &pair)) {
         if (pair[LEFT]->type == COLLIDER_NODE) {
-            tekUpdateOBB(&pair[LEFT]->data.node.left->obb, body_a->transform);
-            tekUpdateOBB(&pair[LEFT]->data.node.right->obb, body_a->transform);
+            tekUpdateOBB(&pair[LEFT]->data.node.left->obb, transform_a);
+            tekUpdateOBB(&pair[LEFT]->data.node.right->obb, transform_a);
         }
         if (pair[RIGHT]->type == COLLIDER_NODE) {
-            tekUpdateOBB(&pair[RIGHT]->data.node.left->obb, body_b->transform);
-            tekUpdateOBB(&pair[RIGHT]->data.node.right->obb, body_b->transform);
+            tekUpdateOBB(&pair[RIGHT]->data.node.left->obb, transform_b);
+            tekUpdateOBB(&pair[RIGHT]->data.node.right->obb, transform_b);
         }
 
         TekColliderNode* temp_pair[2];
@@ -1526,40 +1552,27 @@ exception tekGetCollisionManifolds(TekBody* body_a, TekBody* body_b, flag* colli
                     sub_collision = tekCheckOBBCollision(&node_a->obb, &node_b->obb);
                     obb_obb_checks++;
                 } else if ((node_a->type == COLLIDER_NODE) && (node_b->type == COLLIDER_LEAF)) {
-                    tekUpdateLeaf(node_b, body_b->transform);
+                    tekUpdateLeaf(node_b, transform_b);
                     sub_collision = tekCheckOBBTrianglesCollision(&node_a->obb, node_b->data.leaf.w_vertices, node_b->data.leaf.num_vertices / 3);
                     obb_triangle_checks++;
                 } else if ((node_a->type == COLLIDER_LEAF) && (node_b->type == COLLIDER_NODE)) {
-                    tekUpdateLeaf(node_a, body_a->transform);
+                    tekUpdateLeaf(node_a, transform_a);
                     sub_collision = tekCheckOBBTrianglesCollision(&node_b->obb, node_a->data.leaf.w_vertices, node_a->data.leaf.num_vertices / 3);
                     obb_triangle_checks++;
                 } else {
-                    // triangle-triangle collision is more special
-                    // need to create a collision manifold if there is a collision
-                    tekUpdateLeaf(node_a, body_a->transform);
-                    tekUpdateLeaf(node_b, body_b->transform);
-                    TekCollisionManifold manifold;
-                    tekChainThrow(tekCheckTrianglesCollision(
-                        node_a->data.leaf.w_vertices, node_a->data.leaf.num_vertices / 3,
-                        node_b->data.leaf.w_vertices, node_b->data.leaf.num_vertices / 3,
-                        &sub_collision, &manifold
-                        ));
-
+                    // triangle-triangle collision is more special, it's the expensive part so leave it until later.
+                    // the result never changes how the trees are walked, so the order the pairs are checked in stays the same.
+                    tekUpdateLeaf(node_a, transform_a);
+                    tekUpdateLeaf(node_b, transform_b);
+                    const struct TekLeafPair leaf_pair = {
+                        .leaves = { node_a, node_b },
+                        .bodies = { body_a, body_b }
+                    };
+                    tekChainThrow(vectorAddItem(leaf_pairs, &leaf_pair));
                     triangle_triangle_checks++;
-
-                    if (sub_collision) {
-                        sub_collision = 0;
-                        manifold.bodies[0] = body_a;
-                        manifold.bodies[1] = body_b;
-
-                        flag contained;
-                        tekChainThrow(tekDoesManifoldContainContacts(manifold_vector, &manifold, &contained));
-                        if (!contained && manifold.penetration_depth > EPSILON) tekChainThrow(vectorAddItem(manifold_vector, &manifold));
-                        *collision = 1;
-                    }
                 }
 
-                // if there was a triangle-triangle collision, there has to be some form of collision between bodies, so mark as such.
+                // if there was a collision between the boxes, need to check their children as well.
                 if (sub_collision) {
                     temp_pair[LEFT] = node_a;
                     temp_pair[RIGHT] = node_b;
@@ -1569,57 +1582,127 @@ exception tekGetCollisionManifolds(TekBody* body_a, TekBody* body_b, flag* colli
         }
     }
 
+    // printing every pair every tick is far too slow to leave on all the time
+#ifdef TEK_COLLISION_DEBUG
     const uint unoptimised = body_a->num_indices * body_b->num_indices / 9;
     printf("Un optimised: %u triangle-triangle checks.\n", unoptimised);
     printf("Optimised   : %u obb-obb checks.\n", obb_obb_checks);
     printf("              %u obb-triangle checks.\n", obb_triangle_checks);
     printf("              %u triangle-triangle checks.\n", triangle_triangle_checks);
+#endif
 
     return SUCCESS;
 }
 
+/**
+ * Check the triangles of every pair of leaves found by tekFindLeafPairs(), and create a manifold for each pair that is colliding.
+ * @param leaf_pairs The vector containing the pairs of leaves to check.
+ * @param collision Flag that is set to 1 if any of the pairs were colliding, 0 if not.
+ * @param manifold_vector The vector to add the manifolds to. Will not empty the vector.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+static exception tekCheckLeafPairs(const Vector* leaf_pairs, flag* collision, Vector* manifold_vector) {
+    *collision = 0;
+    for (uint i = 0; i < leaf_pairs->length; i++) {
+        const struct TekLeafPair* leaf_pair;
+        tekChainThrow(vectorGetItemPtr(leaf_pairs, i, &leaf_pair));
+        TekColliderNode* node_a = leaf_pair->leaves[LEFT];
+        TekColliderNode* node_b = leaf_pair->leaves[RIGHT];
+
+        // need to create a collision manifold if there is a collision
+        flag sub_collision = 0;
+        TekCollisionManifold manifold;
+        tekChainThrow(tekCheckTrianglesCollision(
+            node_a->data.leaf.w_vertices, node_a->data.leaf.num_vertices / 3,
+            node_b->data.leaf.w_vertices, node_b->data.leaf.num_vertices / 3,
+            &sub_collision, &manifold
+            ));
+        if (!sub_collision) continue;
+
+        manifold.bodies[0] = leaf_pair->bodies[LEFT];
+        manifold.bodies[1] = leaf_pair->bodies[RIGHT];
+
+        flag contained;
+        tekChainThrow(tekDoesManifoldContainContacts(manifold_vector, &manifold, &contained));
+        if (!contained && manifold.penetration_depth > EPSILON) tekChainThrow(vectorAddItem(manifold_vector, &manifold));
+        *collision = 1;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * Get the collision manifolds releating to the two bodies, and add them to a provided vector. Gives information such as contact position, depth, normals, tangent vectors etc.
+ * @param store The body store containing the transforms of both bodies.
+ * @param body_a The first body involved in the potential collision.
+ * @param body_b The second body involved.
+ * @param collision Flag that is set to 1 if there was a collision, 0 if not.
+ * @param manifold_vector The vector containing all the manifolds that will be produced. Will not empty the vector, so the same vector can be used to collect all the manifolds of an entire colliding system / scenario.
+ * @throws FAILURE if collider buffer not initialised.
+ */
+exception tekGetCollisionManifolds(const TekBodyStore* store, TekBody* body_a, TekBody* body_b, flag* collision, Vector* manifold_vector) {
+    // we need a collider buffer to store pairs of nodes. if not initialised, cannot continue
+    *collision = 0;
+    if (collider_init == DE_INITIALISED) return SUCCESS;
+    if (collider_init == NOT_INITIALISED) tekThrow(FAILURE, "Collider buffer was never initialised.");
+
+    tekTraceBegin("tekGetCollisionManifolds");
+    leaf_pair_buffer.length = 0;
+    tekChainThrowThen(tekFindLeafPairs(store, body_a, body_b, &leaf_pair_buffer), tekTraceEnd("tekGetCollisionManifolds"));
+    tekChainThrowThen(tekCheckLeafPairs(&leaf_pair_buffer, collision, manifold_vector), tekTraceEnd("tekGetCollisionManifolds"));
+    tekTraceEnd("tekGetCollisionManifolds");
+    return SUCCESS;
+}
+
 /**
  * Create an inverse mass matrix, kinda a 12x12 matrix, 0,1 = body a inverse mass + inverse inertia tensor, 2,3 = body b ...
+ * @param store The body store containing the mass data of both bodies.
  * @param body_a The first body being collided.
  * @param body_b The second body being collected.
  * @param inv_mass_matrix[4] The outputted inverse inertia matrix.
  */
-static void tekSetupInvMassMatrix(TekBody* body_a, TekBody* body_b, mat3 inv_mass_matrix[4]) {
+static void tekSetupInvMassMatrix(const TekBodyStore* store, const TekBody* body_a, const TekBody* body_b, mat3 inv_mass_matrix[4]) {
     // if the body is immovable, we can say it has an infinite mass.
     // the inverse mass matrix is 1/infinity, which tends to 0
     // so we can just zero out both matrices.
-    if (body_a->immovable) {
+    if (store->flags[body_a->id] & BODY_FLAG_IMMOVABLE) {
         glm_mat3_zero(inv_mass_matrix[0]);
         glm_mat3_zero(inv_mass_matrix[1]);
     // otherwise, calculate the actual matrices.
     } else {
         glm_mat3_identity(inv_mass_matrix[0]);
-        glm_mat3_scale(inv_mass_matrix[0], 1.0f / body_a->mass);
-        glm_mat3_copy(body_a->inverse_inertia_tensor, inv_mass_matrix[1]);
+        glm_mat3_scale(inv_mass_matrix[0], store->inverse_masses[body_a->id]);
+        glm_mat3_copy(store->world_inverse_inertia_tensors[body_a->id], inv_mass_matrix[1]);
     }
 
     // repeat for body b
-    if (body_b->immovable) {
+    if (store->flags[body_b->id] & BODY_FLAG_IMMOVABLE) {
         glm_mat3_zero(inv_mass_matrix[2]);
         glm_mat3_zero(inv_mass_matrix[3]);
     } else {
         glm_mat3_identity(inv_mass_matrix[2]);
-        glm_mat3_scale(inv_mass_matrix[2], 1.0f / body_b->mass);
-        glm_mat3_copy(body_b->inverse_inertia_tensor, inv_mass_matrix[3]);
+        glm_mat3_scale(inv_mass_matrix[2], store->inverse_masses[body_b->id]);
+        glm_mat3_copy(store->world_inverse_inertia_tensors[body_b->id], inv_mass_matrix[3]);
     }
 }
 
 /**
  * Apply collision between two bodies, based on the contact manifold between them.
+ * @param store The body store containing the velocities of both bodies.
  * @param body_a The first body that is colliding
  * @param body_b The second body that is colliding
  * @param manifold The contact manifold between the bodies
  * @throws SUCCESS nothing throws an exception.
  */
-exception tekApplyCollision(TekBody* body_a, TekBody* body_b, TekCollisionManifold* manifold) {
+exception tekApplyCollision(const TekBodyStore* store, TekBody* body_a, TekBody* body_b, TekCollisionManifold* manifold) {
     vec3 constraints[NUM_CONSTRAINTS][4];
     mat3 inv_mass_matrix[4];
-    tekSetupInvMassMatrix(body_a, body_b, inv_mass_matrix);
+    tekSetupInvMassMatrix(store, body_a, body_b, inv_mass_matrix);
+
+    float* velocity_a = store->velocities[body_a->id];
+    float* angular_velocity_a = store->angular_velocities[body_a->id];
+    float* velocity_b = store->velocities[body_b->id];
+    float* angular_velocity_b = store->angular_velocities[body_b->id];
 
     const float friction = fmaxf(body_a->friction, body_b->friction);
 
@@ -1649,10 +1732,10 @@ exception tekApplyCollision(TekBody* body_a, TekBody* body_b, TekCollisionManifo
         }
 
         float lambda_n = 0.0f; // numerator
-        lambda_n -= glm_vec3_dot(constraints[c][0], body_a->velocity);
-        lambda_n -= glm_vec3_dot(constraints[c][1], body_a->angular_velocity);
-        lambda_n -= glm_vec3_dot(constraints[c][2], body_b->velocity);
-        lambda_n -= glm_vec3_dot(constraints[c][3], body_b->angular_velocity);
+        lambda_n -= glm_vec3_dot(constraints[c][0], velocity_a);
+        lambda_n -= glm_vec3_dot(constraints[c][1], angular_velocity_a);
+        lambda_n -= glm_vec3_dot(constraints[c][2], velocity_b);
+        lambda_n -= glm_vec3_dot(constraints[c][3], angular_velocity_b);
         if (c == NORMAL_CONSTRAINT) {
             lambda_n -= manifold->baumgarte_stabilisation;
         }
@@ -1683,67 +1766,131 @@ exception tekApplyCollision(TekBody* body_a, TekBody* body_b, TekCollisionManifo
         }
 
         // if body is immovable, then do not apply the change
-        if (!body_a->immovable) {
-            glm_vec3_add(body_a->velocity, delta_v[0], body_a->velocity);
-            glm_vec3_add(body_a->angular_velocity, delta_v[1], body_a->angular_velocity);
+        if (!(store->flags[body_a->id] & BODY_FLAG_IMMOVABLE)) {
+            glm_vec3_add(velocity_a, delta_v[0], velocity_a);
+            glm_vec3_add(angular_velocity_a, delta_v[1], angular_velocity_a);
         }
-        if (!body_b->immovable) {
-            glm_vec3_add(body_b->velocity, delta_v[2], body_b->velocity);
-            glm_vec3_add(body_b->angular_velocity, delta_v[3], body_b->angular_velocity);
+        if (!(store->flags[body_b->id] & BODY_FLAG_IMMOVABLE)) {
+            glm_vec3_add(velocity_b, delta_v[2], velocity_b);
+            glm_vec3_add(angular_velocity_b, delta_v[3], angular_velocity_b);
         }
     }
 
     return SUCCESS;
 }
 
+/**
+ * Return early from a qsort comparison function if two values are not equal, ascending order.
+ */
+#define tekCompareValue(a, b) if ((a) < (b)) return -1; if ((a) > (b)) return 1
+
+/**
+ * Comparison function used to sort the contact buffer into an order that only depends on the state of the bodies.
+ * @note Sorts by the ids of the bodies, then the position of the contact points, then the normal and depth. Never uses the address of anything, so the order doesn't change between runs.
+ * @param a A pointer to the first manifold.
+ * @param b A pointer to the second manifold.
+ * @return A negative number if a should come first, positive if b should come first, 0 if they are the same.
+ */
+static int tekCompareManifolds(const void* a, const void* b) {
+    const TekCollisionManifold* manifold_a = a;
+    const TekCollisionManifold* manifold_b = b;
+    for (uint i = 0; i < 2; i++) {
+        tekCompareValue(manifold_a->bodies[i]->id, manifold_b->bodies[i]->id);
+    }
+    for (uint i = 0; i < 2; i++) {
+        for (uint j = 0; j < 3; j++) {
+            tekCompareValue(manifold_a->contact_points[i][j], manifold_b->contact_points[i][j]);
+        }
+    }
+    for (uint j = 0; j < 3; j++) {
+        tekCompareValue(manifold_a->contact_normal[j], manifold_b->contact_normal[j]);
+    }
+    tekCompareValue(manifold_a->penetration_depth, manifold_b->penetration_depth);
+    return 0;
+}
+
 /**
  * Decide which bodies are colliding and apply impulses to seperate any colliding bodies.
  * @param bodies The vector containing all the bodies.
+ * @param store The body store containing the state of all the bodies.
  * @param phys_period The time period of the simulation.
+ * @param max_penetration Where to write the deepest penetration out of all the contacts found, 0 if there were none.
+ * @param profiler The profiler to add the time spent in each phase to. Can be null.
  * @throws FAILURE if contact buffer was not initialised.
  */
-exception tekSolveCollisions(const Vector* bodies, const float phys_period) {
+exception tekSolveCollisions(const Vector* bodies, const TekBodyStore* store, const float phys_period, float* max_penetration, TekProfiler* profiler) {
+    *max_penetration = 0.0f;
     if (collider_init == DE_INITIALISED) return SUCCESS;
     if (collider_init == NOT_INITIALISED) tekThrow(FAILURE, "Contact buffer was never initialised.");
 
+    tekTraceBegin("tekSolveCollisions");
     contact_buffer.length = 0;
+    leaf_pair_buffer.length = 0;
+    long long phase_start = tekProfilerStart(profiler);
 
     // loop through all pairs of bodies
     for (uint i = 0; i < bodies->length; i++) {
         TekBody* body_i;
-        tekChainThrow(vectorGetItemPtr(bodies, i, &body_i));
+        tekChainThrowThen(vectorGetItemPtr(bodies, i, &body_i), tekTraceEnd("tekSolveCollisions"));
         if (!body_i->num_vertices) continue;
         for (uint j = 0; j < i; j++) {
             TekBody* body_j;
-            tekChainThrow(vectorGetItemPtr(bodies, j, &body_j));
+            tekChainThrowThen(vectorGetItemPtr(bodies, j, &body_j), tekTraceEnd("tekSolveCollisions"));
             if (!body_j->num_vertices) continue;
 
             // if both immovable, they will be unaffected by whatever response happens.
-            if (body_i->immovable && body_j->immovable) continue;
-
-            // find contact points and add to the contact buffer
-            flag is_collision = 0;
-            tekChainThrow(tekGetCollisionManifolds(body_i, body_j, &is_collision, &contact_buffer))
+            if ((store->flags[i] & BODY_FLAG_IMMOVABLE) && (store->flags[j] & BODY_FLAG_IMMOVABLE)) continue;
+
+            // find the leaves that might be touching, the triangles are all checked afterwards
+            tekTraceBegin("tekFindLeafPairs");
+            tekChainThrowThen(tekFindLeafPairs(store, body_i, body_j, &leaf_pair_buffer), {
+                tekTraceEnd("tekFindLeafPairs");
+                tekTraceEnd("tekSolveCollisions");
+            });
+            tekTraceEnd("tekFindLeafPairs");
         }
     }
+    tekProfilerLap(profiler, PROFILE_BROADPHASE, &phase_start);
+
+    // find contact points and add to the contact buffer
+    flag is_collision;
+    tekTraceBegin("tekCheckLeafPairs");
+    tekChainThrowThen(tekCheckLeafPairs(&leaf_pair_buffer, &is_collision, &contact_buffer), {
+        tekTraceEnd("tekCheckLeafPairs");
+        tekTraceEnd("tekSolveCollisions");
+    });
+    tekTraceEnd("tekCheckLeafPairs");
+    tekProfilerLap(profiler, PROFILE_NARROWPHASE, &phase_start);
+
+    // the order that contacts are found in depends on how the collider trees are walked, sort them so that the
+    // impulses are always applied in the same order.
+    if (store->deterministic && contact_buffer.length > 1)
+        qsort(contact_buffer.internal, contact_buffer.length, sizeof(TekCollisionManifold), tekCompareManifolds);
 
     // now loop through all contacts between bodies
+    tekTraceBegin("contact prep");
     for (uint i = 0; i < contact_buffer.length; i++) {
         // get both bodies
         TekCollisionManifold* manifold;
-        tekChainThrow(vectorGetItemPtr(&contact_buffer, i, &manifold));
+        tekChainThrowThen(vectorGetItemPtr(&contact_buffer, i, &manifold), {
+            tekTraceEnd("contact prep");
+            tekTraceEnd("tekSolveCollisions");
+        });
 
         TekBody* body_a = manifold->bodies[0], * body_b = manifold->bodies[1];
 
         // get centres of both bodies
         // previously, i forgot that centre of mass != centre, led to 24 (ish) hours of bug fixing LOL
         vec3 centre_a, centre_b;
-        glm_vec3_add(body_a->position, body_a->centre_of_mass, centre_a);
-        glm_vec3_add(body_b->position, body_b->centre_of_mass, centre_b);
+        glm_vec3_add(store->positions[body_a->id], body_a->centre_of_mass, centre_a);
+        glm_vec3_add(store->positions[body_b->id], body_b->centre_of_mass, centre_b);
 
         vec3 ab;
         glm_vec3_sub(centre_b, centre_a, ab);
 
+        // keep track of how deep things are getting, the engine uses it to decide on the time step
+        *max_penetration = fmaxf(*max_penetration, manifold->penetration_depth);
+
         // baumgarte stabilisation = stabilising force to prevent jitter
         manifold->baumgarte_stabilisation = -BAUMGARTE_BETA / phys_period * fmaxf(manifold->penetration_depth - SLOP, 0.0f);
         float restitution = fminf(body_a->restitution, body_b->restitution);
@@ -1753,11 +1900,11 @@ exception tekSolveCollisions(const Vector* bodies, const float phys_period) {
         glm_vec3_sub(manifold->contact_points[1], centre_b, manifold->r_bc);
 
         vec3 delta_v;
-        glm_vec3_sub(body_b->velocity, body_a->velocity, delta_v);
+        glm_vec3_sub(store->velocities[body_b->id], store->velocities[body_a->id], delta_v);
 
         vec3 rw_a, rw_b;
-        glm_vec3_cross(body_a->angular_velocity, manifold->r_ac, rw_a);
-        glm_vec3_cross(body_b->angular_velocity, manifold->r_bc, rw_b);
+        glm_vec3_cross(store->angular_velocities[body_a->id], manifold->r_ac, rw_a);
+        glm_vec3_cross(store->angular_velocities[body_b->id], manifold->r_bc, rw_b);
         glm_vec3_negate(rw_a);
 
         vec3 restitution_vector;
@@ -1767,16 +1914,28 @@ exception tekSolveCollisions(const Vector* bodies, const float phys_period) {
 
         manifold->baumgarte_stabilisation += restitution;
     }
+    tekTraceEnd("contact prep");
+    tekProfilerLap(profiler, PROFILE_CONTACT_PREP, &phase_start);
 
     // iterative solver step -> repeat NUM_ITERATIONS time
     // through the iterations, the change in velocity to seperate approaches global solution
     for (uint s = 0; s < NUM_ITERATIONS; s++) {
+        tekTraceBegin("tekApplyCollision batch");
         for (uint i = 0; i < contact_buffer.length; i++) {
             TekCollisionManifold* manifold;
-            tekChainThrow(vectorGetItemPtr(&contact_buffer, i, &manifold));
-            tekChainThrow(tekApplyCollision(manifold->bodies[0], manifold->bodies[1], manifold));
+            tekChainThrowThen(vectorGetItemPtr(&contact_buffer, i, &manifold), {
+                tekTraceEnd("tekApplyCollision batch");
+                tekTraceEnd("tekSolveCollisions");
+            });
+            tekChainThrowThen(tekApplyCollision(store, manifold->bodies[0], manifold->bodies[1], manifold), {
+                tekTraceEnd("tekApplyCollision batch");
+                tekTraceEnd("tekSolveCollisions");
+            });
         }
+        tekTraceEnd("tekApplyCollision batch");
     }
+    tekProfilerLap(profiler, PROFILE_SOLVER, &phase_start);
 
+    tekTraceEnd("tekSolveCollisions");
     return SUCCESS;
 }
@@ -6,6 +6,7 @@
 #include "../core/exception.h"
 #include "../core/vector.h"
 #include "body.h"
+#include "profiler.h"
 
 #define NORMAL_CONSTRAINT 0
 #define TANGENT_CONSTRAINT_1 1
@@ -32,6 +33,6 @@ typedef struct TekCollisionManifold {
 } TekCollisionManifold;
 
 int tekTriangleTest();
-exception tekGetCollisionManifolds(TekBody* body_a, TekBody* body_b, flag* collision, Vector* manifold_vector);
-exception tekApplyCollision(TekBody* body_a, TekBody* body_b, TekCollisionManifold* manifold);
-exception tekSolveCollisions(const Vector* bodies, float phys_period);
\ No newline at end of file
+exception tekGetCollisionManifolds(const TekBodyStore* store, TekBody* body_a, TekBody* body_b, flag* collision, Vector* manifold_vector);
+exception tekApplyCollision(const TekBodyStore* store, TekBody* body_a, TekBody* body_b, TekCollisionManifold* manifold);
+exception tekSolveCollisions(const Vector* bodies, const TekBodyStore* store, float phys_period, float* max_penetration, TekProfiler* profiler);
\ No newline at end of file
@@ -15,18 +15,19 @@
 #include "collider.h"
 #include "../core/vector.h"
 #include "../core/queue.h"
+#include "../core/stringtable.h"
+#include "../core/trace.h"
 #include "GLFW/glfw3.h"
 #include "collisions.h"
 
+#define THREAD_PRINT_MAX_LENGTH 256 // longest message that can be sent with tprint, including the null terminator
+
 /**
  * Template for generating receive functions for thread queues.
  */
 #define RECV_FUNC(func_name, func_type, param_name) \
 exception func_name(ThreadQueue* queue, func_type* param_name) { \
-    func_type* copy; \
-    if (!threadQueueDequeue(queue, &copy)) return FAILURE; \
-    memcpy(param_name, copy, sizeof(func_type)); \
-    free(copy); \
+    if (!threadQueueDequeue(queue, param_name)) return FAILURE; \
     return SUCCESS; \
 } \
 
@@ -35,7 +36,7 @@ exception func_name(ThreadQueue* queue, func_type* param_name) { \
  * @note Requires the event struct to exist already
  * @param queue A pointer to the thread queue to recieve from.
  * @param event A pointer to an empty TekEvent struct.
- * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FAILURE if the queue is empty.
  */
 static RECV_FUNC(recvEvent, TekEvent, event);
 
@@ -44,7 +45,7 @@ static RECV_FUNC(recvEvent, TekEvent, event);
  * @note Requires the state struct to exist already.
  * @param queue A pointer to the thread queue to recieve from.
  * @param state A pointer to an empty TekState struct.
- * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FAILURE if the queue is empty.
  */
 RECV_FUNC(recvState, TekState, state);
 
@@ -53,10 +54,7 @@ RECV_FUNC(recvState, TekState, state);
  */
 #define PUSH_FUNC(func_name, func_type, param_name) \
 exception func_name(ThreadQueue* queue, const func_type param_name) { \
-    func_type* copy = (func_type*)malloc(sizeof(func_type)); \
-    if (!copy) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for thread queue"); \
-    memcpy(copy, &param_name, sizeof(func_type)); \
-    if (!threadQueueEnqueue(queue, copy)) return FAILURE; \
+    if (!threadQueueEnqueue(queue, &param_name)) return FAILURE; \
     return SUCCESS; \
 } \
 
@@ -64,15 +62,28 @@ exception func_name(ThreadQueue* queue, const func_type param_name) { \
  * @brief Push a state to the thread queue.
  * @param queue A pointer to the thread queue to push to.
  * @param state A pointer to the state struct to push.
- * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FAILURE if the queue is full.
  */
 static PUSH_FUNC(pushState, TekState, state);
 
+/**
+ * @brief Push a state to the thread queue with a key, so that if the queue is overflowing it replaces any older state with the same key.
+ * @param queue A pointer to the thread queue to push to.
+ * @param state The state to push.
+ * @param key The key of the state, states with the same key will be coalesced.
+ * @throws FAILURE if the queue is full.
+ */
+static exception pushStateKeyed(ThreadQueue* queue, const TekState state, const uint key) {
+    if (!threadQueueEnqueueKeyed(queue, &state, key)) return FAILURE;
+    return SUCCESS;
+}
+
 /**
  * @brief Push an event to the thread queue.
+ * @note Any strings in the event should be interned, as they might not be read until long after the event was pushed.
  * @param queue A pointer to the thread queue to push to.
  * @param event A pointer to the event to push.
- * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FAILURE if the queue is full.
  */
 PUSH_FUNC(pushEvent, TekEvent, event);
 
@@ -91,43 +102,43 @@ static exception func_name(ThreadQueue* state_queue, const vec3 param_name) { \
 /**
  * @brief Send a print message through the state queue.
  * @param state_queue The state queue to send the message through.
+ * @param strings The string table to intern the message in.
  * @param format The message to send + formatting e.g. "string: %s"
  * @param ... The formatting to add to the string
  */
-static void threadPrint(ThreadQueue* state_queue, const char* format, ...) {
-    char temp_write;
+static void threadPrint(ThreadQueue* state_queue, StringTable* strings, const char* format, ...) {
+    char buffer[THREAD_PRINT_MAX_LENGTH];
     va_list va;
 
     va_start(va, format);
-    const int len_message = vsnprintf(&temp_write, 0, format, va); // figure out the length of message
+    vsnprintf(buffer, sizeof(buffer), format, va);
     va_end(va);
 
-    char* buffer = (char*)malloc(len_message * sizeof(char)); // create buffer big enough
-    if (!buffer) return;
-
-    va_start(va, format);
-    vsprintf(buffer, format, va);
-    va_end(va);
+    // interned so that the message can be sent as a pointer, and stays around until the graphics thread gets it
+    const char* message;
+    if (stringTableIntern(strings, buffer, &message) != SUCCESS) return;
 
     // send message across
     TekState message_state = {};
     message_state.type = MESSAGE_STATE;
     message_state.object_id = 0;
-    message_state.data.message = buffer;
+    message_state.data.message = message;
     pushState(state_queue, message_state);
 }
 
 /**
  * Send print message through state queue. Acts like normal printf()
  */
-#define tprint(format, ...) threadPrint(state_queue, format, __VA_ARGS__)
+#define tprint(format, ...) threadPrint(state_queue, strings, format, __VA_ARGS__)
 
 /**
  * @brief Send an exception message to the state queue.
+ * @note Exceptions are per thread, so the message is sent along with the code for the graphics thread to report.
  * @param state_queue The state queue to send the exception to.
+ * @param strings The string table to intern the message in.
  * @param exception The exception code.
  */
-static void threadExcept(ThreadQueue* state_queue, const uint exception) {
+static void threadExcept(ThreadQueue* state_queue, StringTable* strings, const uint exception) {
     // create state
     TekState exception_state = {};
     tekPrintException();
@@ -135,7 +146,9 @@ static void threadExcept(ThreadQueue* state_queue, const uint exception) {
     // fill with data
     exception_state.type = EXCEPTION_STATE;
     exception_state.object_id = 0;
-    exception_state.data.exception = exception;
+    exception_state.data.exception.code = exception;
+    if (stringTableIntern(strings, tekGetException(), &exception_state.data.exception.message) != SUCCESS)
+        exception_state.data.exception.message = 0;
 
     // push to state queue
     pushState(state_queue, exception_state);
@@ -143,48 +156,52 @@ static void threadExcept(ThreadQueue* state_queue, const uint exception) {
 
 #define tekEngineCreateBodyCleanup \
     tekDeleteBody(&body); \
-    if (mesh_copy) free(mesh_copy); \
-    if (material_copy) free(material_copy) \
+    tekBodyStoreClearSlot(store, object_id) \
+
+/**
+ * Take a body back out of the bodies vector after it has been added, e.g. if the graphics thread couldn't be told about it.
+ * @param bodies The vector containing the bodies.
+ * @param store The body store containing the body.
+ * @param object_id The ID of the body to remove.
+ * @param body The body that was added, which is deleted.
+ */
+static void tekEngineRemoveCreatedBody(const Vector* bodies, TekBodyStore* store, const uint object_id, TekBody* body) {
+    // leave an empty body behind, same as deleting a body does
+    TekBody* stored_body;
+    if (object_id < bodies->length && vectorGetItemPtr(bodies, object_id, (void**)&stored_body) == SUCCESS)
+        memset(stored_body, 0, sizeof(TekBody));
+    tekDeleteBody(body);
+    tekBodyStoreClearSlot(store, object_id);
+}
 
 /**
  * @brief Create a body given the mesh, material, position etc.
  * @note Will create both a body and a corresponding entity on the graphics thread. The object ids are assigned in order, filling gaps in the order when they appear.
  * @param state_queue The ThreadQueue that will be used to send the entity creation message to the graphics thread.
  * @param bodies A pointer to a vector that contains the bodies.
+ * @param store The body store that will contain the position, velocity etc. of the body.
  * @param object_id The ID of the new body to create.
- * @param mesh_filename The file that contains the mesh for the object.
- * @param material_filename The file that contains the material for the object. Only used in the graphics thread.
+ * @param mesh_filename The file that contains the mesh for the object. Should be interned, as it is passed on to the graphics thread.
+ * @param material_filename The file that contains the material for the object. Only used in the graphics thread, so should also be interned.
  * @param mass The mass of the body.
  * @param friction The coefficient of friction.
  * @param restitution The coefficient of restitution.
  * @param position The position of the body in the world.
  * @param rotation The rotation of the body as a quaternion.
  * @param scale The scale in x, y, and z direction from the original shape of the body.
+ * @param sequence The sequence number of the creation, used by the graphics thread to put it in order with the pose frames.
  * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FAILURE if the state queue is full, in which case the body is not created.
  */
-static exception tekEngineCreateBody(ThreadQueue* state_queue, Vector* bodies, const uint object_id, const char* mesh_filename, const char* material_filename, const float mass, const float friction, const float restitution, vec3 position, vec4 rotation, vec3 scale) {
+static exception tekEngineCreateBody(ThreadQueue* state_queue, Vector* bodies, TekBodyStore* store, const uint object_id, const char* mesh_filename, const char* material_filename, const float mass, const float friction, const float restitution, vec3 position, vec4 rotation, vec3 scale, const uint sequence) {
+    // make sure there is a slot in the store for this id
+    tekChainThrow(tekBodyStoreReserve(store, object_id + 1));
+
     // create the body
     TekBody body = {};
-    tekChainThrow(tekCreateBody(mesh_filename, mass, friction, restitution, position, rotation, scale, &body));
-
-    // copy mesh and material files to new strings
-    const uint len_mesh = strlen(mesh_filename) + 1;
-    const uint len_material = strlen(material_filename) + 1;
-    char* mesh_copy = (char*)malloc(len_mesh);
-    char* material_copy = 0;
-    if (!mesh_copy) tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory to copy mesh filename.", {
-        tekEngineCreateBodyCleanup;
-    });
-    material_copy = (char*)malloc(len_material);
-    if (!material_copy) tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory to copy material filename.", {
-        tekEngineCreateBodyCleanup;
+    tekChainThrowThen(tekCreateBody(mesh_filename, mass, friction, restitution, position, rotation, scale, store, object_id, &body), {
+        tekBodyStoreClearSlot(store, object_id);
     });
-    memcpy(mesh_copy, mesh_filename, len_mesh);
-    memcpy(material_copy, material_filename, len_material);
-
-    // create the state
-    TekState state = {};
-    state.object_id = object_id;
 
     // if body id is greater than current length of the vector
     // add a load of empty bodies before adding the real one
@@ -213,46 +230,69 @@ static exception tekEngineCreateBody(ThreadQueue* state_queue, Vector* bodies, c
         });
     }
 
-    // finish the state and push it to the state queue
-    state.type = ENTITY_CREATE_STATE;
-    state.data.entity.mesh_filename = mesh_filename;
-    state.data.entity.material_filename = material_filename;
-    glm_vec3_copy(position, state.data.entity.position);
-    glm_vec4_copy(rotation, state.data.entity.rotation);
-    glm_vec3_copy(scale, state.data.entity.scale);
+    // write the state straight into the state queue.
+    // the filenames are interned, so they will still be around when the graphics thread reads them
+    // if it can't be sent, the body comes back out so there is never a body without an entity
+    TekState* state = (TekState*)threadQueueReserve(state_queue);
+    if (!state) tekThrowThen(FAILURE, "State queue is full.", tekEngineRemoveCreatedBody(bodies, store, object_id, &body));
+    memset(state, 0, sizeof(TekState));
+    state->type = ENTITY_CREATE_STATE;
+    state->object_id = object_id;
+    state->sequence = sequence;
+    state->data.entity.mesh_filename = mesh_filename;
+    state->data.entity.material_filename = material_filename;
+    glm_vec3_copy(position, state->data.entity.position);
+    glm_vec4_copy(rotation, state->data.entity.rotation);
+    glm_vec3_copy(scale, state->data.entity.scale);
+    if (!threadQueueCommit(state_queue))
+        tekThrowThen(FAILURE, "State queue is full.", tekEngineRemoveCreatedBody(bodies, store, object_id, &body));
 
-    pushState(state_queue, state);
+    return SUCCESS;
+}
 
+/**
+ * @brief Write the pose of every body into the pose buffer and publish it to the graphics thread.
+ * @note Copies whole arrays out of the body store, so there is no per-body work or allocation. Empty slots are copied too, the graphics thread can tell them apart using the flags.
+ * @param pose_buffer The pose buffer shared with the graphics thread.
+ * @param store The body store containing the current and previous pose of every body.
+ * @param alpha How far between the previous and current step the bodies should be drawn, 0 = previous, 1 = current.
+ * @param sequence The number of creates and deletes that have been sent so far.
+ * @throws MEMORY_EXCEPTION if the pose buffer could not grow.
+ */
+static exception tekEnginePublishPoses(TekPoseBuffer* pose_buffer, const TekBodyStore* store, const float alpha, const uint sequence) {
+    TekPoseFrame* frame;
+    tekChainThrow(tekPoseBufferBeginWrite(pose_buffer, store->length, &frame));
+    memcpy(frame->positions, store->positions, store->length * sizeof(vec3));
+    memcpy(frame->rotations, store->rotations, store->length * sizeof(vec4));
+    memcpy(frame->previous_positions, store->previous_positions, store->length * sizeof(vec3));
+    memcpy(frame->previous_rotations, store->previous_rotations, store->length * sizeof(vec4));
+    memcpy(frame->flags, store->flags, store->length * sizeof(flag));
+    frame->alpha = alpha;
+    frame->sequence = sequence;
+    tekPoseBufferPublish(pose_buffer);
     return SUCCESS;
 }
 
 /**
- * @brief Update the position and rotation of a body given its object id.
- * @param state_queue The ThreadQueue that links to the graphics thread.
+ * @brief Advance the simulation by a single fixed step.
  * @param bodies A pointer to a vector containing the bodies.
- * @param object_id The object id of the body to update.
- * @param position The new position of the body.
- * @param rotation The new rotation of the body as a quaternion.
- * @param scale The new scale of the body.
- * @throws ENGINE_EXCEPTION if the object id is invalid.
+ * @param store The body store containing the state of all bodies.
+ * @param phys_period The length of the step in seconds.
+ * @param gravity The downwards acceleration due to gravity.
+ * @param max_penetration Where to write the deepest penetration between two bodies during this step.
+ * @param profiler The profiler to add the time spent in each phase of the step to.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
  */
-static exception tekEngineUpdateBody(ThreadQueue* state_queue, const Vector* bodies, const uint object_id, vec3 position, vec4 rotation, vec3 scale) {
-    TekBody* body;
-    tekChainThrow(vectorGetItemPtr(bodies, object_id, &body));
-    if (body->num_vertices == 0) {
-        // if the number of vertices == 0, then body is not valid
-        // most likely, the whole thing is just zeroes
-        tekThrow(ENGINE_EXCEPTION, "Body ID is not valid.");
-    }
-
-    TekState state = {};
-    state.type = ENTITY_UPDATE_STATE;
-    state.object_id = object_id;
-    glm_vec3_copy(position, state.data.entity_update.position);
-    glm_vec4_copy(rotation, state.data.entity_update.rotation);
-    glm_vec3_copy(scale, state.data.entity_update.scale);
-
-    tekChainThrow(pushState(state_queue, state));
+static exception tekEngineStep(const Vector* bodies, const TekBodyStore* store, const double phys_period, const float gravity, float* max_penetration, TekProfiler* profiler) {
+    // check and fix collisions
+    tekChainThrow(tekSolveCollisions(bodies, store, (float)phys_period, max_penetration, profiler));
+
+    // move every body at once, immovable bodies and null bodies are handled by the store
+    long long integrate_start = tekProfilerStart(profiler);
+    tekTraceBegin("tekBodyAdvanceTime");
+    tekBodyAdvanceTime(store, (float)phys_period, gravity);
+    tekTraceEnd("tekBodyAdvanceTime");
+    tekProfilerLap(profiler, PROFILE_INTEGRATE, &integrate_start);
     return SUCCESS;
 }
 
@@ -260,10 +300,12 @@ static exception tekEngineUpdateBody(ThreadQueue* state_queue, const Vector* bod
  * @brief Delete a body, freeing the object id for reuse and removing the counterpart on the graphics thread.
  * @param state_queue The ThreadQueue linking to the graphics thread.
  * @param bodies A vector containing the bodies.
+ * @param store The body store containing the state of the body.
  * @param object_id The id of the body to delete.
+ * @param sequence The sequence number of the deletion, used by the graphics thread to put it in order with the pose frames.
  * @throws ENGINE_EXCEPTION if the object id is invalid.
  */
-static exception tekEngineDeleteBody(ThreadQueue* state_queue, const Vector* bodies, const uint object_id) {
+static exception tekEngineDeleteBody(ThreadQueue* state_queue, const Vector* bodies, const TekBodyStore* store, const uint object_id, const uint sequence) {
     TekBody* body;
     tekChainThrow(vectorGetItemPtr(bodies, object_id, &body));
     if (body->num_vertices == 0) {
@@ -272,16 +314,20 @@ static exception tekEngineDeleteBody(ThreadQueue* state_queue, const Vector* bod
         tekThrow(ENGINE_EXCEPTION, "Body ID is not valid.");
     }
 
-    TekState state = {};
-    state.object_id = object_id;
-    state.type = ENTITY_DELETE_STATE;
-    tekChainThrow(pushState(state_queue, state));
+    TekState* state = (TekState*)threadQueueReserve(state_queue);
+    if (!state) tekThrow(FAILURE, "State queue is full.");
+    memset(state, 0, sizeof(TekState));
+    state->type = ENTITY_DELETE_STATE;
+    state->object_id = object_id;
+    state->sequence = sequence;
+    if (!threadQueueCommit(state_queue)) tekThrow(FAILURE, "State queue is full.");
 
     // set the data stored to be zeroes
     // removing the body would change the index of other bodies
     // index needed to find object by id.
     tekDeleteBody(body);
     memset(body, 0, sizeof(TekBody));
+    tekBodyStoreClearSlot(store, object_id);
     return SUCCESS;
 }
 
@@ -289,16 +335,18 @@ static exception tekEngineDeleteBody(ThreadQueue* state_queue, const Vector* bod
  * Delete all non null bodies in the bodies vector.
  * @param state_queue The thread queue of the simulation that sends states.
  * @param bodies The vector containing all bodies in the simulation.
+ * @param store The body store containing the state of all bodies.
+ * @param sequence The sequence number of the last create or delete, incremented for each body that is deleted.
  * @throws VECTOR_EXCEPTION .
  */
-static exception tekEngineDeleteAllBodies(ThreadQueue* state_queue, const Vector* bodies) {
+static exception tekEngineDeleteAllBodies(ThreadQueue* state_queue, const Vector* bodies, const TekBodyStore* store, uint* sequence) {
     // loop over bodies
     for (uint i = 0; i < bodies->length; i++) {
         TekBody* body;
         tekChainThrow(vectorGetItemPtr(bodies, i, &body));
         if (body->num_vertices == 0) continue; // num vertices==0 = no body
 
-        tekChainThrow(tekEngineDeleteBody(state_queue, bodies, i));
+        tekChainThrow(tekEngineDeleteBody(state_queue, bodies, store, i, ++(*sequence)));
     }
     return SUCCESS;
 }
@@ -309,9 +357,11 @@ static exception tekEngineDeleteAllBodies(ThreadQueue* state_queue, const Vector
  * @param time The current simulation time.
  * @param position The current position of the body.
  * @param velocity The current rotation of the body.
+ * @param period The time step that the engine is currently using.
+ * @param period_reason Why the engine chose that time step, one of the PERIOD_REASON_* values.
  * @throws MEMORY_EXCEPTION if malloc() fails.
  */
-static exception tekPushInspectState(ThreadQueue* state_queue, const float time, vec3 position, vec3 velocity) {
+static exception tekPushInspectState(ThreadQueue* state_queue, const float time, vec3 position, vec3 velocity, const float period, const flag period_reason) {
     // create a new empty state
     TekState state = {};
 
@@ -320,28 +370,123 @@ static exception tekPushInspectState(ThreadQueue* state_queue, const float time,
     state.data.inspect.time = time;
     glm_vec3_copy(position, state.data.inspect.position);
     glm_vec3_copy(velocity, state.data.inspect.velocity);
+    state.data.inspect.period = period;
+    state.data.inspect.period_reason = period_reason;
 
-    // push to state queue
-    tekChainThrow(pushState(state_queue, state));
+    // push to state queue, only the newest inspect state matters so it can be coalesced.
+    // this happens every frame, so it also moves anything overflowing from last frame into the queue.
+    tekChainThrow(pushStateKeyed(state_queue, state, INSPECT_STATE));
+
+    return SUCCESS;
+}
+
+/**
+ * @brief Send a summary of how long each phase of the recent ticks took to the graphics thread.
+ * @param state_queue The state queue to send the summary through.
+ * @param profiler The profiler to summarise.
+ * @throws FAILURE if the state queue is full.
+ */
+static exception tekPushProfileState(ThreadQueue* state_queue, const TekProfiler* profiler) {
+    TekState state = {};
+    state.type = PROFILE_STATE;
+    tekProfilerGetSummary(profiler, &state.data.profile);
 
+    // same as the inspect state, only the newest summary is worth showing
+    tekChainThrow(pushStateKeyed(state_queue, state, PROFILE_STATE));
     return SUCCESS;
 }
 
+// limits for the adaptive time step
+#define ADAPTIVE_MIN_PERIOD      (1.0 / 960.0)
+#define ADAPTIVE_MAX_PERIOD      (1.0 / 30.0)
+#define ADAPTIVE_MAX_PENETRATION 0.05f // deepest that bodies should sink into each other
+#define ADAPTIVE_BUDGET          0.75  // fraction of each frame that can be spent running steps
+#define ADAPTIVE_SMOOTHING       0.1   // how quickly the measured step cost follows new measurements
+
+// longest time the engine will sleep for while there is nothing to simulate
+#define ENGINE_IDLE_TIMEOUT (BILLION / 2)
+
+// number of ticks between each profile summary sent to the graphics thread, the summary sorts the whole history
+#define PROFILE_SUMMARY_INTERVAL 30
+
+/// State of the adaptive time step, which picks a time step based on how long each step takes and how far bodies are sinking into each other.
+struct TekAdaptivePeriod {
+    flag enabled;
+    double period;
+    double step_cost;
+    flag reason;
+};
+
+/**
+ * @brief Choose the time step for the next frame, based on the cost of the steps and the penetration from the last frame.
+ * @note Penetration is fixed by shrinking the step, but the step will never get so small that the engine cannot keep up with the requested speed. When things settle down, the step drifts back towards the rate chosen by the user.
+ * @param adaptive The adaptive time step state to update.
+ * @param phys_period The time step chosen by the user.
+ * @param frame_period The length of a frame in real time.
+ * @param speed The speed of the simulation relative to real time.
+ * @param max_substeps The most steps that can be run in one frame.
+ * @param step_cost The average wall time taken by each step in the last frame.
+ * @param max_penetration The deepest penetration between two bodies in the last frame.
+ */
+static void tekEngineAdaptPeriod(struct TekAdaptivePeriod* adaptive, const double phys_period, const double frame_period, const double speed, const uint max_substeps, const double step_cost, const float max_penetration) {
+    // smooth out the cost, a single slow step shouldn't cause a big change
+    if (adaptive->step_cost <= 0.0) adaptive->step_cost = step_cost;
+    else adaptive->step_cost += (step_cost - adaptive->step_cost) * ADAPTIVE_SMOOTHING;
+
+    // smallest step that still lets us run at the target speed
+    // steps per frame = speed * frame_period / period, and each one costs step_cost to run
+    const double cost_period = fmax(speed * adaptive->step_cost / ADAPTIVE_BUDGET, speed * frame_period / max_substeps);
+
+    double period = adaptive->period;
+    flag reason = PERIOD_REASON_STEADY;
+    if (max_penetration > ADAPTIVE_MAX_PENETRATION) {
+        // bodies are sinking into each other, take smaller steps
+        period *= 0.5;
+        reason = PERIOD_REASON_PENETRATION;
+    } else if (max_penetration < ADAPTIVE_MAX_PENETRATION * 0.5f) {
+        // things are calm, move back towards the step the user chose
+        const double relaxed_period = fmax(phys_period, cost_period);
+        if (period < relaxed_period) {
+            period = fmin(period * 1.25, relaxed_period);
+            reason = PERIOD_REASON_RELAXING;
+        } else if (period > relaxed_period) {
+            period = fmax(period * 0.8, relaxed_period);
+            reason = PERIOD_REASON_RELAXING;
+        }
+    }
+
+    // never go below the step that we can afford to run
+    if (period < cost_period) {
+        period = cost_period;
+        reason = PERIOD_REASON_TICK_COST;
+    }
+
+    adaptive->period = fmin(fmax(period, ADAPTIVE_MIN_PERIOD), ADAPTIVE_MAX_PERIOD);
+    adaptive->reason = reason;
+}
+
 /// Store the args to link physics thread to graphics thread, so it can be passed as a single pointer to the thread procedure.
 struct TekEngineArgs {
     ThreadQueue* event_queue;
     ThreadQueue* state_queue;
+    TekPoseBuffer* pose_buffer;
+    StringTable* strings;
     double phys_period;
+    double frame_period;
 };
 
 /**
  * Call exception, push exception to state queue and goto cleanup
  */
-#define threadThrow(exception_code, exception_message) { const exception __thread_exception = exception_code; if (__thread_exception) { tekSetException(__thread_exception, __LINE__, __FUNCTION__, __FILE__, exception_message); threadExcept(state_queue, __thread_exception); goto tek_engine_cleanup; } }
+#define threadThrow(exception_code, exception_message) { const exception __thread_exception = exception_code; if (__thread_exception) { tekSetException(__thread_exception, __LINE__, __FUNCTION__, __FILE__, exception_message); threadExcept(state_queue, strings, __thread_exception); goto tek_engine_cleanup; } }
 /**
  * Call an exception, push to state queue and goto cleanup
  */
-#define threadChainThrow(exception_code) { const exception __thread_exception = exception_code; if (__thread_exception) { tekTraceException(__thread_exception, __LINE__, __FUNCTION__, __FILE__); threadExcept(state_queue, __thread_exception); goto tek_engine_cleanup; } }
+#define threadChainThrow(exception_code) { const exception __thread_exception = exception_code; if (__thread_exception) { tekTraceException(__thread_exception, __LINE__, __FUNCTION__, __FILE__); threadExcept(state_queue, strings, __thread_exception); goto tek_engine_cleanup; } }
+/**
+ * Same as threadChainThrow(), but ends a trace marker first so the trace isn't left with a section that never finishes.
+ */
+#define threadChainThrowTraced(exception_code, trace_name) { const exception __thread_exception = exception_code; if (__thread_exception) { tekTraceEnd(trace_name); tekTraceException(__thread_exception, __LINE__, __FUNCTION__, __FILE__); threadExcept(state_queue, strings, __thread_exception); goto tek_engine_cleanup; } }
 
 /**
  * @brief The main physics thread procedure, will run in parallel to the graphics thread. Responsible for logic, has a loop running at fixed time interval.
@@ -352,22 +497,41 @@ static void tekEngine(void* args) {
     const struct TekEngineArgs* engine_args = (struct TekEngineArgs*)args;
     ThreadQueue* event_queue = engine_args->event_queue;
     ThreadQueue* state_queue = engine_args->state_queue;
+    TekPoseBuffer* pose_buffer = engine_args->pose_buffer;
+    StringTable* strings = engine_args->strings;
     double phys_period = engine_args->phys_period;
+    const double frame_period = engine_args->frame_period;
     free(args);
+    tekTraceThread("engine");
 
     // vector to store all the bodies being simulated
     Vector bodies = {};
     threadChainThrow(vectorCreate(0, sizeof(TekBody), &bodies));
 
+    // the state of each body that changes every tick, kept separately so that it is packed together
+    TekBodyStore store = {};
+    threadChainThrow(tekCreateBodyStore(0, &store));
+
     Queue unused_ids = {};
     queueCreate(&unused_ids);
 
     // variables used in the physics loop
-    struct timespec engine_time, step_time;
-    double phys_period_s = floor(phys_period);
-    step_time.tv_sec = (__time_t)phys_period_s;
-    step_time.tv_nsec = (__syscall_slong_t)(1e9 * (phys_period - phys_period_s));
+    // the loop wakes up once per frame, and runs however many fixed steps fit into the time that has passed since last frame
+    struct timespec engine_time, last_time, curr_time, frame_time;
+    const double frame_period_s = floor(frame_period);
+    frame_time.tv_sec = (__time_t)frame_period_s;
+    frame_time.tv_nsec = (__syscall_slong_t)(1e9 * (frame_period - frame_period_s));
     clock_gettime(CLOCK_MONOTONIC, &engine_time);
+    memcpy(&last_time, &engine_time, sizeof(struct timespec));
+    double accumulator = 0.0;
+    float alpha = 1.0f;
+    flag poses_changed = 0;
+    uint entity_sequence = 0;
+    double speed = 1.0;
+    uint max_substeps = DEFAULT_MAX_SUBSTEPS;
+    struct TekAdaptivePeriod adaptive = {};
+    adaptive.period = phys_period;
+    adaptive.reason = PERIOD_REASON_FIXED;
     flag running = 1;
     uint counter = 0;
     flag mode = 0;
@@ -377,13 +541,20 @@ static void tekEngine(void* args) {
     uint inspect_index = 0;
     float time_elapsed = 0.0f;
 
+    // always on, timing each phase only costs a few clock reads per tick
+    TekProfiler profiler;
+    tekCreateProfiler(&profiler);
+
     mat4 snapshot_rotation_matrix;
     vec4 snapshot_rotation_quat;
     TekBody* snapshot_body;
 
     // main loop
     while (running) {
+        long long phase_start = tekProfilerStart(&profiler);
+
         // receive all events from window thread
+        tekTraceBegin("event drain");
         TekEvent event = {};
         while (recvEvent(event_queue, &event) == SUCCESS) {
             // switch event type, each type has corresponding data and action to be performed
@@ -406,17 +577,19 @@ static void tekEngine(void* args) {
                 glm_euler(event.data.body.snapshot.rotation, snapshot_rotation_matrix);
                 glm_mat4_quat(snapshot_rotation_matrix, snapshot_rotation_quat);
 
-                threadChainThrow(tekEngineCreateBody(
-                    state_queue, &bodies, event.data.body.id,
+                threadChainThrowTraced(tekEngineCreateBody(
+                    state_queue, &bodies, &store, event.data.body.id,
                     event.data.body.snapshot.model, event.data.body.snapshot.material,
                     event.data.body.snapshot.mass, event.data.body.snapshot.friction, event.data.body.snapshot.restitution,
-                    event.data.body.snapshot.position, snapshot_rotation_quat, (vec3){1.0f, 1.0f, 1.0f}
-                    ));
+                    event.data.body.snapshot.position, snapshot_rotation_quat, (vec3){1.0f, 1.0f, 1.0f},
+                    ++entity_sequence
+                    ), "event drain");
 
-                threadChainThrow(vectorGetItemPtr(&bodies, event.data.body.id, &snapshot_body));
-                glm_vec3_copy(event.data.body.snapshot.velocity, snapshot_body->velocity);
-                snapshot_body->immovable = event.data.body.snapshot.immovable;
+                glm_vec3_copy(event.data.body.snapshot.velocity, store.velocities[event.data.body.id]);
+                tekBodyStoreSetImmovable(&store, event.data.body.id, (flag)event.data.body.snapshot.immovable);
 
+                // the graphics thread ignores frames from before this create, so make sure a newer one gets sent
+                poses_changed = 1;
                 break;
             case BODY_UPDATE_EVENT:
                 // cannot convert directly for some reason
@@ -424,33 +597,43 @@ static void tekEngine(void* args) {
                 glm_mat4_quat(snapshot_rotation_matrix, snapshot_rotation_quat);
                 glm_euler_xyz_quat_rh(event.data.body.snapshot.rotation, snapshot_rotation_quat);
 
-                threadChainThrow(vectorGetItemPtr(&bodies, event.data.body.id, &snapshot_body));
-                glm_vec3_copy(event.data.body.snapshot.position, snapshot_body->position);
-                glm_vec4_copy(snapshot_rotation_quat, snapshot_body->rotation);
-                glm_vec3_copy(event.data.body.snapshot.velocity, snapshot_body->velocity);
-                glm_vec3_copy(event.data.body.snapshot.angular_velocity, snapshot_body->angular_velocity);
+                threadChainThrowTraced(vectorGetItemPtr(&bodies, event.data.body.id, &snapshot_body), "event drain");
+                glm_vec3_copy(event.data.body.snapshot.position, store.positions[event.data.body.id]);
+                glm_vec4_copy(snapshot_rotation_quat, store.rotations[event.data.body.id]);
+                glm_vec3_copy(event.data.body.snapshot.velocity, store.velocities[event.data.body.id]);
+                glm_vec3_copy(event.data.body.snapshot.angular_velocity, store.angular_velocities[event.data.body.id]);
                 snapshot_body->friction = event.data.body.snapshot.friction;
                 snapshot_body->restitution = event.data.body.snapshot.restitution;
-                threadChainThrow(tekBodySetMass(snapshot_body, event.data.body.snapshot.mass));
-                snapshot_body->immovable = event.data.body.snapshot.immovable;
+                threadChainThrowTraced(tekBodySetMass(&store, snapshot_body, event.data.body.snapshot.mass), "event drain");
+                tekBodyStoreSetImmovable(&store, event.data.body.id, (flag)event.data.body.snapshot.immovable);
+                tekBodyUpdateTransform(&store, event.data.body.id);
 
-                threadChainThrow(tekEngineUpdateBody(
-                    state_queue, &bodies, event.data.body.id,
-                    event.data.body.snapshot.position, snapshot_rotation_quat, (vec3){1.0f, 1.0f, 1.0f}
-                ));
+                // body has been moved, so it should not be interpolated from where it was before
+                glm_vec3_copy(store.positions[event.data.body.id], store.previous_positions[event.data.body.id]);
+                glm_vec4_copy(store.rotations[event.data.body.id], store.previous_rotations[event.data.body.id]);
+                poses_changed = 1;
 
                 break;
             case BODY_DELETE_EVENT:
-                threadChainThrow(tekEngineDeleteBody(state_queue, &bodies, event.data.body.id));
+                threadChainThrowTraced(tekEngineDeleteBody(state_queue, &bodies, &store, event.data.body.id, ++entity_sequence), "event drain");
+                poses_changed = 1;
                 break;
             case CLEAR_EVENT:
-                threadChainThrow(tekEngineDeleteAllBodies(state_queue, &bodies));
+                threadChainThrowTraced(tekEngineDeleteAllBodies(state_queue, &bodies, &store, &entity_sequence), "event drain");
+                poses_changed = 1;
                 break;
             case TIME_EVENT: // update physics time step
                 phys_period = 1 / event.data.time.rate;
-                phys_period_s = floor(phys_period / event.data.time.speed);
-                step_time.tv_sec = (__time_t)(phys_period_s / event.data.time.speed);
-                step_time.tv_nsec = (__syscall_slong_t)(1e9 * (phys_period / event.data.time.speed - phys_period_s));
+                speed = event.data.time.speed;
+                if (event.data.time.max_substeps)
+                    max_substeps = event.data.time.max_substeps;
+                adaptive.period = phys_period;
+                break;
+            case ADAPTIVE_EVENT: // turn the adaptive time step on or off
+                adaptive.enabled = event.data.adaptive;
+                adaptive.period = phys_period;
+                adaptive.step_cost = 0.0;
+                adaptive.reason = adaptive.enabled ? PERIOD_REASON_STEADY : PERIOD_REASON_FIXED;
                 break;
             case PAUSE_EVENT:
                 paused = event.data.paused;
@@ -459,6 +642,13 @@ static void tekEngine(void* args) {
                 if (paused)
                     step = 1;
                 break;
+            case PROFILE_DUMP_EVENT: // write out the timings of recent ticks
+                // not worth stopping the engine over, so just report it
+                if (tekProfilerWriteCSV(&profiler, event.data.filename) == SUCCESS)
+                    tprint("Wrote engine profile to %s\n", event.data.filename);
+                else
+                    tprint("Failed to write engine profile to %s\n", event.data.filename);
+                break;
             case GRAVITY_EVENT: // update acceleration due to gravity
                 gravity = event.data.gravity;
             case INSPECT_EVENT: // change which body is being inspected
@@ -468,64 +658,113 @@ static void tekEngine(void* args) {
             }
         }
 
+        tekTraceEnd("event drain");
         if (!running) break;
+        tekProfilerLap(&profiler, PROFILE_EVENTS, &phase_start);
+
+        // work out how much simulation time has passed since the last frame
+        clock_gettime(CLOCK_MONOTONIC, &curr_time);
+        const double delta_time = (double)(curr_time.tv_sec - last_time.tv_sec) + (double)(curr_time.tv_nsec - last_time.tv_nsec) / (double)BILLION;
+        memcpy(&last_time, &curr_time, sizeof(struct timespec));
 
-        if (step) paused = 0;
+        // the adaptive time step replaces the one chosen by the user if it is enabled
+        const double step_period = adaptive.enabled ? adaptive.period : phys_period;
 
-        // sort out collisions
+        uint num_substeps = 0;
+        float max_penetration = 0.0f;
         if (mode == MODE_RUNNER && !paused) {
-            // check and fix collisions
-            threadChainThrow(tekSolveCollisions(&bodies, (float)phys_period));
-
-            for (uint i = 0; i < bodies.length; i++) {
-                TekBody* body = 0;
-                threadChainThrow(vectorGetItemPtr(&bodies, i, &body));
-
-                // dont simulate null bodies
-                if (!body->num_vertices) continue;
-
-                // dont move immovable bodies
-                if (body->immovable) {
-                    glm_vec3_zero(body->velocity);
-                    glm_vec3_zero(body->angular_velocity);
-                }
-                tekBodyAdvanceTime(body, (float)phys_period, gravity);
-                threadChainThrow(tekEngineUpdateBody(state_queue, &bodies, i, body->position, body->rotation, body->scale));
+            accumulator += delta_time * speed;
+
+            // run fixed steps until there is less than one step of time left over
+            while (accumulator >= step_period && num_substeps < max_substeps) {
+                float step_penetration;
+                tekTraceBegin("tekEngineStep");
+                threadChainThrowTraced(tekEngineStep(&bodies, &store, step_period, gravity, &step_penetration, &profiler), "tekEngineStep");
+                tekTraceEnd("tekEngineStep");
+                max_penetration = fmaxf(max_penetration, step_penetration);
+                accumulator -= step_period;
+                time_elapsed += step_period;
+                num_substeps++;
             }
 
-            time_elapsed += phys_period;
+            // if we couldn't keep up, throw away the extra time rather than falling further and further behind
+            if (accumulator >= step_period)
+                accumulator = fmod(accumulator, step_period);
+
+            // the leftover time is how far through the next step we are
+            alpha = (float)(accumulator / step_period);
+        } else if (mode == MODE_RUNNER && step) {
+            // allows for the sim to be stepped one step at a time
+            tekTraceBegin("tekEngineStep");
+            threadChainThrowTraced(tekEngineStep(&bodies, &store, step_period, gravity, &max_penetration, &profiler), "tekEngineStep");
+            tekTraceEnd("tekEngineStep");
+            time_elapsed += step_period;
+            num_substeps = 1;
+            accumulator = 0.0;
+            alpha = 1.0f;
         }
 
-        // allows for the sim to be stepped one step at a time
-        if (step) {
-            paused = 1;
-            step = 0;
+        // measure how long the steps took, and use it to decide on the next time step
+        if (adaptive.enabled && num_substeps) {
+            struct timespec step_end_time;
+            clock_gettime(CLOCK_MONOTONIC, &step_end_time);
+            const double step_time = (double)(step_end_time.tv_sec - curr_time.tv_sec) + (double)(step_end_time.tv_nsec - curr_time.tv_nsec) / (double)BILLION;
+            tekEngineAdaptPeriod(&adaptive, phys_period, frame_period, speed, max_substeps, step_time / num_substeps, max_penetration);
+        }
+        step = 0;
+
+        // only one frame of poses is published, no matter how many steps were run
+        // the steps have timed themselves, so start timing again from here
+        phase_start = tekProfilerStart(&profiler);
+        tekTraceBegin("publish");
+        if (num_substeps || poses_changed) {
+            threadChainThrowTraced(tekEnginePublishPoses(pose_buffer, &store, alpha, entity_sequence), "publish");
+            poses_changed = 0;
         }
 
         // return details about a specific body to debug
         vec3 inspect_position, inspect_velocity;
-        if (inspect_index < bodies.length) {
-            TekBody* inspect_body = 0;
-            threadChainThrow(vectorGetItemPtr(&bodies, inspect_index, &inspect_body));
-            glm_vec3_copy(inspect_body->position, inspect_position);
-            glm_vec3_copy(inspect_body->velocity, inspect_velocity);
+        if (inspect_index < store.length) {
+            glm_vec3_copy(store.positions[inspect_index], inspect_position);
+            glm_vec3_copy(store.velocities[inspect_index], inspect_velocity);
         } else {
             glm_vec3_zero(inspect_position);
             glm_vec3_zero(inspect_velocity);
         }
-        threadChainThrow(tekPushInspectState(state_queue, time_elapsed, inspect_position, inspect_velocity));
+        threadChainThrowTraced(tekPushInspectState(state_queue, time_elapsed, inspect_position, inspect_velocity, (float)(adaptive.enabled ? adaptive.period : phys_period), adaptive.reason), "publish");
+        if (profiler.num_ticks % PROFILE_SUMMARY_INTERVAL == 0)
+            threadChainThrowTraced(tekPushProfileState(state_queue, &profiler), "publish");
+        tekTraceEnd("publish");
+        tekProfilerLap(&profiler, PROFILE_PUBLISH, &phase_start);
 
         // update engine time
-        engine_time.tv_sec += step_time.tv_sec;
-        engine_time.tv_nsec += step_time.tv_nsec;
+        engine_time.tv_sec += frame_time.tv_sec;
+        engine_time.tv_nsec += frame_time.tv_nsec;
 
-        // wait for time to pass before moving onto next step
+        // wait for time to pass before moving onto next frame
         while (engine_time.tv_nsec >= BILLION) {
             engine_time.tv_nsec -= BILLION;
             engine_time.tv_sec += 1;
         }
 
-        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &engine_time, NULL);
+        // if the frame overran, start timing again from now instead of trying to make up for it
+        // the accumulator already accounts for the lost time
+        if (engine_time.tv_sec < curr_time.tv_sec || (engine_time.tv_sec == curr_time.tv_sec && engine_time.tv_nsec < curr_time.tv_nsec))
+            memcpy(&engine_time, &curr_time, sizeof(struct timespec));
+
+        if (mode == MODE_RUNNER && !paused) {
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &engine_time, NULL);
+        } else {
+            // nothing will change until an event arrives, so sleep until one does instead of waking up every frame.
+            // still wake up now and then so the inspect state doesn't go stale
+            threadQueueWait(event_queue, ENGINE_IDLE_TIMEOUT);
+
+            // start timing again from when we woke up, the time spent asleep shouldn't be simulated
+            clock_gettime(CLOCK_MONOTONIC, &engine_time);
+            memcpy(&last_time, &engine_time, sizeof(struct timespec));
+        }
+        tekProfilerLap(&profiler, PROFILE_SLEEP, &phase_start);
+        tekProfilerEndTick(&profiler);
         counter++;
     }
 
@@ -538,6 +777,7 @@ tek_engine_cleanup:
     }
 
     vectorDelete(&bodies);
+    tekDeleteBodyStore(&store);
     queueDelete(&unused_ids);
 }
 
@@ -545,16 +785,22 @@ tek_engine_cleanup:
  * @brief Start the physics thread, providing two thread queues to send and recieve events / states.
  * @param event_queue A pointer to an existing thread queue that will send events to the physics thread.
  * @param state_queue A pointer to an existing thread queue that will recieve updates of the physics state.
+ * @param pose_buffer A pointer to an existing pose buffer that will recieve the position and rotation of every body each frame.
+ * @param strings A pointer to an existing string table, used to intern any strings that are sent to the graphics thread.
  * @param phys_period A time period that represents the length of a single iteration of the physics loop. In other words '1 / ticks per second'
+ * @param frame_period How often the physics thread sends the state of the bodies to the graphics thread. Several physics steps can run per frame.
  * @param thread A pointer to a pthread_t variable that will contain the thread. Do pthread_join(thread) at the end to ensure the thread is finished.
  * @throws THREAD_EXCEPTION if the call to pthread_create() fails.
  */
-exception tekInitEngine(ThreadQueue* event_queue, ThreadQueue* state_queue, const double phys_period, unsigned long long* thread) {
+exception tekInitEngine(ThreadQueue* event_queue, ThreadQueue* state_queue, TekPoseBuffer* pose_buffer, StringTable* strings, const double phys_period, const double frame_period, unsigned long long* thread) {
     // engine args passed into thread. but can only pass one pointer in hence the struct.
     struct TekEngineArgs* engine_args = (struct TekEngineArgs*)malloc(sizeof(struct TekEngineArgs));
     engine_args->event_queue = event_queue;
     engine_args->state_queue = state_queue;
+    engine_args->pose_buffer = pose_buffer;
+    engine_args->strings = strings;
     engine_args->phys_period = phys_period;
+    engine_args->frame_period = frame_period;
     // create new thread, if returns not 0 then there was a bugger
     if (pthread_create((pthread_t*)thread, NULL, tekEngine, engine_args))
 	    tekThrow(THREAD_EXCEPTION, "Failed to create physics thread");
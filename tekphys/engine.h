@@ -2,9 +2,12 @@
 
 #include "../core/exception.h"
 #include "../core/threadqueue.h"
+#include "../core/stringtable.h"
 
 #include "../tekgl/entity.h"
 #include "body.h"
+#include "posebuffer.h"
+#include "profiler.h"
 
 #define QUIT_EVENT         0
 #define MODE_CHANGE_EVENT  1
@@ -17,13 +20,24 @@
 #define STEP_EVENT         8
 #define GRAVITY_EVENT      9
 #define INSPECT_EVENT     10
+#define ADAPTIVE_EVENT    11
+#define PROFILE_DUMP_EVENT 12
 
 #define MESSAGE_STATE       0
 #define EXCEPTION_STATE     1
 #define ENTITY_CREATE_STATE 2
 #define ENTITY_DELETE_STATE 3
-#define ENTITY_UPDATE_STATE 4
-#define INSPECT_STATE       5
+#define INSPECT_STATE       4
+#define PROFILE_STATE       5
+
+#define DEFAULT_MAX_SUBSTEPS 8
+
+// reasons why the engine chose the time step it is using
+#define PERIOD_REASON_FIXED       0
+#define PERIOD_REASON_STEADY      1
+#define PERIOD_REASON_PENETRATION 2
+#define PERIOD_REASON_TICK_COST   3
+#define PERIOD_REASON_RELAXING    4
 
 typedef struct TekEvent {
     flag type;
@@ -36,18 +50,25 @@ typedef struct TekEvent {
         struct {
             double rate;
             double speed;
+            uint max_substeps;
         } time;
         flag paused;
         float gravity;
+        flag adaptive;
+        const char* filename; // interned, or a string literal
     } data;
 } TekEvent;
 
 typedef struct TekState {
     flag type;
     uint object_id;
+    uint sequence; // for creates and deletes, how many creates and deletes came before it. pose frames are tagged with the same count.
     union {
-        char* message;
-        uint exception;
+        const char* message; // interned, so it doesn't need to be freed
+        struct {
+            uint code;
+            const char* message; // the exception as the engine thread saw it, interned. null if it couldn't be
+        } exception;
         struct {
             const char* mesh_filename;
             const char* material_filename;
@@ -55,22 +76,20 @@ typedef struct TekState {
             vec4 rotation;
             vec3 scale;
         } entity;
-        struct {
-            vec3 position;
-            vec4 rotation;
-            vec3 scale;
-        } entity_update;
         struct {
             float time;
             vec3 position;
             vec3 velocity;
+            float period;
+            flag period_reason;
         } inspect;
+        TekProfileSummary profile;
     } data;
 } TekState;
 
 exception recvState(ThreadQueue* queue, TekState* state);
 exception pushEvent(ThreadQueue* queue, TekEvent event);
-exception tekInitEngine(ThreadQueue* event_queue, ThreadQueue* state_queue, double phys_period, unsigned long long* thread);
+exception tekInitEngine(ThreadQueue* event_queue, ThreadQueue* state_queue, TekPoseBuffer* pose_buffer, StringTable* strings, double phys_period, double frame_period, unsigned long long* thread);
 void tekAwaitEngineStop(unsigned long long thread);
 
 exception pushTriangle(vec3 triangle[3]);
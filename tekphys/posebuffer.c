@@ -0,0 +1,127 @@
+#include "posebuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Template for growing one of the arrays in a pose frame to a new capacity.
+ * @param array_name The name of the array in the frame.
+ * @param array_type The type of each element in the array.
+ */
+#define POSE_FRAME_GROW(array_name, array_type) { \
+    array_type* temp = (array_type*)realloc(frame->array_name, new_capacity * sizeof(array_type)); \
+    if (!temp) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory to grow pose frame."); \
+    frame->array_name = temp; \
+} \
+
+/**
+ * Grow every array in a pose frame to a new capacity.
+ * @param frame The frame to grow.
+ * @param new_capacity The number of bodies the frame should be able to hold.
+ * @throws MEMORY_EXCEPTION if realloc() fails.
+ */
+static exception tekPoseFrameGrow(TekPoseFrame* frame, const uint new_capacity) {
+    POSE_FRAME_GROW(positions, vec3);
+    POSE_FRAME_GROW(rotations, vec4);
+    POSE_FRAME_GROW(previous_positions, vec3);
+    POSE_FRAME_GROW(previous_rotations, vec4);
+    POSE_FRAME_GROW(flags, flag);
+    frame->capacity = new_capacity;
+    return SUCCESS;
+}
+
+/**
+ * @brief Create a pose buffer, used to pass the pose of every body from the physics thread to the graphics thread without allocating anything per body.
+ * @note Triple buffered, so the physics thread can always write a new frame without waiting for the graphics thread to finish reading the last one. Single producer, single consumer.
+ * @param pose_buffer A pointer to an empty TekPoseBuffer struct.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+exception tekCreatePoseBuffer(TekPoseBuffer* pose_buffer) {
+    memset(pose_buffer, 0, sizeof(TekPoseBuffer));
+    for (uint i = 0; i < 3; i++) {
+        tekChainThrowThen(tekPoseFrameGrow(&pose_buffer->frames[i], 1), {
+            tekDeletePoseBuffer(pose_buffer);
+        });
+    }
+
+    // each thread starts off owning a different frame, and the one in the middle is up for grabs
+    pose_buffer->back = 0;
+    atomic_init(&pose_buffer->middle, 1);
+    pose_buffer->front = 2;
+    return SUCCESS;
+}
+
+/**
+ * @brief Delete a pose buffer, freeing all three frames.
+ * @note Both threads should be finished with the buffer before calling this.
+ * @param pose_buffer The pose buffer to delete.
+ */
+void tekDeletePoseBuffer(TekPoseBuffer* pose_buffer) {
+    for (uint i = 0; i < 3; i++) {
+        TekPoseFrame* frame = &pose_buffer->frames[i];
+        free(frame->positions);
+        free(frame->rotations);
+        free(frame->previous_positions);
+        free(frame->previous_rotations);
+        free(frame->flags);
+    }
+
+    // prevent further misuse
+    memset(pose_buffer, 0, sizeof(TekPoseBuffer));
+}
+
+/**
+ * @brief Get the frame that the physics thread should write the next set of poses into.
+ * @note Only to be used by the producer thread. The frame will be grown if needed, but the contents are left over from whenever it was last written so every pose should be overwritten.
+ * @param pose_buffer The pose buffer to write to.
+ * @param length The number of bodies that will be written.
+ * @param frame Where to store a pointer to the frame.
+ * @throws MEMORY_EXCEPTION if realloc() fails.
+ */
+exception tekPoseBufferBeginWrite(TekPoseBuffer* pose_buffer, const uint length, TekPoseFrame** frame) {
+    TekPoseFrame* back_frame = &pose_buffer->frames[pose_buffer->back];
+
+    // the back frame belongs to this thread until it is published, so it is safe to realloc it
+    if (length > back_frame->capacity) {
+        uint new_capacity = back_frame->capacity;
+        while (new_capacity < length) new_capacity *= 2;
+        tekChainThrow(tekPoseFrameGrow(back_frame, new_capacity));
+    }
+    back_frame->length = length;
+
+    *frame = back_frame;
+    return SUCCESS;
+}
+
+/**
+ * @brief Make the frame that was just written available to the graphics thread.
+ * @note Only to be used by the producer thread. If the last published frame was never read, it is replaced by this one.
+ * @param pose_buffer The pose buffer to publish to.
+ */
+void tekPoseBufferPublish(TekPoseBuffer* pose_buffer) {
+    // swap the back frame into the middle, and take whatever was there to write the next frame into.
+    // release so that the reader sees everything written to the frame, acquire so we don't write into the old middle too early.
+    const uint old_middle = atomic_exchange_explicit(&pose_buffer->middle, pose_buffer->back | POSE_BUFFER_FRESH, memory_order_acq_rel);
+    pose_buffer->back = old_middle & POSE_BUFFER_INDEX_MASK;
+}
+
+/**
+ * @brief Get the most recent frame published by the physics thread.
+ * @note Only to be used by the consumer thread. The frame stays valid until the next call to this function.
+ * @param pose_buffer The pose buffer to read from.
+ * @param frame Where to store a pointer to the frame.
+ * @returns 1 if the frame is new since the last call, 0 if nothing has been published since then and the frame is the same as last time.
+ */
+flag tekPoseBufferRead(TekPoseBuffer* pose_buffer, const TekPoseFrame** frame) {
+    flag fresh = 0;
+
+    // only swap if there is something new, otherwise we would take back a frame that we have already read
+    if (atomic_load_explicit(&pose_buffer->middle, memory_order_relaxed) & POSE_BUFFER_FRESH) {
+        const uint old_middle = atomic_exchange_explicit(&pose_buffer->middle, pose_buffer->front, memory_order_acq_rel);
+        pose_buffer->front = old_middle & POSE_BUFFER_INDEX_MASK;
+        fresh = 1;
+    }
+
+    *frame = &pose_buffer->frames[pose_buffer->front];
+    return fresh;
+}
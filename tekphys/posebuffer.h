@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <cglm/vec3.h>
+#include <cglm/vec4.h>
+
+#include "../tekgl.h"
+#include "../core/exception.h"
+
+#define POSE_BUFFER_INDEX_MASK 0x3
+#define POSE_BUFFER_FRESH      0x4
+
+/// The pose of every body at the end of one frame, indexed by body id.
+typedef struct TekPoseFrame {
+    vec3* positions;
+    vec4* rotations;
+    vec3* previous_positions;
+    vec4* previous_rotations;
+    flag* flags; // same as the flags in the body store, tells the reader which ids are in use
+    uint length;
+    uint capacity;
+    float alpha; // how far between the previous and current pose the bodies should be drawn
+    uint sequence; // number of entity creates and deletes the engine had sent when this frame was written
+} TekPoseFrame;
+
+/// Triple buffer of frames, the physics thread writes to one while the graphics thread reads from another.
+typedef struct TekPoseBuffer {
+    TekPoseFrame frames[3];
+    atomic_uint middle; // index of the most recently published frame, plus POSE_BUFFER_FRESH if it hasn't been read yet
+    uint back; // only touched by the physics thread
+    uint front; // only touched by the graphics thread
+} TekPoseBuffer;
+
+exception tekCreatePoseBuffer(TekPoseBuffer* pose_buffer);
+void tekDeletePoseBuffer(TekPoseBuffer* pose_buffer);
+exception tekPoseBufferBeginWrite(TekPoseBuffer* pose_buffer, uint length, TekPoseFrame** frame);
+void tekPoseBufferPublish(TekPoseBuffer* pose_buffer);
+flag tekPoseBufferRead(TekPoseBuffer* pose_buffer, const TekPoseFrame** frame);
@@ -0,0 +1,158 @@
+#include "profiler.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief Initialise a profiler, with no ticks recorded.
+ * @param profiler The profiler to initialise.
+ */
+void tekCreateProfiler(TekProfiler* profiler) {
+    memset(profiler, 0, sizeof(TekProfiler));
+}
+
+/**
+ * @brief Get the name of a phase, as shown in the inspect window and used for the columns of the csv file.
+ * @param phase One of the PROFILE_* values.
+ * @returns The name of the phase.
+ */
+const char* tekProfilerPhaseName(const flag phase) {
+    switch (phase) {
+    case PROFILE_EVENTS:
+        return "events";
+    case PROFILE_BROADPHASE:
+        return "broadphase";
+    case PROFILE_NARROWPHASE:
+        return "narrowphase";
+    case PROFILE_CONTACT_PREP:
+        return "contact_prep";
+    case PROFILE_SOLVER:
+        return "solver";
+    case PROFILE_INTEGRATE:
+        return "integrate";
+    case PROFILE_PUBLISH:
+        return "publish";
+    case PROFILE_SLEEP:
+        return "sleep";
+    default:
+        return "unknown";
+    }
+}
+
+/**
+ * @brief Get the current time, to start timing a phase.
+ * @param profiler The profiler that the phase will be added to. If null, the clock isn't read at all.
+ * @returns The current monotonic time in nanoseconds, or 0 if the profiler is null.
+ */
+long long tekProfilerStart(const TekProfiler* profiler) {
+    if (!profiler) return 0;
+    struct timespec curr_time;
+    clock_gettime(CLOCK_MONOTONIC, &curr_time);
+    return (long long)curr_time.tv_sec * BILLION + curr_time.tv_nsec;
+}
+
+/**
+ * @brief Add the time since start to a phase of the current tick, and move start on to now so the next phase can be timed straight after.
+ * @note A phase can be lapped many times in one tick, the times are added together.
+ * @param profiler The profiler to add the time to. If null, nothing happens.
+ * @param phase One of the PROFILE_* values.
+ * @param start The time that the phase started, from tekProfilerStart() or a previous lap. Updated to the current time.
+ */
+void tekProfilerLap(TekProfiler* profiler, const flag phase, long long* start) {
+    if (!profiler || (uint)phase >= NUM_PROFILE_PHASES) return;
+    const long long curr_time = tekProfilerStart(profiler);
+    profiler->current[(uint)phase] += curr_time - *start;
+    *start = curr_time;
+}
+
+/**
+ * @brief Finish timing the current tick, adding it to the history and starting a new one.
+ * @param profiler The profiler to update. If null, nothing happens.
+ */
+void tekProfilerEndTick(TekProfiler* profiler) {
+    if (!profiler) return;
+    memcpy(profiler->history[profiler->num_ticks % PROFILE_HISTORY], profiler->current, sizeof(profiler->current));
+    memset(profiler->current, 0, sizeof(profiler->current));
+    profiler->num_ticks++;
+}
+
+/**
+ * Comparison function for qsort, to sort an array of times.
+ * @param a A pointer to the first time.
+ * @param b A pointer to the second time.
+ * @return A negative number if a is smaller, positive if b is smaller, 0 if they are the same.
+ */
+static int tekCompareTimes(const void* a, const void* b) {
+    const long long time_a = *(const long long*)a;
+    const long long time_b = *(const long long*)b;
+    return (time_a > time_b) - (time_a < time_b);
+}
+
+/**
+ * Get a percentile from a sorted array, using the nearest rank.
+ * @param sorted The sorted array of times.
+ * @param length The length of the array, must be more than 0.
+ * @param percentile The percentile to get, between 0 and 100.
+ * @returns The time at that percentile, converted to microseconds.
+ */
+static float tekPercentile(const long long* sorted, const uint length, const double percentile) {
+    int rank = (int)ceil(percentile / 100.0 * length) - 1;
+    if (rank < 0) rank = 0;
+    if (rank >= (int)length) rank = (int)length - 1;
+    return (float)((double)sorted[rank] / 1000.0);
+}
+
+/**
+ * @brief Work out the median and 99th percentile of each phase, over all the ticks that are still in the history.
+ * @note Sorts a copy of the history, so it is not something to do every tick.
+ * @param profiler The profiler to summarise.
+ * @param summary Where to write the summary. Filled with zeroes if no ticks have been recorded.
+ */
+void tekProfilerGetSummary(const TekProfiler* profiler, TekProfileSummary* summary) {
+    memset(summary, 0, sizeof(TekProfileSummary));
+    const uint length = profiler->num_ticks < PROFILE_HISTORY ? profiler->num_ticks : PROFILE_HISTORY;
+    if (!length) return;
+
+    long long sorted[PROFILE_HISTORY];
+    for (uint phase = 0; phase < NUM_PROFILE_PHASES; phase++) {
+        for (uint i = 0; i < length; i++)
+            sorted[i] = profiler->history[i][phase];
+        qsort(sorted, length, sizeof(long long), tekCompareTimes);
+        summary->median[phase] = tekPercentile(sorted, length, 50.0);
+        summary->p99[phase] = tekPercentile(sorted, length, 99.0);
+    }
+}
+
+/**
+ * @brief Write every tick in the history to a file as comma separated values, oldest first.
+ * @note One line per tick: the tick number, then the time spent in each phase in microseconds.
+ * @param profiler The profiler to write out.
+ * @param filename The file to write to, will be overwritten.
+ * @throws FILE_EXCEPTION if the file could not be opened.
+ */
+exception tekProfilerWriteCSV(const TekProfiler* profiler, const char* filename) {
+    FILE* file = fopen(filename, "w");
+    if (!file) tekThrow(FILE_EXCEPTION, "Failed to open profile output file.");
+
+    fprintf(file, "tick");
+    for (uint phase = 0; phase < NUM_PROFILE_PHASES; phase++)
+        fprintf(file, ",%s_us", tekProfilerPhaseName((flag)phase));
+    fprintf(file, "\n");
+
+    // once the history has wrapped around, the oldest tick is the one that will be overwritten next
+    const uint length = profiler->num_ticks < PROFILE_HISTORY ? profiler->num_ticks : PROFILE_HISTORY;
+    const uint first_tick = profiler->num_ticks - length;
+    for (uint tick = first_tick; tick < profiler->num_ticks; tick++) {
+        const long long* times = profiler->history[tick % PROFILE_HISTORY];
+        fprintf(file, "%u", tick);
+        for (uint phase = 0; phase < NUM_PROFILE_PHASES; phase++)
+            fprintf(file, ",%.3f", (double)times[phase] / 1000.0);
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+    return SUCCESS;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "../tekgl.h"
+#include "../core/exception.h"
+
+// the parts of an engine tick that are timed
+#define PROFILE_EVENTS       0
+#define PROFILE_BROADPHASE   1
+#define PROFILE_NARROWPHASE  2
+#define PROFILE_CONTACT_PREP 3
+#define PROFILE_SOLVER       4
+#define PROFILE_INTEGRATE    5
+#define PROFILE_PUBLISH      6
+#define PROFILE_SLEEP        7
+#define NUM_PROFILE_PHASES   8
+
+#define PROFILE_HISTORY 256 // number of ticks that are remembered, older ones are overwritten
+
+/// Time spent in each phase of the most recent ticks, in nanoseconds.
+typedef struct TekProfiler {
+    long long current[NUM_PROFILE_PHASES]; // the tick that is being timed right now
+    long long history[PROFILE_HISTORY][NUM_PROFILE_PHASES];
+    uint num_ticks; // total number of ticks recorded, the next one goes at num_ticks % PROFILE_HISTORY
+} TekProfiler;
+
+/// Percentiles of each phase over the remembered ticks, in microseconds. Small enough to be sent to the graphics thread in a state.
+typedef struct TekProfileSummary {
+    float median[NUM_PROFILE_PHASES];
+    float p99[NUM_PROFILE_PHASES];
+} TekProfileSummary;
+
+void tekCreateProfiler(TekProfiler* profiler);
+const char* tekProfilerPhaseName(flag phase);
+long long tekProfilerStart(const TekProfiler* profiler);
+void tekProfilerLap(TekProfiler* profiler, flag phase, long long* start);
+void tekProfilerEndTick(TekProfiler* profiler);
+void tekProfilerGetSummary(const TekProfiler* profiler, TekProfileSummary* summary);
+exception tekProfilerWriteCSV(const TekProfiler* profiler, const char* filename);
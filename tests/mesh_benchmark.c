@@ -0,0 +1,281 @@
+#include "mesh_benchmark.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../core/file.h"
+#include "../core/list.h"
+#include "../tekgl/mesh.h"
+
+#define BENCHMARK_MESH_FILE "mesh_benchmark.tmsh"
+#define BENCHMARK_ROW_SIZE  1000 // vertices in each row of the generated grid
+
+/// The arrays read by one of the parsers, and how long and how much memory it took.
+typedef struct MeshBenchmarkResult {
+    float* vertices;
+    uint len_vertices;
+    uint* indices;
+    uint len_indices;
+    int* layout;
+    uint len_layout;
+    uint position_layout_index;
+    double wall_time;
+    long peak_memory; // in kB above what was in use before, or -1 if it couldn't be measured
+} MeshBenchmarkResult;
+
+// the parser that tekReadMeshArrays() used to use, kept to compare against.
+// reads the whole file into a buffer, splits it into a linked list of strings, then converts every string with strtod().
+
+#define REFERENCE_CONV_FUNC(func_name, func_type, conv_func, conv_type) \
+static exception func_name(const char* string, func_type* output) { \
+    char* check = 0; \
+    const conv_type converted = conv_func(string, &check); \
+    int error = errno; \
+    if ((string + strlen(string) != check) || (error == ERANGE)) \
+        tekThrow(FAILURE, "Failed to convert string data while processing mesh."); \
+    *output = (func_type)converted; \
+    return SUCCESS; \
+} \
+
+REFERENCE_CONV_FUNC(referenceToFloat, float, strtod, double);
+REFERENCE_CONV_FUNC(referenceToUint, uint, strtold, long);
+REFERENCE_CONV_FUNC(referenceToInt, int, strtold, long);
+
+#define REFERENCE_ARRAY_FUNC(func_name, array_type, conv_func) \
+static exception func_name(const List* list, array_type* array) { \
+    uint index = list->length - 1; \
+    const ListItem* item = list->data; \
+    while (item) { \
+        const char* string = item->data; \
+        array_type data; \
+        tekChainThrow(conv_func(string, &data)); \
+        array[index--] = (array_type)data; \
+        item = item->next; \
+    } \
+    return SUCCESS; \
+} \
+
+REFERENCE_ARRAY_FUNC(referenceVertices, float, referenceToFloat);
+REFERENCE_ARRAY_FUNC(referenceIndices, uint, referenceToUint);
+REFERENCE_ARRAY_FUNC(referenceLayout, int, referenceToInt);
+
+static exception referenceReadLists(char* buffer, List* vertices, List* indices, List* layout, uint* position_layout_index) {
+    char* prev_c = buffer;
+    flag in_word = 0;
+    flag in_wildcard = 0;
+    *position_layout_index = 0;
+
+    List* write_list = 0;
+    for (char* c = buffer; *c; c++) {
+        if (*c == '#') {
+            while ((*c != '\n') && (*c != '\r')) c++;
+            in_word = 0;
+            continue;
+        }
+        if ((*c == ' ') || (*c == 0x09) || (*c == '\n') || (*c == '\r')) {
+            if (in_word) {
+                *c = 0;
+                if (!strcmp(prev_c, "VERTICES")) write_list = vertices;
+                else if (!strcmp(prev_c, "INDICES")) write_list = indices;
+                else if (!strcmp(prev_c, "LAYOUT")) write_list = layout;
+                else if (!strcmp(prev_c, "$POSITION_LAYOUT_INDEX")) {
+                    write_list = 0;
+                    in_wildcard = 1;
+                } else if (!in_wildcard) {
+                    if (write_list) tekChainThrow(listInsertItem(write_list, 0, prev_c));
+                } else {
+                    tekChainThrow(referenceToUint(prev_c, position_layout_index));
+                }
+            }
+            in_word = 0;
+            continue;
+        }
+        if (!in_word) prev_c = c;
+        in_word = 1;
+    }
+    if (in_word) {
+        if (!in_wildcard) {
+            if (write_list) tekChainThrow(listInsertItem(write_list, 0, prev_c));
+        } else {
+            tekChainThrow(referenceToUint(prev_c, position_layout_index));
+        }
+    }
+    return SUCCESS;
+}
+
+static exception referenceReadMeshArrays(const char* filename, MeshBenchmarkResult* result) {
+    uint file_size;
+    tekChainThrow(getFileSize(filename, &file_size));
+    char* buffer = (char*)malloc(file_size);
+    if (!buffer) tekThrow(MEMORY_EXCEPTION, "Failed to allocate memory for file.");
+    tekChainThrowThen(readFile(filename, file_size, buffer), free(buffer));
+
+    List vertices = {}, indices = {}, layout = {};
+    listCreate(&vertices);
+    listCreate(&indices);
+    listCreate(&layout);
+
+    exception tek_exception = referenceReadLists(buffer, &vertices, &indices, &layout, &result->position_layout_index);
+    if (!tek_exception) {
+        result->vertices = (float*)malloc(vertices.length * sizeof(float));
+        result->indices = (uint*)malloc(indices.length * sizeof(uint));
+        result->layout = (int*)malloc(layout.length * sizeof(int));
+        result->len_vertices = vertices.length;
+        result->len_indices = indices.length;
+        result->len_layout = layout.length;
+        if (!result->vertices || !result->indices || !result->layout)
+            tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for mesh data.", {
+                listDelete(&vertices);
+                listDelete(&indices);
+                listDelete(&layout);
+                free(buffer);
+            });
+        tek_exception = referenceVertices(&vertices, result->vertices);
+    }
+    if (!tek_exception) tek_exception = referenceIndices(&indices, result->indices);
+    if (!tek_exception) tek_exception = referenceLayout(&layout, result->layout);
+
+    listDelete(&vertices);
+    listDelete(&indices);
+    listDelete(&layout);
+    free(buffer);
+    tekChainThrow(tek_exception);
+    return SUCCESS;
+}
+
+/**
+ * Write a mesh file that is a flat grid of vertices, with a position, normal and texture coordinate for each one like a real mesh.
+ * @param filename The file to write.
+ * @param num_vertices The number of vertices to write, rounded up to a whole number of rows.
+ * @throws FILE_EXCEPTION if the file could not be written.
+ */
+static exception benchmarkWriteMesh(const char* filename, const unsigned long num_vertices) {
+    FILE* file = fopen(filename, "w");
+    if (!file) tekThrow(FILE_EXCEPTION, "Could not open file.");
+
+    const unsigned long num_rows = (num_vertices + BENCHMARK_ROW_SIZE - 1) / BENCHMARK_ROW_SIZE;
+    fprintf(file, "# generated by --bench-mesh, format is (x  y  z)  (normal_x  normal_y  normal_z)  (u  v)\nVERTICES\n");
+    for (unsigned long row = 0; row < num_rows; row++) {
+        for (unsigned long column = 0; column < BENCHMARK_ROW_SIZE; column++) {
+            const float u = (float)column / (BENCHMARK_ROW_SIZE - 1), v = (float)row / (num_rows > 1 ? num_rows - 1 : 1);
+            fprintf(file, "%.6f %.6f %.6f  0.0 1.0 0.0  %.6f %.6f\n", u * 100.0f - 50.0f, 0.01f * (float)((row * 7 + column * 13) % 100), v * 100.0f - 50.0f, u, v);
+        }
+    }
+    fprintf(file, "INDICES\n");
+    for (unsigned long row = 0; row + 1 < num_rows; row++) {
+        for (unsigned long column = 0; column + 1 < BENCHMARK_ROW_SIZE; column++) {
+            const unsigned long corner = row * BENCHMARK_ROW_SIZE + column;
+            fprintf(file, "%lu %lu %lu  %lu %lu %lu\n", corner, corner + BENCHMARK_ROW_SIZE, corner + 1, corner + 1, corner + BENCHMARK_ROW_SIZE, corner + BENCHMARK_ROW_SIZE + 1);
+        }
+    }
+    fprintf(file, "LAYOUT\n3 3 2\n$POSITION_LAYOUT_INDEX 0\n");
+
+    if (fclose(file)) tekThrow(FILE_EXCEPTION, "Failed to write mesh file.");
+    return SUCCESS;
+}
+
+/**
+ * Read a field from /proc/self/status.
+ * @param field The name of the field, including the colon.
+ * @return The value in kB, or -1 if it couldn't be read.
+ */
+static long benchmarkReadStatus(const char* field) {
+    FILE* file = fopen("/proc/self/status", "r");
+    if (!file) return -1;
+    char line[256];
+    long value = -1;
+    const size_t len_field = strlen(field);
+    while (fgets(line, sizeof(line), file)) {
+        if (!strncmp(line, field, len_field)) {
+            value = atol(line + len_field);
+            break;
+        }
+    }
+    fclose(file);
+    return value;
+}
+
+/**
+ * Load the mesh file with one of the parsers, measuring the time taken and the most memory used while loading.
+ * @param name The name to print next to the result.
+ * @param reference 1 to use the old parser, 0 to use tekReadMeshArrays().
+ * @param result The arrays that were read, and the measurements.
+ * @throws FILE_EXCEPTION if the file could not be read.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ */
+static exception tekMeshBenchmark(const char* name, const flag reference, MeshBenchmarkResult* result) {
+    // writing 5 resets the peak memory to what is in use now, so each parser is measured on its own
+    FILE* clear_refs = fopen("/proc/self/clear_refs", "w");
+    if (clear_refs) {
+        fputs("5", clear_refs);
+        fclose(clear_refs);
+    }
+    const long start_memory = benchmarkReadStatus("VmRSS:");
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    if (reference) {
+        tekChainThrow(referenceReadMeshArrays(BENCHMARK_MESH_FILE, result));
+    } else {
+        tekChainThrow(tekReadMeshArrays(BENCHMARK_MESH_FILE, &result->vertices, &result->len_vertices, &result->indices, &result->len_indices, &result->layout, &result->len_layout, &result->position_layout_index));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    result->wall_time = (double)(end_time.tv_sec - start_time.tv_sec) + (double)(end_time.tv_nsec - start_time.tv_nsec) / (double)BILLION;
+
+    const long peak_memory = benchmarkReadStatus("VmHWM:");
+    result->peak_memory = (clear_refs && start_memory >= 0 && peak_memory >= 0) ? peak_memory - start_memory : -1;
+
+    uint vertex_size = 0;
+    for (uint i = 0; i < result->len_layout; i++)
+        vertex_size += result->layout[i];
+    printf("%-24s %u vertices in %.3fs, ", name, vertex_size ? result->len_vertices / vertex_size : 0, result->wall_time);
+    if (result->peak_memory >= 0) printf("peak %.1f MB\n", (double)result->peak_memory / 1024.0);
+    else printf("peak memory unknown\n");
+    return SUCCESS;
+}
+
+/**
+ * Check that both parsers read exactly the same thing.
+ * @param first The first result.
+ * @param second The second result.
+ * @return 1 if they match, 0 if not.
+ */
+static flag benchmarkResultsMatch(const MeshBenchmarkResult* first, const MeshBenchmarkResult* second) {
+    return first->len_vertices == second->len_vertices && first->len_indices == second->len_indices && first->len_layout == second->len_layout
+        && first->position_layout_index == second->position_layout_index
+        && !memcmp(first->vertices, second->vertices, first->len_vertices * sizeof(float))
+        && !memcmp(first->indices, second->indices, first->len_indices * sizeof(uint))
+        && !memcmp(first->layout, second->layout, first->len_layout * sizeof(int));
+}
+
+/**
+ * @brief Measure how quickly a large generated .tmsh file can be loaded by the old list based parser and by tekReadMeshArrays(), and how much memory each one needs.
+ * @param num_vertices The number of vertices in the generated mesh.
+ * @throws FILE_EXCEPTION if the mesh file could not be written or read.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FAILURE if the two parsers read different meshes.
+ */
+exception tekRunMeshBenchmark(const unsigned long num_vertices) {
+    tekChainThrow(benchmarkWriteMesh(BENCHMARK_MESH_FILE, num_vertices));
+
+    MeshBenchmarkResult reference = {}, current = {};
+    exception tek_exception = tekMeshBenchmark("list parser:", 1, &reference);
+    if (!tek_exception) tek_exception = tekMeshBenchmark("single pass parser:", 0, &current);
+    const flag matches = !tek_exception && benchmarkResultsMatch(&reference, &current);
+    if (matches && current.wall_time > 0.0)
+        printf("%-24s %.1fx faster\n", "speedup:", reference.wall_time / current.wall_time);
+
+    free(reference.vertices);
+    free(reference.indices);
+    free(reference.layout);
+    free(current.vertices);
+    free(current.indices);
+    free(current.layout);
+    remove(BENCHMARK_MESH_FILE);
+    tekChainThrow(tek_exception);
+    if (!matches) tekThrow(FAILURE, "Parsers read different meshes.");
+    return SUCCESS;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "../core/exception.h"
+
+exception tekRunMeshBenchmark(unsigned long num_vertices);
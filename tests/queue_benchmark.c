@@ -0,0 +1,192 @@
+#include "queue_benchmark.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../core/threadqueue.h"
+#include "../core/trace.h"
+
+#define BENCHMARK_CAPACITY   4096
+#define BENCHMARK_BATCH_SIZE 64
+
+#define BENCHMARK_REFERENCE 0 // the old ring, one item at a time
+#define BENCHMARK_SINGLE    1 // thread queue, one item at a time
+#define BENCHMARK_BATCH     2 // thread queue, BENCHMARK_BATCH_SIZE items at a time
+
+/// The ring that the thread queue used to be, kept to compare against. Wraps with a modulo, keeps both indices on the same cache line, and loads the other thread's index on every call.
+typedef struct ReferenceQueue {
+    void** buffer;
+    uint buffer_size;
+    atomic_uint front;
+    atomic_uint rear;
+} ReferenceQueue;
+
+typedef struct BenchmarkData {
+    flag kind;
+    ThreadQueue* queue;
+    ReferenceQueue* reference;
+    unsigned long num_items;
+    flag in_order; // set by the consumer if every item came out in the order it went in
+} BenchmarkData;
+
+static flag referenceEnqueue(ReferenceQueue* queue, void* data) {
+    const uint rear = atomic_load_explicit(&queue->rear, memory_order_relaxed);
+    const uint next_rear = (rear + 1) % queue->buffer_size;
+    if (atomic_load_explicit(&queue->front, memory_order_acquire) == next_rear) return 0;
+    queue->buffer[rear] = data;
+    atomic_store_explicit(&queue->rear, next_rear, memory_order_release);
+    return 1;
+}
+
+static flag referenceDequeue(ReferenceQueue* queue, void** data) {
+    const uint front = atomic_load_explicit(&queue->front, memory_order_relaxed);
+    if (atomic_load_explicit(&queue->rear, memory_order_acquire) == front) return 0;
+    *data = queue->buffer[front];
+    atomic_store_explicit(&queue->front, (front + 1) % queue->buffer_size, memory_order_release);
+    return 1;
+}
+
+static void* benchmarkProducer(void* arg) {
+    BenchmarkData* data = (BenchmarkData*)arg;
+    tekTraceThread("benchmark producer");
+
+    // items are just counters, starting from 1 so that the reference ring never sees a null pointer
+    uintptr_t next = 1;
+    uintptr_t batch[BENCHMARK_BATCH_SIZE];
+    while (next <= data->num_items) {
+        switch (data->kind) {
+        case BENCHMARK_REFERENCE:
+            if (referenceEnqueue(data->reference, (void*)(uintptr_t)next)) next++;
+            break;
+        case BENCHMARK_SINGLE:
+            if (threadQueueEnqueue(data->queue, &next)) next++;
+            break;
+        case BENCHMARK_BATCH:
+            uint batch_size = 0;
+            while (batch_size < BENCHMARK_BATCH_SIZE && next + batch_size <= data->num_items) {
+                batch[batch_size] = next + batch_size;
+                batch_size++;
+            }
+            next += threadQueueEnqueueBatch(data->queue, batch, batch_size);
+            break;
+        default:
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static void* benchmarkConsumer(void* arg) {
+    BenchmarkData* data = (BenchmarkData*)arg;
+    tekTraceThread("benchmark consumer");
+    data->in_order = 1;
+
+    uintptr_t expected = 1;
+    uintptr_t batch[BENCHMARK_BATCH_SIZE];
+    while (expected <= data->num_items) {
+        uint num_popped = 0;
+        switch (data->kind) {
+        case BENCHMARK_REFERENCE:
+            void* item;
+            num_popped = referenceDequeue(data->reference, &item);
+            batch[0] = (uintptr_t)item;
+            break;
+        case BENCHMARK_SINGLE:
+            num_popped = threadQueueDequeue(data->queue, batch);
+            break;
+        case BENCHMARK_BATCH:
+            num_popped = threadQueueDequeueBatch(data->queue, batch, BENCHMARK_BATCH_SIZE);
+            break;
+        default:
+            return NULL;
+        }
+
+        for (uint i = 0; i < num_popped; i++) {
+            if (batch[i] != expected) data->in_order = 0;
+            expected++;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Time how long it takes to move a number of items from one thread to another.
+ * @param kind Which queue to use, one of the BENCHMARK_* values.
+ * @param name The name to print next to the result.
+ * @param num_items The number of items to move.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FAILURE if the threads could not be started, or if the items came out in the wrong order.
+ */
+static exception tekQueueBenchmark(const flag kind, const char* name, const unsigned long num_items) {
+    ThreadQueue queue;
+    tekChainThrow(threadQueueCreate(&queue, BENCHMARK_CAPACITY, sizeof(uintptr_t)));
+    ReferenceQueue reference = {};
+    reference.buffer = (void**)malloc(BENCHMARK_CAPACITY * sizeof(void*));
+    if (!reference.buffer)
+        tekThrowThen(MEMORY_EXCEPTION, "Failed to allocate memory for reference queue.", {
+            threadQueueDelete(&queue);
+        });
+    reference.buffer_size = BENCHMARK_CAPACITY;
+
+    BenchmarkData data = {
+        .kind = kind,
+        .queue = &queue,
+        .reference = &reference,
+        .num_items = num_items
+    };
+
+    struct timespec start_time, end_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    pthread_t producer, consumer;
+    if (pthread_create(&consumer, NULL, benchmarkConsumer, &data))
+        tekThrowThen(FAILURE, "Failed to start consumer thread.", {
+            free(reference.buffer);
+            threadQueueDelete(&queue);
+        });
+    if (pthread_create(&producer, NULL, benchmarkProducer, &data)) {
+        // consumer would wait forever, so cancel it
+        pthread_cancel(consumer);
+        pthread_join(consumer, NULL);
+        tekThrowThen(FAILURE, "Failed to start producer thread.", {
+            free(reference.buffer);
+            threadQueueDelete(&queue);
+        });
+    }
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    const double wall_time = (double)(end_time.tv_sec - start_time.tv_sec) + (double)(end_time.tv_nsec - start_time.tv_nsec) / (double)BILLION;
+
+    free(reference.buffer);
+    threadQueueDelete(&queue);
+
+    if (!data.in_order)
+        tekThrow(FAILURE, "Items came out of the queue in the wrong order.");
+
+    printf(
+        "%-24s %lu items in %.3fs (%.1f million items/s, %.2f ns/item)\n",
+        name, num_items, wall_time,
+        wall_time > 0.0 ? num_items / wall_time / 1e6 : 0.0,
+        wall_time * 1e9 / (double)num_items
+    );
+    return SUCCESS;
+}
+
+/**
+ * @brief Measure how quickly items can be passed between two threads, using the old ring, the thread queue, and the thread queue's batch functions.
+ * @param num_items The number of items to send through each queue.
+ * @throws MEMORY_EXCEPTION if malloc() fails.
+ * @throws FAILURE if any of the queues lost or reordered items.
+ */
+exception tekRunQueueBenchmark(const unsigned long num_items) {
+    tekChainThrow(tekQueueBenchmark(BENCHMARK_REFERENCE, "reference ring:", num_items));
+    tekChainThrow(tekQueueBenchmark(BENCHMARK_SINGLE, "thread queue:", num_items));
+    tekChainThrow(tekQueueBenchmark(BENCHMARK_BATCH, "thread queue (batch):", num_items));
+    return SUCCESS;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "../core/exception.h"
+
+exception tekRunQueueBenchmark(unsigned long num_items);
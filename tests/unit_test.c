@@ -4,6 +4,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "../core/testsuite.h"
 
@@ -14,10 +18,24 @@
 #include "../core/priorityqueue.h"
 #include "../core/bitset.h"
 #include "../core/hashtable.h"
+#include "../core/stringtable.h"
 #include "../core/threadqueue.h"
+#include "../core/trace.h"
 #include "../core/yml.h"
 #include "../core/file.h"
 
+#include "../tekgl/renderqueue.h"
+#include "../tekgl/frustum.h"
+#include "../tekgl/simplify.h"
+#include "../tekgl/mesh.h"
+#include "../tekgl/meshbinary.h"
+#include "../tekgl/assets.h"
+
+#include "../tekphys/body.h"
+#include "../tekphys/batch.h"
+#include "../tekphys/posebuffer.h"
+#include "../tekphys/profiler.h"
+
 typedef union TestContext {
     Vector vector;
     List list;
@@ -27,8 +45,27 @@ typedef union TestContext {
     BitSet bitset;
     HashTable hashtable;
     ThreadQueue thread_queue;
+    StringTable string_table;
     char* file;
     YmlFile yml;
+    struct {
+        TekBodyStore scalar;
+        TekBodyStore simd;
+    } body_store;
+    TekPoseBuffer pose_buffer;
+    TekProfiler profiler;
+    TekRenderQueue render_queue;
+    TekCullList cull_list;
+    struct {
+        float* vertices;
+        uint* indices;
+        uint* simplified;
+    } simplify;
+    TekMeshData mesh_binary;
+    struct {
+        TekBatch first;
+        TekBatch second;
+    } determinism;
 } TestContext;
 
 tekTestCreate(vector) (TestContext* test_context) {
@@ -943,17 +980,24 @@ static void* threadQueueProducer(void* arg) {
 static void* threadQueueConsumer(void* arg) {
     ThreadQueueTestData* data = (ThreadQueueTestData*)arg;
     for (uint i = 0; i < THREAD_QUEUE_ITEMS; i++) {
-        void* out = NULL;
-        while (!threadQueueDequeue(data->queue, &out)) {
+        while (!threadQueueDequeue(data->queue, &data->consumed[i])) {
             // queue empty, spin until item appears
         }
-        data->consumed[i] = *(int*)out;
+    }
+    return NULL;
+}
+
+static void* threadQueueWaitingConsumer(void* arg) {
+    ThreadQueueTestData* data = (ThreadQueueTestData*)arg;
+    for (uint i = 0; i < THREAD_QUEUE_ITEMS; i++) {
+        // sleep until the producer wakes us up rather than spinning, giving up if it takes too long
+        if (!threadQueueDequeueTimeout(data->queue, &data->consumed[i], BILLION)) return NULL;
     }
     return NULL;
 }
 
 tekTestCreate(thread_queue) (TestContext* test_context) {
-    tekChainThrow(threadQueueCreate(&test_context->thread_queue, 32));
+    tekChainThrow(threadQueueCreate(&test_context->thread_queue, 32, sizeof(int)));
     return SUCCESS;
 }
 
@@ -965,14 +1009,14 @@ tekTestDelete(thread_queue) (TestContext* test_context) {
 tekTestFunc(thread_queue, enqueue_and_dequeue_items) (TestContext* test_context) {
     // simple test to check enqueue/dequeue order
     int values[5] = { 10, 20, 30, 40, 50 };
-    void* out = NULL;
+    int out = 0;
 
     for (uint i = 0; i < 5; i++)
         tekAssert(1, threadQueueEnqueue(&test_context->thread_queue, &values[i]));
 
     for (uint i = 0; i < 5; i++) {
         tekAssert(1, threadQueueDequeue(&test_context->thread_queue, &out));
-        tekAssert(values[i], *(int*)out);
+        tekAssert(values[i], out);
     }
 
     tekAssert(1, threadQueueIsEmpty(&test_context->thread_queue));
@@ -1000,7 +1044,7 @@ tekTestFunc(thread_queue, multithread_transfer) (TestContext* test_context) {
 
 tekTestFunc(thread_queue, boundary_and_invalid_tests) (TestContext* test_context) {
     // boundary and bogus data tests
-    void* out = NULL;
+    int out = 0;
     int value = 999;
 
     // boundary - dequeue on empty queue
@@ -1009,13 +1053,17 @@ tekTestFunc(thread_queue, boundary_and_invalid_tests) (TestContext* test_context
     // enqueue valid value
     tekAssert(1, threadQueueEnqueue(&test_context->thread_queue, &value));
 
-    // peek should give us the front item
-    tekAssert(1, threadQueuePeek(&test_context->thread_queue, &out));
-    tekAssert(&value, out);
+    // the queue stores its own copy, so changing the original shouldn't matter
+    value = 0;
+
+    // peek should give us the front item, without removing it
+    void* front = NULL;
+    tekAssert(1, threadQueuePeek(&test_context->thread_queue, &front));
+    tekAssert(999, *(int*)front);
 
-    // dequeue should return same pointer
+    // dequeue should give the same value
     tekAssert(1, threadQueueDequeue(&test_context->thread_queue, &out));
-    tekAssert(&value, out);
+    tekAssert(999, out);
 
     return SUCCESS;
 }
@@ -1023,7 +1071,7 @@ tekTestFunc(thread_queue, boundary_and_invalid_tests) (TestContext* test_context
 tekTestFunc(thread_queue, stress_test) (TestContext* test_context) {
     // stress test to see if it can keep up under load
     int values[1024];
-    void* out = NULL;
+    int out = 0;
 
     for (uint i = 0; i < 1024; i++) {
         values[i] = i;
@@ -1032,13 +1080,249 @@ tekTestFunc(thread_queue, stress_test) (TestContext* test_context) {
         }
         threadQueueDequeue(&test_context->thread_queue, &out);
         // silent assert to avoid printing 1024 lines
-        tekSilentAssert(values[i], *(int*)out);
+        tekSilentAssert(values[i], out);
     }
 
     tekAssert(1, threadQueueIsEmpty(&test_context->thread_queue));
     return SUCCESS;
 }
 
+tekTestFunc(thread_queue, drop_policy) (TestContext* test_context) {
+    ThreadQueue* queue = &test_context->thread_queue;
+    int values[32] = {};
+
+    // one slot is always left empty, so 31 items fill the queue
+    for (uint i = 0; i < 31; i++)
+        tekSilentAssert(1, threadQueueEnqueue(queue, &values[i]));
+    tekAssert(0, threadQueueEnqueue(queue, &values[31]));
+
+    ThreadQueueStats stats;
+    threadQueueGetStats(queue, &stats);
+    tekAssert(31, stats.high_water_mark);
+    tekAssert(1, stats.dropped);
+    return SUCCESS;
+}
+
+tekTestFunc(thread_queue, grow_policy) (TestContext* test_context) {
+    ThreadQueue* queue = &test_context->thread_queue;
+    threadQueueSetPolicy(queue, THREAD_QUEUE_GROW);
+    int values[100];
+    int out = 0;
+
+    // nothing should be dropped, the extra items wait in the overflow
+    for (uint i = 0; i < 100; i++) {
+        values[i] = (int)i;
+        tekSilentAssert(1, threadQueueEnqueue(queue, &values[i]));
+    }
+    tekAssert(0, threadQueueFlush(queue));
+
+    // everything should come out in order, as long as the producer keeps flushing
+    for (uint i = 0; i < 100; i++) {
+        if (threadQueueIsEmpty(queue)) threadQueueFlush(queue);
+        tekSilentAssert(1, threadQueueDequeue(queue, &out));
+        tekSilentAssert(values[i], out);
+    }
+    tekAssert(1, threadQueueFlush(queue));
+    tekAssert(1, threadQueueIsEmpty(queue));
+
+    ThreadQueueStats stats;
+    threadQueueGetStats(queue, &stats);
+    tekAssert(100, stats.high_water_mark);
+    tekAssert(0, stats.dropped);
+    return SUCCESS;
+}
+
+tekTestFunc(thread_queue, coalesce_policy) (TestContext* test_context) {
+    ThreadQueue* queue = &test_context->thread_queue;
+    threadQueueSetPolicy(queue, THREAD_QUEUE_COALESCE);
+    int values[31] = {}, first = 1, second = 2, third = 3;
+    int out = 0;
+
+    // fill the ring so that the keyed items overflow
+    for (uint i = 0; i < 31; i++)
+        tekSilentAssert(1, threadQueueEnqueue(queue, &values[i]));
+    tekAssert(1, threadQueueEnqueueKeyed(queue, &first, 7));
+    tekAssert(1, threadQueueEnqueueKeyed(queue, &second, 8));
+
+    // same key as first, so it should be written over it
+    tekAssert(1, threadQueueEnqueueKeyed(queue, &third, 7));
+
+    for (uint i = 0; i < 31; i++)
+        tekSilentAssert(1, threadQueueDequeue(queue, &out));
+    tekAssert(1, threadQueueFlush(queue));
+    tekAssert(1, threadQueueDequeue(queue, &out));
+    tekAssert(third, out);
+    tekAssert(1, threadQueueDequeue(queue, &out));
+    tekAssert(second, out);
+    tekAssert(0, threadQueueDequeue(queue, &out));
+
+    ThreadQueueStats stats;
+    threadQueueGetStats(queue, &stats);
+    tekAssert(1, stats.coalesced);
+    tekAssert(0, stats.dropped);
+    return SUCCESS;
+}
+
+tekTestFunc(thread_queue, block_policy) (TestContext* test_context) {
+    // same as the multithreaded test, but the producer sleeps instead of failing when the queue is full
+    threadQueueSetPolicy(&test_context->thread_queue, THREAD_QUEUE_BLOCK);
+    ThreadQueueTestData shared = { .queue = &test_context->thread_queue };
+
+    pthread_t prod, cons;
+    pthread_create(&prod, NULL, threadQueueProducer, &shared);
+    pthread_create(&cons, NULL, threadQueueConsumer, &shared);
+
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+
+    for (uint i = 0; i < THREAD_QUEUE_ITEMS; i++)
+        tekSilentAssert(shared.produced[i], shared.consumed[i]);
+
+    ThreadQueueStats stats;
+    threadQueueGetStats(&test_context->thread_queue, &stats);
+    tekAssert(0, stats.dropped);
+    return SUCCESS;
+}
+
+tekTestFunc(thread_queue, dequeue_timeout) (TestContext* test_context) {
+    int out = 0;
+
+    // nothing will ever arrive, so this should give up after the timeout
+    tekAssert(0, threadQueueDequeueTimeout(&test_context->thread_queue, &out, 1000000));
+    tekAssert(0, threadQueueWait(&test_context->thread_queue, 1000000));
+
+    // the consumer sleeps whenever the queue is empty, the producer has to wake it up
+    ThreadQueueTestData shared = { .queue = &test_context->thread_queue };
+
+    pthread_t prod, cons;
+    pthread_create(&cons, NULL, threadQueueWaitingConsumer, &shared);
+    pthread_create(&prod, NULL, threadQueueProducer, &shared);
+
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+
+    for (uint i = 0; i < THREAD_QUEUE_ITEMS; i++)
+        tekSilentAssert(shared.produced[i], shared.consumed[i]);
+
+    tekAssert(1, threadQueueIsEmpty(&test_context->thread_queue));
+    return SUCCESS;
+}
+
+tekTestFunc(thread_queue, batch_operations) (TestContext* test_context) {
+    ThreadQueue* queue = &test_context->thread_queue;
+    int values[40];
+    int out[40];
+    for (uint i = 0; i < 40; i++)
+        values[i] = (int)i;
+
+    // go part of the way round first, so that the batches have to wrap around the end of the ring
+    tekAssert(20, threadQueueEnqueueBatch(queue, values, 20));
+    tekAssert(20, threadQueueDequeueBatch(queue, out, 40));
+
+    // only 31 fit, the rest get dropped
+    tekAssert(31, threadQueueEnqueueBatch(queue, values, 40));
+    tekAssert(10, threadQueueDequeueBatch(queue, out, 10));
+    for (uint i = 0; i < 10; i++)
+        tekSilentAssert(values[i], out[i]);
+    tekAssert(21, threadQueueDequeueBatch(queue, out, 40));
+    for (uint i = 0; i < 21; i++)
+        tekSilentAssert(values[i + 10], out[i]);
+    tekAssert(0, threadQueueDequeueBatch(queue, out, 40));
+
+    ThreadQueueStats stats;
+    threadQueueGetStats(queue, &stats);
+    tekAssert(31, stats.high_water_mark);
+    tekAssert(9, stats.dropped);
+
+    // with the grow policy, the ones that don't fit should wait in the overflow instead
+    threadQueueSetPolicy(queue, THREAD_QUEUE_GROW);
+    tekAssert(40, threadQueueEnqueueBatch(queue, values, 40));
+    tekAssert(31, threadQueueDequeueBatch(queue, out, 40));
+    tekAssert(1, threadQueueFlush(queue));
+    tekAssert(9, threadQueueDequeueBatch(queue, out, 40));
+    for (uint i = 0; i < 9; i++)
+        tekSilentAssert(values[i + 31], out[i]);
+
+    return SUCCESS;
+}
+
+tekTestFunc(thread_queue, power_of_two_capacity) (TestContext* test_context) {
+    // 20 should be rounded up to 32, which holds 31 items
+    ThreadQueue queue;
+    tekChainThrow(threadQueueCreate(&queue, 20, sizeof(int)));
+    int value = 0;
+    for (uint i = 0; i < 31; i++)
+        tekSilentAssert(1, threadQueueEnqueue(&queue, &value));
+    tekAssert(0, threadQueueEnqueue(&queue, &value));
+    threadQueueDelete(&queue);
+    return SUCCESS;
+}
+
+tekTestFunc(thread_queue, reserve_and_commit) (TestContext* test_context) {
+    ThreadQueue* queue = &test_context->thread_queue;
+    int out = 0;
+
+    // write straight into the slot, nothing is visible until it is committed
+    int* slot = (int*)threadQueueReserve(queue);
+    tekAssert(1, slot != NULL);
+    *slot = 42;
+    tekAssert(1, threadQueueIsEmpty(queue));
+    tekAssert(1, threadQueueCommit(queue));
+    tekAssert(1, threadQueueDequeue(queue, &out));
+    tekAssert(42, out);
+
+    // when the ring is full, the grow policy should hand out a slot in the overflow instead
+    threadQueueSetPolicy(queue, THREAD_QUEUE_GROW);
+    int value = 0;
+    for (uint i = 0; i < 31; i++)
+        tekSilentAssert(1, threadQueueEnqueue(queue, &value));
+    slot = (int*)threadQueueReserve(queue);
+    tekAssert(1, slot != NULL);
+    *slot = 43;
+    tekAssert(1, threadQueueCommit(queue));
+    for (uint i = 0; i < 31; i++)
+        tekSilentAssert(1, threadQueueDequeue(queue, &out));
+    tekAssert(1, threadQueueFlush(queue));
+    tekAssert(1, threadQueueDequeue(queue, &out));
+    tekAssert(43, out);
+
+    return SUCCESS;
+}
+
+tekTestCreate(string_table) (TestContext* test_context) {
+    tekChainThrow(stringTableCreate(&test_context->string_table));
+    return SUCCESS;
+}
+
+tekTestDelete(string_table) (TestContext* test_context) {
+    stringTableDelete(&test_context->string_table);
+    return SUCCESS;
+}
+
+tekTestFunc(string_table, intern_strings) (TestContext* test_context) {
+    char buffer[16] = "cube.tmsh";
+    const char* first;
+    const char* second;
+    const char* other;
+
+    tekChainThrow(stringTableIntern(&test_context->string_table, buffer, &first));
+    tekAssert(0, strcmp(first, "cube.tmsh"));
+
+    // the interned copy is not the string that was passed in, so changing that should not matter
+    tekAssert(1, first != buffer);
+    strcpy(buffer, "sphere.tmsh");
+    tekAssert(0, strcmp(first, "cube.tmsh"));
+
+    // equal strings should give the same pointer, different strings a different one
+    tekChainThrow(stringTableIntern(&test_context->string_table, "cube.tmsh", &second));
+    tekAssert(first, second);
+    tekChainThrow(stringTableIntern(&test_context->string_table, buffer, &other));
+    tekAssert(1, first != other);
+    tekAssert(0, strcmp(other, "sphere.tmsh"));
+
+    return SUCCESS;
+}
+
 tekTestCreate(file) (TestContext* test_context) {
     return SUCCESS;
 }
@@ -1261,6 +1545,940 @@ tekTestFunc(yml, syntax_errors) (TestContext* test_context) {
     return SUCCESS;
 }
 
+#define BODY_STORE_TEST_LENGTH 37
+#define BODY_STORE_TEST_TICKS 120
+#define BODY_STORE_TEST_TOLERANCE 1e-4f
+
+/**
+ * Produce a random float within a range, using a fixed seed so that the tests are repeatable.
+ * @param seed The state of the random number generator, updated each call.
+ * @param min The smallest possible value.
+ * @param max The largest possible value.
+ * @return The random value.
+ */
+static float randomFloat(uint* seed, const float min, const float max) {
+    // good old linear congruential generator
+    *seed = *seed * 1664525u + 1013904223u;
+    return min + (max - min) * (float)(*seed >> 8) / (float)(1u << 24);
+}
+
+tekTestCreate(body_store) (TestContext* test_context) {
+    tekChainThrow(tekCreateBodyStore(1, &test_context->body_store.scalar));
+    tekChainThrow(tekCreateBodyStore(1, &test_context->body_store.simd));
+    tekChainThrow(tekBodyStoreReserve(&test_context->body_store.scalar, BODY_STORE_TEST_LENGTH));
+    tekChainThrow(tekBodyStoreReserve(&test_context->body_store.simd, BODY_STORE_TEST_LENGTH));
+
+    // fill both stores with the same random bodies
+    // length is not a multiple of 8, so the leftover bodies in the vectorised version get tested too.
+    uint seed = 12345;
+    const TekBodyStore* scalar = &test_context->body_store.scalar;
+    for (uint i = 0; i < BODY_STORE_TEST_LENGTH; i++) {
+        // leave some empty slots
+        if (i % 11 == 5) continue;
+
+        for (uint j = 0; j < 3; j++) {
+            scalar->positions[i][j] = randomFloat(&seed, -10.0f, 10.0f);
+            scalar->velocities[i][j] = randomFloat(&seed, -5.0f, 5.0f);
+            // some fast spinning bodies to make sure sin and cos work for bigger angles
+            scalar->angular_velocities[i][j] = randomFloat(&seed, -20.0f, 20.0f) * (i % 5 == 0 ? 10.0f : 1.0f);
+        }
+        for (uint j = 0; j < 4; j++)
+            scalar->rotations[i][j] = randomFloat(&seed, -1.0f, 1.0f);
+        glm_quat_normalize(scalar->rotations[i]);
+        scalar->inverse_masses[i] = 1.0f;
+        glm_mat3_zero(scalar->inverse_inertia_tensors[i]);
+        for (uint j = 0; j < 3; j++)
+            scalar->inverse_inertia_tensors[i][j][j] = randomFloat(&seed, 0.1f, 2.0f);
+        scalar->flags[i] = BODY_FLAG_ACTIVE;
+        tekBodyStoreSetImmovable(scalar, i, i % 7 == 3);
+    }
+
+    const TekBodyStore* simd = &test_context->body_store.simd;
+    memcpy(simd->positions, scalar->positions, BODY_STORE_TEST_LENGTH * sizeof(vec3));
+    memcpy(simd->velocities, scalar->velocities, BODY_STORE_TEST_LENGTH * sizeof(vec3));
+    memcpy(simd->rotations, scalar->rotations, BODY_STORE_TEST_LENGTH * sizeof(vec4));
+    memcpy(simd->angular_velocities, scalar->angular_velocities, BODY_STORE_TEST_LENGTH * sizeof(vec3));
+    memcpy(simd->inverse_masses, scalar->inverse_masses, BODY_STORE_TEST_LENGTH * sizeof(float));
+    memcpy(simd->inverse_inertia_tensors, scalar->inverse_inertia_tensors, BODY_STORE_TEST_LENGTH * sizeof(mat3));
+    memcpy(simd->flags, scalar->flags, BODY_STORE_TEST_LENGTH * sizeof(flag));
+
+    return SUCCESS;
+}
+
+tekTestDelete(body_store) (TestContext* test_context) {
+    tekDeleteBodyStore(&test_context->body_store.scalar);
+    tekDeleteBodyStore(&test_context->body_store.simd);
+    return SUCCESS;
+}
+
+tekTestFunc(body_store, reserve_clears_slots) (TestContext* test_context) {
+    TekBodyStore* store = &test_context->body_store.scalar;
+
+    // growing should keep existing bodies, and new slots should be empty
+    vec3 position;
+    glm_vec3_copy(store->positions[1], position);
+    tekChainThrow(tekBodyStoreReserve(store, BODY_STORE_TEST_LENGTH * 4));
+    tekAssert(BODY_STORE_TEST_LENGTH * 4, store->length);
+    tekAssert(1, store->capacity >= store->length);
+    tekAssert(position[0], store->positions[1][0]);
+    tekAssert(0, store->flags[BODY_STORE_TEST_LENGTH * 4 - 1]);
+    tekAssert(1.0f, store->rotations[BODY_STORE_TEST_LENGTH * 4 - 1][3]);
+    tekAssert(1.0f, store->transforms[BODY_STORE_TEST_LENGTH * 4 - 1][3][3]);
+
+    // reserving less than the length should do nothing
+    tekChainThrow(tekBodyStoreReserve(store, 1));
+    tekAssert(BODY_STORE_TEST_LENGTH * 4, store->length);
+
+    return SUCCESS;
+}
+
+tekTestFunc(body_store, simd_matches_scalar) (TestContext* test_context) {
+    const TekBodyStore* scalar = &test_context->body_store.scalar;
+    const TekBodyStore* simd = &test_context->body_store.simd;
+
+    for (uint tick = 0; tick < BODY_STORE_TEST_TICKS; tick++) {
+        tekBodyAdvanceTimeScalar(scalar, 1.0f / 30.0f, 9.81f);
+        if (!tekBodyAdvanceTimeSIMD(simd, 1.0f / 30.0f, 9.81f)) {
+            printf("    Vectorised integrator not supported, skipping.\n");
+            return SUCCESS;
+        }
+    }
+
+    // every value should match to within floating point error
+    for (uint i = 0; i < BODY_STORE_TEST_LENGTH; i++) {
+        for (uint j = 0; j < 3; j++) {
+            tekSilentAssert(1, fabsf(scalar->positions[i][j] - simd->positions[i][j]) < BODY_STORE_TEST_TOLERANCE);
+            tekSilentAssert(1, fabsf(scalar->velocities[i][j] - simd->velocities[i][j]) < BODY_STORE_TEST_TOLERANCE);
+        }
+        for (uint j = 0; j < 4; j++) {
+            tekSilentAssert(1, fabsf(scalar->rotations[i][j] - simd->rotations[i][j]) < BODY_STORE_TEST_TOLERANCE);
+            for (uint k = 0; k < 4; k++)
+                tekSilentAssert(1, fabsf(scalar->transforms[i][j][k] - simd->transforms[i][j][k]) < BODY_STORE_TEST_TOLERANCE);
+        }
+        for (uint j = 0; j < 3; j++) {
+            for (uint k = 0; k < 3; k++)
+                tekSilentAssert(1, fabsf(scalar->world_inverse_inertia_tensors[i][j][k] - simd->world_inverse_inertia_tensors[i][j][k]) < BODY_STORE_TEST_TOLERANCE);
+        }
+    }
+
+    // immovable bodies and empty slots should not have moved at all
+    tekAssert(0.0f, simd->velocities[3][0]);
+    tekAssert(1.0f, simd->rotations[5][3]);
+    tekAssert(1.0f, simd->transforms[5][0][0]);
+
+    return SUCCESS;
+}
+
+tekTestFunc(body_store, world_inertia_rotates) (TestContext* test_context) {
+    const TekBodyStore* store = &test_context->body_store.scalar;
+
+    // inertia of 1, 2, 3 around the x, y and z axes
+    glm_mat3_zero(store->inverse_inertia_tensors[0]);
+    store->inverse_inertia_tensors[0][0][0] = 1.0f;
+    store->inverse_inertia_tensors[0][1][1] = 2.0f;
+    store->inverse_inertia_tensors[0][2][2] = 3.0f;
+
+    // after a quarter turn around z, the x and y axes should swap over
+    glm_quatv(store->rotations[0], GLM_PIf * 0.5f, (vec3){ 0.0f, 0.0f, 1.0f });
+    tekBodyUpdateTransform(store, 0);
+    tekSilentAssert(1, fabsf(store->world_inverse_inertia_tensors[0][0][0] - 2.0f) < BODY_STORE_TEST_TOLERANCE);
+    tekSilentAssert(1, fabsf(store->world_inverse_inertia_tensors[0][1][1] - 1.0f) < BODY_STORE_TEST_TOLERANCE);
+    tekSilentAssert(1, fabsf(store->world_inverse_inertia_tensors[0][2][2] - 3.0f) < BODY_STORE_TEST_TOLERANCE);
+    tekSilentAssert(1, fabsf(store->world_inverse_inertia_tensors[0][0][1]) < BODY_STORE_TEST_TOLERANCE);
+
+    return SUCCESS;
+}
+
+tekTestCreate(pose_buffer) (TestContext* test_context) {
+    tekChainThrow(tekCreatePoseBuffer(&test_context->pose_buffer));
+    return SUCCESS;
+}
+
+tekTestDelete(pose_buffer) (TestContext* test_context) {
+    tekDeletePoseBuffer(&test_context->pose_buffer);
+    return SUCCESS;
+}
+
+tekTestFunc(pose_buffer, latest_frame_wins) (TestContext* test_context) {
+    TekPoseBuffer* pose_buffer = &test_context->pose_buffer;
+    const TekPoseFrame* read_frame;
+
+    // nothing published yet
+    tekAssert(0, tekPoseBufferRead(pose_buffer, &read_frame));
+    tekAssert(0, read_frame->length);
+
+    // publish two frames without reading, only the second should be seen
+    for (uint i = 1; i <= 2; i++) {
+        TekPoseFrame* write_frame;
+        tekChainThrow(tekPoseBufferBeginWrite(pose_buffer, i * 10, &write_frame));
+        for (uint j = 0; j < i * 10; j++)
+            write_frame->positions[j][0] = (float)(i * 100 + j);
+        write_frame->alpha = (float)i;
+        tekPoseBufferPublish(pose_buffer);
+    }
+    tekAssert(1, tekPoseBufferRead(pose_buffer, &read_frame));
+    tekAssert(20, read_frame->length);
+    tekAssert(2.0f, read_frame->alpha);
+    tekAssert(219.0f, read_frame->positions[19][0]);
+
+    // reading again without a new frame keeps the same one
+    const TekPoseFrame* same_frame;
+    tekAssert(0, tekPoseBufferRead(pose_buffer, &same_frame));
+    tekAssert(read_frame, same_frame);
+
+    // the three frames should always be different, so neither thread can touch the other's frame
+    tekAssert(1, pose_buffer->back != pose_buffer->front);
+    tekAssert(1, pose_buffer->back != (atomic_load(&pose_buffer->middle) & POSE_BUFFER_INDEX_MASK));
+    tekAssert(1, pose_buffer->front != (atomic_load(&pose_buffer->middle) & POSE_BUFFER_INDEX_MASK));
+
+    return SUCCESS;
+}
+
+tekTestCreate(profiler) (TestContext* test_context) {
+    tekCreateProfiler(&test_context->profiler);
+    return SUCCESS;
+}
+
+tekTestDelete(profiler) (TestContext* test_context) {
+    return SUCCESS;
+}
+
+tekTestFunc(profiler, percentiles) (TestContext* test_context) {
+    TekProfiler* profiler = &test_context->profiler;
+
+    // nothing recorded, so everything should be zero
+    TekProfileSummary summary;
+    tekProfilerGetSummary(profiler, &summary);
+    tekAssert(0.0f, summary.median[PROFILE_SOLVER]);
+
+    // 1 to 100 microseconds, recorded backwards so that the summary has to sort them
+    for (uint i = 100; i > 0; i--) {
+        profiler->current[PROFILE_SOLVER] = (long long)i * 1000;
+        tekProfilerEndTick(profiler);
+    }
+    tekProfilerGetSummary(profiler, &summary);
+    tekAssert(50.0f, summary.median[PROFILE_SOLVER]);
+    tekAssert(99.0f, summary.p99[PROFILE_SOLVER]);
+    tekAssert(0.0f, summary.p99[PROFILE_EVENTS]);
+
+    // each tick should start from zero again
+    tekAssert(0, profiler->current[PROFILE_SOLVER]);
+
+    return SUCCESS;
+}
+
+tekTestFunc(profiler, history_wraps) (TestContext* test_context) {
+    TekProfiler* profiler = &test_context->profiler;
+
+    // the first 10 ticks are very slow, but should be pushed out of the history by the rest
+    for (uint i = 0; i < PROFILE_HISTORY + 10; i++) {
+        profiler->current[PROFILE_INTEGRATE] = i < 10 ? 1000000 : 2000;
+        tekProfilerEndTick(profiler);
+    }
+    TekProfileSummary summary;
+    tekProfilerGetSummary(profiler, &summary);
+    tekAssert(2.0f, summary.p99[PROFILE_INTEGRATE]);
+
+    // csv should start from the oldest tick that is still remembered
+    const char* filename = "profiler_test.csv";
+    tekChainThrow(tekProfilerWriteCSV(profiler, filename));
+    char buffer[256] = {};
+    FILE* file = fopen(filename, "r");
+    tekAssert(1, file != NULL);
+    tekAssert(1, fgets(buffer, sizeof(buffer), file) != NULL);
+    tekAssert(0, strncmp(buffer, "tick,events_us,", 15));
+    tekAssert(1, fgets(buffer, sizeof(buffer), file) != NULL);
+    tekAssert(0, strncmp(buffer, "10,", 3));
+    fclose(file);
+    remove(filename);
+
+    return SUCCESS;
+}
+
+tekTestCreate(trace) (TestContext* test_context) {
+    test_context->file = 0;
+    return SUCCESS;
+}
+
+tekTestDelete(trace) (TestContext* test_context) {
+    free(test_context->file);
+    traceDelete();
+    return SUCCESS;
+}
+
+static void* traceWorker(void* arg) {
+    traceSetThreadName("trace worker");
+    traceRecord("worker section", TRACE_BEGIN);
+    traceRecord("worker section", TRACE_END);
+    return NULL;
+}
+
+tekTestFunc(trace, capture_to_json) (TestContext* test_context) {
+    // calls the functions rather than the macros, so that this is tested even when the markers aren't built in
+    traceRecord("before capture", TRACE_BEGIN);
+    traceStartCapture();
+    tekAssert(1, traceIsCapturing());
+    traceSetThreadName("trace test");
+    traceRecord("outer \"quoted\"", TRACE_BEGIN);
+    pthread_t worker;
+    tekAssert(0, pthread_create(&worker, NULL, traceWorker, NULL));
+    pthread_join(worker, NULL);
+    traceRecord("outer \"quoted\"", TRACE_END);
+
+    const char* filename = "trace_test.json";
+    tekChainThrow(traceStopCapture(filename));
+    tekAssert(0, traceIsCapturing());
+    traceRecord("after capture", TRACE_BEGIN);
+
+    uint len_file;
+    tekChainThrow(getFileSize(filename, &len_file));
+    test_context->file = (char*)malloc(len_file);
+    tekAssert(1, test_context->file != NULL);
+    tekChainThrow(readFile(filename, len_file, test_context->file));
+    remove(filename);
+
+    // both threads should be there by name, with the quotes escaped, and nothing from outside the capture
+    const char* json = test_context->file;
+    tekAssert(0, strncmp(json, "{\"traceEvents\":[", 16));
+    tekAssert(1, strstr(json, "\"args\":{\"name\":\"trace test\"}") != NULL);
+    tekAssert(1, strstr(json, "\"args\":{\"name\":\"trace worker\"}") != NULL);
+    tekAssert(1, strstr(json, "{\"name\":\"outer \\\"quoted\\\"\",\"ph\":\"B\"") != NULL);
+    tekAssert(1, strstr(json, "{\"name\":\"worker section\",\"ph\":\"E\"") != NULL);
+    tekAssert(1, strstr(json, "before capture") == NULL);
+    tekAssert(1, strstr(json, "after capture") == NULL);
+    tekAssert(1, strstr(json, "\"displayTimeUnit\":\"ms\"}") != NULL);
+
+    // a new capture should forget everything from the last one
+    traceStartCapture();
+    tekChainThrow(traceStopCapture(filename));
+    free(test_context->file);
+    tekChainThrow(getFileSize(filename, &len_file));
+    test_context->file = (char*)malloc(len_file);
+    tekAssert(1, test_context->file != NULL);
+    tekChainThrow(readFile(filename, len_file, test_context->file));
+    remove(filename);
+    tekAssert(1, strstr(test_context->file, "worker section") == NULL);
+
+    return SUCCESS;
+}
+
+static void* traceLateWorker(void* arg) {
+    traceSetThreadName("trace late worker");
+    traceRecord("late section", TRACE_BEGIN);
+    traceRecord("late section", TRACE_END);
+    return NULL;
+}
+
+tekTestFunc(trace, reuses_thread_buffers) (TestContext* test_context) {
+    // far more threads than buffers, but never more than one at a time, so every one of them should get a buffer
+    traceStartCapture();
+    for (uint i = 0; i < TRACE_MAX_THREADS * 2; i++) {
+        pthread_t worker;
+        tekAssert(0, pthread_create(&worker, NULL, traceWorker, NULL));
+        pthread_join(worker, NULL);
+    }
+    pthread_t worker;
+    tekAssert(0, pthread_create(&worker, NULL, traceLateWorker, NULL));
+    pthread_join(worker, NULL);
+
+    const char* filename = "trace_test.json";
+    tekChainThrow(traceStopCapture(filename));
+    uint len_file;
+    tekChainThrow(getFileSize(filename, &len_file));
+    test_context->file = (char*)malloc(len_file);
+    tekAssert(1, test_context->file != NULL);
+    tekChainThrow(readFile(filename, len_file, test_context->file));
+    remove(filename);
+
+    tekAssert(1, strstr(test_context->file, "\"args\":{\"name\":\"trace late worker\"}") != NULL);
+    tekAssert(1, strstr(test_context->file, "{\"name\":\"late section\",\"ph\":\"E\"") != NULL);
+
+    return SUCCESS;
+}
+
+tekTestCreate(render_queue) (TestContext* test_context) {
+    tekChainThrow(tekCreateRenderQueue(1, &test_context->render_queue));
+    return SUCCESS;
+}
+
+tekTestDelete(render_queue) (TestContext* test_context) {
+    tekDeleteRenderQueue(&test_context->render_queue);
+    return SUCCESS;
+}
+
+tekTestFunc(render_queue, key_order) (TestContext* test_context) {
+    // solid things are grouped by shader, then material, then mesh, then drawn front to back
+    tekAssert(1, tekRenderKey(0, 1, 9, 9, 1.0f) < tekRenderKey(0, 2, 0, 0, 0.0f));
+    tekAssert(1, tekRenderKey(0, 1, 1, 9, 1.0f) < tekRenderKey(0, 1, 2, 0, 0.0f));
+    tekAssert(1, tekRenderKey(0, 1, 1, 1, 1.0f) < tekRenderKey(0, 1, 1, 2, 0.0f));
+    tekAssert(1, tekRenderKey(0, 1, 1, 1, 0.25f) < tekRenderKey(0, 1, 1, 1, 0.5f));
+
+    // translucent things go after all of that, furthest away first whatever they are drawn with
+    tekAssert(1, tekRenderKey(0, 1023, 9, 9, 1.0f) < tekRenderKey(1, 0, 0, 0, 1.0f));
+    tekAssert(1, tekRenderKey(1, 2, 2, 2, 0.75f) < tekRenderKey(1, 1, 1, 1, 0.5f));
+    tekAssert(1, tekRenderKey(1, 1, 1, 1, 0.5f) < tekRenderKey(1, 2, 1, 1, 0.5f));
+
+    // depth outside of 0 to 1 is clamped
+    tekAssert(tekRenderKey(0, 1, 1, 1, 0.0f), tekRenderKey(0, 1, 1, 1, -5.0f));
+    tekAssert(tekRenderKey(0, 1, 1, 1, 0.0f), tekRenderKey(0, 1, 1, 1, NAN));
+    tekAssert(tekRenderKey(0, 1, 1, 1, 1.0f), tekRenderKey(0, 1, 1, 1, 100.0f));
+
+    return SUCCESS;
+}
+
+tekTestFunc(render_queue, sort_packets) (TestContext* test_context) {
+    TekRenderQueue* queue = &test_context->render_queue;
+
+    // lots of repeated keys, spread over every byte, pushed in a scrambled order. starts with space for 1 so it has to grow
+    const uint num_packets = 1000;
+    uint seed = 12345;
+    for (uint i = 0; i < num_packets; i++) {
+        seed = seed * 1103515245 + 12345;
+        const unsigned long long key = (unsigned long long)(seed % 37) * 0x0102040810204081ULL;
+        tekChainThrow(tekPushRenderPacket(queue, key, (void*)(size_t)i));
+    }
+    tekAssert(num_packets, queue->length);
+    tekAssert(num_packets, queue->stats.num_packets);
+
+    // keys in order, and packets with the same key still in the order they were pushed
+    tekSortRenderQueue(queue);
+    unsigned long long index_sum = 0;
+    for (uint i = 0; i < num_packets; i++) {
+        index_sum += (size_t)queue->packets[i].data;
+        if (!i) continue;
+        const TekRenderPacket* previous = queue->packets + i - 1;
+        const TekRenderPacket* packet = queue->packets + i;
+        tekSilentAssert(1, previous->key <= packet->key);
+        if (previous->key == packet->key) tekSilentAssert(1, (size_t)previous->data < (size_t)packet->data);
+    }
+    tekAssert((unsigned long long)num_packets * (num_packets - 1) / 2, index_sum);
+
+    // only the top byte differs, so only one pass runs and the sorted packets end up in the other buffer
+    tekClearRenderQueue(queue);
+    tekAssert(0, queue->stats.num_packets);
+    for (uint i = 0; i < 4; i++)
+        tekChainThrow(tekPushRenderPacket(queue, (unsigned long long)(3 - i) << 56, (void*)(size_t)i));
+    tekSortRenderQueue(queue);
+    for (uint i = 0; i < 4; i++)
+        tekAssert(3 - i, (size_t)queue->packets[i].data);
+
+    return SUCCESS;
+}
+
+#define CULL_LIST_TEST_LENGTH 1003 // not a multiple of 8, so the vectorised version has some left over
+
+// a box from -10 to 10 on each axis, all facing inwards
+static vec4 cull_list_test_planes[FRUSTUM_NUM_PLANES] = {
+    { 1.0f, 0.0f, 0.0f, 10.0f }, { -1.0f, 0.0f, 0.0f, 10.0f },
+    { 0.0f, 1.0f, 0.0f, 10.0f }, { 0.0f, -1.0f, 0.0f, 10.0f },
+    { 0.0f, 0.0f, 1.0f, 10.0f }, { 0.0f, 0.0f, -1.0f, 10.0f }
+};
+
+tekTestCreate(cull_list) (TestContext* test_context) {
+    tekChainThrow(tekCreateCullList(1, &test_context->cull_list));
+    return SUCCESS;
+}
+
+tekTestDelete(cull_list) (TestContext* test_context) {
+    tekDeleteCullList(&test_context->cull_list);
+    return SUCCESS;
+}
+
+tekTestFunc(cull_list, known_spheres) (TestContext* test_context) {
+    TekCullList* list = &test_context->cull_list;
+
+    // centre, radius and whether it should be visible. repeated to fill a few batches of 8 plus some left over
+    const struct {
+        vec3 center;
+        float radius;
+        flag visible;
+    } spheres[] = {
+        { { 0.0f, 0.0f, 0.0f }, 1.0f, 1 }, // in the middle
+        { { 11.0f, 0.0f, 0.0f }, 2.0f, 1 }, // centre outside but poking in
+        { { 13.0f, 0.0f, 0.0f }, 2.0f, 0 }, // just too far out
+        { { 0.0f, -30.0f, 0.0f }, 5.0f, 0 }, // well below
+        { { 0.0f, 0.0f, 25.0f }, 20.0f, 1 }, // big enough to reach in
+        { { 11.0f, 11.0f, 0.0f }, 1.5f, 1 }, // past the corner, only outside one plane at a time by less than the radius
+        { { 500.0f, 0.0f, 0.0f }, -1.0f, 1 }, // unknown size, never culled
+    };
+    const uint num_spheres = sizeof(spheres) / sizeof(spheres[0]);
+    for (uint i = 0; i < num_spheres * 3; i++)
+        tekChainThrow(tekAddCullSphere(list, (float*)spheres[i % num_spheres].center, spheres[i % num_spheres].radius, (void*)(size_t)i));
+    tekAssert(num_spheres * 3, list->length);
+    tekAssert(1, list->capacity >= list->length);
+    tekAssert(num_spheres * 3 - 1, (size_t)list->data[num_spheres * 3 - 1]);
+
+    tekAssert(15, tekCullSpheresScalar(list, cull_list_test_planes));
+    for (uint i = 0; i < list->length; i++)
+        tekSilentAssert(spheres[i % num_spheres].visible, list->visible[i]);
+
+    // same answers from the vectorised version, after scrambling what the scalar one wrote
+    memset(list->visible, 2, list->length);
+    uint num_visible = 0;
+    if (!tekCullSpheresSIMD(list, cull_list_test_planes, &num_visible)) {
+        printf("    Vectorised culling not supported, skipping.\n");
+        return SUCCESS;
+    }
+    tekAssert(15, num_visible);
+    for (uint i = 0; i < list->length; i++)
+        tekSilentAssert(spheres[i % num_spheres].visible, list->visible[i]);
+
+    tekClearCullList(list);
+    tekAssert(0, list->length);
+    tekAssert(0, tekCullSpheres(list, cull_list_test_planes));
+
+    return SUCCESS;
+}
+
+tekTestFunc(cull_list, simd_matches_scalar) (TestContext* test_context) {
+    TekCullList* list = &test_context->cull_list;
+
+    // spheres scattered around the box, about half of them inside
+    uint seed = 54321;
+    for (uint i = 0; i < CULL_LIST_TEST_LENGTH; i++) {
+        vec3 center;
+        for (uint j = 0; j < 3; j++) {
+            seed = seed * 1103515245 + 12345;
+            center[j] = (float)((seed >> 8) % 4000) / 100.0f - 20.0f;
+        }
+        seed = seed * 1103515245 + 12345;
+        tekChainThrow(tekAddCullSphere(list, center, (float)((seed >> 8) % 500) / 100.0f, NULL));
+    }
+
+    const uint num_scalar = tekCullSpheresScalar(list, cull_list_test_planes);
+    flag* scalar_visible = (flag*)malloc(list->length * sizeof(flag));
+    tekAssert(1, scalar_visible != NULL);
+    memcpy(scalar_visible, list->visible, list->length * sizeof(flag));
+
+    uint num_simd = 0;
+    if (!tekCullSpheresSIMD(list, cull_list_test_planes, &num_simd)) {
+        printf("    Vectorised culling not supported, skipping.\n");
+        free(scalar_visible);
+        return SUCCESS;
+    }
+    uint num_different = 0;
+    for (uint i = 0; i < list->length; i++)
+        num_different += scalar_visible[i] != list->visible[i];
+    free(scalar_visible);
+    tekAssert(0, num_different);
+    tekAssert(num_scalar, num_simd);
+    tekAssert(1, num_scalar > 0 && num_scalar < CULL_LIST_TEST_LENGTH);
+
+    return SUCCESS;
+}
+
+#define SIMPLIFY_TEST_ROWS    24 // rows of quads in the test sphere, with twice as many columns
+#define SIMPLIFY_TEST_COLUMNS (SIMPLIFY_TEST_ROWS * 2)
+#define SIMPLIFY_TEST_VERTICES ((SIMPLIFY_TEST_ROWS + 1) * (SIMPLIFY_TEST_COLUMNS + 1))
+#define SIMPLIFY_TEST_INDICES  (SIMPLIFY_TEST_ROWS * SIMPLIFY_TEST_COLUMNS * 6)
+
+static const int simplify_test_layout[] = { 3, 3 };
+
+tekTestCreate(simplify) (TestContext* test_context) {
+    // a unit sphere with a vertex at each grid point, so the first and last column are at the same position, as are each pole's row, like a seam in a real mesh
+    test_context->simplify.vertices = (float*)malloc(SIMPLIFY_TEST_VERTICES * 6 * sizeof(float));
+    test_context->simplify.indices = (uint*)malloc(SIMPLIFY_TEST_INDICES * sizeof(uint));
+    test_context->simplify.simplified = 0;
+    tekAssert(1, test_context->simplify.vertices && test_context->simplify.indices);
+
+    float* vertex = test_context->simplify.vertices;
+    for (uint row = 0; row <= SIMPLIFY_TEST_ROWS; row++) {
+        for (uint column = 0; column <= SIMPLIFY_TEST_COLUMNS; column++) {
+            const float theta = (float)row / SIMPLIFY_TEST_ROWS * 3.14159265f;
+            const float phi = (float)(column % SIMPLIFY_TEST_COLUMNS) / SIMPLIFY_TEST_COLUMNS * 6.28318531f;
+            const float ring = (row == 0 || row == SIMPLIFY_TEST_ROWS) ? 0.0f : sinf(theta);
+            vertex[0] = vertex[3] = ring * cosf(phi);
+            vertex[1] = vertex[4] = row == 0 ? 1.0f : row == SIMPLIFY_TEST_ROWS ? -1.0f : cosf(theta);
+            vertex[2] = vertex[5] = ring * sinf(phi);
+            vertex += 6;
+        }
+    }
+    uint* index = test_context->simplify.indices;
+    for (uint row = 0; row < SIMPLIFY_TEST_ROWS; row++) {
+        for (uint column = 0; column < SIMPLIFY_TEST_COLUMNS; column++) {
+            const uint corner = row * (SIMPLIFY_TEST_COLUMNS + 1) + column;
+            const uint quad[6] = { corner, corner + SIMPLIFY_TEST_COLUMNS + 1, corner + 1, corner + 1, corner + SIMPLIFY_TEST_COLUMNS + 1, corner + SIMPLIFY_TEST_COLUMNS + 2 };
+            memcpy(index, quad, sizeof(quad));
+            index += 6;
+        }
+    }
+    return SUCCESS;
+}
+
+tekTestDelete(simplify) (TestContext* test_context) {
+    free(test_context->simplify.vertices);
+    free(test_context->simplify.indices);
+    free(test_context->simplify.simplified);
+    return SUCCESS;
+}
+
+tekTestFunc(simplify, reaches_target) (TestContext* test_context) {
+    const float* vertices = test_context->simplify.vertices;
+    uint len_simplified = 0;
+    tekChainThrow(tekSimplifyMesh(
+        vertices, SIMPLIFY_TEST_VERTICES * 6, simplify_test_layout, 2, 0,
+        test_context->simplify.indices, SIMPLIFY_TEST_INDICES, SIMPLIFY_TEST_INDICES / 4,
+        &test_context->simplify.simplified, &len_simplified
+    ));
+    const uint* simplified = test_context->simplify.simplified;
+    tekAssert(1, len_simplified <= SIMPLIFY_TEST_INDICES / 4);
+    tekAssert(1, len_simplified > SIMPLIFY_TEST_INDICES / 8);
+    tekAssert(0, len_simplified % 3);
+
+    // every triangle should still be a real triangle facing outwards, and close to the surface of the sphere
+    float area = 0.0f;
+    for (uint i = 0; i < len_simplified; i += 3) {
+        tekSilentAssert(1, simplified[i] < SIMPLIFY_TEST_VERTICES && simplified[i + 1] < SIMPLIFY_TEST_VERTICES && simplified[i + 2] < SIMPLIFY_TEST_VERTICES);
+        vec3 a, b, c, ab, ac, normal, center;
+        glm_vec3_copy((float*)vertices + simplified[i] * 6, a);
+        glm_vec3_copy((float*)vertices + simplified[i + 1] * 6, b);
+        glm_vec3_copy((float*)vertices + simplified[i + 2] * 6, c);
+        glm_vec3_sub(b, a, ab);
+        glm_vec3_sub(c, a, ac);
+        glm_vec3_cross(ab, ac, normal);
+        glm_vec3_add(a, b, center);
+        glm_vec3_add(center, c, center);
+        glm_vec3_scale(center, 1.0f / 3.0f, center);
+        tekSilentAssert(1, glm_vec3_norm(normal) > 0.0f);
+        tekSilentAssert(1, glm_vec3_dot(normal, center) < 0.0f); // the test sphere is wound inwards
+        tekSilentAssert(1, glm_vec3_norm(center) > 0.9f);
+        area += glm_vec3_norm(normal) * 0.5f;
+    }
+
+    // a sphere has no edges, so it should stay closed and keep about the same surface area (4pi)
+    tekAssert(1, fabsf(area - 4.0f * 3.14159265f) < 1.0f);
+
+    return SUCCESS;
+}
+
+tekTestFunc(simplify, bad_input) (TestContext* test_context) {
+    uint* simplified = 0;
+    uint len_simplified = 0;
+
+    // position isn't 3 floats
+    const int short_layout[] = { 2, 4 };
+    exception tek_exception = tekSimplifyMesh(test_context->simplify.vertices, SIMPLIFY_TEST_VERTICES * 6, short_layout, 2, 0, test_context->simplify.indices, SIMPLIFY_TEST_INDICES, 0, &simplified, &len_simplified);
+    tekAssert(FAILURE, tek_exception);
+
+    // not whole triangles
+    tek_exception = tekSimplifyMesh(test_context->simplify.vertices, SIMPLIFY_TEST_VERTICES * 6, simplify_test_layout, 2, 0, test_context->simplify.indices, 4, 0, &simplified, &len_simplified);
+    tekAssert(FAILURE, tek_exception);
+
+    // index past the end of the vertices
+    const uint indices[] = { 0, 1, SIMPLIFY_TEST_VERTICES };
+    tek_exception = tekSimplifyMesh(test_context->simplify.vertices, SIMPLIFY_TEST_VERTICES * 6, simplify_test_layout, 2, 0, indices, 3, 0, &simplified, &len_simplified);
+    tekAssert(FAILURE, tek_exception);
+
+    // asking for more than there already is only takes out the triangles that were squashed to a line to begin with, one per column at each pole
+    tekChainThrow(tekSimplifyMesh(test_context->simplify.vertices, SIMPLIFY_TEST_VERTICES * 6, simplify_test_layout, 2, 0, test_context->simplify.indices, SIMPLIFY_TEST_INDICES, SIMPLIFY_TEST_INDICES, &test_context->simplify.simplified, &len_simplified));
+    tekAssert(SIMPLIFY_TEST_INDICES - SIMPLIFY_TEST_COLUMNS * 2 * 3, len_simplified);
+
+    return SUCCESS;
+}
+
+tekTestFunc(simplify, lod_hysteresis) (TestContext* test_context) {
+    TekMesh mesh = {};
+    mesh.num_lods = 3;
+
+    // big on screen is full detail, and it steps down as it gets smaller
+    tekAssert(0, tekSelectMeshLod(&mesh, 1.0f, 0));
+    tekAssert(1, tekSelectMeshLod(&mesh, MESH_LOD_SCREEN_SIZE * 0.75f, 0));
+    tekAssert(2, tekSelectMeshLod(&mesh, 0.001f, 0));
+    tekAssert(0, tekSelectMeshLod(&mesh, 1.0f, 2));
+
+    // just either side of where the first level starts, it stays at whatever it was already
+    tekAssert(0, tekSelectMeshLod(&mesh, MESH_LOD_SCREEN_SIZE * 0.99f, 0));
+    tekAssert(1, tekSelectMeshLod(&mesh, MESH_LOD_SCREEN_SIZE * 1.01f, 1));
+
+    // levels the mesh doesn't have aren't used, and meshes without any only have the full level
+    tekAssert(2, tekSelectMeshLod(&mesh, 0.001f, 3));
+    mesh.num_lods = 1;
+    tekAssert(0, tekSelectMeshLod(&mesh, 0.001f, 2));
+
+    return SUCCESS;
+}
+
+#define MESH_BINARY_TEST_MESH   "mesh_binary_test.tmsh"
+#define MESH_BINARY_TEST_BINARY "mesh_binary_test.tmshb"
+
+tekTestCreate(mesh_binary) (TestContext* test_context) {
+    memset(&test_context->mesh_binary, 0, sizeof(TekMeshData));
+    remove(MESH_BINARY_TEST_BINARY);
+    FILE* file = fopen(MESH_BINARY_TEST_MESH, "w");
+    tekAssert(1, file != NULL);
+    fputs("VERTICES\n0.0 1.0 2.0 0.5\n3.0 4.0 5.0 0.25\n6.0 7.0 8.0 0.125\nINDICES\n0 1 2\nLAYOUT\n3 1\n$POSITION_LAYOUT_INDEX 0\n", file);
+    fclose(file);
+    return SUCCESS;
+}
+
+tekTestDelete(mesh_binary) (TestContext* test_context) {
+    tekDeleteMeshData(&test_context->mesh_binary);
+    remove(MESH_BINARY_TEST_MESH);
+    remove(MESH_BINARY_TEST_BINARY);
+    return SUCCESS;
+}
+
+/**
+ * Check that mesh data has the same arrays as the test mesh file.
+ * @param mesh_data The mesh data to check.
+ * @return 1 if everything matches, 0 if not.
+ */
+static flag meshBinaryTestMatches(const TekMeshData* mesh_data) {
+    static const float vertices[] = { 0.0f, 1.0f, 2.0f, 0.5f, 3.0f, 4.0f, 5.0f, 0.25f, 6.0f, 7.0f, 8.0f, 0.125f };
+    static const uint indices[] = { 0, 1, 2 };
+    static const int layout[] = { 3, 1 };
+    return mesh_data->len_vertices == 12 && mesh_data->len_indices == 3 && mesh_data->len_layout == 2
+        && !memcmp(mesh_data->vertices, vertices, sizeof(vertices))
+        && !memcmp(mesh_data->indices, indices, sizeof(indices))
+        && !memcmp(mesh_data->layout, layout, sizeof(layout));
+}
+
+tekTestFunc(mesh_binary, cache_round_trip) (TestContext* test_context) {
+    TekMeshData* mesh_data = &test_context->mesh_binary;
+
+    // first load has to parse the text, and leaves the binary behind for next time
+    tekChainThrow(tekReadMeshData(MESH_BINARY_TEST_MESH, mesh_data));
+    tekAssert(1, mesh_data->mapping == NULL);
+    tekAssert(1, meshBinaryTestMatches(mesh_data));
+    tekAssert(1, fileExists(MESH_BINARY_TEST_BINARY));
+    tekDeleteMeshData(mesh_data);
+
+    // second load maps the binary, with the arrays aligned so they can be used in place
+    tekChainThrow(tekReadMeshData(MESH_BINARY_TEST_MESH, mesh_data));
+    tekAssert(1, mesh_data->mapping != NULL);
+    tekAssert(1, meshBinaryTestMatches(mesh_data));
+    tekAssert(0, (size_t)mesh_data->vertices % MESH_BINARY_ALIGNMENT);
+    tekAssert(0, (size_t)mesh_data->indices % MESH_BINARY_ALIGNMENT);
+    tekDeleteMeshData(mesh_data);
+
+    // a binary older than the text is out of date, so the text is parsed again
+    const struct timespec times[2] = { { 0, 0 }, { 0, 0 } };
+    tekAssert(0, utimensat(AT_FDCWD, MESH_BINARY_TEST_BINARY, times, 0));
+    tekChainThrow(tekReadMeshData(MESH_BINARY_TEST_MESH, mesh_data));
+    tekAssert(1, mesh_data->mapping == NULL);
+    tekAssert(0, fileIsNewer(MESH_BINARY_TEST_MESH, MESH_BINARY_TEST_BINARY));
+
+    return SUCCESS;
+}
+
+tekTestFunc(mesh_binary, rejects_bad_files) (TestContext* test_context) {
+    TekMeshData* mesh_data = &test_context->mesh_binary;
+    tekChainThrow(tekConvertMesh(MESH_BINARY_TEST_MESH, NULL));
+
+    // cut the indices off the end, the header now points past the end of the file
+    uint len_file;
+    tekChainThrow(getFileSize(MESH_BINARY_TEST_BINARY, &len_file));
+    tekAssert(0, truncate(MESH_BINARY_TEST_BINARY, len_file - sizeof(uint)));
+    tekAssert(FAILURE, tekMapMeshBinary(MESH_BINARY_TEST_BINARY, mesh_data));
+    tekAssert(FAILURE, tekReadMeshData(MESH_BINARY_TEST_BINARY, mesh_data));
+
+    // loading the text file just ignores a broken binary and writes a good one
+    tekChainThrow(tekReadMeshData(MESH_BINARY_TEST_MESH, mesh_data));
+    tekAssert(1, mesh_data->mapping == NULL);
+    tekAssert(1, meshBinaryTestMatches(mesh_data));
+    tekDeleteMeshData(mesh_data);
+
+    // anything that isn't a mesh binary at all
+    tekAssert(FAILURE, tekMapMeshBinary(MESH_BINARY_TEST_MESH, mesh_data));
+    tekAssert(FILE_EXCEPTION, tekMapMeshBinary("mesh_binary_missing.tmshb", mesh_data));
+
+    return SUCCESS;
+}
+
+#define MESH_TEXT_TEST_MESH "mesh_text_test.tmsh"
+
+tekTestCreate(mesh_text) (TestContext* test_context) {
+    memset(&test_context->mesh_binary, 0, sizeof(TekMeshData));
+    return SUCCESS;
+}
+
+tekTestDelete(mesh_text) (TestContext* test_context) {
+    tekDeleteMeshData(&test_context->mesh_binary);
+    remove(MESH_TEXT_TEST_MESH);
+    return SUCCESS;
+}
+
+/**
+ * Write some text into the test mesh file, and read it back with tekReadMeshArrays().
+ * @param test_context The test context to read the arrays into.
+ * @param text The text of the mesh file.
+ * @throws FILE_EXCEPTION if the file couldn't be written or read.
+ * @throws FAILURE if the text isn't a valid mesh.
+ */
+static exception meshTextTestRead(TestContext* test_context, const char* text) {
+    tekDeleteMeshData(&test_context->mesh_binary);
+    FILE* file = fopen(MESH_TEXT_TEST_MESH, "w");
+    if (!file) tekThrow(FILE_EXCEPTION, "Could not open file.");
+    fputs(text, file);
+    fclose(file);
+
+    TekMeshData* mesh_data = &test_context->mesh_binary;
+    float* vertices;
+    uint* indices;
+    int* layout;
+    tekChainThrow(tekReadMeshArrays(MESH_TEXT_TEST_MESH, &vertices, &mesh_data->len_vertices, &indices, &mesh_data->len_indices, &layout, &mesh_data->len_layout, &mesh_data->position_layout_index));
+    mesh_data->vertices = vertices;
+    mesh_data->indices = indices;
+    mesh_data->layout = layout;
+    return SUCCESS;
+}
+
+tekTestFunc(mesh_text, parse_numbers) (TestContext* test_context) {
+    // every way of writing a number should come out the same as strtod() gives, whether or not it takes the fast path
+    static const char* numbers[] = {
+        "0.0", "-1.5", "+2", ".25", "3.", "1e3", "1.5E-2", "-0.707107", "0.1", "123456.789",
+        "12345678901234567890", "1e-30", "0.000000000000000000000001", "inf", "0x1p-2"
+    };
+    const uint num_numbers = sizeof(numbers) / sizeof(const char*);
+    char text[512] = "# every number on one line\nVERTICES\n";
+    for (uint i = 0; i < num_numbers; i++) {
+        strcat(text, numbers[i]);
+        strcat(text, i % 2 ? "\n" : " \t");
+    }
+    strcat(text, "INDICES 0 1 2#comment straight after\r\n4294967295 3.0\nLAYOUT 3\n$POSITION_LAYOUT_INDEX 0");
+    tekChainThrow(meshTextTestRead(test_context, text));
+
+    const TekMeshData* mesh_data = &test_context->mesh_binary;
+    tekAssert(num_numbers, mesh_data->len_vertices);
+    flag all_match = 1;
+    for (uint i = 0; i < num_numbers; i++) {
+        if (memcmp(&mesh_data->vertices[i], &(float){ (float)strtod(numbers[i], NULL) }, sizeof(float))) all_match = 0;
+    }
+    tekAssert(1, all_match);
+    tekAssert(5, mesh_data->len_indices);
+    tekAssert(2, mesh_data->indices[2]);
+    tekAssert(4294967295u, mesh_data->indices[3]);
+    tekAssert(3, mesh_data->indices[4]);
+    tekAssert(1, mesh_data->len_layout);
+    tekAssert(3, mesh_data->layout[0]);
+
+    // words that aren't numbers are an error
+    tekAssert(FAILURE, meshTextTestRead(test_context, "VERTICES\n1.0 2.0x 3.0\n"));
+    tekAssert(FAILURE, meshTextTestRead(test_context, "VERTICES\n1.0\nINDICES\n-\n"));
+
+    return SUCCESS;
+}
+
+#define ASSETS_TEST_MESH     "assets_test.tmsh"
+#define ASSETS_TEST_BINARY   "assets_test.tmshb"
+#define ASSETS_TEST_MATERIAL "assets_test.tmat"
+#define ASSETS_TEST_SHADER   "assets_test.glvs"
+#define ASSETS_TEST_SOURCE   "void main() {}\n"
+
+tekTestCreate(assets) (TestContext* test_context) {
+    static const char* filenames[] = { ASSETS_TEST_MESH, ASSETS_TEST_MATERIAL, ASSETS_TEST_SHADER };
+    static const char* contents[] = {
+        "VERTICES\n0.0 1.0 2.0\n3.0 4.0 5.0\n6.0 7.0 8.0\nINDICES\n0 1 2\nLAYOUT\n3\n$POSITION_LAYOUT_INDEX 0\n",
+        "shaders:\n  vertex_shader: \"" ASSETS_TEST_SHADER "\"\n  fragment_shader: \"" ASSETS_TEST_SHADER "\"\nuniforms:\n  model: \"$tek_model_matrix\"\n",
+        ASSETS_TEST_SOURCE
+    };
+    for (uint i = 0; i < sizeof(filenames) / sizeof(char*); i++) {
+        FILE* file = fopen(filenames[i], "w");
+        tekAssert(1, file != NULL);
+        fputs(contents[i], file);
+        fclose(file);
+    }
+    return SUCCESS;
+}
+
+tekTestDelete(assets) (TestContext* test_context) {
+    tekStopPreloadingAssets();
+    remove(ASSETS_TEST_MESH);
+    remove(ASSETS_TEST_BINARY);
+    remove(ASSETS_TEST_MATERIAL);
+    remove(ASSETS_TEST_SHADER);
+    return SUCCESS;
+}
+
+tekTestFunc(assets, preload) (TestContext* test_context) {
+    TekAssetManifest manifest;
+    tekChainThrow(tekCreateAssetManifest(&manifest));
+    tekChainThrowThen(tekAddAsset(&manifest, ASSET_MESH, ASSETS_TEST_MESH), tekDeleteAssetManifest(&manifest));
+    tekChainThrowThen(tekAddAsset(&manifest, ASSET_MESH, ASSETS_TEST_MESH), tekDeleteAssetManifest(&manifest));
+    tekChainThrowThen(tekAddAsset(&manifest, ASSET_MATERIAL, ASSETS_TEST_MATERIAL), tekDeleteAssetManifest(&manifest));
+    tekChainThrowThen(tekAddAsset(&manifest, ASSET_MESH, "assets_missing.tmsh"), tekDeleteAssetManifest(&manifest));
+    tekAssert(3, manifest.assets.length);
+
+    // the same font at a different size is a different atlas, but the same file as another kind of asset is kept apart too
+    tekChainThrowThen(tekAddFontAsset(&manifest, "assets_missing.ttf", 0, 16), tekDeleteAssetManifest(&manifest));
+    tekChainThrowThen(tekAddFontAsset(&manifest, "assets_missing.ttf", 0, 16), tekDeleteAssetManifest(&manifest));
+    tekChainThrowThen(tekAddFontAsset(&manifest, "assets_missing.ttf", 0, 32), tekDeleteAssetManifest(&manifest));
+    tekChainThrowThen(tekAddAsset(&manifest, ASSET_TEXTURE, ASSETS_TEST_MESH), tekDeleteAssetManifest(&manifest));
+    tekAssert(6, manifest.assets.length);
+
+    // the manifest is taken over by the workers
+    tekPreloadAssets(&manifest);
+    tekAssert(0, manifest.assets.length);
+
+    // the mesh is read and has its bounds worked out, ready to upload
+    TekAsset* asset = tekFindPreloadedAsset(ASSET_MESH, ASSETS_TEST_MESH);
+    tekAssert(1, asset != NULL);
+    tekAssert(ASSET_DECODED, asset->state);
+    tekAssert(3, asset->mesh.data.len_indices);
+    tekAssert(1, asset->mesh.bounds_radius > 0.0f);
+
+    // once used, it is read from the disk as normal
+    tekReleasePreloadedAsset(asset);
+    tekAssert(1, tekFindPreloadedAsset(ASSET_MESH, ASSETS_TEST_MESH) == NULL);
+
+    // anything that wasn't preloaded, couldn't be read, or is asked for as the wrong kind also goes to the disk
+    tekAssert(1, tekFindPreloadedAsset(ASSET_MESH, "assets_other.tmsh") == NULL);
+    tekAssert(1, tekFindPreloadedAsset(ASSET_MESH, "assets_missing.tmsh") == NULL);
+    tekAssert(1, tekFindPreloadedAsset(ASSET_TEXTURE, ASSETS_TEST_MATERIAL) == NULL);
+    tekAssert(1, tekFindPreloadedFont("assets_missing.ttf", 0, 16) == NULL);
+    tekAssert(1, tekFindPreloadedFont("assets_missing.ttf", 0, 48) == NULL);
+
+    // reading the material adds its shader, but not the wildcard uniform
+    asset = tekFindPreloadedAsset(ASSET_MATERIAL, ASSETS_TEST_MATERIAL);
+    tekAssert(1, asset != NULL);
+    tekReleasePreloadedAsset(asset);
+    asset = tekFindPreloadedAsset(ASSET_SHADER, ASSETS_TEST_SHADER);
+    tekAssert(1, asset != NULL);
+    tekAssert(0, strcmp(asset->source, ASSETS_TEST_SOURCE));
+    tekAssert(1, tekFindPreloadedAsset(ASSET_TEXTURE, "$tek_model_matrix") == NULL);
+
+    // stopping frees everything that is left
+    tekStopPreloadingAssets();
+    tekAssert(1, tekFindPreloadedAsset(ASSET_SHADER, ASSETS_TEST_SHADER) == NULL);
+
+    return SUCCESS;
+}
+
+#define DETERMINISM_TEST_SCENARIO "../tests/determinism.tscn"
+#define DETERMINISM_TEST_TICKS 600
+
+tekTestCreate(determinism) (TestContext* test_context) {
+    tekChainThrow(tekCreateBatch(DETERMINISM_TEST_SCENARIO, 1, &test_context->determinism.first));
+    tekChainThrowThen(tekCreateBatch(DETERMINISM_TEST_SCENARIO, 1, &test_context->determinism.second), {
+        tekDeleteBatch(&test_context->determinism.first);
+    });
+    return SUCCESS;
+}
+
+tekTestDelete(determinism) (TestContext* test_context) {
+    tekDeleteBatch(&test_context->determinism.first);
+    tekDeleteBatch(&test_context->determinism.second);
+    return SUCCESS;
+}
+
+tekTestFunc(determinism, same_hash_every_tick) (TestContext* test_context) {
+    TekBatch* first = &test_context->determinism.first;
+    TekBatch* second = &test_context->determinism.second;
+
+    // the two runs have their bodies in different places in memory, so this also checks nothing depends on addresses
+    tekAssert(tekBodyStoreHash(&first->store), tekBodyStoreHash(&second->store));
+    for (uint tick = 0; tick < DETERMINISM_TEST_TICKS; tick++) {
+        tekChainThrow(tekBatchStep(first, 1.0 / 120.0, 9.81f));
+        tekChainThrow(tekBatchStep(second, 1.0 / 120.0, 9.81f));
+        tekSilentAssert(tekBodyStoreHash(&first->store), tekBodyStoreHash(&second->store));
+    }
+
+    // make sure the scenario actually did something, otherwise the test proves nothing
+    tekAssert(1, first->store.positions[2][1] < 4.0f);
+
+    return SUCCESS;
+}
+
 exception tekUnitTest() {
     TestContext test_context = {};
 
@@ -1323,6 +2541,17 @@ exception tekUnitTest() {
     tekRunSuite(thread_queue, multithread_transfer, &test_context);
     tekRunSuite(thread_queue, boundary_and_invalid_tests, &test_context);
     tekRunSuite(thread_queue, stress_test, &test_context);
+    tekRunSuite(thread_queue, drop_policy, &test_context);
+    tekRunSuite(thread_queue, grow_policy, &test_context);
+    tekRunSuite(thread_queue, coalesce_policy, &test_context);
+    tekRunSuite(thread_queue, block_policy, &test_context);
+    tekRunSuite(thread_queue, dequeue_timeout, &test_context);
+    tekRunSuite(thread_queue, batch_operations, &test_context);
+    tekRunSuite(thread_queue, power_of_two_capacity, &test_context);
+    tekRunSuite(thread_queue, reserve_and_commit, &test_context);
+
+    // string table
+    tekRunSuite(string_table, intern_strings, &test_context);
 
     // file
     tekRunSuite(file, len_file, &test_context);
@@ -1336,5 +2565,47 @@ exception tekUnitTest() {
     tekRunSuite(yml, typical, &test_context);
     tekRunSuite(yml, syntax_errors, &test_context);
 
+    // body store
+    tekRunSuite(body_store, reserve_clears_slots, &test_context);
+    tekRunSuite(body_store, simd_matches_scalar, &test_context);
+    tekRunSuite(body_store, world_inertia_rotates, &test_context);
+
+    // pose buffer
+    tekRunSuite(pose_buffer, latest_frame_wins, &test_context);
+
+    // profiler
+    tekRunSuite(profiler, percentiles, &test_context);
+    tekRunSuite(profiler, history_wraps, &test_context);
+
+    // trace
+    tekRunSuite(trace, capture_to_json, &test_context);
+    tekRunSuite(trace, reuses_thread_buffers, &test_context);
+
+    // render queue
+    tekRunSuite(render_queue, key_order, &test_context);
+    tekRunSuite(render_queue, sort_packets, &test_context);
+
+    // cull list
+    tekRunSuite(cull_list, known_spheres, &test_context);
+    tekRunSuite(cull_list, simd_matches_scalar, &test_context);
+
+    // simplify
+    tekRunSuite(simplify, reaches_target, &test_context);
+    tekRunSuite(simplify, bad_input, &test_context);
+    tekRunSuite(simplify, lod_hysteresis, &test_context);
+
+    // mesh text
+    tekRunSuite(mesh_text, parse_numbers, &test_context);
+
+    // mesh binary
+    tekRunSuite(mesh_binary, cache_round_trip, &test_context);
+    tekRunSuite(mesh_binary, rejects_bad_files, &test_context);
+
+    // assets
+    tekRunSuite(assets, preload, &test_context);
+
+    // determinism
+    tekRunSuite(determinism, same_hash_every_tick, &test_context);
+
     return SUCCESS;
 }